@@ -0,0 +1,471 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "map.h"
+#include "act.h"
+#include "wad.h"
+#include "proj.h"
+
+/* microbenchmarks for the load, tick and draw paths; results are written
+ * out as one json object per line, so runs can be compared between builds */
+
+static FILE *benchOutput = NULL;
+static const char *benchFilter = NULL;
+
+static RGBMap benchPalette[ 256 ];
+
+static uint32_t benchSeed;
+static uint32_t Bench_Random( void ) {
+	/* fixed lcg so every run sees the same workload */
+	benchSeed = benchSeed * 1664525u + 1013904223u;
+	return benchSeed >> 8;
+}
+
+static int Bench_CompareSamples( const void *a, const void *b ) {
+	uint64_t sa = *( const uint64_t * ) a;
+	uint64_t sb = *( const uint64_t * ) b;
+	return ( sa > sb ) - ( sa < sb );
+}
+
+static void Bench_Report( const char *name, uint64_t *samples, unsigned int numSamples, double itemsPerIteration, const char *unit ) {
+	qsort( samples, numSamples, sizeof( uint64_t ), Bench_CompareSamples );
+
+	uint64_t total = 0;
+	for ( unsigned int i = 0; i < numSamples; ++i ) {
+		total += samples[ i ];
+	}
+
+	double mean = ( double ) total / numSamples;
+	double throughput = ( mean > 0.0 ) ? itemsPerIteration / ( mean / 1000000000.0 ) : 0.0;
+
+	fprintf( benchOutput,
+	         "{\"name\":\"%s\",\"iterations\":%u,\"mean_ns\":%.0f,\"min_ns\":%llu,\"median_ns\":%llu,\"max_ns\":%llu,"
+	         "\"throughput\":%.2f,\"unit\":\"%s/s\"}\n",
+	         name, numSamples, mean,
+	         ( unsigned long long ) samples[ 0 ],
+	         ( unsigned long long ) samples[ numSamples / 2 ],
+	         ( unsigned long long ) samples[ numSamples - 1 ],
+	         throughput, unit );
+	fflush( benchOutput );
+}
+
+typedef struct Benchmark {
+	const char   *name;
+	unsigned int iterations;
+	unsigned int param;
+	void ( *Setup )( unsigned int param );
+	void ( *Prepare )( unsigned int param ); /* before every run, outside the timing */
+	void ( *Run )( unsigned int param );
+	void ( *Teardown )( unsigned int param );
+	double       ( *GetItems )( unsigned int param ); /* work done per iteration */
+	const char   *unit;
+} Benchmark;
+
+/****************************************
+ * WAD decoding
+ ****************************************/
+
+static unsigned int Bench_GetLumpRange( const char *startName, const char *endName, unsigned int *start ) {
+	if ( !Wad_FindLump( globalWad, startName, start ) ) {
+		PrintError( "Failed to find \"%s\"!\n", startName );
+	}
+	( *start )++;
+
+	unsigned int end;
+	if ( !Wad_FindLump( globalWad, endName, &end ) ) {
+		PrintError( "Failed to find \"%s\"!\n", endName );
+	}
+
+	return end - *start;
+}
+
+static void Bench_DecodePictures( unsigned int param ) {
+	unsigned int start;
+	unsigned int num = Bench_GetLumpRange( "P_START", "P_END", &start );
+	SysArena *arena = Sys_GetLoadArena();
+	for ( unsigned int i = 0; i < num; ++i ) {
+		SysArenaMark mark = Sys_GetArenaMark( arena );
+		unsigned int w, h, leftOffset, topOffset;
+		Gfx_DecodePictureByIndex( arena, benchPalette, start + i, &w, &h, &leftOffset, &topOffset );
+		Sys_ResetArenaToMark( arena, mark );
+	}
+}
+
+static double Bench_GetNumPictures( unsigned int param ) {
+	unsigned int start;
+	return Bench_GetLumpRange( "P_START", "P_END", &start );
+}
+
+static void Bench_DecodeSprites( unsigned int param ) {
+	unsigned int start;
+	unsigned int num = Bench_GetLumpRange( "S_START", "S_END", &start );
+	SysArena *arena = Sys_GetLoadArena();
+	for ( unsigned int i = 0; i < num; ++i ) {
+		SysArenaMark mark = Sys_GetArenaMark( arena );
+		unsigned int w, h, leftOffset, topOffset;
+		Gfx_DecodePictureByIndex( arena, benchPalette, start + i, &w, &h, &leftOffset, &topOffset );
+		Sys_ResetArenaToMark( arena, mark );
+	}
+}
+
+static double Bench_GetNumSprites( unsigned int param ) {
+	unsigned int start;
+	return Bench_GetLumpRange( "S_START", "S_END", &start );
+}
+
+static void Bench_DecodeFlats( unsigned int param ) {
+	unsigned int start;
+	unsigned int num = Bench_GetLumpRange( "F_START", "F_END", &start );
+	SysArena *arena = Sys_GetLoadArena();
+	for ( unsigned int i = 0; i < num; ++i ) {
+		SysArenaMark mark = Sys_GetArenaMark( arena );
+		Gfx_DecodeFlatByIndex( arena, benchPalette, start + i );
+		Sys_ResetArenaToMark( arena, mark );
+	}
+}
+
+static double Bench_GetNumFlats( unsigned int param ) {
+	unsigned int start;
+	return Bench_GetLumpRange( "F_START", "F_END", &start );
+}
+
+static void Bench_FindLumps( unsigned int param ) {
+	const char *lumpName;
+	for ( unsigned int i = 0; ( lumpName = plGetPackageFileName( globalWad, i ) ) != NULL; ++i ) {
+		unsigned int index;
+		if ( !Wad_FindLump( globalWad, lumpName, &index ) ) {
+			PrintError( "Failed to find \"%s\"!\n", lumpName );
+		}
+	}
+}
+
+static double Bench_GetNumLumps( unsigned int param ) {
+	unsigned int numLumps = 0;
+	while ( plGetPackageFileName( globalWad, numLumps ) != NULL ) {
+		numLumps++;
+	}
+
+	return numLumps;
+}
+
+static uint8_t  *paletteSource = NULL;
+static PLColour *paletteDestination = NULL;
+
+static void Bench_SetupPaletteExpansion( unsigned int numPixels ) {
+	benchSeed = 1;
+	paletteSource = Sys_AllocateTaggedMemory( numPixels, sizeof( uint8_t ), SYS_MEMORY_TAG_SYS );
+	for ( unsigned int i = 0; i < numPixels; ++i ) {
+		paletteSource[ i ] = ( uint8_t ) Bench_Random();
+	}
+
+	paletteDestination = Sys_AllocateTaggedMemory( numPixels, sizeof( PLColour ), SYS_MEMORY_TAG_SYS );
+}
+
+static void Bench_ExpandPalette( unsigned int numPixels ) {
+	Gfx_ExpandPalette( benchPalette, paletteSource, paletteDestination, numPixels, 255 );
+}
+
+static void Bench_TeardownPaletteExpansion( unsigned int numPixels ) {
+	Sys_FreeMemory( paletteSource );
+	Sys_FreeMemory( paletteDestination );
+}
+
+/* spheres scattered all around a fixed view, so roughly a quarter survive */
+static GfxSphereList cullSpheres;
+static bool          *cullVisible = NULL;
+static GfxFrustum    cullFrustum;
+
+static void Bench_SetupCulling( unsigned int numSpheres ) {
+	benchSeed = numSpheres;
+
+	cullSpheres.x          = Sys_AllocateTaggedMemory( numSpheres, sizeof( float ), SYS_MEMORY_TAG_SYS );
+	cullSpheres.y          = Sys_AllocateTaggedMemory( numSpheres, sizeof( float ), SYS_MEMORY_TAG_SYS );
+	cullSpheres.z          = Sys_AllocateTaggedMemory( numSpheres, sizeof( float ), SYS_MEMORY_TAG_SYS );
+	cullSpheres.radii      = Sys_AllocateTaggedMemory( numSpheres, sizeof( float ), SYS_MEMORY_TAG_SYS );
+	cullSpheres.numSpheres = numSpheres;
+	for ( unsigned int i = 0; i < numSpheres; ++i ) {
+		cullSpheres.x[ i ]     = ( float ) ( Bench_Random() % 4096 ) - 2048.0f;
+		cullSpheres.y[ i ]     = ( float ) ( Bench_Random() % 256 );
+		cullSpheres.z[ i ]     = ( float ) ( Bench_Random() % 4096 ) - 2048.0f;
+		cullSpheres.radii[ i ] = ( float ) ( Bench_Random() % 128 );
+	}
+
+	cullVisible = Sys_AllocateTaggedMemory( numSpheres, sizeof( bool ), SYS_MEMORY_TAG_SYS );
+
+	PLVector3 eye = PLVector3( 0.0f, 75.0f, 0.0f );
+	PLVector3 forward = PLVector3( 1.0f, 0.0f, 0.0f );
+	Gfx_BuildFrustum( &cullFrustum, &eye, &forward, GFX_PLAYER_FOV, ( float ) YIN_DISPLAY_WIDTH / YIN_DISPLAY_HEIGHT );
+}
+
+static void Bench_CullSpheres( unsigned int numSpheres ) {
+	Gfx_CullSpheres( &cullFrustum, &cullSpheres, cullVisible );
+}
+
+static void Bench_TeardownCulling( unsigned int numSpheres ) {
+	Sys_FreeMemory( cullSpheres.x );
+	Sys_FreeMemory( cullSpheres.y );
+	Sys_FreeMemory( cullSpheres.z );
+	Sys_FreeMemory( cullSpheres.radii );
+	Sys_FreeMemory( cullVisible );
+}
+
+/****************************************
+ * Map
+ ****************************************/
+
+/* the streaming thread would otherwise be spun up and joined again
+ * every iteration, which says more about the os than loading */
+static void Bench_SetupMapLoad( unsigned int param ) {
+	Map_SetStreamingThreadEnabled( false );
+}
+
+static void Bench_LoadMap( unsigned int param ) {
+	Map_Load( globalWad, NULL );
+	Map_Unload();
+}
+
+static void Bench_TeardownMapLoad( unsigned int param ) {
+	Map_SetStreamingThreadEnabled( true );
+}
+
+/* targets and samples are scattered over area centres, so they
+ * land on the grid and mostly somewhere the field reaches */
+static PLVector2 *navPositions = NULL;
+static unsigned int navTick;
+static PLVector2 navDirection;
+
+static void Bench_SetupNavigation( unsigned int numPositions ) {
+	benchSeed = numPositions;
+
+	Map_Load( globalWad, NULL );
+
+	navPositions = Sys_AllocateTaggedMemory( numPositions, sizeof( PLVector2 ), SYS_MEMORY_TAG_MAP );
+	for ( unsigned int i = 0; i < numPositions; ++i ) {
+		const MapArea *area = Map_GetArea( Bench_Random() % Map_GetNumAreas() );
+		navPositions[ i ] = PLVector2( ( area->min[ 0 ] + area->max[ 0 ] ) / 2.0f, ( area->min[ 1 ] + area->max[ 1 ] ) / 2.0f );
+	}
+
+	/* so sampling always has a complete field to look at */
+	for ( unsigned int i = 0; i < 1024; ++i ) {
+		Map_UpdateNavigation( &navPositions[ 0 ] );
+	}
+
+	navTick = 0;
+}
+
+/* one tick's worth, with the target hopping between areas */
+static void Bench_UpdateNavigation( unsigned int numPositions ) {
+	Map_UpdateNavigation( &navPositions[ navTick++ % numPositions ] );
+}
+
+static void Bench_SampleNavigation( unsigned int numPositions ) {
+	for ( unsigned int i = 0; i < numPositions; ++i ) {
+		Map_GetNavDirection( &navPositions[ i ], &navDirection );
+	}
+}
+
+static void Bench_TeardownNavigation( unsigned int numPositions ) {
+	Sys_FreeMemory( navPositions );
+	navPositions = NULL;
+
+	Map_Unload();
+}
+
+static MapTrace *benchTraces = NULL;
+
+static void Bench_SetupTraces( unsigned int numTraces ) {
+	Bench_SetupNavigation( numTraces * 2 );
+
+	benchTraces = Sys_AllocateTaggedMemory( numTraces, sizeof( MapTrace ), SYS_MEMORY_TAG_MAP );
+	for ( unsigned int i = 0; i < numTraces; ++i ) {
+		benchTraces[ i ].start = navPositions[ i * 2 ];
+		benchTraces[ i ].end   = navPositions[ i * 2 + 1 ];
+	}
+}
+
+static void Bench_TraceLines( unsigned int numTraces ) {
+	Map_TraceLines( benchTraces, numTraces );
+}
+
+static void Bench_TeardownTraces( unsigned int numTraces ) {
+	Sys_FreeMemory( benchTraces );
+	benchTraces = NULL;
+
+	Bench_TeardownNavigation( numTraces * 2 );
+}
+
+static double Bench_GetOne( unsigned int param ) {
+	return 1.0;
+}
+
+static double Bench_GetParam( unsigned int param ) {
+	return param;
+}
+
+/****************************************
+ * Actors
+ ****************************************/
+
+static Actor **benchActors = NULL;
+
+/* synthetic population of basic actors, scattered over a patch of the map
+ * with some initial velocity so integration and friction have work to do */
+static void Bench_SpawnActors( unsigned int numActors ) {
+	benchSeed = numActors;
+
+	Map_Load( globalWad, NULL );
+
+	benchActors = Sys_AllocateTaggedMemory( numActors, sizeof( Actor * ), SYS_MEMORY_TAG_SYS );
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		PLVector3 position = PLVector3( ( float ) ( Bench_Random() % 4096 ), 0.0f, ( float ) ( Bench_Random() % 4096 ) );
+		benchActors[ i ] = Act_SpawnActor( ACTOR_NONE, position, ( float ) ( Bench_Random() % 360 ) );
+
+		PLVector3 velocity = PLVector3( ( float ) ( Bench_Random() % 16 ) - 8.0f, 0.0f, ( float ) ( Bench_Random() % 16 ) - 8.0f );
+		Act_SetVelocity( benchActors[ i ], &velocity );
+	}
+}
+
+static void Bench_DestroyActors( unsigned int numActors ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		Act_DestroyActor( benchActors[ i ] );
+	}
+
+	Sys_FreeMemory( benchActors );
+	benchActors = NULL;
+
+	Map_Unload();
+}
+
+static void Bench_TickActors( unsigned int numActors ) {
+	Act_TickActors();
+}
+
+/* a full pool fired in random directions through the same crowd; whatever's
+ * been used up is topped back up before each run, so every one sweeps all of them */
+static void Bench_RefillProjectiles( unsigned int numActors ) {
+	while ( Proj_GetNumProjectiles() < PROJ_MAX_PROJECTILES ) {
+		PLVector3 position = PLVector3( ( float ) ( Bench_Random() % 4096 ), 48.0f, ( float ) ( Bench_Random() % 4096 ) );
+		PLVector3 velocity = PLVector3( ( float ) ( Bench_Random() % 48 ) - 24.0f, 0.0f, ( float ) ( Bench_Random() % 48 ) - 24.0f );
+		Proj_SpawnProjectile( NULL, &position, &velocity );
+	}
+}
+
+static void Bench_FireProjectiles( unsigned int numActors ) {
+	Bench_SpawnActors( numActors );
+
+	Proj_ClearProjectiles();
+}
+
+static void Bench_TickProjectiles( unsigned int numActors ) {
+	Proj_TickProjectiles();
+}
+
+static void Bench_ClearProjectiles( unsigned int numActors ) {
+	Proj_ClearProjectiles();
+
+	Bench_DestroyActors( numActors );
+}
+
+static double Bench_GetNumProjectiles( unsigned int param ) {
+	return PROJ_MAX_PROJECTILES;
+}
+
+static void Bench_Broadphase( unsigned int numActors ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		Act_CheckCollisions( benchActors[ i ] );
+	}
+}
+
+
+static const Benchmark benchmarks[] = {
+		{ "decode_pictures", 50, 0, NULL, NULL, Bench_DecodePictures, NULL, Bench_GetNumPictures, "pictures" },
+		{ "decode_sprites", 50, 0, NULL, NULL, Bench_DecodeSprites, NULL, Bench_GetNumSprites, "pictures" },
+		{ "decode_flats", 50, 0, NULL, NULL, Bench_DecodeFlats, NULL, Bench_GetNumFlats, "flats" },
+		{ "find_lumps", 500, 0, NULL, NULL, Bench_FindLumps, NULL, Bench_GetNumLumps, "lumps" },
+		{ "expand_palette_64k", 200, 320 * 200, Bench_SetupPaletteExpansion, NULL, Bench_ExpandPalette, Bench_TeardownPaletteExpansion, Bench_GetParam, "pixels" },
+		{ "cull_spheres_10k", 500, 10000, Bench_SetupCulling, NULL, Bench_CullSpheres, Bench_TeardownCulling, Bench_GetParam, "spheres" },
+		{ "map_load", 200, 0, Bench_SetupMapLoad, NULL, Bench_LoadMap, Bench_TeardownMapLoad, Bench_GetOne, "maps" },
+		{ "nav_update", 500, 64, Bench_SetupNavigation, NULL, Bench_UpdateNavigation, Bench_TeardownNavigation, Bench_GetOne, "ticks" },
+		{ "trace_lines_1k", 200, 1000, Bench_SetupTraces, NULL, Bench_TraceLines, Bench_TeardownTraces, Bench_GetParam, "traces" },
+		{ "nav_sample_10k", 500, 10000, Bench_SetupNavigation, NULL, Bench_SampleNavigation, Bench_TeardownNavigation, Bench_GetParam, "samples" },
+		{ "tick_actors_100", 500, 100, Bench_SpawnActors, NULL, Bench_TickActors, Bench_DestroyActors, Bench_GetParam, "actors" },
+		{ "tick_actors_1k", 200, 1000, Bench_SpawnActors, NULL, Bench_TickActors, Bench_DestroyActors, Bench_GetParam, "actors" },
+		{ "tick_actors_10k", 50, 10000, Bench_SpawnActors, NULL, Bench_TickActors, Bench_DestroyActors, Bench_GetParam, "actors" },
+		{ "tick_projectiles_512_vs_1k", 200, 1000, Bench_FireProjectiles, Bench_RefillProjectiles, Bench_TickProjectiles, Bench_ClearProjectiles, Bench_GetNumProjectiles, "projectiles" },
+		{ "broadphase_100", 500, 100, Bench_SpawnActors, NULL, Bench_Broadphase, Bench_DestroyActors, Bench_GetParam, "actors" },
+		{ "broadphase_1k", 50, 1000, Bench_SpawnActors, NULL, Bench_Broadphase, Bench_DestroyActors, Bench_GetParam, "actors" },
+		{ "broadphase_10k", 5, 10000, Bench_SpawnActors, NULL, Bench_Broadphase, Bench_DestroyActors, Bench_GetParam, "actors" },
+};
+
+static void Bench_Run( const Benchmark *benchmark ) {
+	if ( benchFilter != NULL && strstr( benchmark->name, benchFilter ) == NULL ) {
+		return;
+	}
+
+	if ( benchmark->Setup != NULL ) {
+		benchmark->Setup( benchmark->param );
+	}
+
+	/* warm up caches first, this run isn't counted */
+	if ( benchmark->Prepare != NULL ) {
+		benchmark->Prepare( benchmark->param );
+	}
+	benchmark->Run( benchmark->param );
+
+	uint64_t *samples = Sys_AllocateTaggedMemory( benchmark->iterations, sizeof( uint64_t ), SYS_MEMORY_TAG_SYS );
+	for ( unsigned int i = 0; i < benchmark->iterations; ++i ) {
+		if ( benchmark->Prepare != NULL ) {
+			benchmark->Prepare( benchmark->param );
+		}
+
+		uint64_t start = Sys_GetNanoseconds();
+		benchmark->Run( benchmark->param );
+		samples[ i ] = Sys_GetNanoseconds() - start;
+	}
+
+	Bench_Report( benchmark->name, samples, benchmark->iterations, benchmark->GetItems( benchmark->param ), benchmark->unit );
+
+	Sys_FreeMemory( samples );
+
+	if ( benchmark->Teardown != NULL ) {
+		benchmark->Teardown( benchmark->param );
+	}
+}
+
+int main( int argc, char **argv ) {
+	int status = Sys_InitializePlatform( argc, argv );
+	if ( status != EXIT_SUCCESS ) {
+		return status;
+	}
+
+	benchOutput = stdout;
+
+	const char *outPath = plGetCommandLineArgumentValue( "-out" );
+	if ( outPath != NULL ) {
+		benchOutput = fopen( outPath, "w" );
+		if ( benchOutput == NULL ) {
+			PrintError( "Failed to open \"%s\" for writing!\n", outPath );
+		}
+	}
+
+	benchFilter = plGetCommandLineArgumentValue( "-filter" );
+
+	Gfx_LoadPalette( benchPalette, "PLAYPAL" );
+
+	Act_Initialize();
+
+	for ( unsigned int i = 0; i < plArrayElements( benchmarks ); ++i ) {
+		Bench_Run( &benchmarks[ i ] );
+	}
+
+	Act_Shutdown();
+
+	if ( benchOutput != stdout ) {
+		fclose( benchOutput );
+	}
+
+	return EXIT_SUCCESS;
+}
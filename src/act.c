@@ -2,24 +2,32 @@
  * Project Yin
  * */
 
-#include <PL/pl_llist.h>
-
 #include "yin.h"
 #include "act.h"
 #include "gfx.h"
+#include "game.h"
 #include "map.h"
-
+#include "prof.h"
+#include "proj.h"
+#include "wad.h"
+
+/* tick and draw are handed every actor of the one type at once, so
+ * each type's logic runs as a single loop rather than a call apiece.
+ * tick gets the fully active ones first, followed by any that are only
+ * thinking now and again, which shouldn't bother animating */
 typedef struct ActorSetup {
 	void (*Spawn)( struct Actor *self );
-	void (*Tick)( struct Actor *self, void *userData );
-	void (*Draw)( struct Actor *self, void *userData );
+	void (*Tick)( struct Actor **actors, unsigned int numActors, unsigned int numActive );
+	void (*Draw)( struct Actor **actors, unsigned int numActors );
 	void (*Collide)( struct Actor *self, struct Actor *other, void *userData );
 	void (*Destroy)( struct Actor *self, void *userData );
 } ActorSetup;
 
-static void Act_DrawBasic( Actor *self, void *userData ) {
+static void Act_DrawBasic( Actor **actors, unsigned int numActors ) {
 	Gfx_EnableShaderProgram( SHADER_GENERIC );
-	Gfx_DrawAxesPivot( Act_GetPosition( self ), PLVector3( 0, 0, 0 ) );
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		Gfx_DrawAxesPivot( Act_GetPosition( actors[ i ] ), PLVector3( 0, 0, 0 ) );
+	}
 }
 
 void Monster_Collide( struct Actor *self, struct Actor *other, void *userData ) {
@@ -27,33 +35,98 @@ void Monster_Collide( struct Actor *self, struct Actor *other, void *userData )
 		/* probably colliding with another actor, give them a push... */
 		PLVector3 curVelocity = Act_GetVelocity( self );
 		Act_SetVelocity( other, &curVelocity );
+		Act_WakeActor( other );
 	}
 
 	/* otherwise, probably world collision */
 }
 
+/* steps every actor on through its walk cycle once frameDelay runs over */
+void Monster_AdvanceFrames( Actor **actors, unsigned int numActors, unsigned int *frameDelay, unsigned int numSets ) {
+	if( ++( *frameDelay ) <= 32 ) {
+		return;
+	}
+
+	*frameDelay = 0;
+
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		unsigned int curFrame = Act_GetCurrentFrame( actors[ i ] ) + 1;
+		if( curFrame >= numSets ) {
+			curFrame = 0;
+		}
+
+		Act_SetCurrentFrame( actors[ i ], curFrame );
+	}
+}
+
+/* heads each actor along the navigation field towards the player, and
+ * leaves it to slow down once there's no way through or it's arrived */
+void Monster_Chase( Actor **actors, unsigned int numActors, float speed ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		PLVector3 position = Act_GetPosition( actors[ i ] );
+		PLVector2 direction;
+		if ( !Map_GetNavDirection( &PLVector2( position.x, position.z ), &direction ) ) {
+			continue;
+		}
+
+		PLVector3 velocity = PLVector3( direction.x * speed, 0.0f, direction.y * speed );
+		Act_SetVelocity( actors[ i ], &velocity );
+		Act_SetAngle( actors[ i ], atan2f( direction.y, direction.x ) * PL_180_DIV_PI );
+	}
+}
+
 void Boss_Spawn( Actor *self );
-void Boss_Draw( Actor *self, void *userData );
-void Boss_Tick( Actor *self, void *userData );
+void Boss_Draw( Actor **actors, unsigned int numActors );
+void Boss_Tick( Actor **actors, unsigned int numActors, unsigned int numActive );
+void Boss_Destroy( Actor *self, void *userData );
 void Troo_Spawn( Actor *self );
-void Troo_Draw( Actor *self, void *userData );
-void Troo_Tick( Actor *self, void *userData );
+void Troo_Draw( Actor **actors, unsigned int numActors );
+void Troo_Tick( Actor **actors, unsigned int numActors, unsigned int numActive );
+void Troo_Destroy( Actor *self, void *userData );
 void Sarg_Spawn( Actor *self );
-void Sarg_Draw( Actor *self, void *userData );
-void Sarg_Tick( Actor *self, void *userData );
+void Sarg_Draw( Actor **actors, unsigned int numActors );
+void Sarg_Tick( Actor **actors, unsigned int numActors, unsigned int numActive );
+void Sarg_Destroy( Actor *self, void *userData );
 
 void Player_Spawn( Actor *self );
-void Player_Tick( Actor *self, void *userData );
+void Player_Tick( Actor **actors, unsigned int numActors, unsigned int numActive );
 void Player_Collide( Actor *self, Actor *other, void *userData );
 
-ActorSetup actorSpawnSetup[ MAX_ACTOR_TYPES ] = {
+static const ActorSetup actorSpawnSetup[ MAX_ACTOR_TYPES ] = {
 		[ ACTOR_NONE   ] = { NULL, NULL, Act_DrawBasic, NULL, NULL },
 		[ ACTOR_PLAYER ] = { Player_Spawn, Player_Tick, NULL, Player_Collide, NULL },
-		[ ACTOR_BOSS   ] = { Boss_Spawn, Boss_Tick, Boss_Draw, Monster_Collide, NULL },
-		[ ACTOR_SARG   ] = { Sarg_Spawn, Troo_Tick, Sarg_Draw, Monster_Collide, NULL },
-		[ ACTOR_TROO   ] = { Troo_Spawn, Sarg_Tick, Troo_Draw, Monster_Collide, NULL },
+		[ ACTOR_BOSS   ] = { Boss_Spawn, Boss_Tick, Boss_Draw, Monster_Collide, Boss_Destroy },
+		[ ACTOR_SARG   ] = { Sarg_Spawn, Sarg_Tick, Sarg_Draw, Monster_Collide, Sarg_Destroy },
+		[ ACTOR_TROO   ] = { Troo_Spawn, Troo_Tick, Troo_Draw, Monster_Collide, Troo_Destroy },
+};
+
+/* used to label per-actor zones in traces */
+static const char *actorTypeNames[ MAX_ACTOR_TYPES ] = {
+		[ ACTOR_NONE   ] = "None",
+		[ ACTOR_PLAYER ] = "Player",
+		[ ACTOR_BOSS   ] = "Boss",
+		[ ACTOR_SARG   ] = "Sarg",
+		[ ACTOR_TROO   ] = "Troo",
 };
 
+/* far away actors are put to sleep and those in the middle distance are
+ * only ticked every so often, so the cost of a tick follows what's going
+ * on around the player rather than how many things are in the map. this
+ * only looks at the game state, so demos still play back the same */
+#define ACT_ACTIVE_DISTANCE  1024.0f
+#define ACT_DORMANT_DISTANCE 2560.0f
+#define ACT_SIGHT_DISTANCE   4096.0f /* anything the player can see is kept ticking until here */
+#define ACT_SIGHT_COS        0.5f    /* a little wider than the fov */
+#define ACT_REDUCED_INTERVAL 4       /* ticks */
+#define ACT_DORMANT_INTERVAL 32      /* ticks between checks on sleeping actors */
+#define ACT_WAKE_TICKS       120     /* how long an event keeps an actor fully active */
+
+typedef enum ActorThink {
+	ACT_THINK_ACTIVE,  /* every tick */
+	ACT_THINK_REDUCED, /* every ACT_REDUCED_INTERVAL ticks, without animating */
+	ACT_THINK_DORMANT, /* nothing besides checking if it should wake */
+} ActorThink;
+
 typedef struct Actor {
 	PLVector3    position;
 	PLVector3    velocity;
@@ -67,46 +140,162 @@ typedef struct Actor {
 	unsigned int currentFrame;
 	unsigned int frameSwapTime;
 
-	ActorType  type;
-	ActorSetup setup;
+	ActorThink   think;
+	unsigned int nextThinkTick;
+	unsigned int lastThinkTick;
+	unsigned int wakeUntilTick;
+	unsigned int thinkPhase;   /* which tick of each interval a slowed down actor thinks on */
+	bool         canSeePlayer; /* as of its last think */
 
-	PLLinkedListNode *node;
-	void             *userData;
+	ActorType    type;
+	unsigned int bucketIndex; /* where it sits within its type's bucket */
+	void         *userData;
 } Actor;
 
-static PLLinkedList *actorList;
+/* actors are kept together by type, and everything walking over them goes
+ * through the types in order; the actors themselves stay where they were
+ * allocated, so pointers to them remain valid as the buckets change */
+typedef struct ActorBucket {
+	Actor        **actors;
+	unsigned int numActors;
+	unsigned int maxActors;
+} ActorBucket;
+
+static ActorBucket actorBuckets[ MAX_ACTOR_TYPES ];
+static unsigned int numActors = 0;
+static unsigned int numSpawnedActors = 0;
+static unsigned int numTickedActors = 0;
+
+static bool isDormancyEnabled = true;
+
+static void Act_InsertIntoBucket( Actor *actor ) {
+	ActorBucket *bucket = &actorBuckets[ actor->type ];
+	if ( bucket->numActors >= bucket->maxActors ) {
+		unsigned int maxActors = ( bucket->maxActors > 0 ) ? bucket->maxActors * 2 : 16;
+		Actor **actors = Sys_AllocateTaggedMemory( maxActors, sizeof( Actor * ), SYS_MEMORY_TAG_ACT );
+		if ( bucket->actors != NULL ) {
+			memcpy( actors, bucket->actors, sizeof( Actor * ) * bucket->numActors );
+			Sys_FreeMemory( bucket->actors );
+		}
+
+		bucket->actors    = actors;
+		bucket->maxActors = maxActors;
+	}
+
+	actor->bucketIndex = bucket->numActors;
+	bucket->actors[ bucket->numActors++ ] = actor;
+}
+
+/* swaps the last one of the type into its place */
+static void Act_RemoveFromBucket( Actor *actor ) {
+	ActorBucket *bucket = &actorBuckets[ actor->type ];
+	Actor *last = bucket->actors[ --bucket->numActors ];
+	bucket->actors[ actor->bucketIndex ] = last;
+	last->bucketIndex = actor->bucketIndex;
+}
 
 Actor *Act_SpawnActor( ActorType type, PLVector3 position, float angle ) {
-	Actor *actor = Sys_AllocateMemory( 1, sizeof( Actor ) );
-	actor->node     = plInsertLinkedListNode( actorList, actor );
-	actor->setup    = actorSpawnSetup[ type ];
+	Actor *actor = Sys_AllocateTaggedMemory( 1, sizeof( Actor ), SYS_MEMORY_TAG_ACT );
 	actor->area     = 0;
 	actor->type     = type;
 	actor->position = position;
 	actor->angle    = angle;
+	Act_InsertIntoBucket( actor );
+
+	/* everything starts out active, and only spreads out once it's slowed down */
+	actor->think         = ACT_THINK_ACTIVE;
+	actor->lastThinkTick = Sys_GetNumTicks();
+	actor->nextThinkTick = actor->lastThinkTick;
+	actor->thinkPhase    = numSpawnedActors++ % ACT_DORMANT_INTERVAL;
+
+	numActors++;
 
 	/* give everything a set of basic bounds */
 	actor->bounds.maxs = PLVector3( 16.0f, 16.0f, 16.0f );
 	actor->bounds.mins = PLVector3( -16.0f, -16.0f, -16.0f );
 
-	if ( actor->setup.Spawn != NULL ) {
-		actor->setup.Spawn( actor );
+	if ( actorSpawnSetup[ type ].Spawn != NULL ) {
+		actorSpawnSetup[ type ].Spawn( actor );
 	}
 
 	return actor;
 }
 
 Actor *Act_DestroyActor( Actor *self ) {
-	if ( self->setup.Destroy != NULL) {
-		self->setup.Destroy( self, self->userData );
+	if ( actorSpawnSetup[ self->type ].Destroy != NULL) {
+		actorSpawnSetup[ self->type ].Destroy( self, self->userData );
 	}
 
-	plDestroyLinkedListNode( actorList, self->node );
-	free( self->userData );
-	free( self );
+	Proj_ForgetOwner( self );
+
+	Act_RemoveFromBucket( self );
+	numActors--;
+	Sys_FreeMemory( self->userData );
+	Sys_FreeMemory( self );
 	return NULL;
 }
 
+unsigned int Act_GetNumActors( void ) {
+	return numActors;
+}
+
+/* copies out up to maxActors, in the order they're ticked */
+unsigned int Act_GetActors( Actor **actors, unsigned int maxActors ) {
+	unsigned int numCopied = 0;
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		const ActorBucket *bucket = &actorBuckets[ type ];
+		for ( unsigned int i = 0; i < bucket->numActors && numCopied < maxActors; ++i ) {
+			actors[ numCopied++ ] = bucket->actors[ i ];
+		}
+	}
+
+	return numCopied;
+}
+
+unsigned int Act_GetNumTickedActors( void ) {
+	return numTickedActors;
+}
+
+/* for anything that should get an actor's attention, regardless of where it is */
+void Act_WakeActor( Actor *self ) {
+	unsigned int tick = Sys_GetNumTicks();
+	self->wakeUntilTick = tick + ACT_WAKE_TICKS;
+	if ( self->think != ACT_THINK_ACTIVE ) {
+		self->nextThinkTick = tick;
+	}
+}
+
+static uint32_t Act_HashBytes( uint32_t hash, const void *data, size_t size ) {
+	/* fnv-1a */
+	const uint8_t *bytes = data;
+	for ( size_t i = 0; i < size; ++i ) {
+		hash ^= bytes[ i ];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* used to verify that demo playback matches what was recorded */
+uint32_t Act_GetStateChecksum( void ) {
+	uint32_t hash = 2166136261u;
+
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		const ActorBucket *bucket = &actorBuckets[ type ];
+		for ( unsigned int i = 0; i < bucket->numActors; ++i ) {
+			const Actor *actor = bucket->actors[ i ];
+			hash = Act_HashBytes( hash, &actor->type, sizeof( actor->type ) );
+			hash = Act_HashBytes( hash, &actor->position, sizeof( actor->position ) );
+			hash = Act_HashBytes( hash, &actor->velocity, sizeof( actor->velocity ) );
+			hash = Act_HashBytes( hash, &actor->angle, sizeof( actor->angle ) );
+			hash = Act_HashBytes( hash, &actor->viewOffset, sizeof( actor->viewOffset ) );
+			hash = Act_HashBytes( hash, &actor->currentFrame, sizeof( actor->currentFrame ) );
+		}
+	}
+
+	return hash;
+}
+
 ActorType Act_GetType( const Actor *self ) { return self->type; }
 void      Act_SetPosition( Actor *self, const PLVector3 *position ) { self->position = *position; }
 PLVector3 Act_GetPosition( const Actor *self ) { return self->position; }
@@ -144,21 +333,25 @@ PLVector3 Act_GetForward( const Actor *self ) {
 	return self->forward;
 }
 
-void Act_SpawnActors( void ) {
+#define ACT_THING_RECORD_SIZE 16
+
+void Act_SpawnActors( PLPackage *wad, unsigned int lumpIndex ) {
 	PrintMsg( "Spawning actors...\n" );
 
-	PLFile *filePtr = plLoadPackageFile( globalWad, "M_THINGS" );
-	if ( filePtr == NULL) {
-		PrintError( "Failed to find \"M_THINGS\" block!\nPL: %s\n", plGetError());
-	}
+	Prof_BeginTrace( "Act_SpawnActors" );
 
-	bool status;
-	uint32_t numThings = plReadInt32( filePtr, false, &status );
-	if ( !status ) {
-		PrintError( "Failed to get number of things!\nPL: %s\n", plGetError());
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t size;
+	const uint8_t *data = Wad_LoadLumpByIndex( wad, lumpIndex, arena, &size );
+	if ( data == NULL ) {
+		PrintError( "Failed to load \"M_THINGS\" block!\n" );
 	}
 
-	for ( unsigned int i = 0; i < numThings; ++i ) {
+	uint32_t numThings = Wad_GetLumpRecordCount( data, size, ACT_THING_RECORD_SIZE, "M_THINGS" );
+	const uint8_t *record = data + sizeof( uint32_t );
+	for ( unsigned int i = 0; i < numThings; ++i, record += ACT_THING_RECORD_SIZE ) {
 		struct {
 			int16_t xPos;
 			int16_t yPos;
@@ -169,17 +362,22 @@ void Act_SpawnActors( void ) {
 		PrintMsg( "Spawning actor %d/%d...\n", i + 1, numThings );
 
 		/* these are intentionally flipped... */
-		thing.yPos = ( int16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 ) * 2;
-		thing.xPos = ( int16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 ) * 2;
-		thing.type = ( uint16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 );
-		thing.flags = ( uint16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 );
+		thing.yPos = Wad_GetFixedInteger( record ) * 2;
+		thing.xPos = Wad_GetFixedInteger( record + 4 ) * 2;
+		thing.type = ( uint16_t ) Wad_GetFixedInteger( record + 8 );
+		thing.flags = ( uint16_t ) Wad_GetFixedInteger( record + 12 );
 
-		if ( !status ) {
-			PrintError( "Failed to get thing data!\nPL: %s\n", plGetError());
+		if ( thing.type >= MAX_ACTOR_TYPES ) {
+			PrintWarn( "Invalid type for thing %d (%d), skipping!\n", i, thing.type );
+			continue;
 		}
 
 		Act_SpawnActor( thing.type, PLVector3( thing.xPos, 0, thing.yPos ), 0.0f );
 	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Prof_EndTrace( "Act_SpawnActors" );
 }
 
 static bool Act_IsColliding( Actor *self, Actor *other ) {
@@ -190,103 +388,379 @@ static bool Act_IsColliding( Actor *self, Actor *other ) {
 	return plIsAABBIntersecting( &self->bounds, &other->bounds );
 }
 
-static Actor *Act_CheckCollisions( Actor *self ) {
+Actor *Act_CheckCollisions( Actor *self ) {
 	/* in the future, perhaps it's worth tracking multiple lists per sector? */
-	PLLinkedListNode *curNode = plGetRootNode( actorList );
-	while( curNode != NULL ) {
-		Actor *actor = plGetLinkedListNodeUserData( curNode );
-		if( actor == NULL ) {
-			PrintError( "Invalid actor data in node!\n" );
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		const ActorBucket *bucket = &actorBuckets[ type ];
+		for ( unsigned int i = 0; i < bucket->numActors; ++i ) {
+			Actor *actor = bucket->actors[ i ];
+
+			/* "don't have time to play with myself" */
+			if( actor == self ) {
+				continue;
+			}
+
+			if( Act_IsColliding( self, actor ) ) {
+				return actor;
+			}
 		}
+	}
+
+	return NULL;
+}
+
+/* sprites are drawn upwards from an actor's position and are a fair bit
+ * bigger than its bounds, so they're culled against a box covering both */
+#define ACT_DRAW_EXTENT 64.0f
+#define ACT_DRAW_HEIGHT 128.0f
+
+static unsigned int numDrawnActors = 0;
 
-		/* "don't have time to play with myself" */
-		if( actor == self ) {
-			curNode = plGetNextLinkedListNode( curNode );
+unsigned int Act_GetNumDrawnActors( void ) {
+	return numDrawnActors;
+}
+
+void Act_DisplayActors( void ) {
+	numDrawnActors = 0;
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	/* gather everything that draws, so the whole lot
+	 * can be tested against the frustum in one go */
+	Actor **drawActors = Sys_ArenaAllocate( arena, numActors, sizeof( Actor * ) );
+	GfxSphereList spheres;
+	spheres.x          = Sys_ArenaAllocate( arena, numActors, sizeof( float ) );
+	spheres.y          = Sys_ArenaAllocate( arena, numActors, sizeof( float ) );
+	spheres.z          = Sys_ArenaAllocate( arena, numActors, sizeof( float ) );
+	spheres.radii      = Sys_ArenaAllocate( arena, numActors, sizeof( float ) );
+	spheres.numSpheres = 0;
+
+	unsigned int typeStarts[ MAX_ACTOR_TYPES + 1 ];
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		typeStarts[ type ] = spheres.numSpheres;
+		if ( actorSpawnSetup[ type ].Draw == NULL ) {
 			continue;
 		}
 
-		if( Act_IsColliding( self, actor ) ) {
-			return actor;
+		const ActorBucket *bucket = &actorBuckets[ type ];
+		for ( unsigned int j = 0; j < bucket->numActors; ++j ) {
+			Actor *actor = bucket->actors[ j ];
+
+			PLVector3 mins = PLVector3(
+					fminf( actor->bounds.mins.x, -ACT_DRAW_EXTENT ),
+					fminf( actor->bounds.mins.y, -ACT_DRAW_HEIGHT ),
+					fminf( actor->bounds.mins.z, -ACT_DRAW_EXTENT ) );
+			PLVector3 maxs = PLVector3(
+					fmaxf( actor->bounds.maxs.x, ACT_DRAW_EXTENT ),
+					fmaxf( actor->bounds.maxs.y, ACT_DRAW_HEIGHT ),
+					fmaxf( actor->bounds.maxs.z, ACT_DRAW_EXTENT ) );
+
+			unsigned int i = spheres.numSpheres++;
+			drawActors[ i ] = actor;
+			spheres.x[ i ] = actor->position.x + ( mins.x + maxs.x ) / 2.0f;
+			spheres.y[ i ] = actor->position.y + ( mins.y + maxs.y ) / 2.0f;
+			spheres.z[ i ] = actor->position.z + ( mins.z + maxs.z ) / 2.0f;
+			spheres.radii[ i ] = sqrtf(
+					( maxs.x - mins.x ) * ( maxs.x - mins.x ) +
+					( maxs.y - mins.y ) * ( maxs.y - mins.y ) +
+					( maxs.z - mins.z ) * ( maxs.z - mins.z ) ) / 2.0f;
 		}
+	}
+	typeStarts[ MAX_ACTOR_TYPES ] = spheres.numSpheres;
+
+	bool *visible = Sys_ArenaAllocate( arena, spheres.numSpheres, sizeof( bool ) );
 
-		curNode = plGetNextLinkedListNode( curNode );
+	GfxFrustum frustum;
+	if ( Gfx_GetViewFrustum( &frustum ) ) {
+		Gfx_CullSpheres( &frustum, &spheres, visible );
+	} else {
+		memset( visible, true, spheres.numSpheres * sizeof( bool ) );
 	}
 
-	return NULL;
-}
+	/* squeeze out whatever was culled, then hand each type what's left */
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		unsigned int numVisible = 0;
+		Actor **typeActors = &drawActors[ typeStarts[ type ] ];
+		for ( unsigned int i = typeStarts[ type ]; i < typeStarts[ type + 1 ]; ++i ) {
+			if ( visible[ i ] ) {
+				typeActors[ numVisible++ ] = drawActors[ i ];
+			}
+		}
 
-void Act_DisplayActors( void ) {
-	PLLinkedListNode *curNode = plGetRootNode( actorList );
-	while ( curNode != NULL ) {
-		Actor *actor = plGetLinkedListNodeUserData( curNode );
-		if ( actor == NULL ) {
-			PrintError( "Invalid actor data in node!\n" );
+		if ( numVisible == 0 ) {
+			continue;
 		}
 
-		if ( actor->setup.Draw ) {
-			actor->setup.Draw( actor, actor->userData );
+		actorSpawnSetup[ type ].Draw( typeActors, numVisible );
+		numDrawnActors += numVisible;
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+/* sight checks for everything that's due to think this tick go out
+ * as one batch, rather than each actor tracing on its own */
+static void Act_CheckSight( const Actor *player, unsigned int tick ) {
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	Actor **sightActors = Sys_ArenaAllocate( arena, numActors, sizeof( Actor * ) );
+	MapTrace *traces = Sys_ArenaAllocate( arena, numActors, sizeof( MapTrace ) );
+	unsigned int numTraces = 0;
+
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		const ActorBucket *bucket = &actorBuckets[ type ];
+		for ( unsigned int i = 0; i < bucket->numActors; ++i ) {
+			Actor *actor = bucket->actors[ i ];
+			if ( actor == player || tick < actor->nextThinkTick ) {
+				continue;
+			}
+
+			actor->canSeePlayer = false;
+
+			float dx = actor->position.x - player->position.x;
+			float dz = actor->position.z - player->position.z;
+			if ( dx * dx + dz * dz >= ACT_SIGHT_DISTANCE * ACT_SIGHT_DISTANCE ) {
+				continue;
+			}
+
+			sightActors[ numTraces ] = actor;
+			traces[ numTraces ].start = PLVector2( actor->position.x, actor->position.z );
+			traces[ numTraces ].end   = PLVector2( player->position.x, player->position.z );
+			numTraces++;
 		}
+	}
+
+	Map_TraceLines( traces, numTraces );
 
-		curNode = plGetNextLinkedListNode( curNode );
+	for ( unsigned int i = 0; i < numTraces; ++i ) {
+		sightActors[ i ]->canSeePlayer = ( traces[ i ].lineIndex == MAP_TRACE_NO_LINE );
 	}
+
+	Sys_ResetArenaToMark( arena, mark );
 }
 
-void Act_TickActors( void ) {
-	PLLinkedListNode *curNode = plGetRootNode( actorList );
-	while ( curNode != NULL ) {
-		Actor *actor = plGetLinkedListNodeUserData( curNode );
-		if ( actor == NULL ) {
-			PrintError( "Invalid actor data in node!\n" );
+bool Act_CanSeePlayer( const Actor *self ) {
+	return self->canSeePlayer;
+}
+
+static ActorThink Act_GetThinkLevel( const Actor *self, const Actor *player, unsigned int tick ) {
+	if ( !isDormancyEnabled || player == NULL || self == player || tick < self->wakeUntilTick ) {
+		return ACT_THINK_ACTIVE;
+	}
+
+	float dx = self->position.x - player->position.x;
+	float dz = self->position.z - player->position.z;
+	float distance = dx * dx + dz * dz;
+	if ( distance < ACT_ACTIVE_DISTANCE * ACT_ACTIVE_DISTANCE ) {
+		return ACT_THINK_ACTIVE;
+	} else if ( distance < ACT_DORMANT_DISTANCE * ACT_DORMANT_DISTANCE ) {
+		return ACT_THINK_REDUCED;
+	} else if ( self->canSeePlayer ) {
+		float facing = dx * player->forward.x + dz * player->forward.z;
+		if ( facing > 0.0f && facing * facing > ACT_SIGHT_COS * ACT_SIGHT_COS * distance ) {
+			return ACT_THINK_REDUCED;
 		}
+	}
+
+	return ACT_THINK_DORMANT;
+}
+
+/* the first tick after this one that lands on the actor's phase, so that
+ * everything spawned together doesn't get slowed down onto the same tick */
+static unsigned int Act_GetNextThinkTick( const Actor *self, unsigned int tick, unsigned int interval ) {
+	unsigned int next = tick + interval;
+	return next - ( next - self->thinkPhase % interval ) % interval;
+}
 
-		if ( actor->setup.Tick != NULL ) {
-			actor->setup.Tick( actor, actor->userData );
+/* works out how each actor in the bucket should think this tick, returning
+ * how many need moving. at the front are those that think, with the fully
+ * active ones first, and behind them any just put to sleep, which still
+ * need to catch up on what they owe since they last thought */
+static unsigned int Act_ScheduleBucket( const ActorBucket *bucket, const Actor *player, unsigned int tick,
+                                        Actor **dueActors, unsigned int *dueSteps,
+                                        unsigned int *numThinking, unsigned int *numActive ) {
+	unsigned int numDue = 0;
+	*numThinking = 0;
+	*numActive = 0;
+
+	for ( unsigned int i = 0; i < bucket->numActors; ++i ) {
+		Actor *actor = bucket->actors[ i ];
+		if ( tick < actor->nextThinkTick ) {
+			continue;
 		}
 
-		plAnglesAxes( PLVector3( 0, actor->angle, 0 ), NULL, NULL, &actor->forward );
+		/* nothing's happened while it was asleep, so there's nothing to catch up on */
+		bool wasDormant = ( actor->think == ACT_THINK_DORMANT );
+		unsigned int numSteps = wasDormant ? 1 : tick - actor->lastThinkTick;
+		if ( numSteps == 0 ) {
+			numSteps = 1;
+		}
 
-		actor->position = plAddVector3( actor->position, actor->velocity );
-		if( actor->type != ACTOR_PLAYER ) {
-			static const float friction = 16.0f;
-			if( actor->velocity.x != 0 ) {
-				actor->velocity.x -= ( actor->velocity.x / friction );
-			}
-			if( actor->velocity.y != 0 ) {
-				actor->velocity.y -= ( actor->velocity.y / friction );
-			}
-			if( actor->velocity.z != 0 ) {
-				actor->velocity.z -= ( actor->velocity.z / friction );
-			}
+		actor->think = Act_GetThinkLevel( actor, player, tick );
+		actor->lastThinkTick = tick;
+		switch ( actor->think ) {
+			case ACT_THINK_ACTIVE:
+				actor->nextThinkTick = tick + 1;
+				break;
+			case ACT_THINK_REDUCED:
+				actor->nextThinkTick = Act_GetNextThinkTick( actor, tick, ACT_REDUCED_INTERVAL );
+				break;
+			case ACT_THINK_DORMANT:
+				actor->nextThinkTick = Act_GetNextThinkTick( actor, tick, ACT_DORMANT_INTERVAL );
+				if ( wasDormant ) {
+					continue;
+				}
+				break;
+		}
+
+		/* shuffle whatever's in the way along, to keep each group together */
+		unsigned int j = numDue++;
+		if ( actor->think != ACT_THINK_DORMANT ) {
+			dueActors[ j ] = dueActors[ *numThinking ];
+			dueSteps[ j ] = dueSteps[ *numThinking ];
+			j = ( *numThinking )++;
 		}
+		if ( actor->think == ACT_THINK_ACTIVE ) {
+			dueActors[ j ] = dueActors[ *numActive ];
+			dueSteps[ j ] = dueSteps[ *numActive ];
+			j = ( *numActive )++;
+		}
+
+		dueActors[ j ] = actor;
+		dueSteps[ j ] = numSteps;
+	}
+
+	return numDue;
+}
+
+/* returns true if the actor ran into something */
+static bool Act_CheckMoveCollisions( Actor *actor ) {
+	/* check actor vs actor collision */
+	const ActorSetup *setup = &actorSpawnSetup[ actor->type ];
+	if( setup->Collide == NULL ) {
+		return false;
+	}
+
+	bool hasCollided = false;
+	Actor *collider = Act_CheckCollisions( actor );
+	if( collider != NULL ) {
+		setup->Collide( actor, collider, actor->userData );
+		hasCollided = true;
+	}
+
+	/* and now check actor vs world collision */
+	if( actor->type == ACTOR_PLAYER && Map_CheckCollisions( &actor->bounds, actor->area ) ) {
+		PrintMsg( "COLLIDING...\n" );
+		setup->Collide( actor, NULL, actor->userData );
+		hasCollided = true;
+	}
+
+	return hasCollided;
+}
+
+static void Act_MoveActor( Actor *actor, unsigned int numSteps ) {
+	plAnglesAxes( PLVector3( 0, actor->angle, 0 ), NULL, NULL, &actor->forward );
+
+	/* covers every tick since the last one in one go; friction
+	 * is geometric, so summing the series gives the same result */
+	PLVector3 move;
+	if( actor->type != ACTOR_PLAYER ) {
+		static const float friction = 16.0f;
+		float retained = 1.0f - 1.0f / friction;
+		float decay = ( numSteps == 1 ) ? retained : powf( retained, ( float ) numSteps );
+		float distance = ( numSteps == 1 ) ? 1.0f : ( 1.0f - decay ) / ( 1.0f - retained );
+		move = plScaleVector3f( actor->velocity, distance );
+		actor->velocity = plScaleVector3f( actor->velocity, decay );
+	} else {
+		move = actor->velocity;
+	}
+
+	/* but that can carry it further than its own bounds, straight past
+	 * anything in the way, so split it up into steps no larger than half
+	 * its width and stop at the first thing it runs into */
+	float maxStep = fminf( actor->bounds.maxs.x - actor->bounds.mins.x, actor->bounds.maxs.z - actor->bounds.mins.z ) / 2.0f;
+	float length = plVector3Length( &move );
+	unsigned int numSubsteps = 1;
+	if ( maxStep > 0.0f && length > maxStep ) {
+		numSubsteps = ( unsigned int ) ceilf( length / maxStep );
+		move = plScaleVector3f( move, 1.0f / ( float ) numSubsteps );
+	}
+
+	for ( unsigned int i = 0; i < numSubsteps; ++i ) {
+		actor->position = plAddVector3( actor->position, move );
 
 		/* ensure bounds origin is kept updated */
 		actor->bounds.origin = actor->position;
 
-		/* check actor vs actor collision */
-		if( actor->setup.Collide != NULL ) {
-			Actor *collider = Act_CheckCollisions( actor );
-			if( collider != NULL ) {
-				actor->setup.Collide( actor, collider, actor->userData );
-			}
+		if ( Act_CheckMoveCollisions( actor ) ) {
+			break;
+		}
+	}
+}
 
-			/* and now check actor vs world collision */
-			if( actor->type == ACTOR_PLAYER && Map_CheckCollisions( &actor->bounds, actor->area ) ) {
-				PrintMsg( "COLLIDING...\n" );
-				actor->setup.Collide( actor, NULL, actor->userData );
-			}
+void Act_TickActors( void ) {
+	Prof_BeginZone( PROF_ZONE_ACT_TICK );
+
+	numTickedActors = 0;
+
+	unsigned int tick = Sys_GetNumTicks();
+	const Actor *player = Gam_GetPlayer();
+	if ( player != NULL ) {
+		Act_CheckSight( player, tick );
+	}
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	Actor **dueActors = Sys_ArenaAllocate( arena, numActors, sizeof( Actor * ) );
+	unsigned int *dueSteps = Sys_ArenaAllocate( arena, numActors, sizeof( unsigned int ) );
+
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		unsigned int numThinking, numActive;
+		unsigned int numDue = Act_ScheduleBucket( &actorBuckets[ type ], player, tick, dueActors, dueSteps, &numThinking, &numActive );
+		if ( numDue == 0 ) {
+			continue;
+		}
+
+		numTickedActors += numThinking;
+
+		if ( actorSpawnSetup[ type ].Tick != NULL && numThinking > 0 ) {
+			Prof_BeginTrace( actorTypeNames[ type ] );
+			actorSpawnSetup[ type ].Tick( dueActors, numThinking, numActive );
+			Prof_EndTrace( actorTypeNames[ type ] );
 		}
 
-		curNode = plGetNextLinkedListNode( curNode );
+		for ( unsigned int i = 0; i < numDue; ++i ) {
+			Act_MoveActor( dueActors[ i ], dueSteps[ i ] );
+		}
 	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Prof_EndZone( PROF_ZONE_ACT_TICK );
 }
 
 void Act_Initialize( void ) {
-	actorList = plCreateLinkedList();
-	if ( actorList == NULL) {
-		PrintError( "Failed to create actor list!\nPL: %s\n", plGetError());
+	isDormancyEnabled = !plHasCommandLineArgument( "-nodormancy" );
+}
+
+void Act_DestroyAllActors( void ) {
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		ActorBucket *bucket = &actorBuckets[ type ];
+		while ( bucket->numActors > 0 ) {
+			Act_DestroyActor( bucket->actors[ bucket->numActors - 1 ] );
+		}
 	}
 }
 
 void Act_Shutdown( void ) {
-	plDestroyLinkedList( actorList );
+	/* clean up anything still hanging around */
+	Act_DestroyAllActors();
+
+	for ( unsigned int type = 0; type < MAX_ACTOR_TYPES; ++type ) {
+		Sys_FreeMemory( actorBuckets[ type ].actors );
+	}
+	memset( actorBuckets, 0, sizeof( actorBuckets ) );
 }
@@ -22,12 +22,22 @@ typedef struct Actor Actor;
 void Act_Initialize( void );
 void Act_Shutdown( void );
 
-void Act_SpawnActors( void );
+void Act_SpawnActors( PLPackage *wad, unsigned int lumpIndex );
+void Act_DestroyAllActors( void );
 void Act_DisplayActors( void );
 void Act_TickActors( void );
 
+unsigned int Act_GetNumActors( void );
+unsigned int Act_GetActors( Actor **actors, unsigned int maxActors );
+unsigned int Act_GetNumDrawnActors( void ); /* last frame, after culling */
+unsigned int Act_GetNumTickedActors( void ); /* last tick, excluding anything asleep or skipped */
+uint32_t     Act_GetStateChecksum( void );
+Actor        *Act_CheckCollisions( Actor *self );
+
 Actor *Act_SpawnActor( ActorType type, PLVector3 position, float angle );
 Actor *Act_DestroyActor( Actor *self );
+void  Act_WakeActor( Actor *self );
+bool  Act_CanSeePlayer( const Actor *self ); /* as of its last think, and only up to a distance */
 
 ActorType    Act_GetType( const Actor *self );
 void         Act_SetPosition( Actor *self, const PLVector3 *position );
@@ -48,6 +58,8 @@ PLVector3    Act_GetForward( const Actor *self );
 
 /* generic monster functions */
 void Monster_Collide( struct Actor *self, struct Actor *other, void *userData );
+void Monster_AdvanceFrames( Actor **actors, unsigned int numActors, unsigned int *frameDelay, unsigned int numSets );
+void Monster_Chase( Actor **actors, unsigned int numActors, float speed );
 
 /* player functions */
 bool Player_IsPointVisible( Actor *self, const PLVector2 *point );
@@ -15,42 +15,37 @@ static const char *walkFrameNames[] = {
 
 #define BOSS_NUM_WALK_FRAMES plArrayElements( walkFrameNames )
 #define BOSS_NUM_WALK_SETS   BOSS_NUM_WALK_FRAMES / GFX_NUM_SPRITE_ANGLES
+#define BOSS_WALK_SPEED      1.5f
 
 typedef struct ABoss {
 	GfxAnimationFrame *walkFrames[ BOSS_NUM_WALK_FRAMES ];
 } ABoss;
 
-void Boss_Draw( Actor *self, void *userData ) {
-	if ( Act_GetType( self ) != ACTOR_BOSS ) {
-		return;
-	}
-
-	PLVector3 position = Act_GetPosition( self );
+void Boss_Draw( Actor **actors, unsigned int numActors ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		PLVector3 position = Act_GetPosition( actors[ i ] );
 
-	ABoss *bossData = ( ABoss* ) userData;
-	Gfx_DrawAnimation( bossData->walkFrames, BOSS_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( self ), &position, Act_GetAngle( self ) );
+		ABoss *bossData = ( ABoss* ) Act_GetUserData( actors[ i ] );
+		Gfx_DrawAnimation( bossData->walkFrames, BOSS_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( actors[ i ] ), &position, Act_GetAngle( actors[ i ] ) );
+	}
 }
 
-void Boss_Tick( Actor *self, void *userData ) {
-	/* wedge this in here, running out of time */
+void Boss_Tick( Actor **actors, unsigned int numActors, unsigned int numActive ) {
 	static unsigned int frameDelay = 0;
-	if( ++frameDelay > 32 ) {
-		unsigned int curFrame = Act_GetCurrentFrame( self ) + 1;
-		if( curFrame >= BOSS_NUM_WALK_SETS ) {
-			curFrame = 0;
-		}
-
-		Act_SetCurrentFrame( self, curFrame );
-
-		frameDelay = 0;
-	}
+	Monster_AdvanceFrames( actors, numActive, &frameDelay, BOSS_NUM_WALK_SETS );
+	Monster_Chase( actors, numActors, BOSS_WALK_SPEED );
 }
 
 void Boss_Spawn( Actor *self ) {
-	ABoss *bossData = Sys_AllocateMemory( 1, sizeof( ABoss ) );
+	ABoss *bossData = Sys_AllocateTaggedMemory( 1, sizeof( ABoss ), SYS_MEMORY_TAG_ACT );
 	Act_SetUserData( self, bossData );
 
 	/* now to load in our sprite data... */
 	
 	Gfx_LoadAnimationFrames( walkFrameNames, bossData->walkFrames, BOSS_NUM_WALK_FRAMES );
 }
+
+void Boss_Destroy( Actor *self, void *userData ) {
+	ABoss *bossData = ( ABoss* ) userData;
+	Gfx_ReleaseAnimationFrames( bossData->walkFrames, BOSS_NUM_WALK_FRAMES );
+}
@@ -4,6 +4,7 @@
 
 #include "yin.h"
 #include "act.h"
+#include "proj.h"
 
 #define PLAYER_VIEW_OFFSET  75.0f
 
@@ -13,6 +14,10 @@
 #define PLAYER_MAX_VELOCITY  PLAYER_RUN_SPEED
 #define PLAYER_MIN_VELOCITY  0.5f
 
+#define PLAYER_FIRE_INTERVAL 8     /* ticks */
+#define PLAYER_FIRE_SPEED    24.0f
+#define PLAYER_FIRE_HEIGHT   48.0f
+
 typedef struct APlayer {
 	PLVector3 ulViewPos;
 	PLVector3 urViewPos;
@@ -23,6 +28,8 @@ typedef struct APlayer {
 
 	float forwardVelocity;
 	float viewBob;
+
+	unsigned int nextFireTick;
 } APlayer;
 
 static void Player_CalculateViewFrustum( Actor *self ) {
@@ -71,13 +78,13 @@ bool Player_IsPointVisible( Actor *self, const PLVector2 *point ) {
 void Player_Spawn( Actor *self ) {
 	Act_SetViewOffset( self, PLAYER_VIEW_OFFSET );
 
-	APlayer* playerData = Sys_AllocateMemory( 1, sizeof( APlayer ) );
+	APlayer* playerData = Sys_AllocateTaggedMemory( 1, sizeof( APlayer ), SYS_MEMORY_TAG_ACT );
 	Act_SetUserData( self, playerData );
 
 	Player_CalculateViewFrustum( self );
 }
 
-void Player_Tick( Actor *self, void *userData ) {
+static void Player_TickActor( Actor *self, void *userData ) {
 	float nAngle = Act_GetAngle( self );
 	if ( Sys_GetInputState( YIN_INPUT_LEFT ) ) {
 		nAngle += PLAYER_TURN_SPEED;
@@ -109,12 +116,28 @@ void Player_Tick( Actor *self, void *userData ) {
 
 	Player_CalculateViewFrustum( self );
 
+	if ( Sys_GetInputState( YIN_INPUT_A ) && Sys_GetNumTicks() >= playerData->nextFireTick ) {
+		PLVector3 forward = Act_GetForward( self );
+		PLVector3 position = Act_GetPosition( self );
+		position.y += PLAYER_FIRE_HEIGHT;
+		PLVector3 velocity = plScaleVector3f( forward, PLAYER_FIRE_SPEED );
+		if ( Proj_SpawnProjectile( self, &position, &velocity ) ) {
+			playerData->nextFireTick = Sys_GetNumTicks() + PLAYER_FIRE_INTERVAL;
+		}
+	}
+
 	/* apply view bob */
 	float velocityVector = plVector3Length( &curVelocity );
 	playerData->viewBob += ( sinf( Sys_GetNumTicks() / 5.0f ) / 10.0f ) * velocityVector;
 	Act_SetViewOffset( self, PLAYER_VIEW_OFFSET + playerData->viewBob );
 }
 
+void Player_Tick( Actor **actors, unsigned int numActors, unsigned int numActive ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		Player_TickActor( actors[ i ], Act_GetUserData( actors[ i ] ) );
+	}
+}
+
 void Player_Collide( Actor *self, Actor *other, void *userData ) {
 	Monster_Collide( self, other, userData );
 
@@ -15,41 +15,36 @@ static const char *walkFrameNames[] = {
 
 #define SARG_NUM_WALK_FRAMES plArrayElements( walkFrameNames )
 #define SARG_NUM_WALK_SETS   SARG_NUM_WALK_FRAMES / GFX_NUM_SPRITE_ANGLES
+#define SARG_WALK_SPEED      2.5f
 
 typedef struct ASarg {
 	GfxAnimationFrame *walkFrames[ SARG_NUM_WALK_FRAMES ];
 } ASarg;
 
-void Sarg_Draw( Actor *self, void *userData ) {
-	if( Act_GetType( self ) != ACTOR_SARG ) {
-		return;
-	}
-
-	PLVector3 position = Act_GetPosition( self );
+void Sarg_Draw( Actor **actors, unsigned int numActors ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		PLVector3 position = Act_GetPosition( actors[ i ] );
 
-	ASarg *sargData = ( ASarg* ) userData;
-	Gfx_DrawAnimation( sargData->walkFrames, SARG_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( self ), &position, Act_GetAngle( self ) );
+		ASarg *sargData = ( ASarg* ) Act_GetUserData( actors[ i ] );
+		Gfx_DrawAnimation( sargData->walkFrames, SARG_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( actors[ i ] ), &position, Act_GetAngle( actors[ i ] ) );
+	}
 }
 
-void Sarg_Tick( Actor *self, void *userData ) {
-	/* wedge this in here, running out of time */
+void Sarg_Tick( Actor **actors, unsigned int numActors, unsigned int numActive ) {
 	static unsigned int frameDelay = 0;
-	if( ++frameDelay > 32 ) {
-		unsigned int curFrame = Act_GetCurrentFrame( self ) + 1;
-		if( curFrame >= SARG_NUM_WALK_SETS ) {
-			curFrame = 0;
-		}
-
-		Act_SetCurrentFrame( self, curFrame );
-
-		frameDelay = 0;
-	}
+	Monster_AdvanceFrames( actors, numActive, &frameDelay, SARG_NUM_WALK_SETS );
+	Monster_Chase( actors, numActors, SARG_WALK_SPEED );
 }
 
 void Sarg_Spawn( Actor *self ) {
-	ASarg *sargData = Sys_AllocateMemory( 1, sizeof( ASarg ) );
+	ASarg *sargData = Sys_AllocateTaggedMemory( 1, sizeof( ASarg ), SYS_MEMORY_TAG_ACT );
 	Act_SetUserData( self, sargData );
 
 	/* now to load in our sprite data... */
 	Gfx_LoadAnimationFrames( walkFrameNames, sargData->walkFrames, SARG_NUM_WALK_FRAMES );
 }
+
+void Sarg_Destroy( Actor *self, void *userData ) {
+	ASarg *sargData = ( ASarg* ) userData;
+	Gfx_ReleaseAnimationFrames( sargData->walkFrames, SARG_NUM_WALK_FRAMES );
+}
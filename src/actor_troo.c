@@ -15,41 +15,36 @@ static const char *walkFrameNames[] = {
 
 #define TROO_NUM_WALK_FRAMES plArrayElements( walkFrameNames )
 #define TROO_NUM_WALK_SETS   TROO_NUM_WALK_FRAMES / GFX_NUM_SPRITE_ANGLES
+#define TROO_WALK_SPEED      2.0f
 
 typedef struct ATroo {
 	GfxAnimationFrame *walkFrames[ TROO_NUM_WALK_FRAMES ];
 } ATroo;
 
-void Troo_Draw( Actor *self, void *userData ) {
-	if ( Act_GetType( self ) != ACTOR_TROO ) {
-		return;
-	}
-
-	PLVector3 position = Act_GetPosition( self );
+void Troo_Draw( Actor **actors, unsigned int numActors ) {
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		PLVector3 position = Act_GetPosition( actors[ i ] );
 
-	ATroo *trooData = ( ATroo* ) userData;
-	Gfx_DrawAnimation( trooData->walkFrames, TROO_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( self ), &position, Act_GetAngle( self ) );
+		ATroo *trooData = ( ATroo* ) Act_GetUserData( actors[ i ] );
+		Gfx_DrawAnimation( trooData->walkFrames, TROO_NUM_WALK_FRAMES - 1, Act_GetCurrentFrame( actors[ i ] ), &position, Act_GetAngle( actors[ i ] ) );
+	}
 }
 
-void Troo_Tick( Actor *self, void *userData ) {
-	/* wedge this in here, running out of time */
+void Troo_Tick( Actor **actors, unsigned int numActors, unsigned int numActive ) {
 	static unsigned int frameDelay = 0;
-	if( ++frameDelay > 32 ) {
-		unsigned int curFrame = Act_GetCurrentFrame( self ) + 1;
-		if( curFrame >= TROO_NUM_WALK_SETS ) {
-			curFrame = 0;
-		}
-
-		Act_SetCurrentFrame( self, curFrame );
-
-		frameDelay = 0;
-	}
+	Monster_AdvanceFrames( actors, numActive, &frameDelay, TROO_NUM_WALK_SETS );
+	Monster_Chase( actors, numActors, TROO_WALK_SPEED );
 }
 
 void Troo_Spawn( Actor *self ) {
-	ATroo *trooData = Sys_AllocateMemory( 1, sizeof( ATroo ) );
+	ATroo *trooData = Sys_AllocateTaggedMemory( 1, sizeof( ATroo ), SYS_MEMORY_TAG_ACT );
 	Act_SetUserData( self, trooData );
 
 	/* now to load in our sprite data... */
 	Gfx_LoadAnimationFrames( walkFrameNames, trooData->walkFrames, TROO_NUM_WALK_FRAMES );
 }
+
+void Troo_Destroy( Actor *self, void *userData ) {
+	ATroo *trooData = ( ATroo* ) userData;
+	Gfx_ReleaseAnimationFrames( trooData->walkFrames, TROO_NUM_WALK_FRAMES );
+}
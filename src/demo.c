@@ -0,0 +1,429 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "demo.h"
+#include "game.h"
+#include "act.h"
+#include "map.h"
+#include "prof.h"
+
+#include <stdarg.h>
+
+/* file layout, everything little-endian:
+ *   header: magic[4], version u16, tick rate u16, start tick u32, map name[16]
+ *   then per tick: input mask u16, state checksum u32
+ * the map name is empty for wads that only hold the one map */
+
+#define DEMO_MAP_NAME_SIZE 16
+#define DEMO_HEADER_SIZE   ( 12 + DEMO_MAP_NAME_SIZE )
+#define DEMO_RECORD_SIZE   6
+
+typedef enum DemoMode {
+	DEMO_MODE_NONE,
+	DEMO_MODE_RECORD,
+	DEMO_MODE_PLAYBACK,
+} DemoMode;
+
+static struct {
+	DemoMode     mode;
+	const char   *path;
+
+	/* recording */
+	FILE         *file;
+	bool         started;
+
+	/* playback */
+	uint8_t      *data;
+	size_t       numTicks;
+	uint32_t     startTick;
+	char         mapName[ DEMO_MAP_NAME_SIZE + 1 ];
+
+	size_t       curTick; /* ticks recorded or played back so far */
+
+	uint16_t     inputMask;
+	FILE         *checksumFile;
+	unsigned int numMismatches;
+
+	/* timedemo */
+	bool         isTimeDemo;
+	uint64_t     *frameTimes; /* ns */
+	size_t       numFrames;
+	double       zoneStartTimes[ MAX_PROF_ZONES ]; /* ms, as of the first frame */
+	double       gpuZoneStartTimes[ MAX_PROF_ZONES ];
+} demo = {
+		.mode = DEMO_MODE_NONE,
+};
+
+static void Demo_WriteUInt16( uint8_t *dst, uint16_t value ) {
+	dst[ 0 ] = ( uint8_t ) ( value & 0xFF );
+	dst[ 1 ] = ( uint8_t ) ( value >> 8 );
+}
+
+static void Demo_WriteUInt32( uint8_t *dst, uint32_t value ) {
+	Demo_WriteUInt16( dst, ( uint16_t ) ( value & 0xFFFF ) );
+	Demo_WriteUInt16( dst + 2, ( uint16_t ) ( value >> 16 ) );
+}
+
+static uint16_t Demo_ReadUInt16( const uint8_t *src ) {
+	return ( uint16_t ) ( src[ 0 ] | ( src[ 1 ] << 8 ) );
+}
+
+static uint32_t Demo_ReadUInt32( const uint8_t *src ) {
+	return ( uint32_t ) Demo_ReadUInt16( src ) | ( ( uint32_t ) Demo_ReadUInt16( src + 2 ) << 16 );
+}
+
+static void Demo_LoadPlayback( const char *path ) {
+	FILE *file = fopen( path, "rb" );
+	if ( file == NULL ) {
+		PrintError( "Failed to open demo \"%s\"!\n", path );
+	}
+
+	fseek( file, 0, SEEK_END );
+	long fileSize = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	if ( fileSize < DEMO_HEADER_SIZE || ( fileSize - DEMO_HEADER_SIZE ) % DEMO_RECORD_SIZE != 0 ) {
+		PrintError( "Invalid demo size for \"%s\" (%ld bytes)!\n", path, fileSize );
+	}
+
+	demo.data = Sys_AllocateTaggedMemory( ( size_t ) fileSize, sizeof( uint8_t ), SYS_MEMORY_TAG_SYS );
+	if ( fread( demo.data, 1, ( size_t ) fileSize, file ) != ( size_t ) fileSize ) {
+		PrintError( "Failed to read demo \"%s\"!\n", path );
+	}
+
+	fclose( file );
+
+	if ( memcmp( demo.data, DEMO_MAGIC, 4 ) != 0 ) {
+		PrintError( "Invalid demo identifier for \"%s\"!\n", path );
+	}
+
+	uint16_t version = Demo_ReadUInt16( demo.data + 4 );
+	if ( version != DEMO_VERSION ) {
+		PrintError( "Unsupported demo version for \"%s\", %d/%d!\n", path, version, DEMO_VERSION );
+	}
+
+	uint16_t tickRate = Demo_ReadUInt16( demo.data + 6 );
+	if ( tickRate != YIN_TICK_RATE ) {
+		PrintWarn( "Demo was recorded at a different tick rate (%dms vs %dms)!\n", tickRate, YIN_TICK_RATE );
+	}
+
+	demo.startTick = Demo_ReadUInt32( demo.data + 8 );
+	memcpy( demo.mapName, demo.data + 12, DEMO_MAP_NAME_SIZE );
+	demo.mapName[ DEMO_MAP_NAME_SIZE ] = '\0';
+	demo.numTicks  = ( ( size_t ) fileSize - DEMO_HEADER_SIZE ) / DEMO_RECORD_SIZE;
+	demo.curTick   = 0;
+
+	PrintMsg( "Playing back demo \"%s\" (%zu ticks)...\n", path, demo.numTicks );
+}
+
+void Demo_Initialize( void ) {
+	memset( &demo, 0, sizeof( demo ) );
+
+	if ( plHasCommandLineArgument( "-timedemo" ) ) {
+		demo.path = plGetCommandLineArgumentValue( "-timedemo" );
+		if ( demo.path == NULL ) {
+			PrintError( "No demo specified for timedemo!\n" );
+		}
+
+		demo.mode = DEMO_MODE_PLAYBACK;
+		Demo_LoadPlayback( demo.path );
+
+		demo.isTimeDemo = true;
+		demo.frameTimes = Sys_AllocateTaggedMemory( demo.numTicks, sizeof( uint64_t ), SYS_MEMORY_TAG_SYS );
+	} else if ( plHasCommandLineArgument( "-playdemo" ) ) {
+		demo.path = plGetCommandLineArgumentValue( "-playdemo" );
+		if ( demo.path == NULL ) {
+			PrintError( "No demo specified for playback!\n" );
+		}
+
+		demo.mode = DEMO_MODE_PLAYBACK;
+		Demo_LoadPlayback( demo.path );
+	} else if ( plHasCommandLineArgument( "-record" ) ) {
+		demo.path = plGetCommandLineArgumentValue( "-record" );
+		if ( demo.path == NULL ) {
+			PrintError( "No demo specified for recording!\n" );
+		}
+
+		demo.file = fopen( demo.path, "wb" );
+		if ( demo.file == NULL ) {
+			PrintError( "Failed to open \"%s\" for recording!\n", demo.path );
+		}
+
+		demo.mode = DEMO_MODE_RECORD;
+		PrintMsg( "Recording demo to \"%s\"...\n", demo.path );
+	}
+
+	const char *checksumPath = plGetCommandLineArgumentValue( "-checksums" );
+	if ( checksumPath != NULL ) {
+		demo.checksumFile = fopen( checksumPath, "w" );
+		if ( demo.checksumFile == NULL ) {
+			PrintWarn( "Failed to open \"%s\" for writing checksums!\n", checksumPath );
+		}
+	}
+}
+
+/* playback takes over from the menu, so the game starts on the same tick
+ * it did when the demo was recorded */
+void Demo_Start( void ) {
+	if ( demo.mode != DEMO_MODE_PLAYBACK ) {
+		return;
+	}
+
+	/* has to be the map it was recorded on, regardless of -map */
+	const char *mapName = NULL;
+	if ( demo.mapName[ 0 ] != '\0' ) {
+		mapName = demo.mapName;
+		if ( !Map_Exists( globalWad, mapName ) ) {
+			PrintError( "Demo \"%s\" was recorded on \"%s\", which isn't in this wad!\n", demo.path, mapName );
+		}
+	}
+
+	Sys_SetNumTicks( demo.startTick );
+	Gam_Start( mapName );
+}
+
+void Demo_Shutdown( void ) {
+	if ( demo.file != NULL ) {
+		fclose( demo.file );
+		demo.file = NULL;
+	}
+
+	if ( demo.checksumFile != NULL ) {
+		fclose( demo.checksumFile );
+		demo.checksumFile = NULL;
+	}
+
+	Sys_FreeMemory( demo.data );
+	demo.data = NULL;
+
+	Sys_FreeMemory( demo.frameTimes );
+	demo.frameTimes = NULL;
+
+	demo.mode = DEMO_MODE_NONE;
+}
+
+bool Demo_IsRecording( void ) {
+	return demo.mode == DEMO_MODE_RECORD;
+}
+
+bool Demo_IsPlaying( void ) {
+	return demo.mode == DEMO_MODE_PLAYBACK;
+}
+
+bool Demo_IsFinished( void ) {
+	return demo.mode == DEMO_MODE_PLAYBACK && demo.curTick >= demo.numTicks;
+}
+
+void Demo_BeginTick( void ) {
+	switch ( demo.mode ) {
+		default: break;
+		case DEMO_MODE_RECORD:
+			/* nothing worth recording until we're in game */
+			if ( !Gam_IsActive() ) {
+				break;
+			}
+
+			if ( !demo.started ) {
+				uint8_t header[ DEMO_HEADER_SIZE ];
+				memcpy( header, DEMO_MAGIC, 4 );
+				Demo_WriteUInt16( header + 4, DEMO_VERSION );
+				Demo_WriteUInt16( header + 6, YIN_TICK_RATE );
+				Demo_WriteUInt32( header + 8, Sys_GetNumTicks() );
+				memset( header + 12, 0, DEMO_MAP_NAME_SIZE );
+				memcpy( header + 12, Map_GetName(), strnlen( Map_GetName(), DEMO_MAP_NAME_SIZE ) );
+				fwrite( header, 1, sizeof( header ), demo.file );
+
+				demo.started = true;
+			}
+
+			demo.inputMask = Sys_GetInputMask();
+			break;
+		case DEMO_MODE_PLAYBACK:
+			if ( Demo_IsFinished() ) {
+				demo.inputMask = 0;
+				break;
+			}
+
+			demo.inputMask = Demo_ReadUInt16( demo.data + DEMO_HEADER_SIZE + demo.curTick * DEMO_RECORD_SIZE );
+			break;
+	}
+}
+
+void Demo_EndTick( void ) {
+	if ( demo.mode == DEMO_MODE_NONE || ( demo.mode == DEMO_MODE_RECORD && !demo.started ) || Demo_IsFinished() ) {
+		return;
+	}
+
+	uint32_t checksum = Act_GetStateChecksum();
+	if ( demo.mode == DEMO_MODE_RECORD ) {
+		uint8_t record[ DEMO_RECORD_SIZE ];
+		Demo_WriteUInt16( record, demo.inputMask );
+		Demo_WriteUInt32( record + 2, checksum );
+		fwrite( record, 1, sizeof( record ), demo.file );
+	} else {
+		uint32_t expected = Demo_ReadUInt32( demo.data + DEMO_HEADER_SIZE + demo.curTick * DEMO_RECORD_SIZE + 2 );
+		if ( checksum != expected ) {
+			/* only shout about the first one, everything after will follow suit */
+			if ( demo.numMismatches == 0 ) {
+				PrintWarn( "Demo desync on tick %zu (%08X vs %08X)!\n", demo.curTick, checksum, expected );
+			}
+			demo.numMismatches++;
+		}
+	}
+
+	if ( demo.checksumFile != NULL ) {
+		fprintf( demo.checksumFile, "%zu %08X\n", demo.curTick, checksum );
+	}
+
+	demo.curTick++;
+	if ( Demo_IsFinished() ) {
+		PrintMsg( "Demo finished after %zu ticks, %u mismatches\n", demo.numTicks, demo.numMismatches );
+	}
+}
+
+bool Demo_GetInputState( InputButton inputIndex ) {
+	return ( demo.inputMask & ( 1u << inputIndex ) ) != 0;
+}
+
+unsigned int Demo_GetNumMismatches( void ) {
+	return demo.numMismatches;
+}
+
+/****************************************
+ * Timedemo
+ ****************************************/
+
+bool Demo_IsTimeDemo( void ) {
+	return demo.isTimeDemo;
+}
+
+/* called at the start of the first frame, so loading isn't counted
+ * towards the per-frame subsystem times */
+void Demo_BeginTimeDemo( void ) {
+	if ( !demo.isTimeDemo ) {
+		return;
+	}
+
+	for ( unsigned int i = 0; i < MAX_PROF_ZONES; ++i ) {
+		demo.zoneStartTimes[ i ]    = Prof_GetZoneTotalTime( i );
+		demo.gpuZoneStartTimes[ i ] = Prof_GetZoneTotalGPUTime( i );
+	}
+}
+
+void Demo_AddFrameTime( uint64_t frameTime ) {
+	if ( !demo.isTimeDemo || demo.numFrames >= demo.numTicks ) {
+		return;
+	}
+
+	demo.frameTimes[ demo.numFrames++ ] = frameTime;
+}
+
+static int Demo_CompareFrameTimes( const void *a, const void *b ) {
+	uint64_t fa = *( const uint64_t * ) a;
+	uint64_t fb = *( const uint64_t * ) b;
+	return ( fa > fb ) - ( fa < fb );
+}
+
+static double Demo_GetPercentile( const uint64_t *sortedTimes, size_t numTimes, double percentile ) {
+	size_t index = ( size_t ) ( percentile / 100.0 * ( numTimes - 1 ) + 0.5 );
+	return sortedTimes[ index ] / 1000000.0;
+}
+
+/* appends to the summary, stopping at the end of it rather than running off */
+static void Demo_AppendSummary( char *summary, size_t size, size_t *length, const char *format, ... ) {
+	if ( *length >= size - 1 ) {
+		return;
+	}
+
+	va_list args;
+	va_start( args, format );
+	int written = vsnprintf( summary + *length, size - *length, format, args );
+	va_end( args );
+
+	if ( written < 0 ) {
+		return;
+	}
+
+	*length += ( size_t ) written;
+	if ( *length >= size ) {
+		*length = size - 1;
+	}
+}
+
+/* writes a single json object describing the run, to stdout and
+ * optionally to the file given by -summary */
+void Demo_WriteTimeDemoSummary( void ) {
+	if ( !demo.isTimeDemo || demo.numFrames == 0 ) {
+		return;
+	}
+
+	uint64_t *sortedTimes = Sys_AllocateTaggedMemory( demo.numFrames, sizeof( uint64_t ), SYS_MEMORY_TAG_SYS );
+	memcpy( sortedTimes, demo.frameTimes, demo.numFrames * sizeof( uint64_t ) );
+	qsort( sortedTimes, demo.numFrames, sizeof( uint64_t ), Demo_CompareFrameTimes );
+
+	uint64_t totalTime = 0;
+	for ( size_t i = 0; i < demo.numFrames; ++i ) {
+		totalTime += sortedTimes[ i ];
+	}
+
+	double seconds = totalTime / 1000000000.0;
+	double averageFrame = ( totalTime / 1000000.0 ) / demo.numFrames;
+
+	char summary[ 2048 ];
+	size_t length = 0;
+	Demo_AppendSummary( summary, sizeof( summary ), &length,
+	                    "{\"demo\":\"%s\",\"frames\":%zu,\"seconds\":%.3f,\"avg_fps\":%.2f,\"mismatches\":%u,"
+	                    "\"frame_ms\":{\"avg\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+	                    demo.path, demo.numFrames, seconds, ( seconds > 0.0 ) ? demo.numFrames / seconds : 0.0,
+	                    demo.numMismatches, averageFrame,
+	                    Demo_GetPercentile( sortedTimes, demo.numFrames, 50.0 ),
+	                    Demo_GetPercentile( sortedTimes, demo.numFrames, 95.0 ),
+	                    Demo_GetPercentile( sortedTimes, demo.numFrames, 99.0 ),
+	                    sortedTimes[ demo.numFrames - 1 ] / 1000000.0 );
+
+	Sys_FreeMemory( sortedTimes );
+
+	/* per-subsystem breakdown, averaged per frame */
+	Demo_AppendSummary( summary, sizeof( summary ), &length, "\"cpu_ms\":{" );
+	for ( unsigned int i = 0; i < MAX_PROF_ZONES; ++i ) {
+		double cpuTime = Prof_GetZoneTotalTime( i ) - demo.zoneStartTimes[ i ];
+		Demo_AppendSummary( summary, sizeof( summary ), &length, "%s\"%s\":%.3f", i > 0 ? "," : "",
+		                    Prof_GetZoneName( i ), cpuTime / demo.numFrames );
+	}
+
+	Demo_AppendSummary( summary, sizeof( summary ), &length, "},\"gpu_ms\":{" );
+	unsigned int numGPUZones = 0;
+	for ( unsigned int i = 0; i < MAX_PROF_ZONES; ++i ) {
+		double gpuTime = Prof_GetZoneTotalGPUTime( i );
+		if ( gpuTime < 0.0 ) {
+			continue;
+		}
+
+		/* the timer might only have come up after the first frame */
+		if ( demo.gpuZoneStartTimes[ i ] > 0.0 ) {
+			gpuTime -= demo.gpuZoneStartTimes[ i ];
+		}
+
+		Demo_AppendSummary( summary, sizeof( summary ), &length, "%s\"%s\":%.3f", numGPUZones++ > 0 ? "," : "",
+		                    Prof_GetZoneName( i ), gpuTime / demo.numFrames );
+	}
+
+	Demo_AppendSummary( summary, sizeof( summary ), &length, "}}\n" );
+
+	fputs( summary, stdout );
+	fflush( stdout );
+
+	const char *summaryPath = plGetCommandLineArgumentValue( "-summary" );
+	if ( summaryPath != NULL ) {
+		FILE *file = fopen( summaryPath, "w" );
+		if ( file == NULL ) {
+			PrintWarn( "Failed to open \"%s\" for writing timedemo summary!\n", summaryPath );
+			return;
+		}
+
+		fputs( summary, file );
+		fclose( file );
+	}
+}
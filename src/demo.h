@@ -0,0 +1,33 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#pragma once
+
+/* demos are a per-tick log of the input state along with a checksum of
+ * the game state after that tick, so playback can be verified */
+
+#define DEMO_MAGIC   "YDEM"
+#define DEMO_VERSION 8 /* bumped whenever the simulation changes */
+
+void Demo_Initialize( void );
+void Demo_Start( void );
+void Demo_Shutdown( void );
+
+bool Demo_IsRecording( void );
+bool Demo_IsPlaying( void );
+bool Demo_IsFinished( void );
+
+void Demo_BeginTick( void );
+void Demo_EndTick( void );
+
+bool Demo_GetInputState( InputButton inputIndex );
+
+unsigned int Demo_GetNumMismatches( void );
+
+/* timedemo plays back as fast as possible, one tick per frame,
+ * and reports on how long each frame took */
+bool Demo_IsTimeDemo( void );
+void Demo_BeginTimeDemo( void );
+void Demo_AddFrameTime( uint64_t frameTime );
+void Demo_WriteTimeDemoSummary( void );
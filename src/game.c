@@ -4,8 +4,10 @@
 
 #include "yin.h"
 #include "game.h"
+#include "gfx.h"
 #include "act.h"
 #include "map.h"
+#include "proj.h"
 
 /* game specific implementation goes here! */
 
@@ -32,20 +34,71 @@ Actor *Gam_GetPlayer( void ) {
 	return playerActor;
 }
 
-void Gam_Start( void ) {
+/* keeps the map streamed in around the player, and
+ * everything that's after them pointed their way */
+static void Gam_UpdateMap( void ) {
+	if ( playerActor == NULL ) {
+		return;
+	}
+
+	PLVector3 position = Act_GetPosition( playerActor );
+	Map_UpdateStreaming( &PLVector2( position.x, position.z ) );
+	Map_UpdateNavigation( &PLVector2( position.x, position.z ) );
+}
+
+/* pass NULL to use the -map argument, or otherwise the first map */
+void Gam_Start( const char *mapName ) {
+	if ( mapName == NULL ) {
+		mapName = plGetCommandLineArgumentValue( "-map" );
+	}
+
 	menuState = MENU_STATE_HUD;
 	inputTarget = INPUT_TARGET_GAME;
 
-	Map_Load( globalWad ); /* load the map from the global wad */
+	Map_Load( globalWad, mapName );
 
-	Act_SpawnActors();
+	Act_SpawnActors( globalWad, Map_GetLumpIndex( MAP_LUMP_THINGS ) );
 
 	/* spawn the player in */
 	playerActor = Act_SpawnActor( ACTOR_PLAYER, PLVector3( 500, 0, 1276 ), -90.0f );
+
+	Gam_UpdateMap();
+
+	gameState = GAME_STATE_ACTIVE;
+}
+
+bool Gam_IsActive( void ) {
+	return gameState == GAME_STATE_ACTIVE;
 }
 
+/* tears down everything specific to the current map; textures
+ * and sprite frames are left loaded, for the next one to reuse */
 void Gam_End( void ) {
+	Proj_ClearProjectiles();
+	Act_DestroyAllActors();
+	playerActor = NULL;
 
+	Map_Unload();
+
+	gameState = GAME_STATE_PAUSED;
+}
+
+void Gam_ChangeMap( const char *mapName ) {
+	if ( !Map_Exists( globalWad, mapName ) ) {
+		PrintWarn( "Failed to find map \"%s\"!\n", mapName );
+		return;
+	}
+
+	uint64_t startTime = Sys_GetNanoseconds();
+
+	Gam_End();
+	Gam_Start( mapName );
+
+	/* only now that the new map's actors hold onto what they need,
+	 * so anything shared between the two maps isn't reloaded */
+	Gfx_PurgeAnimationFrames();
+
+	PrintMsg( "Changed map to \"%s\" in %.2fms\n", mapName, ( Sys_GetNanoseconds() - startTime ) / 1000000.0 );
 }
 
 void Gam_Tick( void ) {
@@ -53,7 +106,10 @@ void Gam_Tick( void ) {
 		return;
 	}
 
+	Gam_UpdateMap();
+
 	Act_TickActors();
+	Proj_TickProjectiles();
 }
 
 void Gam_Keyboard( unsigned char key ) {
@@ -61,8 +117,7 @@ void Gam_Keyboard( unsigned char key ) {
 		switch( menuState ) {
 			case MENU_STATE_START:
 				/* if any key was hit here, just switch to the game */
-				Gam_Start();
-				gameState = GAME_STATE_ACTIVE;
+				Gam_Start( NULL );
 				break;
 			default:
 			PrintError( "Unhandled menu state, %d!\n", menuState );
@@ -73,4 +128,6 @@ void Gam_Keyboard( unsigned char key ) {
 
 void Gam_Initialize( void ) {}
 
-void Gam_Shutdown( void ) {}
+void Gam_Shutdown( void ) {
+	Map_Unload();
+}
@@ -13,6 +13,11 @@ MenuState Gam_GetMenuState( void );
 typedef struct Actor Actor;
 Actor *Gam_GetPlayer( void );
 
+void Gam_Start( const char *mapName );
+void Gam_End( void );
+void Gam_ChangeMap( const char *mapName );
+bool Gam_IsActive( void );
+
 void Gam_Initialize( void );
 void Gam_Shutdown( void );
 void Gam_Tick( void );
@@ -7,17 +7,18 @@
 #include "game.h"
 #include "act.h"
 #include "map.h"
-
-static PLShaderProgram *shaderPrograms[MAX_SHADER_TYPES];
+#include "prof.h"
+#include "proj.h"
+#include "gfx_gl.h"
+#include "wad.h"
 
 static PLCamera *auxCamera = NULL;
 static PLCamera *playerCamera = NULL;
 
-typedef struct RGBMap {
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-} RGBMap;
+/* from the player camera, as of the scene being drawn */
+static GfxFrustum viewFrustum;
+static bool       isViewFrustumValid = false;
+
 static RGBMap playPal[256], titlePal[256];
 
 PLTexture *fallbackTexture = NULL;
@@ -28,11 +29,18 @@ static PLTexture *numTextureTable[10];
 
 static GfxAnimationFrame **wallTextures;
 static unsigned int      numWallTextures;
+static unsigned int      firstWallLump;
 static PLTexture         **floorTextures;
 static unsigned int      numFloorTextures;
+static unsigned int      firstFloorLump;
 
 PLTexture *Gfx_GenerateTextureFromData( uint8_t *data, unsigned int w, unsigned int h, unsigned int numChannels,
 										bool generateMipMap ) {
+	/* no context to upload to */
+	if ( Sys_IsHeadless() ) {
+		return NULL;
+	}
+
 	PLColourFormat cFormat;
 	PLImageFormat iFormat;
 
@@ -81,62 +89,77 @@ PLTexture *Gfx_GenerateTextureFromData( uint8_t *data, unsigned int w, unsigned
 	return texture;
 }
 
-GfxAnimationFrame *Gfx_LoadPictureByIndex( const RGBMap *palette, unsigned int index ) {
-	PLFile *filePtr = plLoadPackageFileByIndex( globalWad, index );
-	if ( filePtr == NULL ) {
-		const char *fileName = plGetPackageFileName( globalWad, index );
-		if ( fileName == NULL ) {
-			fileName = "Unknown";
-		}
-
-		PrintError( "Failed to load picture %d (%s)!\nPL: %s\n", index, fileName, plGetError() );
+void Gfx_ReplaceTexture( PLTexture **texture, PLTexture *newTexture ) {
+	if ( *texture != NULL && *texture != fallbackTexture ) {
+		plDestroyTexture( *texture );
 	}
 
-	bool status;
-	uint8_t w = plReadInt8( filePtr, &status );
-	uint8_t h = plReadInt8( filePtr, &status );
-	uint8_t leftOffset = plReadInt8( filePtr, &status );
-	uint8_t topOffset = plReadInt8( filePtr, &status );
-	if ( !status ) {
-		plCloseFile( filePtr );
-		PrintError( "Failed to read in width and height for picture %d!\nPL: %s\n", index, plGetError() );
+	*texture = newTexture;
+}
+
+/* stages rgba texels to be uploaded over the next few frames if there's
+ * room, otherwise falls back to uploading them there and then */
+void Gfx_UploadTexture( PLTexture **destination, const uint8_t *data, unsigned int width, unsigned int height ) {
+	GfxUpload *upload = Gfx_BeginTextureUpload( destination, width, height );
+	if ( upload == NULL ) {
+		/* so an older one still in the ring doesn't land on top of this */
+		Gfx_CancelTextureUploads( destination );
+		Gfx_ReplaceTexture( destination, Gfx_GenerateTextureFromData(( uint8_t * ) data, width, height, 4, false ) );
+		return;
 	}
 
-	/* read in the column offsets */
+	memcpy( Gfx_GetUploadBuffer( upload ), data, ( size_t ) width * height * sizeof( PLColour ) );
+	Gfx_EndTextureUpload( upload );
+}
 
-	int16_t *columnOffsets = Sys_AllocateMemory( w, sizeof( int16_t ) );
-	for ( unsigned int i = 0; i < w; ++i ) {
-		columnOffsets[ i ] = plReadInt16( filePtr, false, &status );
-	}
+#define GFX_PICTURE_HEADER_SIZE 4
 
-	if ( !status ) {
-		plCloseFile( filePtr );
-		PrintError( "Failed to read in column offsets for picture %d!\nPL: %s\n", index, plGetError() );
+/* returns false if the picture is too small to hold its column offsets */
+static bool Gfx_GetPictureHeader( const uint8_t *data, size_t size, unsigned int *width, unsigned int *height,
+                                  unsigned int *leftOffset, unsigned int *topOffset ) {
+	if ( size < GFX_PICTURE_HEADER_SIZE ) {
+		return false;
 	}
 
-	PLColour *colourBuffer = Sys_AllocateMemory( (size_t) w * h, sizeof( PLColour ) );
-	for ( unsigned int i = 0; i < w; ++i ) {
-		plFileSeek( filePtr, columnOffsets[ i ], PL_SEEK_SET );
+	*width      = data[ 0 ];
+	*height     = data[ 1 ];
+	*leftOffset = data[ 2 ];
+	*topOffset  = data[ 3 ];
+
+	return size >= GFX_PICTURE_HEADER_SIZE + ( size_t ) *width * sizeof( uint16_t );
+}
+
+/* decodes a column-based picture into width * height rgba texels. the
+ * header should already have been checked with Gfx_GetPictureHeader.
+ * this only touches its arguments, so it's safe to run on any thread */
+static void Gfx_DecodePicture( const uint8_t *data, size_t size, const RGBMap *palette, PLColour *colourBuffer ) {
+	unsigned int w = data[ 0 ];
+	unsigned int h = data[ 1 ];
 
-		uint8_t rowStart = 0;
-		while ( 1 ) {
-			rowStart = plReadInt8( filePtr, &status );
-			if ( rowStart == 255 ) {
+	/* anything not covered by a post is transparent */
+	memset( colourBuffer, 0, ( size_t ) w * h * sizeof( PLColour ) );
+
+	/* posts that run off the end of the lump or the picture are dropped */
+	for ( unsigned int i = 0; i < w; ++i ) {
+		size_t offset = Wad_GetUInt16( &data[ GFX_PICTURE_HEADER_SIZE + i * sizeof( uint16_t ) ] );
+		while ( offset < size ) {
+			uint8_t rowStart = data[ offset++ ];
+			if ( rowStart == 255 || offset >= size ) {
 				break;
 			}
 
-			uint8_t pixelCount = plReadInt8( filePtr, &status );
-			if ( !status ) {
-				PrintError( "Failed to read pixel count (i=%d)\nPL: %s\n", i, plGetError() );
+			unsigned int pixelCount = data[ offset++ ];
+			if ( offset + pixelCount > size ) {
+				break;
 			}
 
-			for ( unsigned int j = 0; j < pixelCount; ++j ) {
-				uint8_t pixel = plReadInt8( filePtr, &status );
+			for ( unsigned int j = 0; j < pixelCount && j + rowStart < h; ++j ) {
+				uint8_t pixel = data[ offset + j ];
 
 				unsigned int pos = ( j + rowStart ) * w + i;
-				colourBuffer[ pos ].r = playPal[ pixel ].r;
-				colourBuffer[ pos ].g = playPal[ pixel ].g;
-				colourBuffer[ pos ].b = playPal[ pixel ].b;
+				colourBuffer[ pos ].r = palette[ pixel ].r;
+				colourBuffer[ pos ].g = palette[ pixel ].g;
+				colourBuffer[ pos ].b = palette[ pixel ].b;
 
 				/* unlike others, cyan denotes transparency here */
 				bool isCyan =
@@ -145,24 +168,110 @@ GfxAnimationFrame *Gfx_LoadPictureByIndex( const RGBMap *palette, unsigned int i
 						colourBuffer[ pos ].b == 255;
 				colourBuffer[ pos ].a = isCyan ? 0 : 255;
 			}
+
+			offset += pixelCount;
 		}
 	}
+}
 
-	plCloseFile( filePtr );
+/* decodes a column-based picture into an rgba buffer allocated from the given arena */
+PLColour *Gfx_DecodePictureByIndex( SysArena *arena, const RGBMap *palette, unsigned int index, unsigned int *width, unsigned int *height,
+                                    unsigned int *leftOffset, unsigned int *topOffset ) {
+	size_t size;
+	uint8_t *data = Wad_LoadLumpByIndex( globalWad, index, arena, &size );
+	if ( data == NULL ) {
+		PrintError( "Failed to load picture %d!\n", index );
+	}
+
+	if ( !Gfx_GetPictureHeader( data, size, width, height, leftOffset, topOffset ) ) {
+		PrintError( "Failed to read in header for picture %d, only %zu bytes!\n", index, size );
+	}
+
+	PLColour *colourBuffer = Sys_ArenaAllocate( arena, ( size_t ) *width * *height, sizeof( PLColour ) );
+	Gfx_DecodePicture( data, size, palette, colourBuffer );
+
+	return colourBuffer;
+}
+
+/* everything the loader needs to decode a picture, owned by the job */
+typedef struct GfxPictureJob {
+	RGBMap  palette[ 256 ];
+	size_t  size;
+	uint8_t data[];
+} GfxPictureJob;
+
+static void Gfx_FillPictureUpload( uint8_t *texels, void *userData ) {
+	GfxPictureJob *job = userData;
+	Gfx_DecodePicture( job->data, job->size, job->palette, ( PLColour * ) texels );
+	Sys_FreeMemory( job );
+}
+
+/* the frame keeps its current texture until the new one is uploaded.
+ * the lump is read here, but decoding happens on the upload loader,
+ * straight into the upload's texels */
+static void Gfx_UploadPicture( GfxAnimationFrame *frame, const RGBMap *palette, unsigned int index ) {
+	const char *fileName = plGetPackageFileName( globalWad, index );
+	if ( fileName == NULL ) {
+		fileName = "Unknown";
+	}
+
+	Prof_BeginTrace( fileName );
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t size;
+	uint8_t *data = Wad_LoadLumpByIndex( globalWad, index, arena, &size );
+	if ( data == NULL ) {
+		PrintError( "Failed to load picture %d (%s)!\n", index, fileName );
+	}
+
+	unsigned int w, h, leftOffset, topOffset;
+	if ( !Gfx_GetPictureHeader( data, size, &w, &h, &leftOffset, &topOffset ) ) {
+		PrintError( "Failed to read in header for picture %d (%s), only %zu bytes!\n", index, fileName, size );
+	}
 
-	/* setup the animation frame we're going to use */
-	GfxAnimationFrame *frame = Sys_AllocateMemory( 1, sizeof( GfxAnimationFrame ) );
-	frame->texture    = Gfx_GenerateTextureFromData(( uint8_t * ) colourBuffer, w, h, 4, false );
 	frame->leftOffset = leftOffset;
 	frame->topOffset  = topOffset;
 
-	free( colourBuffer );
+	GfxUpload *upload = Gfx_BeginTextureUpload( &frame->texture, w, h );
+	if ( upload != NULL ) {
+		GfxPictureJob *job = Sys_AllocateTaggedMemory( 1, sizeof( GfxPictureJob ) + size, SYS_MEMORY_TAG_GFX );
+		memcpy( job->palette, palette, sizeof( job->palette ) );
+		memcpy( job->data, data, size );
+		job->size = size;
+
+		Gfx_QueueTextureUpload( upload, Gfx_FillPictureUpload, job );
+	} else {
+		PLColour *colourBuffer = Sys_ArenaAllocate( arena, ( size_t ) w * h, sizeof( PLColour ) );
+		Gfx_DecodePicture( data, size, palette, colourBuffer );
+		Gfx_ReplaceTexture( &frame->texture, Gfx_GenerateTextureFromData(( uint8_t * ) colourBuffer, w, h, 4, false ) );
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Prof_EndTrace( fileName );
+}
+
+GfxAnimationFrame *Gfx_LoadPictureByIndex( const RGBMap *palette, unsigned int index ) {
+	/* setup the animation frame we're going to use */
+	GfxAnimationFrame *frame = Sys_AllocateTaggedMemory( 1, sizeof( GfxAnimationFrame ), SYS_MEMORY_TAG_GFX );
+	frame->texture   = fallbackTexture;
+	frame->lumpIndex = index;
+
+	Gfx_UploadPicture( frame, palette, index );
 
 	return frame;
 }
 
 GfxAnimationFrame *Gfx_LoadPictureByName( const RGBMap *palette, const char *indexName ) {
-	return Gfx_LoadPictureByIndex( palette, plGetPackageTableIndex( globalWad, indexName ) );
+	unsigned int index;
+	if ( !Wad_FindLump( globalWad, indexName, &index ) ) {
+		PrintWarn( "Failed to find \"%s\"!\n", indexName );
+		return NULL;
+	}
+
+	return Gfx_LoadPictureByIndex( palette, index );
 }
 
 PLTexture *Gfx_GetWallTexture( unsigned int index ) {
@@ -175,18 +284,20 @@ PLTexture *Gfx_GetWallTexture( unsigned int index ) {
 }
 
 void Gfx_LoadWallTextures( void ) {
-	unsigned int posStart = plGetPackageTableIndex( globalWad, "P_START" ) + 1;
-	if ( plGetFunctionResult() != PL_RESULT_SUCCESS ) {
-		PrintError( "Failed to find the start of the wall table!\nPL: %s\n", plGetError() );
+	unsigned int posStart;
+	if ( !Wad_FindLump( globalWad, "P_START", &posStart ) ) {
+		PrintError( "Failed to find the start of the wall table!\n" );
 	}
+	posStart++;
 
-	unsigned int posEnd = plGetPackageTableIndex( globalWad, "P_END" );
-	if ( plGetFunctionResult() != PL_RESULT_SUCCESS ) {
-		PrintError( "Failed to find the end of the wall table!\nPL: %s\n", plGetError() );
+	unsigned int posEnd;
+	if ( !Wad_FindLump( globalWad, "P_END", &posEnd ) ) {
+		PrintError( "Failed to find the end of the wall table!\n" );
 	}
 
+	firstWallLump = posStart;
 	numWallTextures = posEnd - posStart;
-	wallTextures = Sys_AllocateMemory( numWallTextures, sizeof( PLTexture* ) );
+	wallTextures = Sys_AllocateTaggedMemory( numWallTextures, sizeof( PLTexture* ), SYS_MEMORY_TAG_GFX );
 
 	for ( unsigned int i = 0; i < numWallTextures; ++i ) {
 		unsigned int fileIndex = posStart + i;
@@ -194,8 +305,20 @@ void Gfx_LoadWallTextures( void ) {
 	}
 }
 
-PLTexture *Gfx_LoadFlatByIndex( const RGBMap *palette, unsigned int index ) {
-	PLFile *filePtr = plLoadPackageFileByIndex( globalWad, index );
+/* converts palette indices to rgba; pass a negative transparentIndex
+ * if every index should be opaque */
+void Gfx_ExpandPalette( const RGBMap *palette, const uint8_t *src, PLColour *dst, size_t numPixels, int transparentIndex ) {
+	for ( size_t i = 0; i < numPixels; ++i ) {
+		dst[ i ].r = palette[ src[ i ] ].r;
+		dst[ i ].g = palette[ src[ i ] ].g;
+		dst[ i ].b = palette[ src[ i ] ].b;
+		dst[ i ].a = ( src[ i ] == transparentIndex ) ? 0 : 255;
+	}
+}
+
+/* returns NULL if the flat couldn't be decoded */
+PLColour *Gfx_DecodeFlatByIndex( SysArena *arena, const RGBMap *palette, unsigned int index ) {
+	PLFile *filePtr = Wad_OpenLumpByIndex( globalWad, index );
 	if ( filePtr == NULL ) {
 		const char *fileName = plGetPackageFileName( globalWad, index );
 		if ( fileName == NULL ) {
@@ -203,39 +326,52 @@ PLTexture *Gfx_LoadFlatByIndex( const RGBMap *palette, unsigned int index ) {
 		}
 
 		PrintWarn( "Failed to load flat %d (%s)!\nPL: %s\n", index, fileName, plGetError() );
-		return fallbackTexture;
+		return NULL;
 	}
 
 	/* all flats are assumed to be 64x64 */
 	size_t flatSize = plGetFileSize( filePtr );
-	if ( flatSize != 4096 ) {
+	if ( flatSize != GFX_FLAT_SIZE * GFX_FLAT_SIZE ) {
 		PrintWarn( "Unexpected flat size for %d, %d/64!\n", index, flatSize );
 		plCloseFile( filePtr );
-		return fallbackTexture;
+		return NULL;
 	}
 
-	PLColour *colourBuffer = Sys_AllocateMemory( flatSize, sizeof( PLColour ) );
-	for ( unsigned int i = 0; i < flatSize; ++i ) {
-		bool status;
-		uint8_t pixel = plReadInt8( filePtr, &status );
-		if ( !status ) {
-			PrintError( "Failed to read pixel %d for flat %d!\nPL: %s\n", i, index, plGetError() );
-		}
-
-		colourBuffer[ i ].r = palette[ pixel ].r;
-		colourBuffer[ i ].g = palette[ pixel ].g;
-		colourBuffer[ i ].b = palette[ pixel ].b;
-		/* transparency isn't supported here? */
-		colourBuffer[ i ].a = 255;
+	uint8_t pixels[ GFX_FLAT_SIZE * GFX_FLAT_SIZE ];
+	if ( plReadFile( filePtr, pixels, 1, flatSize ) != flatSize ) {
+		PrintError( "Failed to read pixels for flat %d!\nPL: %s\n", index, plGetError() );
 	}
 
 	plCloseFile( filePtr );
 
-	PLTexture *texture = Gfx_GenerateTextureFromData(( uint8_t * ) colourBuffer, 64, 64, 4, false );
+	/* transparency isn't supported here? */
+	PLColour *colourBuffer = Sys_ArenaAllocate( arena, flatSize, sizeof( PLColour ) );
+	Gfx_ExpandPalette( palette, pixels, colourBuffer, flatSize, -1 );
 
-	free( colourBuffer );
+	return colourBuffer;
+}
 
-	return texture;
+/* there's little to decoding a flat, so that's done here, but the
+ * texture is left to the upload ring to replace destination later */
+static void Gfx_UploadFlat( PLTexture **destination, const RGBMap *palette, unsigned int index ) {
+	const char *fileName = plGetPackageFileName( globalWad, index );
+	if ( fileName == NULL ) {
+		fileName = "Unknown";
+	}
+
+	Prof_BeginTrace( fileName );
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	PLColour *colourBuffer = Gfx_DecodeFlatByIndex( arena, palette, index );
+	if ( colourBuffer != NULL ) {
+		Gfx_UploadTexture( destination, ( uint8_t * ) colourBuffer, GFX_FLAT_SIZE, GFX_FLAT_SIZE );
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Prof_EndTrace( fileName );
 }
 
 PLTexture *Gfx_GetFloorTexture( unsigned int index ) {
@@ -248,22 +384,25 @@ PLTexture *Gfx_GetFloorTexture( unsigned int index ) {
 }
 
 void Gfx_LoadFloorTextures( void ) {
-	unsigned int posStart = plGetPackageTableIndex( globalWad, "F_START" ) + 1;
-	if ( plGetFunctionResult() != PL_RESULT_SUCCESS ) {
-		PrintError( "Failed to find the start of the floor table!\nPL: %s\n", plGetError() );
+	unsigned int posStart;
+	if ( !Wad_FindLump( globalWad, "F_START", &posStart ) ) {
+		PrintError( "Failed to find the start of the floor table!\n" );
 	}
+	posStart++;
 
-	unsigned int posEnd = plGetPackageTableIndex( globalWad, "F_END" );
-	if ( plGetFunctionResult() != PL_RESULT_SUCCESS ) {
-		PrintError( "Failed to find the end of the floor table!\nPL: %s\n", plGetError() );
+	unsigned int posEnd;
+	if ( !Wad_FindLump( globalWad, "F_END", &posEnd ) ) {
+		PrintError( "Failed to find the end of the floor table!\n" );
 	}
 
+	firstFloorLump = posStart;
 	numFloorTextures = posEnd - posStart;
-	floorTextures = Sys_AllocateMemory( numFloorTextures, sizeof( PLTexture* ) );
+	floorTextures = Sys_AllocateTaggedMemory( numFloorTextures, sizeof( PLTexture* ), SYS_MEMORY_TAG_GFX );
 
 	for ( unsigned int i = 0; i < numFloorTextures; ++i ) {
 		unsigned int fileIndex = posStart + i;
-		floorTextures[ i ] = Gfx_LoadFlatByIndex( playPal, fileIndex );
+		floorTextures[ i ] = fallbackTexture;
+		Gfx_UploadFlat( &floorTextures[ i ], playPal, fileIndex );
 	}
 }
 
@@ -271,7 +410,7 @@ void Gfx_LoadPalette( RGBMap *palette, const char *indexName ) {
 	/* clear out the palette before we continue */
 	memset( palette, 0, 256 );
 
-	PLFile *filePtr = plLoadPackageFile( globalWad, indexName );
+	PLFile *filePtr = Wad_OpenLump( globalWad, indexName );
 	if ( filePtr == NULL) {
 		PrintWarn( "Failed to find \"%s\"!\nPL: %s\n", indexName, plGetError());
 		return;
@@ -284,23 +423,140 @@ void Gfx_LoadPalette( RGBMap *palette, const char *indexName ) {
 	plCloseFile( filePtr );
 }
 
+/* sprite frames are shared by every actor using them and are kept
+ * around between maps, so each one only ever gets decoded the once */
+
+#define GFX_MAX_CACHED_FRAMES 1024 /* must be a power of two */
+
+typedef struct GfxCachedFrame {
+	GfxAnimationFrame *frame;
+	unsigned int      refCount;
+} GfxCachedFrame;
+
+static GfxCachedFrame frameCache[ GFX_MAX_CACHED_FRAMES ];
+static unsigned int   numCachedFrames = 0;
+
+static GfxCachedFrame *Gfx_FindCachedFrame( unsigned int lumpIndex ) {
+	unsigned int slot = ( lumpIndex * 2654435761u ) & ( GFX_MAX_CACHED_FRAMES - 1 );
+	for ( unsigned int i = 0; i < GFX_MAX_CACHED_FRAMES; ++i, slot = ( slot + 1 ) & ( GFX_MAX_CACHED_FRAMES - 1 ) ) {
+		if ( frameCache[ slot ].frame == NULL || frameCache[ slot ].frame->lumpIndex == lumpIndex ) {
+			return &frameCache[ slot ];
+		}
+	}
+
+	return NULL;
+}
+
 void Gfx_LoadAnimationFrames( const char **frameList, GfxAnimationFrame **destination, unsigned int numFrames ) {
 	for ( unsigned int i = 0; i < numFrames; ++i ) {
-		PrintMsg( "Loading frame %d (%s)...\n", i, frameList[ i ] );
-		destination[ i ] = Gfx_LoadPictureByName( playPal, frameList[ i ] );
-		if ( destination[ i ] == NULL ) {
-			PrintError( "Failed to load frame %d (%s)!\n", i, frameList[ i ] );
+		unsigned int lumpIndex;
+		if ( !Wad_FindLump( globalWad, frameList[ i ], &lumpIndex ) ) {
+			PrintError( "Failed to find frame %d (%s)!\n", i, frameList[ i ] );
+		}
+
+		GfxCachedFrame *cachedFrame = Gfx_FindCachedFrame( lumpIndex );
+		if ( cachedFrame == NULL ) {
+			PrintError( "Ran out of slots in the frame cache (%d)!\n", GFX_MAX_CACHED_FRAMES );
+		}
+
+		if ( cachedFrame->frame == NULL ) {
+			PrintMsg( "Loading frame %d (%s)...\n", i, frameList[ i ] );
+			cachedFrame->frame = Gfx_LoadPictureByIndex( playPal, lumpIndex );
+			if ( cachedFrame->frame == NULL ) {
+				PrintError( "Failed to load frame %d (%s)!\n", i, frameList[ i ] );
+			}
+
+			numCachedFrames++;
+		}
+
+		cachedFrame->refCount++;
+		destination[ i ] = cachedFrame->frame;
+	}
+}
+
+/* counterpart to Gfx_LoadAnimationFrames; frames stay cached even once
+ * nothing's using them, until Gfx_PurgeAnimationFrames is called */
+void Gfx_ReleaseAnimationFrames( GfxAnimationFrame **frames, unsigned int numFrames ) {
+	for ( unsigned int i = 0; i < numFrames; ++i ) {
+		if ( frames[ i ] == NULL ) {
+			continue;
+		}
+
+		GfxCachedFrame *cachedFrame = Gfx_FindCachedFrame( frames[ i ]->lumpIndex );
+		if ( cachedFrame == NULL || cachedFrame->frame != frames[ i ] || cachedFrame->refCount == 0 ) {
+			PrintWarn( "Attempted to release a frame that isn't cached (%d)!\n", frames[ i ]->lumpIndex );
+		} else {
+			cachedFrame->refCount--;
 		}
+
+		frames[ i ] = NULL;
 	}
 }
 
-PLTexture *Gfx_LoadLumpTexture( const RGBMap *palette, const char *indexName ) {
-	PLFile *filePtr = plLoadPackageFile( globalWad, indexName );
+/* frees any cached frames that are no longer referenced */
+void Gfx_PurgeAnimationFrames( void ) {
+	/* rebuild the table from scratch, as we can't simply
+	 * punch holes into it without breaking the probing */
+	GfxCachedFrame *oldCache = Sys_AllocateTaggedMemory( GFX_MAX_CACHED_FRAMES, sizeof( GfxCachedFrame ), SYS_MEMORY_TAG_GFX );
+	memcpy( oldCache, frameCache, sizeof( frameCache ) );
+	memset( frameCache, 0, sizeof( frameCache ) );
+
+	unsigned int numPurged = 0;
+	numCachedFrames = 0;
+	for ( unsigned int i = 0; i < GFX_MAX_CACHED_FRAMES; ++i ) {
+		if ( oldCache[ i ].frame == NULL ) {
+			continue;
+		}
+
+		if ( oldCache[ i ].refCount == 0 ) {
+			Gfx_DestroyAnimationFrames( &oldCache[ i ].frame, 1 );
+			numPurged++;
+			continue;
+		}
+
+		*Gfx_FindCachedFrame( oldCache[ i ].frame->lumpIndex ) = oldCache[ i ];
+		numCachedFrames++;
+	}
+
+	Sys_FreeMemory( oldCache );
+
+	PrintMsg( "Purged %d cached frames, %d remaining\n", numPurged, numCachedFrames );
+}
+
+/* frees every cached frame, whether it's still referenced or not. this
+ * is all that's set up without a context, so it's the only part of
+ * Gfx_Shutdown that headless mode needs */
+void Gfx_ShutdownFrameCache( void ) {
+	for ( unsigned int i = 0; i < GFX_MAX_CACHED_FRAMES; ++i ) {
+		Gfx_DestroyAnimationFrames( &frameCache[ i ].frame, 1 );
+	}
+	numCachedFrames = 0;
+}
+
+void Gfx_DestroyAnimationFrames( GfxAnimationFrame **frames, unsigned int numFrames ) {
+	for ( unsigned int i = 0; i < numFrames; ++i ) {
+		if ( frames[ i ] == NULL ) {
+			continue;
+		}
+
+		Gfx_CancelTextureUploads( &frames[ i ]->texture );
+		Gfx_ReplaceTexture( &frames[ i ]->texture, NULL );
+
+		Sys_FreeMemory( frames[ i ] );
+		frames[ i ] = NULL;
+	}
+}
+
+/* destination is left as it is if the lump can't be found */
+static void Gfx_UploadLumpTexture( PLTexture **destination, const RGBMap *palette, const char *indexName ) {
+	PLFile *filePtr = Wad_OpenLump( globalWad, indexName );
 	if ( filePtr == NULL) {
 		PrintWarn( "Failed to find \"%s\"!\nPL: %s\n", indexName, plGetError());
-		return fallbackTexture;
+		return;
 	}
 
+	Prof_BeginTrace( indexName );
+
 	bool status;
 	uint16_t width = plReadInt16( filePtr, false, &status );
 	if ( width == 0 ) {
@@ -321,7 +577,10 @@ PLTexture *Gfx_LoadLumpTexture( const RGBMap *palette, const char *indexName ) {
 	/* seems to be totally unused... */
 	plFileSeek( filePtr, 4, PL_SEEK_CUR );
 
-	uint8_t *imageBuffer = Sys_AllocateMemory( lumpDataSize, sizeof( uint8_t ) );
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	uint8_t *imageBuffer = Sys_ArenaAllocate( arena, lumpDataSize, sizeof( uint8_t ) );
 	if ( plReadFile( filePtr, imageBuffer, 1, lumpDataSize ) != lumpDataSize ) {
 		PrintError( "Failed to read in lump data for \"%s\"!\nPL: %s\n", indexName, plGetError());
 	}
@@ -329,57 +588,271 @@ PLTexture *Gfx_LoadLumpTexture( const RGBMap *palette, const char *indexName ) {
 	plCloseFile( filePtr );
 
 	/* now convert using the palette (I'm lazy, so we'll just convert to rgba) */
-	PLColour *colourBuffer = Sys_AllocateMemory( lumpDataSize, sizeof( PLColour ) );
-	for ( unsigned int i = 0; i < lumpDataSize; ++i ) {
-		colourBuffer[ i ].r = palette[ imageBuffer[ i ] ].r;
-		colourBuffer[ i ].g = palette[ imageBuffer[ i ] ].g;
-		colourBuffer[ i ].b = palette[ imageBuffer[ i ] ].b;
-		colourBuffer[ i ].a = ( imageBuffer[ i ] == 255 ) ? 0 : 255;
-	}
-	free( imageBuffer );
+	PLColour *colourBuffer = Sys_ArenaAllocate( arena, lumpDataSize, sizeof( PLColour ) );
+	Gfx_ExpandPalette( palette, imageBuffer, colourBuffer, lumpDataSize, 255 );
 
-	PLTexture *texture = Gfx_GenerateTextureFromData(( uint8_t * ) colourBuffer, width, height, 4, false );
+	Gfx_UploadTexture( destination, ( uint8_t * ) colourBuffer, width, height );
 
-	free( colourBuffer );
+	Sys_ResetArenaToMark( arena, mark );
 
-	return texture;
+	Prof_EndTrace( indexName );
 }
 
-static void Gfx_RegisterShaderStage( PLShaderProgram *program, PLShaderStageType type, const char *path ) {
-	PLFile *filePtr = plLoadPackageFile( globalWad, path );
+/* every shader is built from the same pair of lumps, with the features
+ * it needs defined up front, so unused paths are compiled out rather
+ * than branched over. permutations are built the first time they're
+ * used, apart from the named types which are built upfront */
+#define GFX_VERTEX_SHADER   "SVERTEX"
+#define GFX_FRAGMENT_SHADER "SFRAG"
+
+static const char *shaderFeatureNames[ GFX_NUM_SHADER_FEATURES ] = {
+		"FEATURE_TEXTURE",
+		"FEATURE_ALPHA_TEST",
+		"FEATURE_LIT",
+		"FEATURE_FOG",
+};
+
+/* the only feature the vertex stage cares about */
+#define GFX_VERTEX_SHADER_FEATURES GFX_SHADER_FEATURE_LIT
+
+static const unsigned int shaderTypeFeatures[ MAX_SHADER_TYPES ] = {
+		[ SHADER_GENERIC ]    = 0,
+		[ SHADER_TEXTURE ]    = GFX_SHADER_FEATURE_TEXTURE,
+		[ SHADER_ALPHA_TEST ] = GFX_SHADER_FEATURE_TEXTURE | GFX_SHADER_FEATURE_ALPHA_TEST,
+		[ SHADER_LIT ]        = GFX_SHADER_FEATURE_TEXTURE | GFX_SHADER_FEATURE_ALPHA_TEST | GFX_SHADER_FEATURE_LIT | GFX_SHADER_FEATURE_FOG,
+};
+
+/* stages are shared between permutations, so each is only compiled once,
+ * and only if the program using it isn't in the binary cache */
+typedef struct GfxShaderStage {
+	const char        *path;
+	PLShaderStageType type;
+	unsigned int      features;
+	uint64_t          hash; /* of the source, defines included */
+	PLShaderStage     *stage;
+} GfxShaderStage;
+
+#define GFX_MAX_SHADER_STAGES ( GFX_NUM_SHADER_PERMUTATIONS * 2 )
+static GfxShaderStage shaderStages[ GFX_MAX_SHADER_STAGES ];
+static unsigned int   numShaderStages = 0;
+
+typedef struct GfxShaderPermutation {
+	PLShaderProgram *program;
+	GfxShaderStage  *vertStage;
+	GfxShaderStage  *fragStage;
+	bool            isBroken; /* so we don't retry every frame */
+} GfxShaderPermutation;
+
+static GfxShaderPermutation shaderPermutations[ GFX_NUM_SHADER_PERMUTATIONS ];
+
+/* returns the lump with the stage's feature defines prepended */
+static char *Gfx_ReadShaderSource( SysArena *arena, const GfxShaderStage *stage, size_t *length ) {
+	PLFile *filePtr = Wad_OpenLump( globalWad, stage->path );
 	if ( filePtr == NULL ) {
-		PrintError( "Failed to find shader \"%s\" in WAD!\nPL: %s\n", path, plGetError() );
+		PrintWarn( "Failed to find shader \"%s\" in WAD!\nPL: %s\n", stage->path, plGetError() );
+		return NULL;
 	}
 
-	const char *buffer = plGetFileData( filePtr );
-	size_t length = plGetFileSize( filePtr );
+	size_t sourceLength = plGetFileSize( filePtr );
+	size_t maxLength = sourceLength + 64 * ( GFX_NUM_SHADER_FEATURES + 1 );
+	char *buffer = Sys_ArenaAllocate( arena, maxLength, sizeof( char ) );
 
-	if ( !plRegisterShaderStageFromMemory( program, buffer, length, type ) ) {
-		PrintError( "Failed to register stage!\nPL: %s\n", plGetError() );
+	size_t offset = 0;
+	for ( unsigned int i = 0; i < GFX_NUM_SHADER_FEATURES; ++i ) {
+		if ( stage->features & ( 1u << i ) ) {
+			offset += snprintf( buffer + offset, maxLength - offset, "#define %s\n", shaderFeatureNames[ i ] );
+		}
 	}
 
+	/* keep line numbers in any errors matching the lump */
+	offset += snprintf( buffer + offset, maxLength - offset, "#line 1\n" );
+
+	memcpy( buffer + offset, plGetFileData( filePtr ), sourceLength );
+	*length = offset + sourceLength;
+
 	plCloseFile( filePtr );
+
+	return buffer;
 }
 
-static void Gfx_RegisterShader( GfxShaderType type, const char *vertPath, const char *fragPath ) {
-	shaderPrograms[ type ] = plCreateShaderProgram();
-	if ( shaderPrograms[ type ] == NULL) {
-		PrintError( "Failed to create shader program!\nPL: %s\n", plGetError());
+/* returns false if the lump couldn't be found */
+static bool Gfx_HashShaderStage( GfxShaderStage *stage ) {
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t length;
+	const char *buffer = Gfx_ReadShaderSource( arena, stage, &length );
+	if ( buffer != NULL ) {
+		stage->hash = Gfx_HashBytes( GFX_HASH_SEED, &stage->type, sizeof( stage->type ) );
+		stage->hash = Gfx_HashBytes( stage->hash, buffer, length );
 	}
 
-	Gfx_RegisterShaderStage( shaderPrograms[ type ], PL_SHADER_TYPE_VERTEX, vertPath );
-	Gfx_RegisterShaderStage( shaderPrograms[ type ], PL_SHADER_TYPE_FRAGMENT, fragPath );
+	Sys_ResetArenaToMark( arena, mark );
+
+	return buffer != NULL;
+}
+
+static GfxShaderStage *Gfx_GetShaderStage( const char *path, PLShaderStageType type, unsigned int features ) {
+	for ( unsigned int i = 0; i < numShaderStages; ++i ) {
+		if ( shaderStages[ i ].type == type && shaderStages[ i ].features == features && strcmp( shaderStages[ i ].path, path ) == 0 ) {
+			return &shaderStages[ i ];
+		}
+	}
 
-	if ( !plLinkShaderProgram( shaderPrograms[ type ] )) {
-		PrintError( "Failed to link shader stages!\nPL: %s\n", plGetError());
+	if ( numShaderStages >= GFX_MAX_SHADER_STAGES ) {
+		PrintWarn( "Ran out of shader stage slots (%d)!\n", GFX_MAX_SHADER_STAGES );
+		return NULL;
 	}
+
+	GfxShaderStage *stage = &shaderStages[ numShaderStages ];
+	stage->path     = path;
+	stage->type     = type;
+	stage->features = features;
+	stage->stage    = NULL;
+	if ( !Gfx_HashShaderStage( stage ) ) {
+		return NULL;
+	}
+
+	numShaderStages++;
+
+	return stage;
+}
+
+static bool Gfx_CompileShaderStage( GfxShaderStage *stage ) {
+	if ( stage->stage != NULL ) {
+		return true;
+	}
+
+	Prof_BeginTrace( stage->path );
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t length;
+	const char *buffer = Gfx_ReadShaderSource( arena, stage, &length );
+	if ( buffer != NULL ) {
+		stage->stage = plParseShaderStage( stage->type, buffer, length );
+		if ( stage->stage == NULL ) {
+			PrintWarn( "Failed to compile stage \"%s\" (%x)!\nPL: %s\n", stage->path, stage->features, plGetError() );
+		}
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Prof_EndTrace( stage->path );
+
+	return stage->stage != NULL;
+}
+
+/* returns NULL on failure, so a broken shader can be caught on reload */
+static PLShaderProgram *Gfx_CreateShaderProgram( GfxShaderStage *vertStage, GfxShaderStage *fragStage ) {
+	PLShaderProgram *program = plCreateShaderProgram();
+	if ( program == NULL ) {
+		PrintWarn( "Failed to create shader program!\nPL: %s\n", plGetError() );
+		return NULL;
+	}
+
+	uint64_t key = Gfx_HashBytes( vertStage->hash, &fragStage->hash, sizeof( fragStage->hash ) );
+	if ( Gfx_LoadProgramBinary( program, key ) ) {
+		return program;
+	}
+
+	if ( !Gfx_CompileShaderStage( vertStage ) || !Gfx_CompileShaderStage( fragStage ) ) {
+		plDestroyShaderProgram( program, false );
+		return NULL;
+	}
+
+	plAttachShaderStage( program, vertStage->stage );
+	plAttachShaderStage( program, fragStage->stage );
+
+	Gfx_PrepareProgramBinary( program );
+	if ( !plLinkShaderProgram( program ) ) {
+		PrintWarn( "Failed to link shader stages (%s, %s)!\nPL: %s\n", vertStage->path, fragStage->path, plGetError() );
+		plDestroyShaderProgram( program, false );
+		return NULL;
+	}
+
+	Gfx_StoreProgramBinary( program, key );
+
+	return program;
+}
+
+static GfxShaderPermutation *Gfx_GetShaderPermutation( unsigned int features ) {
+	GfxShaderPermutation *permutation = &shaderPermutations[ features ];
+	if ( permutation->program != NULL || permutation->isBroken ) {
+		return permutation;
+	}
+
+	Prof_BeginTrace( "Gfx_GetShaderPermutation" );
+
+	permutation->vertStage = Gfx_GetShaderStage( GFX_VERTEX_SHADER, PL_SHADER_TYPE_VERTEX, features & GFX_VERTEX_SHADER_FEATURES );
+	permutation->fragStage = Gfx_GetShaderStage( GFX_FRAGMENT_SHADER, PL_SHADER_TYPE_FRAGMENT, features );
+	if ( permutation->vertStage != NULL && permutation->fragStage != NULL ) {
+		permutation->program = Gfx_CreateShaderProgram( permutation->vertStage, permutation->fragStage );
+	}
+
+	if ( permutation->program == NULL ) {
+		PrintWarn( "Failed to build shader permutation (%x)!\n", features );
+		permutation->isBroken = true;
+	}
+
+	Prof_EndTrace( "Gfx_GetShaderPermutation" );
+
+	return permutation;
+}
+
+static void Gfx_RegisterShaders( void ) {
+	for ( unsigned int i = 0; i < MAX_SHADER_TYPES; ++i ) {
+		if ( Gfx_GetShaderPermutation( shaderTypeFeatures[ i ] )->program == NULL ) {
+			PrintError( "Failed to register shader (%d)!\n", i );
+		}
+	}
+
+	Gfx_SaveShaderCache();
+}
+
+static void Gfx_DestroyShaders( void ) {
+	for ( unsigned int i = 0; i < GFX_NUM_SHADER_PERMUTATIONS; ++i ) {
+		if ( shaderPermutations[ i ].program != NULL ) {
+			plDestroyShaderProgram( shaderPermutations[ i ].program, false );
+		}
+	}
+	memset( shaderPermutations, 0, sizeof( shaderPermutations ) );
+
+	for ( unsigned int i = 0; i < numShaderStages; ++i ) {
+		if ( shaderStages[ i ].stage != NULL ) {
+			plDestroyShaderStage( shaderStages[ i ].stage );
+		}
+	}
+	numShaderStages = 0;
+}
+
+/* features is a mask of GfxShaderFeature */
+void Gfx_EnableShaderPermutation( unsigned int features ) {
+	if ( features >= GFX_NUM_SHADER_PERMUTATIONS ) {
+		PrintWarn( "Invalid shader permutation (%x)!\n", features );
+		return;
+	}
+
+	GfxShaderPermutation *permutation = Gfx_GetShaderPermutation( features );
+	if ( permutation->program == NULL ) {
+		/* better to draw something than nothing */
+		permutation = &shaderPermutations[ 0 ];
+	}
+
+	plSetShaderProgram( permutation->program );
 }
 
 void Gfx_EnableShaderProgram( GfxShaderType type ) {
-	plSetShaderProgram( shaderPrograms[ type ] );
+	Gfx_EnableShaderPermutation( shaderTypeFeatures[ type ] );
 }
 
 void Gfx_DrawAnimationFrame( GfxAnimationFrame *frame, const PLVector3 *position, float spriteAngle ) {
+	/* same botched scale as we draw with below */
+	if ( Gfx_IsSpriteOccluded( position, frame->texture->w * 1.7f / 2.0f ) ) {
+		return;
+	}
+
 	PLMatrix4 transform;
 	transform = plMatrix4Identity();
 	transform = plMultiplyMatrix4( transform,
@@ -405,6 +878,7 @@ void Gfx_DrawAnimationFrame( GfxAnimationFrame *frame, const PLVector3 *position
 #endif
 
 	plDrawTexturedRectangle( &transform, x, y, w, h, frame->texture );
+	Prof_CountDrawCall();
 }
 
 void Gfx_DrawAnimation( GfxAnimationFrame **animation, unsigned int numFrames, unsigned int curFrame, const PLVector3 *position, float angle ) {
@@ -456,6 +930,7 @@ void Gfx_DrawDigit( int x, int y, int digit ) {
 			( signed ) numTextureTable[ digit ]->w,
 			( signed ) numTextureTable[ digit ]->h,
 			numTextureTable[ digit ] );
+	Prof_CountDrawCall();
 }
 
 void Gfx_DrawNumber( int x, int y, unsigned int number ) {
@@ -477,11 +952,121 @@ void Gfx_DrawNumber( int x, int y, unsigned int number ) {
 	Gfx_DrawDigit( x, y, number % 10 );
 }
 
+/****************************************
+ * Hot Reload
+ ****************************************/
+
+static bool Gfx_ReloadShaders( const char *lumpName ) {
+	if ( strcmp( lumpName, GFX_VERTEX_SHADER ) != 0 && strcmp( lumpName, GFX_FRAGMENT_SHADER ) != 0 ) {
+		return false;
+	}
+
+	/* the old stages stay attached to the old programs until they're replaced */
+	PLShaderStage *oldStages[ GFX_MAX_SHADER_STAGES ];
+	unsigned int numOldStages = 0;
+	bool isChanged = false;
+	for ( unsigned int i = 0; i < numShaderStages; ++i ) {
+		GfxShaderStage *stage = &shaderStages[ i ];
+		if ( strcmp( lumpName, stage->path ) != 0 ) {
+			continue;
+		}
+
+		uint64_t oldHash = stage->hash;
+		if ( !Gfx_HashShaderStage( stage ) || stage->hash == oldHash ) {
+			continue;
+		}
+
+		if ( stage->stage != NULL ) {
+			oldStages[ numOldStages++ ] = stage->stage;
+		}
+		stage->stage = NULL;
+		isChanged = true;
+	}
+
+	if ( !isChanged ) {
+		return true;
+	}
+
+	for ( unsigned int i = 0; i < GFX_NUM_SHADER_PERMUTATIONS; ++i ) {
+		GfxShaderPermutation *permutation = &shaderPermutations[ i ];
+		if ( permutation->vertStage == NULL || permutation->fragStage == NULL ) {
+			continue;
+		}
+
+		/* give broken ones another go, as this might be the fix */
+		permutation->isBroken = false;
+
+		/* keep the old one around if the new one is broken */
+		PLShaderProgram *program = Gfx_CreateShaderProgram( permutation->vertStage, permutation->fragStage );
+		if ( program == NULL ) {
+			continue;
+		}
+
+		if ( permutation->program != NULL ) {
+			plDestroyShaderProgram( permutation->program, false );
+		}
+		permutation->program = program;
+	}
+
+	for ( unsigned int i = 0; i < numOldStages; ++i ) {
+		plDestroyShaderStage( oldStages[ i ] );
+	}
+
+	Gfx_SaveShaderCache();
+
+	return true;
+}
+
+static bool Gfx_ReloadLump( const char *lumpName, unsigned int lumpIndex ) {
+	bool isHandled = Gfx_ReloadShaders( lumpName );
+
+	if ( lumpIndex >= firstWallLump && lumpIndex < firstWallLump + numWallTextures ) {
+		/* updated in place, as actors and walls hold onto the frame itself */
+		Gfx_UploadPicture( wallTextures[ lumpIndex - firstWallLump ], playPal, lumpIndex );
+		isHandled = true;
+	}
+
+	if ( lumpIndex >= firstFloorLump && lumpIndex < firstFloorLump + numFloorTextures ) {
+		Gfx_UploadFlat( &floorTextures[ lumpIndex - firstFloorLump ], playPal, lumpIndex );
+		isHandled = true;
+	}
+
+	GfxCachedFrame *cachedFrame = Gfx_FindCachedFrame( lumpIndex );
+	if ( cachedFrame != NULL && cachedFrame->frame != NULL ) {
+		Gfx_UploadPicture( cachedFrame->frame, playPal, lumpIndex );
+		isHandled = true;
+	}
+
+	if ( strcmp( lumpName, "TITLEPIC" ) == 0 ) {
+		Gfx_UploadLumpTexture( &titlePicTexture, titlePal, lumpName );
+		isHandled = true;
+	} else if ( strcmp( lumpName, "PLAYSCRN" ) == 0 ) {
+		Gfx_UploadLumpTexture( &playScrnTexture, playPal, lumpName );
+		isHandled = true;
+	} else if ( strncmp( lumpName, "WNUMBER", 7 ) == 0 && lumpName[ 7 ] >= '0' && lumpName[ 7 ] <= '9' && lumpName[ 8 ] == '\0' ) {
+		Gfx_UploadLumpTexture( &numTextureTable[ lumpName[ 7 ] - '0' ], titlePal, lumpName );
+		isHandled = true;
+	}
+
+	/* palettes aren't handled, as that would mean redoing everything */
+
+	return isHandled;
+}
+
 void Gfx_Initialize( void ) {
 	PrintMsg( "Initializing Gfx...\n" );
 
+	Prof_BeginTrace( "Gfx_Initialize" );
+
 	plSetGraphicsMode( PL_GFX_MODE_OPENGL_CORE );
 
+	Gfx_InitializeGL();
+	Gfx_InitializeUploads();
+	Gfx_InitializeShaderCache();
+	Gfx_InitializeOcclusion();
+	Gfx_InitializeBillboards();
+	Prof_InitializeGPU();
+
 	/* create both the interface camera and player camera */
 
 	auxCamera = plCreateCamera();
@@ -498,15 +1083,14 @@ void Gfx_Initialize( void ) {
 	if ( playerCamera == NULL) {
 		PrintError( "Failed to create player camera!\nPL: %s\n", plGetError());
 	}
-	playerCamera->fov = 75.0f;
+	playerCamera->fov = GFX_PLAYER_FOV;
 	playerCamera->viewport.w = YIN_DISPLAY_WIDTH;
 	playerCamera->viewport.h = YIN_DISPLAY_HEIGHT;
 
 	/* create the default shader programs */
-	Gfx_RegisterShader( SHADER_GENERIC, "SVERTEX", "SCOLOUR" );
-	Gfx_RegisterShader( SHADER_TEXTURE, "SVERTEX", "STEXTURE" );
-	Gfx_RegisterShader( SHADER_ALPHA_TEST, "SVERTEX", "SALPHA" );
-	Gfx_RegisterShader( SHADER_LIT, "SVERTEX", "SLIT" );
+	Prof_BeginTrace( "Gfx_RegisterShaders" );
+	Gfx_RegisterShaders();
+	Prof_EndTrace( "Gfx_RegisterShaders" );
 
 	plSetClearColour(PLColour( 0, 0, 0, 255 ) );
 
@@ -526,24 +1110,54 @@ void Gfx_Initialize( void ) {
 	}
 
 	/* and now, finally, load in the splash screen! */
-	titlePicTexture = Gfx_LoadLumpTexture( titlePal, "TITLEPIC" );
-	playScrnTexture = Gfx_LoadLumpTexture( playPal, "PLAYSCRN" );
+	titlePicTexture = playScrnTexture = fallbackTexture;
+	Gfx_UploadLumpTexture( &titlePicTexture, titlePal, "TITLEPIC" );
+	Gfx_UploadLumpTexture( &playScrnTexture, playPal, "PLAYSCRN" );
 
 	/* load the numbers */
 	for ( unsigned int i = 0; i < 10; ++i ) {
 		char numName[16];
 		snprintf( numName, sizeof( numName ), "WNUMBER%d", i );
-		numTextureTable[ i ] = Gfx_LoadLumpTexture( titlePal, numName );
+		numTextureTable[ i ] = fallbackTexture;
+		Gfx_UploadLumpTexture( &numTextureTable[ i ], titlePal, numName );
 	}
 
+	Prof_BeginTrace( "Gfx_LoadWallTextures" );
 	Gfx_LoadWallTextures();
+	Prof_EndTrace( "Gfx_LoadWallTextures" );
+
+	Prof_BeginTrace( "Gfx_LoadFloorTextures" );
 	Gfx_LoadFloorTextures();
+	Prof_EndTrace( "Gfx_LoadFloorTextures" );
+
+	/* no point spreading these out, nothing's being drawn yet */
+	Gfx_FlushUploads();
 
 	plSetDepthBufferMode( PL_DEPTHBUFFER_ENABLE );
 	plSetDepthMask( true );
+
+	Wad_RegisterReloadHandler( Gfx_ReloadLump );
+
+	Prof_EndTrace( "Gfx_Initialize" );
 }
 
 void Gfx_Shutdown( void ) {
+	Gfx_ShutdownBillboards();
+	Gfx_ShutdownUploads();
+	Gfx_DestroyShaders();
+	Gfx_ShutdownShaderCache();
+
+	Gfx_ShutdownFrameCache();
+
+	Gfx_DestroyAnimationFrames( wallTextures, numWallTextures );
+	Sys_FreeMemory( wallTextures );
+	wallTextures = NULL;
+	numWallTextures = 0;
+
+	Sys_FreeMemory( floorTextures );
+	floorTextures = NULL;
+	numFloorTextures = 0;
+
 	plDestroyCamera( auxCamera );
 	plDestroyCamera( playerCamera );
 }
@@ -573,6 +1187,7 @@ void Gfx_DisplayMenu( void ) {
 		case MENU_STATE_START:
 			Gfx_EnableShaderProgram( SHADER_TEXTURE );
 			plDrawTexturedRectangle( &transform, 0, 0, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, titlePicTexture );
+			Prof_CountDrawCall();
 			break;
 
 		case MENU_STATE_HUD:
@@ -581,6 +1196,7 @@ void Gfx_DisplayMenu( void ) {
 			Gfx_DrawViewSprite();
 
 			plDrawTexturedRectangle( &transform, 0, 0, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, playScrnTexture );
+			Prof_CountDrawCall();
 			break;
 	}
 #endif
@@ -602,7 +1218,20 @@ void Gfx_DrawAxesPivot( PLVector3 position, PLVector3 rotation ) {
 	//printf( "%s\n", plPrintVector3( &position, pl_int_var ) );
 }
 
+/* returns false if there's nothing sensible to cull against, i.e. the
+ * scene isn't being drawn through the player camera right now */
+bool Gfx_GetViewFrustum( GfxFrustum *frustum ) {
+	if ( !isViewFrustumValid ) {
+		return false;
+	}
+
+	*frustum = viewFrustum;
+	return true;
+}
+
 void Gfx_DisplayScene( void ) {
+	isViewFrustumValid = false;
+
 	if ( Gam_GetMenuState() == MENU_STATE_START ) {
 		return;
 	}
@@ -612,6 +1241,21 @@ void Gfx_DisplayScene( void ) {
 		return;
 	}
 
+	/* drawn entirely on the cpu, gl just puts it on screen */
+	if ( Gfx_IsSoftwareRendererEnabled() ) {
+		Prof_BeginZone( PROF_ZONE_MAP_DRAW );
+		Gfx_DrawSoftwareScene( player );
+		Prof_EndZone( PROF_ZONE_MAP_DRAW );
+
+		plSetupCamera( auxCamera );
+		Gfx_EnableShaderProgram( SHADER_TEXTURE );
+
+		PLMatrix4 transform = plMatrix4Identity();
+		plDrawTexturedRectangle( &transform, 0, 0, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, Gfx_UpdateSoftwareTexture() );
+		Prof_CountDrawCall();
+		return;
+	}
+
 #ifdef DEBUG_CAM
 	playerCamera->position = Act_GetPosition( player );
 	playerCamera->position.y = 512;
@@ -627,6 +1271,11 @@ void Gfx_DisplayScene( void ) {
 
 	plSetupCamera( playerCamera );
 
+	/* taken from what the camera actually drew with, so it holds for the debug camera too */
+	PLMatrix4 viewProjection = plMultiplyMatrix4( playerCamera->internal.proj, playerCamera->internal.view );
+	Gfx_ExtractFrustum( &viewFrustum, &viewProjection );
+	isViewFrustumValid = true;
+
 #ifdef DEBUG_CAM
 	PLMatrix4 mat = plMatrix4Identity();
 
@@ -646,13 +1295,66 @@ void Gfx_DisplayScene( void ) {
 	plDrawLine( &mat, &startPos, &PLColour( 0, 0, 255, 255 ), &endPos, &PLColour( 255, 0, 0, 255 ) );
 #endif
 
+	Gfx_BeginOcclusion( player );
+
+	Prof_BeginZone( PROF_ZONE_MAP_DRAW );
 	Map_Draw();
+	Prof_EndZone( PROF_ZONE_MAP_DRAW );
+
+	Prof_BeginZone( PROF_ZONE_ACT_DRAW );
 	Act_DisplayActors();
+	Proj_DrawProjectiles();
+	Prof_EndZone( PROF_ZONE_ACT_DRAW );
+
+	Gfx_EndOcclusion();
+}
+
+/* timings are displayed in tenths of a millisecond, since
+ * Gfx_DrawNumber only deals with whole numbers */
+static unsigned int Gfx_ToOverlayTime( double ms ) {
+	if ( ms < 0.0 ) {
+		return 0;
+	}
+
+	return ( unsigned int ) ( ms * 10.0 + 0.5 );
+}
+
+static void Gfx_DisplayProfilerOverlay( void ) {
+	if ( !Prof_IsOverlayEnabled() ) {
+		return;
+	}
+
+	plSetupCamera( auxCamera );
+
+	Gfx_EnableShaderProgram( SHADER_ALPHA_TEST );
+
+	unsigned int rows[] = {
+			Gfx_ToOverlayTime( Prof_GetZoneTime( PROF_ZONE_TICK ) ),
+			Gfx_ToOverlayTime( Prof_GetZoneTime( PROF_ZONE_FRAME ) ),
+			Gfx_ToOverlayTime( Prof_GetZoneGPUTime( PROF_ZONE_FRAME ) ),
+			Gfx_ToOverlayTime( Prof_GetZoneTime( PROF_ZONE_MAP_DRAW ) ),
+			Gfx_ToOverlayTime( Prof_GetZoneTime( PROF_ZONE_ACT_DRAW ) ),
+			Prof_GetNumDrawCalls(),
+			Act_GetNumActors(),
+			Act_GetNumDrawnActors(),
+			Act_GetNumTickedActors(),
+			Gfx_GetNumOccluded(),
+			Proj_GetNumProjectiles(),
+	};
+
+	int y = 4;
+	for ( unsigned int i = 0; i < plArrayElements( rows ); ++i ) {
+		Gfx_DrawNumber( 4, y, rows[ i ] );
+		y += ( signed ) numTextureTable[ 0 ]->h + 2;
+	}
 }
 
 void Gfx_Display( void ) {
+	Gfx_ProcessUploads();
+
 	plClearBuffers( PL_BUFFER_DEPTH | PL_BUFFER_COLOUR );
 
 	Gfx_DisplayScene();
 	Gfx_DisplayMenu();
+	Gfx_DisplayProfilerOverlay();
 }
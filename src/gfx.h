@@ -13,25 +13,161 @@ typedef enum GfxShaderType {
 	MAX_SHADER_TYPES
 } GfxShaderType;
 
+/* compiled into the shader, rather than toggled at runtime; the types
+ * above are just the combinations we use most often */
+typedef enum GfxShaderFeature {
+	GFX_SHADER_FEATURE_TEXTURE    = 1 << 0,
+	GFX_SHADER_FEATURE_ALPHA_TEST = 1 << 1, /* needs TEXTURE */
+	GFX_SHADER_FEATURE_LIT        = 1 << 2,
+	GFX_SHADER_FEATURE_FOG        = 1 << 3,
+} GfxShaderFeature;
+
+#define GFX_NUM_SHADER_FEATURES     4
+#define GFX_NUM_SHADER_PERMUTATIONS ( 1 << GFX_NUM_SHADER_FEATURES )
+
 /* todo: introduce container around this */
 typedef struct GfxAnimationFrame {
 	unsigned int leftOffset;
 	unsigned int topOffset;
+	unsigned int lumpIndex;
 	PLTexture    *texture;
 } GfxAnimationFrame;
 
 #define GFX_NUM_SPRITE_ANGLES 8
+#define GFX_FLAT_SIZE         64
+
+typedef struct RGBMap {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} RGBMap;
 
 void Gfx_Initialize( void );
 void Gfx_Shutdown( void );
 void Gfx_Display( void );
 void Gfx_EnableShaderProgram( GfxShaderType type );
+void Gfx_EnableShaderPermutation( unsigned int features );
 
 void Gfx_DrawAxesPivot( PLVector3 position, PLVector3 rotation );
 void Gfx_DrawAnimationFrame( GfxAnimationFrame *frame, const PLVector3 *position, float spriteAngle );
 void Gfx_DrawAnimation( GfxAnimationFrame **animation, unsigned int numFrames, unsigned int curFrame, const PLVector3 *position, float angle );
 
+void Gfx_LoadPalette( RGBMap *palette, const char *indexName );
+void Gfx_ExpandPalette( const RGBMap *palette, const uint8_t *src, PLColour *dst, size_t numPixels, int transparentIndex );
+
+PLColour *Gfx_DecodePictureByIndex( SysArena *arena, const RGBMap *palette, unsigned int index, unsigned int *width, unsigned int *height,
+                                    unsigned int *leftOffset, unsigned int *topOffset );
+PLColour *Gfx_DecodeFlatByIndex( SysArena *arena, const RGBMap *palette, unsigned int index );
+
 void Gfx_LoadAnimationFrames( const char **frameList, GfxAnimationFrame **destination, unsigned int numFrames );
+void Gfx_ReleaseAnimationFrames( GfxAnimationFrame **frames, unsigned int numFrames );
+void Gfx_DestroyAnimationFrames( GfxAnimationFrame **frames, unsigned int numFrames );
+void Gfx_PurgeAnimationFrames( void );
+void Gfx_ShutdownFrameCache( void );
+
+/* texture uploads are staged, so they can be spread across frames */
+#define GFX_UPLOAD_RING_SIZE    ( 4 * 1024 * 1024 )
+#define GFX_UPLOAD_FRAME_BUDGET ( 512 * 1024 ) /* bytes issued per frame */
+
+typedef struct GfxUpload GfxUpload;
+
+void      Gfx_InitializeUploads( void );
+void      Gfx_ShutdownUploads( void );
+void      Gfx_ProcessUploads( void );
+void      Gfx_FlushUploads( void );
+GfxUpload *Gfx_BeginTextureUpload( PLTexture **destination, unsigned int width, unsigned int height );
+uint8_t   *Gfx_GetUploadBuffer( GfxUpload *upload );
+void      Gfx_EndTextureUpload( GfxUpload *upload );
+void      Gfx_CancelTextureUploads( PLTexture **destination );
+
+/* called on the loader thread to write the upload's rgba texels */
+typedef void ( *GfxUploadFillFunction )( uint8_t *texels, void *userData );
+void Gfx_QueueTextureUpload( GfxUpload *upload, GfxUploadFillFunction Fill, void *userData );
+
+PLTexture *Gfx_GenerateTextureFromData( uint8_t *data, unsigned int w, unsigned int h, unsigned int numChannels,
+                                        bool generateMipMap );
+void Gfx_UploadTexture( PLTexture **destination, const uint8_t *data, unsigned int width, unsigned int height );
+void Gfx_ReplaceTexture( PLTexture **texture, PLTexture *newTexture );
+
+/* palettized fallback, for when there's no usable gl driver (-software) */
+#define GFX_PLAYER_FOV 75.0f /* vertical, in degrees */
+
+typedef struct Actor Actor;
+
+void      Gfx_InitializeSoftware( void );
+void      Gfx_ShutdownSoftware( void );
+bool      Gfx_IsSoftwareRendererEnabled( void );
+void      Gfx_DrawSoftwareScene( Actor *player );
+PLTexture *Gfx_UpdateSoftwareTexture( void );
+bool      Gfx_WriteSoftwareScreenshot( const char *path );
+
+/* per-column wall depths, so hidden geometry can be skipped on the cpu */
+typedef struct GfxOcclusionSpan {
+	float sx0, sx1; /* screen columns */
+	float invDepth0, invDepth1;
+	float minDepth;
+} GfxOcclusionSpan;
+
+void         Gfx_InitializeOcclusion( void );
+void         Gfx_BeginOcclusion( Actor *player );
+void         Gfx_EndOcclusion( void );
+bool         Gfx_IsOcclusionEnabled( void );
+unsigned int Gfx_GetNumOccluded( void );
+bool         Gfx_ProjectWall( const PLVector2 *start, const PLVector2 *end, GfxOcclusionSpan *span );
+bool         Gfx_IsSpanOccluded( const GfxOcclusionSpan *span );
+void         Gfx_AddOccluder( const GfxOcclusionSpan *span );
+bool         Gfx_IsBoxOccluded( float minX, float minY, float maxX, float maxY );
+bool         Gfx_IsSpriteOccluded( const PLVector3 *position, float radius );
+
+/* view frustum, with the planes facing inwards */
+#define GFX_FRUSTUM_PLANES     5 /* near, left, right, bottom and top; there's no far plane */
+#define GFX_FRUSTUM_NEAR_PLANE 1.0f
+
+typedef struct GfxFrustum {
+	PLVector3 normals[ GFX_FRUSTUM_PLANES ];
+	float     distances[ GFX_FRUSTUM_PLANES ];
+} GfxFrustum;
+
+/* kept as separate arrays, so they can be tested several at a time */
+typedef struct GfxSphereList {
+	float        *x, *y, *z;
+	float        *radii;
+	unsigned int numSpheres;
+} GfxSphereList;
+
+void Gfx_BuildFrustum( GfxFrustum *frustum, const PLVector3 *eye, const PLVector3 *forward, float fov, float aspect );
+void Gfx_ExtractFrustum( GfxFrustum *frustum, const PLMatrix4 *viewProjection );
+bool Gfx_GetViewFrustum( GfxFrustum *frustum );
+void Gfx_CullSpheres( const GfxFrustum *frustum, const GfxSphereList *spheres, bool *visible );
+
+/* camera facing quads, drawn together in one go */
+#define GFX_MAX_BILLBOARDS 512
+
+void         Gfx_InitializeBillboards( void );
+void         Gfx_ShutdownBillboards( void );
+void         Gfx_DrawBillboards( const GfxSphereList *spheres );
+unsigned int Gfx_GetNumDrawnBillboards( void ); /* last frame */
+
+/* render target for -offscreen, where there's no window to draw to */
+#define GFX_DEFAULT_FRAME_TIMES_FILE "frametimes.csv"
+
+void Gfx_InitializeOffscreenTarget( void );
+void Gfx_ShutdownOffscreenTarget( void );
+void Gfx_BindOffscreenTarget( void );
+void Gfx_EndOffscreenFrame( void );
+void Gfx_FlushCaptures( void );
+
+/* linked programs are cached on disk between runs */
+#define GFX_HASH_SEED 14695981039346656037ULL
+
+uint64_t Gfx_HashBytes( uint64_t hash, const void *data, size_t size );
+
+void Gfx_InitializeShaderCache( void );
+void Gfx_ShutdownShaderCache( void );
+void Gfx_SaveShaderCache( void );
+bool Gfx_LoadProgramBinary( PLShaderProgram *program, uint64_t key );
+void Gfx_PrepareProgramBinary( PLShaderProgram *program );
+void Gfx_StoreProgramBinary( PLShaderProgram *program, uint64_t key );
 
 PLTexture *Gfx_GetWallTexture( unsigned int index );
 PLTexture *Gfx_GetFloorTexture( unsigned int index );
@@ -0,0 +1,157 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "act.h"
+#include "game.h"
+#include "prof.h"
+
+/* camera facing quads that all share the one texture, for projectiles and
+ * the like. the platform library doesn't give us instancing, so instead
+ * every quad is written into a single dynamic mesh each frame and the
+ * whole lot goes out in one draw */
+
+#define GFX_BILLBOARD_TEXTURE_SIZE 16
+
+static struct {
+	PLMesh       *mesh;
+	PLTexture    *texture;
+	unsigned int numQuads; /* written last time, so anything left over can be collapsed */
+	unsigned int numDrawn;
+} billboards;
+
+/* a soft orange blob, brighter in the middle */
+static PLTexture *Gfx_GenerateBillboardTexture( void ) {
+	PLColour pixels[ GFX_BILLBOARD_TEXTURE_SIZE * GFX_BILLBOARD_TEXTURE_SIZE ];
+	const float centre = ( GFX_BILLBOARD_TEXTURE_SIZE - 1 ) / 2.0f;
+	for ( unsigned int y = 0; y < GFX_BILLBOARD_TEXTURE_SIZE; ++y ) {
+		for ( unsigned int x = 0; x < GFX_BILLBOARD_TEXTURE_SIZE; ++x ) {
+			float dx = ( x - centre ) / centre, dy = ( y - centre ) / centre;
+			float intensity = 1.0f - sqrtf( dx * dx + dy * dy );
+			if ( intensity < 0.0f ) {
+				pixels[ y * GFX_BILLBOARD_TEXTURE_SIZE + x ] = PLColour( 0, 0, 0, 0 );
+				continue;
+			}
+
+			pixels[ y * GFX_BILLBOARD_TEXTURE_SIZE + x ] = PLColour(
+					255, ( uint8_t ) ( 96 + 159 * intensity ), ( uint8_t ) ( 192 * intensity * intensity ), 255 );
+		}
+	}
+
+	return Gfx_GenerateTextureFromData( ( uint8_t * ) pixels, GFX_BILLBOARD_TEXTURE_SIZE, GFX_BILLBOARD_TEXTURE_SIZE, 4, false );
+}
+
+void Gfx_InitializeBillboards( void ) {
+	billboards.mesh = plCreateMesh( PL_MESH_TRIANGLES, PL_DRAW_DYNAMIC, GFX_MAX_BILLBOARDS * 2, GFX_MAX_BILLBOARDS * 4 );
+	if ( billboards.mesh == NULL ) {
+		PrintError( "Failed to create billboard mesh!\nPL: %s\n", plGetError() );
+	}
+
+	/* the layout of each quad never changes, only where it is */
+	unsigned int index = 0;
+	for ( unsigned int i = 0; i < GFX_MAX_BILLBOARDS; ++i ) {
+		unsigned int vertex = i * 4;
+		plSetMeshTrianglePosition( billboards.mesh, &index, vertex, vertex + 1, vertex + 2 );
+		plSetMeshTrianglePosition( billboards.mesh, &index, vertex + 2, vertex + 1, vertex + 3 );
+
+		plSetMeshVertexST( billboards.mesh, vertex, 0.0f, 0.0f );
+		plSetMeshVertexST( billboards.mesh, vertex + 1, 1.0f, 0.0f );
+		plSetMeshVertexST( billboards.mesh, vertex + 2, 0.0f, 1.0f );
+		plSetMeshVertexST( billboards.mesh, vertex + 3, 1.0f, 1.0f );
+	}
+	plSetMeshUniformColour( billboards.mesh, PLColour( 255, 255, 255, 255 ) );
+
+	billboards.texture = Gfx_GenerateBillboardTexture();
+	if ( billboards.texture == NULL ) {
+		PrintError( "Failed to create billboard texture!\n" );
+	}
+}
+
+void Gfx_ShutdownBillboards( void ) {
+	if ( billboards.mesh != NULL ) {
+		plDestroyMesh( billboards.mesh );
+	}
+
+	if ( billboards.texture != NULL ) {
+		plDestroyTexture( billboards.texture );
+	}
+
+	memset( &billboards, 0, sizeof( billboards ) );
+}
+
+unsigned int Gfx_GetNumDrawnBillboards( void ) {
+	return billboards.numDrawn;
+}
+
+static void Gfx_SetBillboardQuad( unsigned int quad, const PLVector3 *right, float x, float y, float z, float radius ) {
+	unsigned int vertex = quad * 4;
+	float rx = right->x * radius, rz = right->z * radius;
+	plSetMeshVertexPosition( billboards.mesh, vertex, PLVector3( x - rx, y + radius, z - rz ) );
+	plSetMeshVertexPosition( billboards.mesh, vertex + 1, PLVector3( x + rx, y + radius, z + rz ) );
+	plSetMeshVertexPosition( billboards.mesh, vertex + 2, PLVector3( x - rx, y - radius, z - rz ) );
+	plSetMeshVertexPosition( billboards.mesh, vertex + 3, PLVector3( x + rx, y - radius, z + rz ) );
+}
+
+/* anything past GFX_MAX_BILLBOARDS is dropped */
+void Gfx_DrawBillboards( const GfxSphereList *spheres ) {
+	billboards.numDrawn = 0;
+
+	Actor *player = Gam_GetPlayer();
+	if ( billboards.mesh == NULL || player == NULL ) {
+		return;
+	}
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	bool *visible = Sys_ArenaAllocate( arena, spheres->numSpheres, sizeof( bool ) );
+	GfxFrustum frustum;
+	if ( Gfx_GetViewFrustum( &frustum ) ) {
+		Gfx_CullSpheres( &frustum, spheres, visible );
+	} else {
+		memset( visible, true, spheres->numSpheres * sizeof( bool ) );
+	}
+
+	/* the camera never pitches, so they only need turning to face it */
+	PLVector3 forward = Act_GetForward( player );
+	PLVector3 right = PLVector3( -forward.z, 0.0f, forward.x );
+
+	unsigned int numQuads = 0;
+	for ( unsigned int i = 0; i < spheres->numSpheres && numQuads < GFX_MAX_BILLBOARDS; ++i ) {
+		if ( !visible[ i ] ) {
+			continue;
+		}
+
+		PLVector3 position = PLVector3( spheres->x[ i ], spheres->y[ i ], spheres->z[ i ] );
+		if ( Gfx_IsSpriteOccluded( &position, spheres->radii[ i ] ) ) {
+			continue;
+		}
+
+		Gfx_SetBillboardQuad( numQuads++, &right, spheres->x[ i ], spheres->y[ i ], spheres->z[ i ], spheres->radii[ i ] );
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	/* whatever was drawn last frame and isn't now gets squashed flat */
+	for ( unsigned int i = numQuads; i < billboards.numQuads; ++i ) {
+		Gfx_SetBillboardQuad( i, &right, 0.0f, 0.0f, 0.0f, 0.0f );
+	}
+	billboards.numQuads = numQuads;
+
+	if ( numQuads == 0 ) {
+		return;
+	}
+
+	Gfx_EnableShaderProgram( SHADER_ALPHA_TEST );
+
+	plSetTexture( billboards.texture, 0 );
+	plSetNamedShaderUniformMatrix4( NULL, "pl_model", plMatrix4Identity(), true );
+	plUploadMesh( billboards.mesh );
+	plDrawMesh( billboards.mesh );
+	plSetTexture( NULL, 0 );
+	Prof_CountDrawCall();
+
+	billboards.numDrawn = numQuads;
+}
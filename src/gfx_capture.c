@@ -0,0 +1,248 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "gfx_gl.h"
+#include "prof.h"
+
+/* render target for offscreen runs. frames are read back through a
+ * small ring of pixel buffers, so by the time one is mapped the gpu has
+ * long since finished with it and we don't stall waiting on the copy */
+
+#define GFX_CAPTURE_LATENCY    3
+#define GFX_CAPTURE_FRAME_SIZE ( YIN_DISPLAY_WIDTH * YIN_DISPLAY_HEIGHT * 4 )
+
+typedef struct GfxCapture {
+	GLuint       buffer;
+	GLsync       fence;
+	unsigned int frame;
+	bool         isPending;
+} GfxCapture;
+
+static struct {
+	bool   isInitialized;
+	GLuint frameBuffer;
+	GLuint colourBuffer;
+	GLuint depthBuffer;
+
+	GfxCapture   captures[ GFX_CAPTURE_LATENCY ];
+	unsigned int nextCapture;
+	const char   *capturePrefix; /* NULL if we're not capturing */
+	unsigned int captureInterval;
+	bool         isRaw;
+	uint8_t      *flipBuffer;
+
+	unsigned int frame;
+	FILE         *timesFile;
+} offscreen;
+
+static void Gfx_WriteCapture( const GfxCapture *capture, const uint8_t *pixels ) {
+	/* gl reads bottom up */
+	const size_t rowSize = YIN_DISPLAY_WIDTH * 4;
+	for ( unsigned int y = 0; y < YIN_DISPLAY_HEIGHT; ++y ) {
+		memcpy( &offscreen.flipBuffer[ y * rowSize ], &pixels[ ( YIN_DISPLAY_HEIGHT - 1 - y ) * rowSize ], rowSize );
+	}
+
+	char path[ PL_SYSTEM_MAX_PATH ];
+	snprintf( path, sizeof( path ), "%s%05u.%s", offscreen.capturePrefix, capture->frame, offscreen.isRaw ? "raw" : "png" );
+
+	if ( offscreen.isRaw ) {
+		FILE *file = fopen( path, "wb" );
+		if ( file == NULL ) {
+			PrintWarn( "Failed to open \"%s\" for writing!\n", path );
+			return;
+		}
+
+		fwrite( offscreen.flipBuffer, 1, GFX_CAPTURE_FRAME_SIZE, file );
+		fclose( file );
+		return;
+	}
+
+	PLImage *image = plCreateImage( offscreen.flipBuffer, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, PL_COLOURFORMAT_RGBA, PL_IMAGEFORMAT_RGBA8 );
+	if ( image == NULL ) {
+		PrintWarn( "Failed to create image for \"%s\"!\nPL: %s\n", path, plGetError() );
+		return;
+	}
+
+	if ( !plWriteImage( image, path ) ) {
+		PrintWarn( "Failed to write \"%s\"!\nPL: %s\n", path, plGetError() );
+	}
+
+	plDestroyImage( image );
+}
+
+static void Gfx_ResolveCapture( GfxCapture *capture ) {
+	if ( !capture->isPending ) {
+		return;
+	}
+
+	capture->isPending = false;
+
+	/* should long since have been signalled, unless we're flushing */
+	gfxGL.ClientWaitSync( capture->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED );
+	gfxGL.DeleteSync( capture->fence );
+	capture->fence = NULL;
+
+	gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, capture->buffer );
+	const uint8_t *pixels = gfxGL.MapBufferRange( GL_PIXEL_PACK_BUFFER, 0, GFX_CAPTURE_FRAME_SIZE, GL_MAP_READ_BIT );
+	if ( pixels != NULL ) {
+		Gfx_WriteCapture( capture, pixels );
+		gfxGL.UnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	} else {
+		PrintWarn( "Failed to map capture of frame %d!\n", capture->frame );
+	}
+	gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+}
+
+static void Gfx_QueueCapture( void ) {
+	GfxCapture *capture = &offscreen.captures[ offscreen.nextCapture ];
+	offscreen.nextCapture = ( offscreen.nextCapture + 1 ) % GFX_CAPTURE_LATENCY;
+
+	/* ring's full, so the oldest has to go out before we reuse it */
+	Gfx_ResolveCapture( capture );
+
+	gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, capture->buffer );
+	glReadPixels( 0, 0, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+	gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	capture->fence     = gfxGL.FenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	capture->frame     = offscreen.frame;
+	capture->isPending = true;
+}
+
+static void Gfx_WriteFrameTimes( void ) {
+	if ( offscreen.timesFile == NULL ) {
+		return;
+	}
+
+	fprintf( offscreen.timesFile, "%u,%.3f,%.3f,%.3f,%.3f,%u\n", offscreen.frame,
+	         Prof_GetZoneLatestTime( PROF_ZONE_MAP_DRAW ),
+	         Prof_GetZoneLatestTime( PROF_ZONE_ACT_DRAW ),
+	         Prof_GetZoneLatestGPUTime( PROF_ZONE_MAP_DRAW ),
+	         Prof_GetZoneLatestGPUTime( PROF_ZONE_ACT_DRAW ),
+	         Prof_GetNumDrawCalls() );
+}
+
+void Gfx_InitializeOffscreenTarget( void ) {
+	if ( gfxGL.GenFramebuffers == NULL || gfxGL.GenRenderbuffers == NULL || gfxGL.BufferData == NULL ||
+	     gfxGL.MapBufferRange == NULL || gfxGL.FenceSync == NULL ) {
+		PrintError( "Offscreen rendering requires framebuffer objects and pixel buffers!\n" );
+	}
+
+	memset( &offscreen, 0, sizeof( offscreen ) );
+
+	gfxGL.GenRenderbuffers( 1, &offscreen.colourBuffer );
+	gfxGL.BindRenderbuffer( GL_RENDERBUFFER, offscreen.colourBuffer );
+	gfxGL.RenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT );
+
+	gfxGL.GenRenderbuffers( 1, &offscreen.depthBuffer );
+	gfxGL.BindRenderbuffer( GL_RENDERBUFFER, offscreen.depthBuffer );
+	gfxGL.RenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT );
+	gfxGL.BindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	gfxGL.GenFramebuffers( 1, &offscreen.frameBuffer );
+	gfxGL.BindFramebuffer( GL_FRAMEBUFFER, offscreen.frameBuffer );
+	gfxGL.FramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen.colourBuffer );
+	gfxGL.FramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen.depthBuffer );
+
+	GLenum status = gfxGL.CheckFramebufferStatus( GL_FRAMEBUFFER );
+	if ( status != GL_FRAMEBUFFER_COMPLETE ) {
+		PrintError( "Offscreen framebuffer is incomplete (%x)!\n", status );
+	}
+
+	offscreen.isInitialized = true;
+
+	offscreen.capturePrefix = plGetCommandLineArgumentValue( "-capture" );
+	if ( offscreen.capturePrefix != NULL ) {
+		offscreen.isRaw = plHasCommandLineArgument( "-captureraw" );
+
+		offscreen.captureInterval = 1;
+		const char *interval = plGetCommandLineArgumentValue( "-captureinterval" );
+		if ( interval != NULL ) {
+			offscreen.captureInterval = strtoul( interval, NULL, 10 );
+			if ( offscreen.captureInterval == 0 ) {
+				offscreen.captureInterval = 1;
+			}
+		}
+
+		for ( unsigned int i = 0; i < GFX_CAPTURE_LATENCY; ++i ) {
+			gfxGL.GenBuffers( 1, &offscreen.captures[ i ].buffer );
+			gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, offscreen.captures[ i ].buffer );
+			gfxGL.BufferData( GL_PIXEL_PACK_BUFFER, GFX_CAPTURE_FRAME_SIZE, NULL, GL_STREAM_READ );
+		}
+		gfxGL.BindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+		offscreen.flipBuffer = Sys_AllocateTaggedMemory( GFX_CAPTURE_FRAME_SIZE, sizeof( uint8_t ), SYS_MEMORY_TAG_GFX );
+
+		PrintMsg( "Capturing every %d frame(s) to \"%s\"...\n", offscreen.captureInterval, offscreen.capturePrefix );
+	}
+
+	const char *timesPath = plGetCommandLineArgumentValue( "-frametimes" );
+	if ( timesPath == NULL ) {
+		timesPath = GFX_DEFAULT_FRAME_TIMES_FILE;
+	}
+
+	offscreen.timesFile = fopen( timesPath, "w" );
+	if ( offscreen.timesFile != NULL ) {
+		fprintf( offscreen.timesFile, "frame,map_draw_ms,act_draw_ms,map_draw_gpu_ms,act_draw_gpu_ms,draw_calls\n" );
+	} else {
+		PrintWarn( "Failed to open \"%s\" for writing frame times!\n", timesPath );
+	}
+}
+
+/* anything else could have left another target bound, so
+ * this needs to happen at the start of every frame */
+void Gfx_BindOffscreenTarget( void ) {
+	gfxGL.BindFramebuffer( GL_FRAMEBUFFER, offscreen.frameBuffer );
+}
+
+/* called once the frame's been drawn, in place of swapping buffers */
+void Gfx_EndOffscreenFrame( void ) {
+	if ( offscreen.capturePrefix != NULL && ( offscreen.frame % offscreen.captureInterval ) == 0 ) {
+		Gfx_QueueCapture();
+	}
+
+	Gfx_WriteFrameTimes();
+
+	offscreen.frame++;
+}
+
+/* writes out anything still in flight */
+void Gfx_FlushCaptures( void ) {
+	if ( offscreen.capturePrefix == NULL ) {
+		return;
+	}
+
+	for ( unsigned int i = 0; i < GFX_CAPTURE_LATENCY; ++i ) {
+		Gfx_ResolveCapture( &offscreen.captures[ ( offscreen.nextCapture + i ) % GFX_CAPTURE_LATENCY ] );
+	}
+}
+
+void Gfx_ShutdownOffscreenTarget( void ) {
+	if ( !offscreen.isInitialized ) {
+		return;
+	}
+
+	Gfx_FlushCaptures();
+
+	if ( offscreen.timesFile != NULL ) {
+		fclose( offscreen.timesFile );
+	}
+
+	if ( offscreen.capturePrefix != NULL ) {
+		for ( unsigned int i = 0; i < GFX_CAPTURE_LATENCY; ++i ) {
+			gfxGL.DeleteBuffers( 1, &offscreen.captures[ i ].buffer );
+		}
+
+		Sys_FreeMemory( offscreen.flipBuffer );
+	}
+
+	gfxGL.BindFramebuffer( GL_FRAMEBUFFER, 0 );
+	gfxGL.DeleteFramebuffers( 1, &offscreen.frameBuffer );
+	gfxGL.DeleteRenderbuffers( 1, &offscreen.colourBuffer );
+	gfxGL.DeleteRenderbuffers( 1, &offscreen.depthBuffer );
+
+	memset( &offscreen, 0, sizeof( offscreen ) );
+}
@@ -0,0 +1,114 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+
+#if defined( __SSE__ )
+#include <xmmintrin.h>
+#endif
+
+static PLVector3 Gfx_NormalizePlaneNormal( PLVector3 normal ) {
+	float length = sqrtf( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z );
+	return PLVector3( normal.x / length, normal.y / length, normal.z / length );
+}
+
+/* the camera never pitches or rolls, so forward is always level */
+void Gfx_BuildFrustum( GfxFrustum *frustum, const PLVector3 *eye, const PLVector3 *forward, float fov, float aspect ) {
+	const PLVector3 right = PLVector3( -forward->z, 0.0f, forward->x );
+
+	float tanVertical = tanf( plDegreesToRadians( fov ) / 2.0f );
+	float tanHorizontal = tanVertical * aspect;
+
+	frustum->normals[ 0 ] = *forward;
+	frustum->normals[ 1 ] = Gfx_NormalizePlaneNormal( PLVector3(
+			right.x + forward->x * tanHorizontal, 0.0f, right.z + forward->z * tanHorizontal ) );
+	frustum->normals[ 2 ] = Gfx_NormalizePlaneNormal( PLVector3(
+			-right.x + forward->x * tanHorizontal, 0.0f, -right.z + forward->z * tanHorizontal ) );
+	frustum->normals[ 3 ] = Gfx_NormalizePlaneNormal( PLVector3(
+			forward->x * tanVertical, 1.0f, forward->z * tanVertical ) );
+	frustum->normals[ 4 ] = Gfx_NormalizePlaneNormal( PLVector3(
+			forward->x * tanVertical, -1.0f, forward->z * tanVertical ) );
+
+	for ( unsigned int i = 0; i < GFX_FRUSTUM_PLANES; ++i ) {
+		const PLVector3 *normal = &frustum->normals[ i ];
+		frustum->distances[ i ] = -( normal->x * eye->x + normal->y * eye->y + normal->z * eye->z );
+	}
+
+	frustum->distances[ 0 ] -= GFX_FRUSTUM_NEAR_PLANE;
+}
+
+/* pulls the planes straight out of a combined projection * view matrix
+ * (column major, as gl has it), so they match whatever camera drew the
+ * scene. each plane is a sum or difference of the matrix's last row
+ * with one of the others; the far plane is left out, as elsewhere */
+void Gfx_ExtractFrustum( GfxFrustum *frustum, const PLMatrix4 *viewProjection ) {
+	static const struct {
+		unsigned int row;
+		float        sign;
+	} planes[ GFX_FRUSTUM_PLANES ] = {
+			{ 2, 1.0f },  /* near */
+			{ 0, 1.0f },  /* left */
+			{ 0, -1.0f }, /* right */
+			{ 1, 1.0f },  /* bottom */
+			{ 1, -1.0f }, /* top */
+	};
+
+	const float *m = viewProjection->m;
+	for ( unsigned int i = 0; i < GFX_FRUSTUM_PLANES; ++i ) {
+		unsigned int row = planes[ i ].row;
+		float sign = planes[ i ].sign;
+		float x = m[ 3 ] + sign * m[ row ];
+		float y = m[ 7 ] + sign * m[ 4 + row ];
+		float z = m[ 11 ] + sign * m[ 8 + row ];
+		float w = m[ 15 ] + sign * m[ 12 + row ];
+
+		float length = sqrtf( x * x + y * y + z * z );
+		frustum->normals[ i ]   = PLVector3( x / length, y / length, z / length );
+		frustum->distances[ i ] = w / length;
+	}
+}
+
+/* tests all the spheres against each plane in turn, writing true into
+ * visible for any that are at least partly inside */
+void Gfx_CullSpheres( const GfxFrustum *frustum, const GfxSphereList *spheres, bool *visible ) {
+	unsigned int i = 0;
+
+#if defined( __SSE__ )
+	for ( ; i + 4 <= spheres->numSpheres; i += 4 ) {
+		__m128 x = _mm_loadu_ps( &spheres->x[ i ] );
+		__m128 y = _mm_loadu_ps( &spheres->y[ i ] );
+		__m128 z = _mm_loadu_ps( &spheres->z[ i ] );
+		__m128 negativeRadii = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( &spheres->radii[ i ] ) );
+
+		__m128 inside = _mm_cmpeq_ps( x, x ); /* all set */
+		for ( unsigned int j = 0; j < GFX_FRUSTUM_PLANES; ++j ) {
+			const PLVector3 *normal = &frustum->normals[ j ];
+			__m128 distance = _mm_add_ps(
+					_mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( normal->x ) ), _mm_mul_ps( y, _mm_set1_ps( normal->y ) ) ),
+					_mm_add_ps( _mm_mul_ps( z, _mm_set1_ps( normal->z ) ), _mm_set1_ps( frustum->distances[ j ] ) ) );
+			inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, negativeRadii ) );
+		}
+
+		int mask = _mm_movemask_ps( inside );
+		visible[ i + 0 ] = ( mask & 1 ) != 0;
+		visible[ i + 1 ] = ( mask & 2 ) != 0;
+		visible[ i + 2 ] = ( mask & 4 ) != 0;
+		visible[ i + 3 ] = ( mask & 8 ) != 0;
+	}
+#endif
+
+	for ( ; i < spheres->numSpheres; ++i ) {
+		visible[ i ] = true;
+		for ( unsigned int j = 0; j < GFX_FRUSTUM_PLANES; ++j ) {
+			const PLVector3 *normal = &frustum->normals[ j ];
+			float distance = normal->x * spheres->x[ i ] + normal->y * spheres->y[ i ] + normal->z * spheres->z[ i ] +
+			                 frustum->distances[ j ];
+			if ( distance < -spheres->radii[ i ] ) {
+				visible[ i ] = false;
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,113 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx_gl.h"
+
+GfxGL gfxGL;
+
+static void *Gfx_GetProcAddress( const char *name ) {
+	/* there's no glut window behind an offscreen context */
+	if ( Sys_IsOffscreen() ) {
+		return Sys_GetOffscreenProcAddress( name );
+	}
+
+	return ( void * ) glutGetProcAddress( name );
+}
+
+/* core profile doesn't let us query the extension string in one go,
+ * so this has to walk the indexed list instead */
+bool Gfx_IsExtensionSupported( const char *name ) {
+	if ( gfxGL.GetStringi == NULL ) {
+		return false;
+	}
+
+	GLint numExtensions = 0;
+	glGetIntegerv( GL_NUM_EXTENSIONS, &numExtensions );
+	for ( GLint i = 0; i < numExtensions; ++i ) {
+		const char *extension = ( const char * ) gfxGL.GetStringi( GL_EXTENSIONS, ( GLuint ) i );
+		if ( extension != NULL && strcmp( extension, name ) == 0 ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Gfx_InitializeGL( void ) {
+	memset( &gfxGL, 0, sizeof( GfxGL ) );
+
+	gfxGL.GetStringi          = Gfx_GetProcAddress( "glGetStringi" );
+	gfxGL.GenQueries          = Gfx_GetProcAddress( "glGenQueries" );
+	gfxGL.DeleteQueries       = Gfx_GetProcAddress( "glDeleteQueries" );
+	gfxGL.QueryCounter        = Gfx_GetProcAddress( "glQueryCounter" );
+	gfxGL.GetQueryObjectiv    = Gfx_GetProcAddress( "glGetQueryObjectiv" );
+	gfxGL.GetQueryObjectui64v = Gfx_GetProcAddress( "glGetQueryObjectui64v" );
+	gfxGL.GenBuffers          = Gfx_GetProcAddress( "glGenBuffers" );
+	gfxGL.DeleteBuffers       = Gfx_GetProcAddress( "glDeleteBuffers" );
+	gfxGL.BindBuffer          = Gfx_GetProcAddress( "glBindBuffer" );
+	gfxGL.BufferStorage       = Gfx_GetProcAddress( "glBufferStorage" );
+	gfxGL.BufferData          = Gfx_GetProcAddress( "glBufferData" );
+	gfxGL.MapBufferRange      = Gfx_GetProcAddress( "glMapBufferRange" );
+	gfxGL.UnmapBuffer         = Gfx_GetProcAddress( "glUnmapBuffer" );
+	gfxGL.FenceSync           = Gfx_GetProcAddress( "glFenceSync" );
+	gfxGL.ClientWaitSync      = Gfx_GetProcAddress( "glClientWaitSync" );
+	gfxGL.DeleteSync          = Gfx_GetProcAddress( "glDeleteSync" );
+
+	/* framebuffer objects are core in 3.0, so these should always be there */
+	gfxGL.GenFramebuffers         = Gfx_GetProcAddress( "glGenFramebuffers" );
+	gfxGL.DeleteFramebuffers      = Gfx_GetProcAddress( "glDeleteFramebuffers" );
+	gfxGL.BindFramebuffer         = Gfx_GetProcAddress( "glBindFramebuffer" );
+	gfxGL.FramebufferRenderbuffer = Gfx_GetProcAddress( "glFramebufferRenderbuffer" );
+	gfxGL.CheckFramebufferStatus  = Gfx_GetProcAddress( "glCheckFramebufferStatus" );
+	gfxGL.GenRenderbuffers        = Gfx_GetProcAddress( "glGenRenderbuffers" );
+	gfxGL.DeleteRenderbuffers     = Gfx_GetProcAddress( "glDeleteRenderbuffers" );
+	gfxGL.BindRenderbuffer        = Gfx_GetProcAddress( "glBindRenderbuffer" );
+	gfxGL.RenderbufferStorage     = Gfx_GetProcAddress( "glRenderbufferStorage" );
+
+	gfxGL.GetProgramiv        = Gfx_GetProcAddress( "glGetProgramiv" );
+	gfxGL.ProgramParameteri   = Gfx_GetProcAddress( "glProgramParameteri" );
+	gfxGL.GetProgramBinary    = Gfx_GetProcAddress( "glGetProgramBinary" );
+	gfxGL.ProgramBinary       = Gfx_GetProcAddress( "glProgramBinary" );
+
+	/* timer queries are core in 3.3, but we only ask for 3.2 */
+	gfxGL.hasTimerQuery =
+			gfxGL.GenQueries != NULL &&
+			gfxGL.QueryCounter != NULL &&
+			gfxGL.GetQueryObjectiv != NULL &&
+			gfxGL.GetQueryObjectui64v != NULL &&
+			Gfx_IsExtensionSupported( "GL_ARB_timer_query" );
+
+	/* persistent mapping is 4.4, so again down to the driver */
+	gfxGL.hasBufferStorage =
+			gfxGL.GenBuffers != NULL &&
+			gfxGL.DeleteBuffers != NULL &&
+			gfxGL.BindBuffer != NULL &&
+			gfxGL.BufferStorage != NULL &&
+			gfxGL.MapBufferRange != NULL &&
+			gfxGL.UnmapBuffer != NULL &&
+			gfxGL.FenceSync != NULL &&
+			gfxGL.ClientWaitSync != NULL &&
+			gfxGL.DeleteSync != NULL &&
+			Gfx_IsExtensionSupported( "GL_ARB_buffer_storage" );
+
+	/* and program binaries are 4.1; a driver can support them but not
+	 * actually offer any formats, in which case there's no point */
+	gfxGL.hasProgramBinary =
+			gfxGL.GetProgramiv != NULL &&
+			gfxGL.ProgramParameteri != NULL &&
+			gfxGL.GetProgramBinary != NULL &&
+			gfxGL.ProgramBinary != NULL &&
+			Gfx_IsExtensionSupported( "GL_ARB_get_program_binary" );
+	if ( gfxGL.hasProgramBinary ) {
+		GLint numFormats = 0;
+		glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+		gfxGL.hasProgramBinary = numFormats > 0;
+	}
+
+	PrintMsg( "GL: %s (%s)\n", glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+	PrintMsg( "GL: timer queries %s\n", gfxGL.hasTimerQuery ? "available" : "unavailable" );
+	PrintMsg( "GL: buffer storage %s\n", gfxGL.hasBufferStorage ? "available" : "unavailable" );
+	PrintMsg( "GL: program binaries %s\n", gfxGL.hasProgramBinary ? "available" : "unavailable" );
+}
@@ -0,0 +1,54 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#pragma once
+
+/* the platform library hides GL from us, but there are a handful of
+ * features it doesn't expose, so we fetch those entry points ourselves */
+
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+
+typedef struct GfxGL {
+	bool hasTimerQuery;
+	bool hasBufferStorage;
+	bool hasProgramBinary;
+
+	PFNGLGETSTRINGIPROC         GetStringi;
+	PFNGLGENQUERIESPROC         GenQueries;
+	PFNGLDELETEQUERIESPROC      DeleteQueries;
+	PFNGLQUERYCOUNTERPROC       QueryCounter;
+	PFNGLGETQUERYOBJECTIVPROC   GetQueryObjectiv;
+	PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+
+	PFNGLGENBUFFERSPROC         GenBuffers;
+	PFNGLDELETEBUFFERSPROC      DeleteBuffers;
+	PFNGLBINDBUFFERPROC         BindBuffer;
+	PFNGLBUFFERSTORAGEPROC      BufferStorage;
+	PFNGLBUFFERDATAPROC         BufferData;
+	PFNGLMAPBUFFERRANGEPROC     MapBufferRange;
+	PFNGLUNMAPBUFFERPROC        UnmapBuffer;
+	PFNGLFENCESYNCPROC          FenceSync;
+	PFNGLCLIENTWAITSYNCPROC     ClientWaitSync;
+	PFNGLDELETESYNCPROC         DeleteSync;
+
+	PFNGLGENFRAMEBUFFERSPROC         GenFramebuffers;
+	PFNGLDELETEFRAMEBUFFERSPROC      DeleteFramebuffers;
+	PFNGLBINDFRAMEBUFFERPROC         BindFramebuffer;
+	PFNGLFRAMEBUFFERRENDERBUFFERPROC FramebufferRenderbuffer;
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC  CheckFramebufferStatus;
+	PFNGLGENRENDERBUFFERSPROC        GenRenderbuffers;
+	PFNGLDELETERENDERBUFFERSPROC     DeleteRenderbuffers;
+	PFNGLBINDRENDERBUFFERPROC        BindRenderbuffer;
+	PFNGLRENDERBUFFERSTORAGEPROC     RenderbufferStorage;
+
+	PFNGLGETPROGRAMIVPROC       GetProgramiv;
+	PFNGLPROGRAMPARAMETERIPROC  ProgramParameteri;
+	PFNGLGETPROGRAMBINARYPROC   GetProgramBinary;
+	PFNGLPROGRAMBINARYPROC      ProgramBinary;
+} GfxGL;
+extern GfxGL gfxGL;
+
+void Gfx_InitializeGL( void );
+bool Gfx_IsExtensionSupported( const char *name );
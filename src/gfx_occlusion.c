@@ -0,0 +1,221 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "act.h"
+
+#include <float.h>
+
+/* horizontal occlusion buffer. every wall runs from the floor to the
+ * ceiling, so once one has been drawn across a column nothing behind it
+ * in that column can be seen; we keep the nearest wall depth for each
+ * column and test anything else against that before submitting it */
+
+#define GFX_OCCLUSION_NEAR_PLANE 1.0f
+
+static struct {
+	bool      isEnabled;
+	bool      isActive; /* only between begin and end */
+	PLVector2 origin;
+	PLVector2 forward;
+	PLVector2 right;
+	float     focalLength;
+
+	float depths[ YIN_DISPLAY_WIDTH ];
+
+	unsigned int numOccluded; /* this frame */
+} occlusion;
+
+static float Gfx_GetViewDepth( float x, float y ) {
+	return ( x - occlusion.origin.x ) * occlusion.forward.x + ( y - occlusion.origin.y ) * occlusion.forward.y;
+}
+
+static float Gfx_GetViewLateral( float x, float y ) {
+	return ( x - occlusion.origin.x ) * occlusion.right.x + ( y - occlusion.origin.y ) * occlusion.right.y;
+}
+
+static float Gfx_GetScreenX( float lateral, float depth ) {
+	return YIN_DISPLAY_WIDTH / 2.0f + lateral * occlusion.focalLength / depth;
+}
+
+/* anything reaching past the edges of the screen is let through, so we
+ * don't have to match the camera's frustum exactly */
+static bool Gfx_IsRangeOccluded( float sx0, float sx1, float minDepth ) {
+	if ( sx0 < 0.0f || sx1 > YIN_DISPLAY_WIDTH ) {
+		return false;
+	}
+
+	int x0 = ( int ) floorf( sx0 - 0.5f );
+	int x1 = ( int ) ceilf( sx1 + 0.5f );
+	if ( x0 < 0 ) {
+		x0 = 0;
+	}
+	if ( x1 > YIN_DISPLAY_WIDTH ) {
+		x1 = YIN_DISPLAY_WIDTH;
+	}
+
+	for ( int x = x0; x < x1; ++x ) {
+		if ( occlusion.depths[ x ] >= minDepth ) {
+			return false;
+		}
+	}
+
+	occlusion.numOccluded++;
+
+	return true;
+}
+
+bool Gfx_IsOcclusionEnabled( void ) {
+	return occlusion.isEnabled && occlusion.isActive;
+}
+
+void Gfx_InitializeOcclusion( void ) {
+	/* the debug camera looks down on the whole map, so
+	 * what the player can see doesn't mean anything */
+#ifdef DEBUG_CAM
+	occlusion.isEnabled = false;
+#else
+	occlusion.isEnabled = !plHasCommandLineArgument( "-noocclusion" );
+#endif
+}
+
+void Gfx_BeginOcclusion( Actor *player ) {
+	PLVector3 position = Act_GetPosition( player );
+	PLVector3 forward = Act_GetForward( player );
+
+	occlusion.origin      = PLVector2( position.x, position.z );
+	occlusion.forward     = PLVector2( forward.x, forward.z );
+	occlusion.right       = PLVector2( -forward.z, forward.x );
+	occlusion.focalLength = ( YIN_DISPLAY_HEIGHT / 2.0f ) / tanf( plDegreesToRadians( GFX_PLAYER_FOV ) / 2.0f );
+	occlusion.numOccluded = 0;
+	occlusion.isActive    = true;
+
+	for ( unsigned int i = 0; i < YIN_DISPLAY_WIDTH; ++i ) {
+		occlusion.depths[ i ] = FLT_MAX;
+	}
+}
+
+void Gfx_EndOcclusion( void ) {
+	occlusion.isActive = false;
+}
+
+unsigned int Gfx_GetNumOccluded( void ) {
+	return occlusion.numOccluded;
+}
+
+/* returns false if the wall is entirely behind the viewer */
+bool Gfx_ProjectWall( const PLVector2 *start, const PLVector2 *end, GfxOcclusionSpan *span ) {
+	float ax = Gfx_GetViewLateral( start->x, start->y ), az = Gfx_GetViewDepth( start->x, start->y );
+	float bx = Gfx_GetViewLateral( end->x, end->y ), bz = Gfx_GetViewDepth( end->x, end->y );
+	if ( az < GFX_OCCLUSION_NEAR_PLANE && bz < GFX_OCCLUSION_NEAR_PLANE ) {
+		return false;
+	}
+
+	if ( az < GFX_OCCLUSION_NEAR_PLANE ) {
+		ax += ( bx - ax ) * ( GFX_OCCLUSION_NEAR_PLANE - az ) / ( bz - az );
+		az = GFX_OCCLUSION_NEAR_PLANE;
+	} else if ( bz < GFX_OCCLUSION_NEAR_PLANE ) {
+		bx += ( ax - bx ) * ( GFX_OCCLUSION_NEAR_PLANE - bz ) / ( az - bz );
+		bz = GFX_OCCLUSION_NEAR_PLANE;
+	}
+
+	float asx = Gfx_GetScreenX( ax, az ), bsx = Gfx_GetScreenX( bx, bz );
+	if ( asx <= bsx ) {
+		span->sx0 = asx; span->invDepth0 = 1.0f / az;
+		span->sx1 = bsx; span->invDepth1 = 1.0f / bz;
+	} else {
+		span->sx0 = bsx; span->invDepth0 = 1.0f / bz;
+		span->sx1 = asx; span->invDepth1 = 1.0f / az;
+	}
+
+	span->minDepth = ( az < bz ) ? az : bz;
+
+	return true;
+}
+
+bool Gfx_IsSpanOccluded( const GfxOcclusionSpan *span ) {
+	if ( !Gfx_IsOcclusionEnabled() ) {
+		return false;
+	}
+
+	return Gfx_IsRangeOccluded( span->sx0, span->sx1, span->minDepth );
+}
+
+/* columns are claimed by whichever wall covers their centre, same as
+ * the rasterizer, so walls sharing an edge don't leave a gap between */
+void Gfx_AddOccluder( const GfxOcclusionSpan *span ) {
+	if ( !Gfx_IsOcclusionEnabled() ) {
+		return;
+	}
+
+	int x0 = ( int ) ceilf( span->sx0 - 0.5f );
+	int x1 = ( int ) ceilf( span->sx1 - 0.5f );
+	if ( x0 < 0 ) {
+		x0 = 0;
+	}
+	if ( x1 > YIN_DISPLAY_WIDTH ) {
+		x1 = YIN_DISPLAY_WIDTH;
+	}
+
+	/* 1/z is linear across the screen */
+	float width = span->sx1 - span->sx0;
+	for ( int x = x0; x < x1; ++x ) {
+		float t = ( width > 0.0f ) ? ( x + 0.5f - span->sx0 ) / width : 0.0f;
+		float depth = 1.0f / ( span->invDepth0 + ( span->invDepth1 - span->invDepth0 ) * t );
+		if ( depth < occlusion.depths[ x ] ) {
+			occlusion.depths[ x ] = depth;
+		}
+	}
+}
+
+/* for floors and ceilings, which are drawn as one quad per area */
+bool Gfx_IsBoxOccluded( float minX, float minY, float maxX, float maxY ) {
+	if ( !Gfx_IsOcclusionEnabled() ) {
+		return false;
+	}
+
+	const PLVector2 corners[ 4 ] = {
+			PLVector2( minX, minY ),
+			PLVector2( maxX, minY ),
+			PLVector2( minX, maxY ),
+			PLVector2( maxX, maxY ),
+	};
+
+	float sx0 = FLT_MAX, sx1 = -FLT_MAX, minDepth = FLT_MAX;
+	for ( unsigned int i = 0; i < 4; ++i ) {
+		float depth = Gfx_GetViewDepth( corners[ i ].x, corners[ i ].y );
+		if ( depth < GFX_OCCLUSION_NEAR_PLANE ) {
+			return false;
+		}
+
+		float sx = Gfx_GetScreenX( Gfx_GetViewLateral( corners[ i ].x, corners[ i ].y ), depth );
+		sx0 = ( sx < sx0 ) ? sx : sx0;
+		sx1 = ( sx > sx1 ) ? sx : sx1;
+		minDepth = ( depth < minDepth ) ? depth : minDepth;
+	}
+
+	return Gfx_IsRangeOccluded( sx0, sx1, minDepth );
+}
+
+/* sprites always face the camera, so they're treated as a
+ * disc of the given radius around their position */
+bool Gfx_IsSpriteOccluded( const PLVector3 *position, float radius ) {
+	if ( !Gfx_IsOcclusionEnabled() ) {
+		return false;
+	}
+
+	float depth = Gfx_GetViewDepth( position->x, position->z );
+	float nearDepth = depth - radius;
+	if ( nearDepth < GFX_OCCLUSION_NEAR_PLANE ) {
+		return false;
+	}
+
+	float farDepth = depth + radius;
+	float lateral = Gfx_GetViewLateral( position->x, position->z );
+	float a = Gfx_GetScreenX( lateral - radius, nearDepth ), b = Gfx_GetScreenX( lateral - radius, farDepth );
+	float c = Gfx_GetScreenX( lateral + radius, nearDepth ), d = Gfx_GetScreenX( lateral + radius, farDepth );
+
+	return Gfx_IsRangeOccluded( ( a < b ) ? a : b, ( c > d ) ? c : d, nearDepth );
+}
@@ -0,0 +1,330 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "gfx_gl.h"
+
+/* linked programs are kept on disk, keyed on a hash of their sources,
+ * so the next launch can skip compiling and linking them altogether.
+ * the whole file is thrown out if the driver has changed since */
+
+#define GFX_SHADER_CACHE_PATH    "shaders.cache"
+#define GFX_SHADER_CACHE_MAGIC   "YSHC"
+#define GFX_SHADER_CACHE_VERSION 1
+#define GFX_MAX_PROGRAM_BINARIES 64
+#define GFX_MAX_PROGRAM_BINARY_SIZE ( 16 * 1024 * 1024 ) /* anything bigger is a corrupt cache */
+
+typedef struct GfxProgramBinary {
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+	void     *data;
+} GfxProgramBinary;
+
+static GfxProgramBinary programBinaries[ GFX_MAX_PROGRAM_BINARIES ];
+static unsigned int     numProgramBinaries = 0;
+
+static uint64_t driverHash     = 0;
+static bool     isCacheEnabled = false;
+static bool     isCacheDirty   = false;
+
+uint64_t Gfx_HashBytes( uint64_t hash, const void *data, size_t size ) {
+	/* fnv-1a */
+	const uint8_t *bytes = data;
+	for ( size_t i = 0; i < size; ++i ) {
+		hash ^= bytes[ i ];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t Gfx_HashString( uint64_t hash, const char *string ) {
+	if ( string == NULL ) {
+		return hash;
+	}
+
+	return Gfx_HashBytes( hash, string, strlen( string ) + 1 );
+}
+
+static GfxProgramBinary *Gfx_FindProgramBinary( uint64_t key ) {
+	for ( unsigned int i = 0; i < numProgramBinaries; ++i ) {
+		if ( programBinaries[ i ].key == key ) {
+			return &programBinaries[ i ];
+		}
+	}
+
+	return NULL;
+}
+
+static void Gfx_RemoveProgramBinary( GfxProgramBinary *binary ) {
+	Sys_FreeMemory( binary->data );
+	*binary = programBinaries[ --numProgramBinaries ];
+	isCacheDirty = true;
+}
+
+static void Gfx_LoadShaderCache( void ) {
+	FILE *file = fopen( GFX_SHADER_CACHE_PATH, "rb" );
+	if ( file == NULL ) {
+		return;
+	}
+
+	char magic[ 4 ];
+	uint32_t version, numEntries;
+	uint64_t fileDriverHash;
+	if ( fread( magic, sizeof( magic ), 1, file ) != 1 ||
+	     fread( &version, sizeof( version ), 1, file ) != 1 ||
+	     fread( &fileDriverHash, sizeof( fileDriverHash ), 1, file ) != 1 ||
+	     fread( &numEntries, sizeof( numEntries ), 1, file ) != 1 ) {
+		PrintWarn( "Failed to read shader cache header, ignoring!\n" );
+		fclose( file );
+		return;
+	}
+
+	if ( memcmp( magic, GFX_SHADER_CACHE_MAGIC, sizeof( magic ) ) != 0 || version != GFX_SHADER_CACHE_VERSION ) {
+		PrintWarn( "Unexpected shader cache format, ignoring!\n" );
+		fclose( file );
+		return;
+	}
+
+	/* binaries from another driver are useless to us */
+	if ( fileDriverHash != driverHash ) {
+		PrintMsg( "Driver has changed, rebuilding shader cache\n" );
+		fclose( file );
+		isCacheDirty = true;
+		return;
+	}
+
+	for ( uint32_t i = 0; i < numEntries && numProgramBinaries < GFX_MAX_PROGRAM_BINARIES; ++i ) {
+		GfxProgramBinary binary;
+		if ( fread( &binary.key, sizeof( binary.key ), 1, file ) != 1 ||
+		     fread( &binary.format, sizeof( binary.format ), 1, file ) != 1 ||
+		     fread( &binary.length, sizeof( binary.length ), 1, file ) != 1 ) {
+			PrintWarn( "Shader cache is truncated!\n" );
+			break;
+		}
+
+		if ( binary.length == 0 || binary.length > GFX_MAX_PROGRAM_BINARY_SIZE ) {
+			PrintWarn( "Invalid program binary length in shader cache (%u)!\n", binary.length );
+			break;
+		}
+
+		binary.data = Sys_AllocateTaggedMemory( 1, binary.length, SYS_MEMORY_TAG_GFX );
+		if ( fread( binary.data, 1, binary.length, file ) != binary.length ) {
+			PrintWarn( "Shader cache is truncated!\n" );
+			Sys_FreeMemory( binary.data );
+			break;
+		}
+
+		programBinaries[ numProgramBinaries++ ] = binary;
+	}
+
+	fclose( file );
+
+	PrintMsg( "Loaded %d program binaries from shader cache\n", numProgramBinaries );
+}
+
+void Gfx_SaveShaderCache( void ) {
+	if ( !isCacheEnabled || !isCacheDirty ) {
+		return;
+	}
+
+	FILE *file = fopen( GFX_SHADER_CACHE_PATH, "wb" );
+	if ( file == NULL ) {
+		PrintWarn( "Failed to open \"%s\" for writing!\n", GFX_SHADER_CACHE_PATH );
+		return;
+	}
+
+	uint32_t version = GFX_SHADER_CACHE_VERSION;
+	uint32_t numEntries = numProgramBinaries;
+	fwrite( GFX_SHADER_CACHE_MAGIC, 4, 1, file );
+	fwrite( &version, sizeof( version ), 1, file );
+	fwrite( &driverHash, sizeof( driverHash ), 1, file );
+	fwrite( &numEntries, sizeof( numEntries ), 1, file );
+
+	for ( unsigned int i = 0; i < numProgramBinaries; ++i ) {
+		fwrite( &programBinaries[ i ].key, sizeof( programBinaries[ i ].key ), 1, file );
+		fwrite( &programBinaries[ i ].format, sizeof( programBinaries[ i ].format ), 1, file );
+		fwrite( &programBinaries[ i ].length, sizeof( programBinaries[ i ].length ), 1, file );
+		fwrite( programBinaries[ i ].data, 1, programBinaries[ i ].length, file );
+	}
+
+	fclose( file );
+
+	isCacheDirty = false;
+}
+
+static PLShaderUniformType Gfx_GetUniformType( GLenum type ) {
+	switch ( type ) {
+		case GL_FLOAT: return PL_UNIFORM_FLOAT;
+		case GL_INT: return PL_UNIFORM_INT;
+		case GL_UNSIGNED_INT: return PL_UNIFORM_UINT;
+		case GL_BOOL: return PL_UNIFORM_BOOL;
+		case GL_DOUBLE: return PL_UNIFORM_DOUBLE;
+		case GL_SAMPLER_1D: return PL_UNIFORM_SAMPLER1D;
+		case GL_SAMPLER_2D: return PL_UNIFORM_SAMPLER2D;
+		case GL_SAMPLER_3D: return PL_UNIFORM_SAMPLER3D;
+		case GL_SAMPLER_CUBE: return PL_UNIFORM_SAMPLERCUBE;
+		case GL_SAMPLER_1D_SHADOW: return PL_UNIFORM_SAMPLER1DSHADOW;
+		case GL_SAMPLER_2D_SHADOW: return PL_UNIFORM_SAMPLER2DSHADOW;
+		case GL_FLOAT_VEC2: return PL_UNIFORM_VEC2;
+		case GL_FLOAT_VEC3: return PL_UNIFORM_VEC3;
+		case GL_FLOAT_VEC4: return PL_UNIFORM_VEC4;
+		case GL_FLOAT_MAT3: return PL_UNIFORM_MAT3;
+		case GL_FLOAT_MAT4: return PL_UNIFORM_MAT4;
+		default: return PL_INVALID_UNIFORM;
+	}
+}
+
+static char *Gfx_CopyProgramName( const char *name ) {
+	size_t length = strlen( name ) + 1;
+	char *copy = pl_malloc( length );
+	memcpy( copy, name, length );
+	return copy;
+}
+
+/* fills in the uniform and attribute tables the same way the platform
+ * does when it links a program, as that's how named uniforms are found.
+ * these are allocated through the platform, as it frees them alongside
+ * the program */
+static void Gfx_RegisterProgramData( PLShaderProgram *program ) {
+	GLuint id = program->internal.id;
+	char name[ 256 ];
+
+	GLint numUniforms = 0;
+	gfxGL.GetProgramiv( id, GL_ACTIVE_UNIFORMS, &numUniforms );
+	program->num_uniforms = 0;
+	program->uniforms = ( numUniforms > 0 ) ? pl_calloc( ( size_t ) numUniforms, sizeof( *program->uniforms ) ) : NULL;
+	for ( GLint i = 0; i < numUniforms; ++i ) {
+		GLint size;
+		GLenum type;
+		glGetActiveUniform( id, ( GLuint ) i, sizeof( name ), NULL, &size, &type, name );
+
+		/* arrays come back as "name[0]", but are looked up without it */
+		char *bracket = strchr( name, '[' );
+		if ( bracket != NULL ) {
+			*bracket = '\0';
+		}
+
+		unsigned int j = program->num_uniforms++;
+		program->uniforms[ j ].name        = Gfx_CopyProgramName( name );
+		program->uniforms[ j ].slot        = glGetUniformLocation( id, name );
+		program->uniforms[ j ].type        = Gfx_GetUniformType( type );
+		program->uniforms[ j ].numElements = ( unsigned int ) size;
+	}
+
+	GLint numAttributes = 0;
+	gfxGL.GetProgramiv( id, GL_ACTIVE_ATTRIBUTES, &numAttributes );
+	program->num_attributes = 0;
+	program->attributes = ( numAttributes > 0 ) ? pl_calloc( ( size_t ) numAttributes, sizeof( *program->attributes ) ) : NULL;
+	for ( GLint i = 0; i < numAttributes; ++i ) {
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib( id, ( GLuint ) i, sizeof( name ), NULL, &size, &type, name );
+
+		unsigned int j = program->num_attributes++;
+		program->attributes[ j ].name = Gfx_CopyProgramName( name );
+		program->attributes[ j ].slot = glGetAttribLocation( id, name );
+	}
+}
+
+/* returns true if the program could be restored from the cache, in
+ * which case it's ready to use without attaching or linking anything */
+bool Gfx_LoadProgramBinary( PLShaderProgram *program, uint64_t key ) {
+	if ( !isCacheEnabled ) {
+		return false;
+	}
+
+	GfxProgramBinary *binary = Gfx_FindProgramBinary( key );
+	if ( binary == NULL ) {
+		return false;
+	}
+
+	gfxGL.ProgramBinary( program->internal.id, binary->format, binary->data, ( GLsizei ) binary->length );
+
+	/* drivers are allowed to reject a binary for any reason */
+	GLint status = GL_FALSE;
+	gfxGL.GetProgramiv( program->internal.id, GL_LINK_STATUS, &status );
+	if ( status != GL_TRUE ) {
+		PrintWarn( "Cached program binary was rejected, rebuilding!\n" );
+		Gfx_RemoveProgramBinary( binary );
+		return false;
+	}
+
+	/* we've skipped the platform's link step, so let it know */
+	Gfx_RegisterProgramData( program );
+	program->is_linked = true;
+
+	return true;
+}
+
+/* needs to be called before the program is linked */
+void Gfx_PrepareProgramBinary( PLShaderProgram *program ) {
+	if ( !isCacheEnabled ) {
+		return;
+	}
+
+	gfxGL.ProgramParameteri( program->internal.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+}
+
+void Gfx_StoreProgramBinary( PLShaderProgram *program, uint64_t key ) {
+	if ( !isCacheEnabled ) {
+		return;
+	}
+
+	GLint length = 0;
+	gfxGL.GetProgramiv( program->internal.id, GL_PROGRAM_BINARY_LENGTH, &length );
+	if ( length <= 0 ) {
+		return;
+	}
+
+	GfxProgramBinary *binary = Gfx_FindProgramBinary( key );
+	if ( binary != NULL ) {
+		Gfx_RemoveProgramBinary( binary );
+	} else if ( numProgramBinaries >= GFX_MAX_PROGRAM_BINARIES ) {
+		PrintWarn( "Ran out of slots in the shader cache (%d)!\n", GFX_MAX_PROGRAM_BINARIES );
+		return;
+	}
+
+	binary = &programBinaries[ numProgramBinaries ];
+	binary->key  = key;
+	binary->data = Sys_AllocateTaggedMemory( 1, ( size_t ) length, SYS_MEMORY_TAG_GFX );
+
+	GLsizei writtenLength = 0;
+	GLenum format = 0;
+	gfxGL.GetProgramBinary( program->internal.id, length, &writtenLength, &format, binary->data );
+	if ( writtenLength <= 0 ) {
+		Sys_FreeMemory( binary->data );
+		return;
+	}
+
+	binary->format = format;
+	binary->length = ( uint32_t ) writtenLength;
+
+	numProgramBinaries++;
+	isCacheDirty = true;
+}
+
+void Gfx_InitializeShaderCache( void ) {
+	isCacheEnabled = gfxGL.hasProgramBinary && !plHasCommandLineArgument( "-noshadercache" );
+	if ( !isCacheEnabled ) {
+		return;
+	}
+
+	driverHash = Gfx_HashString( GFX_HASH_SEED, ( const char * ) glGetString( GL_VENDOR ) );
+	driverHash = Gfx_HashString( driverHash, ( const char * ) glGetString( GL_RENDERER ) );
+	driverHash = Gfx_HashString( driverHash, ( const char * ) glGetString( GL_VERSION ) );
+
+	Gfx_LoadShaderCache();
+}
+
+void Gfx_ShutdownShaderCache( void ) {
+	Gfx_SaveShaderCache();
+
+	for ( unsigned int i = 0; i < numProgramBinaries; ++i ) {
+		Sys_FreeMemory( programBinaries[ i ].data );
+	}
+	numProgramBinaries = 0;
+}
@@ -0,0 +1,725 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "gfx_gl.h"
+#include "map.h"
+#include "act.h"
+#include "wad.h"
+
+#include <float.h>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+/* native renderer for machines without a usable gl driver. everything
+ * stays in palette indices until it's presented: walls are drawn a
+ * column at a time straight from the map segments, floors and ceilings
+ * a row span at a time, and the screen is split into vertical strips
+ * that are drawn in parallel */
+
+#define GFX_SOFT_MAX_THREADS     16
+#define GFX_SOFT_LIGHT_LEVELS    32
+#define GFX_SOFT_LIGHT_DISTANCE  96.0f /* world units per light level */
+#define GFX_SOFT_NEAR_PLANE      1.0f
+#define GFX_SOFT_FLAT_SHIFT      6 /* log2 of GFX_FLAT_SIZE */
+#define GFX_SOFT_FLOOR_FLAT      0
+#define GFX_SOFT_CEILING_FLAT    1
+
+#if ( 1 << GFX_SOFT_FLAT_SHIFT ) != GFX_FLAT_SIZE
+#error "GFX_SOFT_FLAT_SHIFT doesn't match GFX_FLAT_SIZE!"
+#endif
+
+typedef struct GfxSoftTexture {
+	unsigned int width;
+	unsigned int height;
+	uint8_t      *pixels; /* column major, so walls can step straight down */
+} GfxSoftTexture;
+
+typedef struct GfxSoftView {
+	PLVector2 origin;
+	PLVector2 forward;
+	PLVector2 right;
+	float     eyeHeight;
+	float     ceilingHeight;
+	float     focalLength; /* in pixels */
+} GfxSoftView;
+
+/* nearest wall found in each column */
+typedef struct GfxSoftColumn {
+	float                depth;
+	float                u;
+	const GfxSoftTexture *texture;
+	int                  top;
+	int                  bottom;
+} GfxSoftColumn;
+
+/* a segment that made it on screen, projected once per frame and then
+ * filled in by every strip it overlaps */
+typedef struct GfxSoftSpan {
+	float                asx, bsx; /* screen x of either end */
+	float                invAz, invBz;
+	float                au, bu;
+	int                  start, end; /* columns covered */
+	const GfxSoftTexture *texture;
+} GfxSoftSpan;
+
+static struct {
+	bool isEnabled;
+
+	RGBMap   palette[ 256 ];
+	uint32_t palette32[ 256 ]; /* rgba, for presenting */
+	uint8_t  lightTables[ GFX_SOFT_LIGHT_LEVELS ][ 256 ];
+
+	GfxSoftTexture *wallTextures;
+	unsigned int   numWallTextures;
+	GfxSoftTexture flats[ 2 ];
+
+	uint8_t       *frameBuffer;
+	GfxSoftColumn columns[ YIN_DISPLAY_WIDTH ];
+	GfxSoftView   view;
+
+	/* spans for the current frame, from the frame arena, binned by strip */
+	GfxSoftSpan  *spans;
+	unsigned int *binnedSpans;
+	unsigned int binStarts[ GFX_SOFT_MAX_THREADS + 1 ];
+
+	/* strip 0 is drawn by whoever calls Gfx_DrawSoftwareScene */
+	SysThread    *threads[ GFX_SOFT_MAX_THREADS ];
+	unsigned int numStrips;
+	SysMutex     *mutex;
+	SysCondition *startCondition;
+	SysCondition *doneCondition;
+	unsigned int frameNumber;
+	unsigned int numStripsRemaining;
+	bool         isShuttingDown;
+
+	PLTexture *texture;
+	uint32_t  *rgbaBuffer;
+} soft;
+
+/****************************************
+ * Resources
+ ****************************************/
+
+static uint8_t Gfx_FindNearestPaletteIndex( int r, int g, int b ) {
+	uint8_t bestIndex = 0;
+	int bestDistance = INT32_MAX;
+	for ( unsigned int i = 0; i < 256; ++i ) {
+		int dr = soft.palette[ i ].r - r;
+		int dg = soft.palette[ i ].g - g;
+		int db = soft.palette[ i ].b - b;
+		int distance = dr * dr + dg * dg + db * db;
+		if ( distance < bestDistance ) {
+			bestDistance = distance;
+			bestIndex = ( uint8_t ) i;
+		}
+	}
+
+	return bestIndex;
+}
+
+/* each level maps an index to whatever's closest to it once darkened */
+static void Gfx_BuildLightTables( void ) {
+	for ( unsigned int level = 0; level < GFX_SOFT_LIGHT_LEVELS; ++level ) {
+		float scale = 1.0f - ( float ) level / GFX_SOFT_LIGHT_LEVELS;
+		for ( unsigned int i = 0; i < 256; ++i ) {
+			soft.lightTables[ level ][ i ] = Gfx_FindNearestPaletteIndex(
+					( int ) ( soft.palette[ i ].r * scale ),
+					( int ) ( soft.palette[ i ].g * scale ),
+					( int ) ( soft.palette[ i ].b * scale ) );
+		}
+	}
+
+	for ( unsigned int i = 0; i < 256; ++i ) {
+		PLColour colour = { soft.palette[ i ].r, soft.palette[ i ].g, soft.palette[ i ].b, 255 };
+		memcpy( &soft.palette32[ i ], &colour, sizeof( uint32_t ) );
+	}
+}
+
+/* same layout as Gfx_DecodePictureByIndex, but kept as indices */
+static void Gfx_LoadSoftwarePicture( GfxSoftTexture *texture, unsigned int index ) {
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t size;
+	const uint8_t *data = Wad_LoadLumpByIndex( globalWad, index, arena, &size );
+	if ( data == NULL || size < 4 ) {
+		PrintError( "Failed to load picture %d!\n", index );
+	}
+
+	texture->width  = data[ 0 ];
+	texture->height = data[ 1 ];
+	if ( texture->width == 0 || texture->height == 0 || size < 4 + texture->width * 2 ) {
+		PrintError( "Invalid picture %d!\n", index );
+	}
+
+	/* posts that run off the end of the lump are dropped and those that run
+	 * off the bottom are clipped, same as Gfx_DecodePicture */
+	texture->pixels = Sys_AllocateTaggedMemory( texture->width * texture->height, sizeof( uint8_t ), SYS_MEMORY_TAG_GFX );
+	for ( unsigned int i = 0; i < texture->width; ++i ) {
+		size_t offset = ( uint16_t ) Wad_GetInt16( &data[ 4 + i * 2 ] );
+		uint8_t *column = &texture->pixels[ i * texture->height ];
+		while ( offset < size ) {
+			unsigned int rowStart = data[ offset++ ];
+			if ( rowStart == 255 || offset >= size ) {
+				break;
+			}
+
+			unsigned int pixelCount = data[ offset++ ];
+			if ( offset + pixelCount > size ) {
+				break;
+			}
+
+			if ( rowStart < texture->height ) {
+				unsigned int numRows = ( rowStart + pixelCount > texture->height ) ? texture->height - rowStart : pixelCount;
+				memcpy( &column[ rowStart ], &data[ offset ], numRows );
+			}
+			offset += pixelCount;
+		}
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+static void Gfx_LoadSoftwareFlat( GfxSoftTexture *texture, unsigned int index ) {
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	size_t size;
+	const uint8_t *data = Wad_LoadLumpByIndex( globalWad, index, arena, &size );
+	if ( data == NULL || size != GFX_FLAT_SIZE * GFX_FLAT_SIZE ) {
+		PrintError( "Failed to load flat %d!\n", index );
+	}
+
+	/* flats are only ever sampled by spans, so stay row major */
+	texture->width  = GFX_FLAT_SIZE;
+	texture->height = GFX_FLAT_SIZE;
+	texture->pixels = Sys_AllocateTaggedMemory( size, sizeof( uint8_t ), SYS_MEMORY_TAG_GFX );
+	memcpy( texture->pixels, data, size );
+
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+static unsigned int Gfx_GetSoftwareLumpRange( const char *startName, const char *endName, unsigned int *start ) {
+	unsigned int end;
+	if ( !Wad_FindLump( globalWad, startName, start ) || !Wad_FindLump( globalWad, endName, &end ) ) {
+		PrintError( "Failed to find \"%s\"/\"%s\"!\n", startName, endName );
+	}
+
+	return end - ++( *start );
+}
+
+static void Gfx_LoadSoftwareTextures( void ) {
+	unsigned int start;
+	soft.numWallTextures = Gfx_GetSoftwareLumpRange( "P_START", "P_END", &start );
+	if ( soft.numWallTextures == 0 ) {
+		PrintError( "No wall textures for the software renderer!\n" );
+	}
+
+	soft.wallTextures = Sys_AllocateTaggedMemory( soft.numWallTextures, sizeof( GfxSoftTexture ), SYS_MEMORY_TAG_GFX );
+	for ( unsigned int i = 0; i < soft.numWallTextures; ++i ) {
+		Gfx_LoadSoftwarePicture( &soft.wallTextures[ i ], start + i );
+	}
+
+	unsigned int numFlats = Gfx_GetSoftwareLumpRange( "F_START", "F_END", &start );
+	if ( numFlats < plArrayElements( soft.flats ) ) {
+		PrintError( "Not enough flats for the software renderer (%d)!\n", numFlats );
+	}
+
+	for ( unsigned int i = 0; i < plArrayElements( soft.flats ); ++i ) {
+		Gfx_LoadSoftwareFlat( &soft.flats[ i ], start + i );
+	}
+}
+
+static const GfxSoftTexture *Gfx_GetSoftwareWallTexture( unsigned int index ) {
+	if ( index >= soft.numWallTextures ) {
+		index = ( MAP_DEFAULT_WALL_TEXTURE < soft.numWallTextures ) ? MAP_DEFAULT_WALL_TEXTURE : 0;
+	}
+
+	return &soft.wallTextures[ index ];
+}
+
+/****************************************
+ * Drawing
+ ****************************************/
+
+static const uint8_t *Gfx_GetLightTable( float depth ) {
+	int level = ( int ) ( depth / GFX_SOFT_LIGHT_DISTANCE );
+	if ( level >= GFX_SOFT_LIGHT_LEVELS ) {
+		level = GFX_SOFT_LIGHT_LEVELS - 1;
+	}
+
+	return soft.lightTables[ level ];
+}
+
+static unsigned int Gfx_GetColumnStrip( int x ) {
+	return ( ( x + 1 ) * soft.numStrips - 1 ) / YIN_DISPLAY_WIDTH;
+}
+
+static bool Gfx_ProjectSegment( const MapSegment *segment, GfxSoftSpan *span ) {
+	const GfxSoftView *view = &soft.view;
+	const float centreX = YIN_DISPLAY_WIDTH / 2.0f;
+
+	/* into view space, where y is depth */
+	PLVector2 a = PLVector2( segment->start.x - view->origin.x, segment->start.y - view->origin.y );
+	PLVector2 b = PLVector2( segment->end.x - view->origin.x, segment->end.y - view->origin.y );
+	float ax = a.x * view->right.x + a.y * view->right.y;
+	float az = a.x * view->forward.x + a.y * view->forward.y;
+	float bx = b.x * view->right.x + b.y * view->right.y;
+	float bz = b.x * view->forward.x + b.y * view->forward.y;
+	float au = 0.0f;
+	float bu = segment->length;
+
+	if ( az < GFX_SOFT_NEAR_PLANE && bz < GFX_SOFT_NEAR_PLANE ) {
+		return false;
+	}
+
+	/* clip against the near plane */
+	if ( az < GFX_SOFT_NEAR_PLANE ) {
+		float t = ( GFX_SOFT_NEAR_PLANE - az ) / ( bz - az );
+		ax += ( bx - ax ) * t;
+		au += ( bu - au ) * t;
+		az = GFX_SOFT_NEAR_PLANE;
+	} else if ( bz < GFX_SOFT_NEAR_PLANE ) {
+		float t = ( GFX_SOFT_NEAR_PLANE - bz ) / ( az - bz );
+		bx += ( ax - bx ) * t;
+		bu += ( au - bu ) * t;
+		bz = GFX_SOFT_NEAR_PLANE;
+	}
+
+	float asx = centreX + ax * view->focalLength / az;
+	float bsx = centreX + bx * view->focalLength / bz;
+	if ( asx > bsx ) {
+		float tmp;
+		tmp = asx; asx = bsx; bsx = tmp;
+		tmp = az; az = bz; bz = tmp;
+		tmp = au; au = bu; bu = tmp;
+	}
+
+	/* columns whose centres fall within the wall */
+	int start = ( int ) ceilf( asx - 0.5f );
+	int end = ( int ) ceilf( bsx - 0.5f );
+	if ( start < 0 ) {
+		start = 0;
+	}
+	if ( end > YIN_DISPLAY_WIDTH ) {
+		end = YIN_DISPLAY_WIDTH;
+	}
+	if ( start >= end ) {
+		return false;
+	}
+
+	/* 1/z and u/z are linear across the screen */
+	span->asx     = asx;
+	span->bsx     = bsx;
+	span->invAz   = 1.0f / az;
+	span->invBz   = 1.0f / bz;
+	span->au      = au;
+	span->bu      = bu;
+	span->start   = start;
+	span->end     = end;
+	span->texture = Gfx_GetSoftwareWallTexture( segment->textureIndex );
+
+	return true;
+}
+
+/* projects everything once up front, so each strip only has to look at
+ * the spans that actually overlap it */
+static void Gfx_ProjectSpans( SysArena *arena ) {
+	unsigned int numAreas = Map_GetNumAreas();
+	unsigned int maxSpans = 0;
+	for ( unsigned int i = 0; i < numAreas; ++i ) {
+		unsigned int numSegments;
+		if ( Map_GetAreaSegments( i, &numSegments ) != NULL ) {
+			maxSpans += numSegments;
+		}
+	}
+
+	soft.spans = Sys_ArenaAllocate( arena, maxSpans + 1, sizeof( GfxSoftSpan ) );
+	memset( soft.binStarts, 0, sizeof( soft.binStarts ) );
+
+	unsigned int numSpans = 0;
+	for ( unsigned int i = 0; i < numAreas; ++i ) {
+		unsigned int numSegments;
+		const MapSegment *segments = Map_GetAreaSegments( i, &numSegments );
+		if ( segments == NULL ) {
+			continue;
+		}
+
+		for ( unsigned int j = 0; j < numSegments; ++j ) {
+			GfxSoftSpan *span = &soft.spans[ numSpans ];
+			if ( !Gfx_ProjectSegment( &segments[ j ], span ) ) {
+				continue;
+			}
+
+			numSpans++;
+			unsigned int lastStrip = Gfx_GetColumnStrip( span->end - 1 );
+			for ( unsigned int strip = Gfx_GetColumnStrip( span->start ); strip <= lastStrip; ++strip ) {
+				soft.binStarts[ strip + 1 ]++;
+			}
+		}
+	}
+
+	/* counts into offsets, then fill each bin in order */
+	for ( unsigned int i = 0; i < soft.numStrips; ++i ) {
+		soft.binStarts[ i + 1 ] += soft.binStarts[ i ];
+	}
+
+	unsigned int binEnds[ GFX_SOFT_MAX_THREADS ];
+	memcpy( binEnds, soft.binStarts, sizeof( binEnds ) );
+
+	soft.binnedSpans = Sys_ArenaAllocate( arena, soft.binStarts[ soft.numStrips ] + 1, sizeof( unsigned int ) );
+	for ( unsigned int i = 0; i < numSpans; ++i ) {
+		unsigned int lastStrip = Gfx_GetColumnStrip( soft.spans[ i ].end - 1 );
+		for ( unsigned int strip = Gfx_GetColumnStrip( soft.spans[ i ].start ); strip <= lastStrip; ++strip ) {
+			soft.binnedSpans[ binEnds[ strip ]++ ] = i;
+		}
+	}
+}
+
+/* finds the nearest wall in each column of the strip */
+static void Gfx_FillStripColumns( unsigned int strip, unsigned int x0, unsigned int x1 ) {
+	for ( unsigned int x = x0; x < x1; ++x ) {
+		soft.columns[ x ].depth = FLT_MAX;
+		soft.columns[ x ].texture = NULL;
+	}
+
+	for ( unsigned int i = soft.binStarts[ strip ]; i < soft.binStarts[ strip + 1 ]; ++i ) {
+		const GfxSoftSpan *span = &soft.spans[ soft.binnedSpans[ i ] ];
+		int start = ( span->start > ( int ) x0 ) ? span->start : ( int ) x0;
+		int end = ( span->end < ( int ) x1 ) ? span->end : ( int ) x1;
+
+		float width = span->bsx - span->asx;
+		for ( int x = start; x < end; ++x ) {
+			float t = ( x + 0.5f - span->asx ) / width;
+			float depth = 1.0f / ( span->invAz + ( span->invBz - span->invAz ) * t );
+			if ( depth >= soft.columns[ x ].depth ) {
+				continue;
+			}
+
+			soft.columns[ x ].depth   = depth;
+			soft.columns[ x ].u       = ( span->au * span->invAz + ( span->bu * span->invBz - span->au * span->invAz ) * t ) * depth;
+			soft.columns[ x ].texture = span->texture;
+		}
+	}
+}
+
+static void Gfx_DrawWallColumns( unsigned int x0, unsigned int x1 ) {
+	const GfxSoftView *view = &soft.view;
+	const float horizon = YIN_DISPLAY_HEIGHT / 2.0f;
+
+	for ( unsigned int x = x0; x < x1; ++x ) {
+		GfxSoftColumn *column = &soft.columns[ x ];
+		if ( column->texture == NULL ) {
+			column->top = column->bottom = ( int ) horizon;
+			continue;
+		}
+
+		float scale = view->focalLength / column->depth;
+		float top = horizon - ( view->ceilingHeight - view->eyeHeight ) * scale;
+		float bottom = horizon + view->eyeHeight * scale;
+
+		column->top = ( int ) ceilf( top - 0.5f );
+		column->bottom = ( int ) ceilf( bottom - 0.5f );
+		if ( column->top < 0 ) {
+			column->top = 0;
+		}
+		if ( column->bottom > YIN_DISPLAY_HEIGHT ) {
+			column->bottom = YIN_DISPLAY_HEIGHT;
+		}
+
+		const GfxSoftTexture *texture = column->texture;
+		const uint8_t *texels = &texture->pixels[ ( ( unsigned int ) fmaxf( column->u, 0.0f ) % texture->width ) * texture->height ];
+		const uint8_t *light = Gfx_GetLightTable( column->depth );
+
+		/* one texel per world unit, measured down from the ceiling */
+		float step = 1.0f / scale;
+		float v = ( view->ceilingHeight - view->eyeHeight ) + ( column->top + 0.5f - horizon ) * step;
+		int32_t fixedV = ( int32_t ) ( v * 65536.0f );
+		int32_t fixedStep = ( int32_t ) ( step * 65536.0f );
+
+		uint8_t *dst = &soft.frameBuffer[ column->top * YIN_DISPLAY_WIDTH + x ];
+		for ( int y = column->top; y < column->bottom; ++y ) {
+			*dst = light[ texels[ ( unsigned int ) ( fixedV >> 16 ) % texture->height ] ];
+			dst += YIN_DISPLAY_WIDTH;
+			fixedV += fixedStep;
+		}
+	}
+}
+
+/* u and v are 16.16 texel coordinates into a flat */
+static void Gfx_DrawSpan( uint8_t *dst, unsigned int count, uint32_t u, uint32_t v, uint32_t du, uint32_t dv,
+                          const uint8_t *flat, const uint8_t *light ) {
+#if defined( __SSE2__ )
+	/* four pixels' worth of addressing at a time */
+	const __m128i mask = _mm_set1_epi32( GFX_FLAT_SIZE - 1 );
+	__m128i us = _mm_setr_epi32( ( int ) u, ( int ) ( u + du ), ( int ) ( u + du * 2 ), ( int ) ( u + du * 3 ) );
+	__m128i vs = _mm_setr_epi32( ( int ) v, ( int ) ( v + dv ), ( int ) ( v + dv * 2 ), ( int ) ( v + dv * 3 ) );
+	const __m128i dus = _mm_set1_epi32( ( int ) ( du * 4 ) );
+	const __m128i dvs = _mm_set1_epi32( ( int ) ( dv * 4 ) );
+	for ( ; count >= 4; count -= 4, dst += 4 ) {
+		__m128i column = _mm_and_si128( _mm_srli_epi32( us, 16 ), mask );
+		__m128i row = _mm_and_si128( _mm_srli_epi32( vs, 16 ), mask );
+		__m128i offsets = _mm_or_si128( _mm_slli_epi32( row, GFX_SOFT_FLAT_SHIFT ), column );
+
+		uint32_t offset[ 4 ];
+		_mm_storeu_si128( ( __m128i * ) offset, offsets );
+		dst[ 0 ] = light[ flat[ offset[ 0 ] ] ];
+		dst[ 1 ] = light[ flat[ offset[ 1 ] ] ];
+		dst[ 2 ] = light[ flat[ offset[ 2 ] ] ];
+		dst[ 3 ] = light[ flat[ offset[ 3 ] ] ];
+
+		us = _mm_add_epi32( us, dus );
+		vs = _mm_add_epi32( vs, dvs );
+	}
+
+	u = ( uint32_t ) _mm_cvtsi128_si32( us );
+	v = ( uint32_t ) _mm_cvtsi128_si32( vs );
+#endif
+
+	for ( ; count > 0; --count, ++dst ) {
+		*dst = light[ flat[ ( ( ( v >> 16 ) & ( GFX_FLAT_SIZE - 1 ) ) << GFX_SOFT_FLAT_SHIFT ) + ( ( u >> 16 ) & ( GFX_FLAT_SIZE - 1 ) ) ] ];
+		u += du;
+		v += dv;
+	}
+}
+
+/* every row is a plane at a fixed distance, so the texture
+ * coordinates step linearly across it */
+static void Gfx_DrawFlatSpans( unsigned int x0, unsigned int x1 ) {
+	const GfxSoftView *view = &soft.view;
+	const float horizon = YIN_DISPLAY_HEIGHT / 2.0f;
+	const float centreX = YIN_DISPLAY_WIDTH / 2.0f;
+
+	for ( int y = 0; y < YIN_DISPLAY_HEIGHT; ++y ) {
+		bool isFloor = ( y + 0.5f ) > horizon;
+		float height = isFloor ? view->eyeHeight : ( view->ceilingHeight - view->eyeHeight );
+		float distance = height * view->focalLength / fabsf( y + 0.5f - horizon );
+
+		const uint8_t *flat = soft.flats[ isFloor ? GFX_SOFT_FLOOR_FLAT : GFX_SOFT_CEILING_FLAT ].pixels;
+		const uint8_t *light = Gfx_GetLightTable( distance );
+
+		/* world position under the centre of the first column, and per column after */
+		float lateral = ( x0 + 0.5f - centreX ) * distance / view->focalLength;
+		float wx = view->origin.x + view->forward.x * distance + view->right.x * lateral;
+		float wy = view->origin.y + view->forward.y * distance + view->right.y * lateral;
+		float dx = view->right.x * distance / view->focalLength;
+		float dy = view->right.y * distance / view->focalLength;
+
+		uint8_t *row = &soft.frameBuffer[ y * YIN_DISPLAY_WIDTH ];
+		unsigned int x = x0;
+		while ( x < x1 ) {
+			/* skip over anything a wall already covers */
+			while ( x < x1 && ( isFloor ? y < soft.columns[ x ].bottom : y >= soft.columns[ x ].top ) ) {
+				++x;
+			}
+
+			unsigned int spanStart = x;
+			while ( x < x1 && ( isFloor ? y >= soft.columns[ x ].bottom : y < soft.columns[ x ].top ) ) {
+				++x;
+			}
+
+			if ( x == spanStart ) {
+				continue;
+			}
+
+			float offset = ( float ) ( spanStart - x0 );
+			Gfx_DrawSpan( &row[ spanStart ], x - spanStart,
+			              ( uint32_t ) ( int32_t ) ( ( wx + dx * offset ) * 65536.0f ),
+			              ( uint32_t ) ( int32_t ) ( ( wy + dy * offset ) * 65536.0f ),
+			              ( uint32_t ) ( int32_t ) ( dx * 65536.0f ),
+			              ( uint32_t ) ( int32_t ) ( dy * 65536.0f ),
+			              flat, light );
+		}
+	}
+}
+
+static void Gfx_DrawStrip( unsigned int strip ) {
+	unsigned int x0 = strip * YIN_DISPLAY_WIDTH / soft.numStrips;
+	unsigned int x1 = ( strip + 1 ) * YIN_DISPLAY_WIDTH / soft.numStrips;
+
+	Gfx_FillStripColumns( strip, x0, x1 );
+	Gfx_DrawWallColumns( x0, x1 );
+	Gfx_DrawFlatSpans( x0, x1 );
+}
+
+static void Gfx_SoftwareThread( void *userData ) {
+	unsigned int strip = ( unsigned int ) ( uintptr_t ) userData;
+	unsigned int lastFrame = 0;
+
+	Sys_LockMutex( soft.mutex );
+	while ( true ) {
+		while ( soft.frameNumber == lastFrame && !soft.isShuttingDown ) {
+			Sys_WaitCondition( soft.startCondition, soft.mutex );
+		}
+
+		if ( soft.isShuttingDown ) {
+			break;
+		}
+
+		lastFrame = soft.frameNumber;
+		Sys_UnlockMutex( soft.mutex );
+
+		Gfx_DrawStrip( strip );
+
+		Sys_LockMutex( soft.mutex );
+		if ( --soft.numStripsRemaining == 0 ) {
+			Sys_SignalCondition( soft.doneCondition );
+		}
+	}
+	Sys_UnlockMutex( soft.mutex );
+}
+
+/****************************************
+ * Public
+ ****************************************/
+
+bool Gfx_IsSoftwareRendererEnabled( void ) {
+	return soft.isEnabled;
+}
+
+void Gfx_DrawSoftwareScene( Actor *player ) {
+	PLVector3 position = Act_GetPosition( player );
+	PLVector3 forward = Act_GetForward( player );
+
+	/* the map is laid out over x and z */
+	GfxSoftView *view = &soft.view;
+	view->origin        = PLVector2( position.x, position.z );
+	view->forward       = PLVector2( forward.x, forward.z );
+	view->right         = PLVector2( -forward.z, forward.x );
+	view->eyeHeight     = Act_GetViewOffset( player );
+	view->ceilingHeight = Gfx_GetSoftwareWallTexture( MAP_DEFAULT_WALL_TEXTURE )->height * 2.0f;
+	view->focalLength   = ( YIN_DISPLAY_HEIGHT / 2.0f ) / tanf( plDegreesToRadians( GFX_PLAYER_FOV ) / 2.0f );
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+	Gfx_ProjectSpans( arena );
+
+	Sys_LockMutex( soft.mutex );
+	soft.numStripsRemaining = soft.numStrips - 1;
+	soft.frameNumber++;
+	Sys_BroadcastCondition( soft.startCondition );
+	Sys_UnlockMutex( soft.mutex );
+
+	Gfx_DrawStrip( 0 );
+
+	Sys_LockMutex( soft.mutex );
+	while ( soft.numStripsRemaining > 0 ) {
+		Sys_WaitCondition( soft.doneCondition, soft.mutex );
+	}
+	Sys_UnlockMutex( soft.mutex );
+
+	soft.spans = NULL;
+	soft.binnedSpans = NULL;
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+/* converts the last frame and hands it over to gl for display */
+PLTexture *Gfx_UpdateSoftwareTexture( void ) {
+	for ( unsigned int i = 0; i < YIN_DISPLAY_WIDTH * YIN_DISPLAY_HEIGHT; ++i ) {
+		soft.rgbaBuffer[ i ] = soft.palette32[ soft.frameBuffer[ i ] ];
+	}
+
+	if ( soft.texture == NULL ) {
+		soft.texture = Gfx_GenerateTextureFromData( ( uint8_t * ) soft.rgbaBuffer, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, 4, false );
+		return soft.texture;
+	}
+
+	/* go through the platform library first, so it doesn't lose track of what's bound */
+	plSetTexture( NULL, 0 );
+	glBindTexture( GL_TEXTURE_2D, soft.texture->internal.id );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, soft.rgbaBuffer );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	return soft.texture;
+}
+
+/* binary ppm, as it needs nothing to write and most tools can read it */
+bool Gfx_WriteSoftwareScreenshot( const char *path ) {
+	FILE *file = fopen( path, "wb" );
+	if ( file == NULL ) {
+		PrintWarn( "Failed to open \"%s\" for writing!\n", path );
+		return false;
+	}
+
+	fprintf( file, "P6\n%d %d\n255\n", YIN_DISPLAY_WIDTH, YIN_DISPLAY_HEIGHT );
+	for ( unsigned int i = 0; i < YIN_DISPLAY_WIDTH * YIN_DISPLAY_HEIGHT; ++i ) {
+		fwrite( &soft.palette[ soft.frameBuffer[ i ] ], sizeof( RGBMap ), 1, file );
+	}
+
+	fclose( file );
+
+	PrintMsg( "Wrote \"%s\"\n", path );
+
+	return true;
+}
+
+void Gfx_InitializeSoftware( void ) {
+	PrintMsg( "Initializing software renderer...\n" );
+
+	Gfx_LoadPalette( soft.palette, "PLAYPAL" );
+	Gfx_BuildLightTables();
+	Gfx_LoadSoftwareTextures();
+
+	soft.frameBuffer = Sys_AllocateTaggedMemory( YIN_DISPLAY_WIDTH * YIN_DISPLAY_HEIGHT, sizeof( uint8_t ), SYS_MEMORY_TAG_GFX );
+	soft.rgbaBuffer = Sys_AllocateTaggedMemory( YIN_DISPLAY_WIDTH * YIN_DISPLAY_HEIGHT, sizeof( uint32_t ), SYS_MEMORY_TAG_GFX );
+
+	soft.numStrips = Sys_GetNumProcessors();
+	const char *threadsArg = plGetCommandLineArgumentValue( "-softthreads" );
+	if ( threadsArg != NULL ) {
+		soft.numStrips = strtoul( threadsArg, NULL, 10 );
+	}
+	soft.numStrips = plClamp( 1, soft.numStrips, GFX_SOFT_MAX_THREADS );
+
+	soft.mutex = Sys_CreateMutex();
+	soft.startCondition = Sys_CreateCondition();
+	soft.doneCondition = Sys_CreateCondition();
+	for ( unsigned int i = 1; i < soft.numStrips; ++i ) {
+		soft.threads[ i ] = Sys_CreateThread( "Gfx_SoftwareThread", Gfx_SoftwareThread, ( void * ) ( uintptr_t ) i );
+	}
+
+	PrintMsg( "Software renderer drawing %d strips\n", soft.numStrips );
+
+	soft.isEnabled = true;
+}
+
+void Gfx_ShutdownSoftware( void ) {
+	if ( !soft.isEnabled ) {
+		return;
+	}
+
+	Sys_LockMutex( soft.mutex );
+	soft.isShuttingDown = true;
+	Sys_BroadcastCondition( soft.startCondition );
+	Sys_UnlockMutex( soft.mutex );
+
+	for ( unsigned int i = 1; i < soft.numStrips; ++i ) {
+		Sys_JoinThread( soft.threads[ i ] );
+	}
+
+	Sys_DestroyCondition( soft.doneCondition );
+	Sys_DestroyCondition( soft.startCondition );
+	Sys_DestroyMutex( soft.mutex );
+
+	if ( soft.texture != NULL ) {
+		plDestroyTexture( soft.texture );
+	}
+
+	for ( unsigned int i = 0; i < soft.numWallTextures; ++i ) {
+		Sys_FreeMemory( soft.wallTextures[ i ].pixels );
+	}
+	Sys_FreeMemory( soft.wallTextures );
+
+	for ( unsigned int i = 0; i < plArrayElements( soft.flats ); ++i ) {
+		Sys_FreeMemory( soft.flats[ i ].pixels );
+	}
+
+	Sys_FreeMemory( soft.frameBuffer );
+	Sys_FreeMemory( soft.rgbaBuffer );
+
+	memset( &soft, 0, sizeof( soft ) );
+}
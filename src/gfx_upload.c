@@ -0,0 +1,432 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "gfx.h"
+#include "gfx_gl.h"
+#include "prof.h"
+
+/* texels are staged in a ring that loaders can write into from any
+ * thread. the main thread then issues a bounded amount of that each
+ * frame and fences every batch, so we know when the gpu has finished
+ * reading from that part of the ring. without persistent mapping the
+ * ring is plain system memory, but we still get the per-frame budget.
+ * anything slow to produce, like decoding a picture, can be handed to
+ * the loader thread, which fills in the texels straight in the ring */
+
+#define GFX_MAX_UPLOADS          512
+#define GFX_UPLOAD_WAIT_TIMEOUT  1000000000ULL /* ns */
+
+typedef enum GfxUploadState {
+	GFX_UPLOAD_STATE_WRITING,   /* loader is still filling in the texels */
+	GFX_UPLOAD_STATE_QUEUED,    /* waiting to be issued */
+	GFX_UPLOAD_STATE_IN_FLIGHT, /* issued, waiting on the fence */
+} GfxUploadState;
+
+struct GfxUpload {
+	GfxUploadState state;
+	size_t         offset;
+	size_t         size;
+	unsigned int   width;
+	unsigned int   height;
+	PLTexture      **destination;
+	GLsync         fence; /* only set on the last upload of each batch */
+};
+
+/* uploads hold onto ring memory in the order they were begun, and the
+ * first numIssuedUploads of them are in flight */
+static GfxUpload    uploads[ GFX_MAX_UPLOADS ];
+static unsigned int firstUpload      = 0;
+static unsigned int numUploads       = 0;
+static unsigned int numIssuedUploads = 0;
+
+/* uploads waiting on the loader to fill them in, in the order they were queued */
+typedef struct GfxUploadJob {
+	GfxUpload             *upload;
+	GfxUploadFillFunction Fill;
+	void                  *userData;
+} GfxUploadJob;
+
+static struct {
+	SysThread    *thread;
+	SysMutex     *mutex;
+	SysCondition *jobCondition;  /* signalled whenever a job is queued */
+	SysCondition *idleCondition; /* broadcast once the queue runs dry */
+	GfxUploadJob jobs[ GFX_MAX_UPLOADS ];
+	unsigned int firstJob;
+	unsigned int numJobs;
+	bool         isBusy; /* part way through a job */
+	bool         isRunning;
+} uploadLoader;
+
+static SysMutex *uploadMutex = NULL;
+static GLuint   ringBuffer   = 0;
+static uint8_t  *ringMemory  = NULL;
+static size_t   ringHead     = 0; /* where the next upload is staged */
+static size_t   ringTail     = 0; /* start of the oldest upload */
+
+#define Gfx_GetUpload( i ) ( &uploads[ ( firstUpload + ( i ) ) % GFX_MAX_UPLOADS ] )
+
+/* expects the mutex to be held */
+static bool Gfx_AllocateRingSpace( size_t size, size_t *offset ) {
+	if ( numUploads == 0 ) {
+		ringHead = ringTail = 0;
+	}
+
+	if ( numUploads == 0 || ringHead > ringTail ) {
+		if ( ringHead + size <= GFX_UPLOAD_RING_SIZE ) {
+			*offset = ringHead;
+		} else if ( size <= ringTail ) {
+			/* wrap around, leaving the end of the ring unused */
+			*offset = 0;
+		} else {
+			return false;
+		}
+	} else if ( ringHead + size <= ringTail ) {
+		*offset = ringHead;
+	} else {
+		return false;
+	}
+
+	ringHead = *offset + size;
+
+	return true;
+}
+
+/* returns NULL if there's no room, in which case the caller should
+ * upload the texture itself. once uploaded, the texture replaces
+ * whatever destination points to, so destination needs to stay valid
+ * until then, or be cancelled. safe to call from any thread */
+GfxUpload *Gfx_BeginTextureUpload( PLTexture **destination, unsigned int width, unsigned int height ) {
+	if ( uploadMutex == NULL ) {
+		return NULL;
+	}
+
+	size_t size = ( size_t ) width * height * sizeof( PLColour );
+	if ( size == 0 || size > GFX_UPLOAD_RING_SIZE ) {
+		return NULL;
+	}
+
+	Sys_LockMutex( uploadMutex );
+
+	GfxUpload *upload = NULL;
+	size_t offset;
+	if ( numUploads < GFX_MAX_UPLOADS && Gfx_AllocateRingSpace( size, &offset ) ) {
+		upload = Gfx_GetUpload( numUploads++ );
+		upload->state       = GFX_UPLOAD_STATE_WRITING;
+		upload->offset      = offset;
+		upload->size        = size;
+		upload->width       = width;
+		upload->height      = height;
+		upload->destination = destination;
+		upload->fence       = NULL;
+	}
+
+	Sys_UnlockMutex( uploadMutex );
+
+	return upload;
+}
+
+/* rgba texels go here, width * height of them */
+uint8_t *Gfx_GetUploadBuffer( GfxUpload *upload ) {
+	return ringMemory + upload->offset;
+}
+
+/* marks the texels as written, so the upload can be issued */
+void Gfx_EndTextureUpload( GfxUpload *upload ) {
+	Sys_LockMutex( uploadMutex );
+	upload->state = GFX_UPLOAD_STATE_QUEUED;
+	Sys_UnlockMutex( uploadMutex );
+}
+
+static void Gfx_UploadLoaderThread( void *userData ) {
+	u_unused( userData );
+
+	Sys_LockMutex( uploadLoader.mutex );
+	for ( ;; ) {
+		while ( uploadLoader.isRunning && uploadLoader.numJobs == 0 ) {
+			Sys_WaitCondition( uploadLoader.jobCondition, uploadLoader.mutex );
+		}
+
+		/* whatever's left is still finished off before stopping, so nothing leaks */
+		if ( uploadLoader.numJobs == 0 ) {
+			break;
+		}
+
+		GfxUploadJob job = uploadLoader.jobs[ uploadLoader.firstJob ];
+		uploadLoader.firstJob = ( uploadLoader.firstJob + 1 ) % GFX_MAX_UPLOADS;
+		uploadLoader.numJobs--;
+		uploadLoader.isBusy = true;
+		Sys_UnlockMutex( uploadLoader.mutex );
+
+		Prof_BeginTrace( "Gfx_FillUpload" );
+		job.Fill( Gfx_GetUploadBuffer( job.upload ), job.userData );
+		Gfx_EndTextureUpload( job.upload );
+		Prof_EndTrace( "Gfx_FillUpload" );
+
+		Sys_LockMutex( uploadLoader.mutex );
+		uploadLoader.isBusy = false;
+		if ( uploadLoader.numJobs == 0 ) {
+			Sys_BroadcastCondition( uploadLoader.idleCondition );
+		}
+	}
+	Sys_UnlockMutex( uploadLoader.mutex );
+}
+
+/* hands the upload over to the loader thread, which calls Fill with
+ * the upload's texels and then ends it; Fill owns userData from here */
+void Gfx_QueueTextureUpload( GfxUpload *upload, GfxUploadFillFunction Fill, void *userData ) {
+	/* every job holds an upload that's still being written, so this can't overflow */
+	Sys_LockMutex( uploadLoader.mutex );
+	assert( uploadLoader.numJobs < GFX_MAX_UPLOADS );
+	GfxUploadJob *job = &uploadLoader.jobs[ ( uploadLoader.firstJob + uploadLoader.numJobs ) % GFX_MAX_UPLOADS ];
+	job->upload   = upload;
+	job->Fill     = Fill;
+	job->userData = userData;
+	uploadLoader.numJobs++;
+	Sys_SignalCondition( uploadLoader.jobCondition );
+	Sys_UnlockMutex( uploadLoader.mutex );
+}
+
+static void Gfx_WaitForUploadLoader( void ) {
+	Sys_LockMutex( uploadLoader.mutex );
+	while ( uploadLoader.numJobs > 0 || uploadLoader.isBusy ) {
+		Sys_WaitCondition( uploadLoader.idleCondition, uploadLoader.mutex );
+	}
+	Sys_UnlockMutex( uploadLoader.mutex );
+}
+
+/* drops any pending uploads into destination, including ones the
+ * loader is still filling in; main thread only */
+void Gfx_CancelTextureUploads( PLTexture **destination ) {
+	if ( uploadMutex == NULL ) {
+		return;
+	}
+
+	Sys_LockMutex( uploadMutex );
+	for ( unsigned int i = numIssuedUploads; i < numUploads; ++i ) {
+		GfxUpload *upload = Gfx_GetUpload( i );
+		if ( upload->destination == destination ) {
+			upload->destination = NULL;
+		}
+	}
+	Sys_UnlockMutex( uploadMutex );
+}
+
+/* frees up ring memory for any batches the gpu has finished with */
+static void Gfx_RetireUploads( bool wait ) {
+	Sys_LockMutex( uploadMutex );
+
+	while ( numIssuedUploads > 0 ) {
+		unsigned int batchSize = 0;
+		GfxUpload *last;
+		do {
+			last = Gfx_GetUpload( batchSize++ );
+		} while ( last->fence == NULL && batchSize < numIssuedUploads );
+
+		/* no fence means it came straight out of system memory */
+		if ( last->fence != NULL ) {
+			GLenum result = gfxGL.ClientWaitSync( last->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			                                      wait ? GFX_UPLOAD_WAIT_TIMEOUT : 0 );
+			if ( result == GL_TIMEOUT_EXPIRED ) {
+				break;
+			}
+
+			gfxGL.DeleteSync( last->fence );
+			last->fence = NULL;
+		}
+
+		firstUpload = ( firstUpload + batchSize ) % GFX_MAX_UPLOADS;
+		numUploads -= batchSize;
+		numIssuedUploads -= batchSize;
+	}
+
+	if ( numUploads > 0 ) {
+		ringTail = Gfx_GetUpload( 0 )->offset;
+	}
+
+	Sys_UnlockMutex( uploadMutex );
+}
+
+/* issues queued uploads in order, up to the given number of bytes;
+ * at least one always goes through, so nothing can get stuck */
+static void Gfx_IssueUploads( size_t budget ) {
+	Sys_LockMutex( uploadMutex );
+
+	unsigned int firstIssue = numIssuedUploads;
+	unsigned int numIssue = 0;
+	size_t numBytes = 0;
+	while ( firstIssue + numIssue < numUploads ) {
+		GfxUpload *upload = Gfx_GetUpload( firstIssue + numIssue );
+		if ( upload->state != GFX_UPLOAD_STATE_QUEUED || ( numIssue > 0 && numBytes + upload->size > budget ) ) {
+			break;
+		}
+
+		numBytes += upload->size;
+		numIssue++;
+	}
+
+	Sys_UnlockMutex( uploadMutex );
+
+	if ( numIssue == 0 ) {
+		return;
+	}
+
+	Prof_BeginTrace( "Gfx_IssueUploads" );
+
+	/* go through the platform library first, so it doesn't lose track of what's bound */
+	plSetTexture( NULL, 0 );
+
+	if ( ringBuffer != 0 ) {
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, ringBuffer );
+	}
+
+	for ( unsigned int i = 0; i < numIssue; ++i ) {
+		/* only the main thread touches destinations */
+		GfxUpload *upload = Gfx_GetUpload( firstIssue + i );
+		if ( upload->destination == NULL ) {
+			continue;
+		}
+
+		PLTexture *texture = plCreateTexture();
+		if ( texture == NULL ) {
+			PrintError( "Failed to create texture!\nPL: %s\n", plGetError() );
+		}
+
+		texture->flags |= PL_TEXTURE_FLAG_NOMIPS;
+		texture->filter = PL_TEXTURE_FILTER_NEAREST;
+		texture->format = PL_IMAGEFORMAT_RGBA8;
+		texture->w      = upload->width;
+		texture->h      = upload->height;
+		texture->size   = upload->size;
+
+		glBindTexture( GL_TEXTURE_2D, texture->internal.id );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0 );
+
+		/* with a buffer bound, the pointer is an offset into it */
+		const void *pixels = ( ringBuffer != 0 ) ? ( const void * ) ( uintptr_t ) upload->offset : ringMemory + upload->offset;
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, ( GLsizei ) upload->width, ( GLsizei ) upload->height, 0,
+		              GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+
+		Gfx_ReplaceTexture( upload->destination, texture );
+	}
+
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	GLsync fence = NULL;
+	if ( ringBuffer != 0 ) {
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		fence = gfxGL.FenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	}
+
+	Sys_LockMutex( uploadMutex );
+	for ( unsigned int i = 0; i < numIssue; ++i ) {
+		Gfx_GetUpload( firstIssue + i )->state = GFX_UPLOAD_STATE_IN_FLIGHT;
+	}
+	Gfx_GetUpload( firstIssue + numIssue - 1 )->fence = fence;
+	numIssuedUploads += numIssue;
+	Sys_UnlockMutex( uploadMutex );
+
+	Prof_EndTrace( "Gfx_IssueUploads" );
+}
+
+/* called once per frame, before anything is drawn */
+void Gfx_ProcessUploads( void ) {
+	if ( uploadMutex == NULL ) {
+		return;
+	}
+
+	Gfx_RetireUploads( false );
+	Gfx_IssueUploads( GFX_UPLOAD_FRAME_BUDGET );
+}
+
+/* issues everything that's queued and waits on it, for loading screens */
+void Gfx_FlushUploads( void ) {
+	if ( uploadMutex == NULL ) {
+		return;
+	}
+
+	Gfx_WaitForUploadLoader();
+	Gfx_IssueUploads( SIZE_MAX );
+	Gfx_RetireUploads( true );
+}
+
+void Gfx_InitializeUploads( void ) {
+	uploadMutex = Sys_CreateMutex();
+
+	if ( gfxGL.hasBufferStorage ) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		gfxGL.GenBuffers( 1, &ringBuffer );
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, ringBuffer );
+		gfxGL.BufferStorage( GL_PIXEL_UNPACK_BUFFER, GFX_UPLOAD_RING_SIZE, NULL, flags );
+		ringMemory = gfxGL.MapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, GFX_UPLOAD_RING_SIZE, flags );
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+		if ( ringMemory == NULL ) {
+			PrintWarn( "Failed to map the upload ring, falling back to system memory!\n" );
+			gfxGL.DeleteBuffers( 1, &ringBuffer );
+			ringBuffer = 0;
+		}
+	}
+
+	if ( ringMemory == NULL ) {
+		ringMemory = Sys_AllocateTaggedMemory( 1, GFX_UPLOAD_RING_SIZE, SYS_MEMORY_TAG_GFX );
+	}
+
+	PrintMsg( "Staging texture uploads through %s (%dKB)\n",
+	          ringBuffer != 0 ? "a persistent buffer" : "system memory", GFX_UPLOAD_RING_SIZE / 1024 );
+
+	uploadLoader.mutex         = Sys_CreateMutex();
+	uploadLoader.jobCondition  = Sys_CreateCondition();
+	uploadLoader.idleCondition = Sys_CreateCondition();
+	uploadLoader.isRunning     = true;
+	uploadLoader.thread        = Sys_CreateThread( "Gfx_UploadLoader", Gfx_UploadLoaderThread, NULL );
+}
+
+static void Gfx_StopUploadLoader( void ) {
+	if ( uploadLoader.thread == NULL ) {
+		return;
+	}
+
+	Sys_LockMutex( uploadLoader.mutex );
+	uploadLoader.isRunning = false;
+	Sys_SignalCondition( uploadLoader.jobCondition );
+	Sys_UnlockMutex( uploadLoader.mutex );
+
+	Sys_JoinThread( uploadLoader.thread );
+
+	Sys_DestroyCondition( uploadLoader.idleCondition );
+	Sys_DestroyCondition( uploadLoader.jobCondition );
+	Sys_DestroyMutex( uploadLoader.mutex );
+
+	memset( &uploadLoader, 0, sizeof( uploadLoader ) );
+}
+
+void Gfx_ShutdownUploads( void ) {
+	if ( uploadMutex == NULL ) {
+		return;
+	}
+
+	Gfx_StopUploadLoader();
+
+	/* anything that hasn't been issued yet has nowhere to go */
+	Gfx_RetireUploads( true );
+	firstUpload = numUploads = numIssuedUploads = 0;
+
+	if ( ringBuffer != 0 ) {
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, ringBuffer );
+		gfxGL.UnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+		gfxGL.BindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		gfxGL.DeleteBuffers( 1, &ringBuffer );
+		ringBuffer = 0;
+	} else {
+		Sys_FreeMemory( ringMemory );
+	}
+	ringMemory = NULL;
+
+	Sys_DestroyMutex( uploadMutex );
+	uploadMutex = NULL;
+}
@@ -7,6 +7,53 @@
 #include "gfx.h"
 #include "act.h"
 #include "game.h"
+#include "prof.h"
+#include "wad.h"
+
+#include <stdatomic.h>
+
+/* regions are groups of neighbouring areas, whose segments are built
+ * on a worker thread as the player gets close and thrown away again
+ * once they're far enough away or we're over budget. this only bounds
+ * the segment cache that drawing walks, it doesn't let a map be bigger
+ * than memory: the raw points, lines, line indices and things stay
+ * resident for the whole map, and the blockmap and navigation grid each
+ * hold onto every wall, as traces and flow fields span the whole map.
+ * nothing outside of Map_UpdateStreaming ever waits on a region */
+
+typedef enum MapRegionState {
+	MAP_REGION_UNLOADED,
+	MAP_REGION_QUEUED,
+	MAP_REGION_LOADING,
+	MAP_REGION_RESIDENT,
+} MapRegionState;
+
+typedef struct MapRegion {
+	unsigned int firstArea;
+	unsigned int numAreas;
+	unsigned int numSegments;
+	int          max[ 2 ];
+	int          min[ 2 ];
+	float        distance; /* from the player, as of the last update */
+	MapSegment   *segments;
+	atomic_int   state;
+	bool         isQueued; /* has an entry in the streaming queue, guarded by its mutex */
+} MapRegion;
+
+static struct {
+	SysThread     *thread;
+	SysMutex      *mutex;
+	SysCondition  *requestCondition;
+	SysCondition  *loadedCondition;
+	unsigned int  *queue;
+	unsigned int  queueHead;
+	unsigned int  numQueued;
+	bool          isRunning;
+	size_t        budget;
+	atomic_size_t residentBytes;
+} mapStreamer;
+
+static bool isStreamingThreadEnabled = true; /* applies from the next load */
 
 static struct {
 	MapArea      *areas;
@@ -15,6 +62,13 @@ static struct {
 	unsigned int numPoints;
 	MapLine      *lines;
 	unsigned int numLines;
+	uint16_t     *lineIndices; /* per area, indexed by firstLine */
+	unsigned int numSegments;
+	MapRegion    *regions;
+	unsigned int numRegions;
+	unsigned int *regionAreas; /* per region, indexed by firstArea */
+	char         name[ 16 ];
+	unsigned int lumpIndices[ MAX_MAP_LUMPS ];
 } mapData = {
 		.points    = NULL,
 		.numPoints = 0,
@@ -22,100 +76,252 @@ static struct {
 		.numLines  = 0,
 };
 
-static void Map_LoadPoints( PLPackage *wad ) {
-	PLFile *filePtr = plLoadPackageFile( wad, "M_POINTS" );
-	if ( filePtr == NULL ) {
-		PrintError( "Failed to find point data!\nPL: %s\n", plGetError() );
+#define MAP_POINT_RECORD_SIZE 8
+#define MAP_LINE_RECORD_SIZE  20
+#define MAP_AREA_HEADER_SIZE  10
+
+/* maps are namespaced by a marker lump (i.e. "MAP01") followed by
+ * their own set of lumps, in any order; older wads without a marker
+ * can only hold the one map */
+
+static const char *mapLumpNames[ MAX_MAP_LUMPS ] = {
+		[ MAP_LUMP_POINTS ] = "M_POINTS",
+		[ MAP_LUMP_LINES  ] = "M_LINES",
+		[ MAP_LUMP_AREAS  ] = "M_AREAS",
+		[ MAP_LUMP_THINGS ] = "M_THINGS",
+};
+
+/* returns MAX_MAP_LUMPS if the lump isn't part of a map */
+static MapLump Map_GetLumpType( const char *lumpName ) {
+	for ( unsigned int i = 0; i < MAX_MAP_LUMPS; ++i ) {
+		if ( strcmp( lumpName, mapLumpNames[ i ] ) == 0 ) {
+			return ( MapLump ) i;
+		}
 	}
 
-	bool status;
-	mapData.numPoints = plReadInt32( filePtr, false, &status );
-	mapData.points = Sys_AllocateMemory( mapData.numPoints, sizeof( MapPoint ) );
-	for ( unsigned int i = 0; i < mapData.numPoints; ++i ) {
-		/* flipped so they match up with what we need */
-		mapData.points[ i ].y = ( int16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 ) * 2;
-		mapData.points[ i ].x = ( int16_t ) ( plReadInt32( filePtr, false, &status ) >> 16 ) * 2;
+	return MAX_MAP_LUMPS;
+}
+
+/* a marker only counts if it's directly followed by every one of the map's lumps */
+static bool Map_FindLumpsAfterMarker( PLPackage *wad, unsigned int markerIndex, unsigned int lumpIndices[ MAX_MAP_LUMPS ] ) {
+	bool isFound[ MAX_MAP_LUMPS ] = { false };
+	for ( unsigned int i = 0; i < MAX_MAP_LUMPS; ++i ) {
+		const char *lumpName = plGetPackageFileName( wad, markerIndex + 1 + i );
+		if ( lumpName == NULL ) {
+			return false;
+		}
+
+		MapLump lump = Map_GetLumpType( lumpName );
+		if ( lump == MAX_MAP_LUMPS || isFound[ lump ] ) {
+			return false;
+		}
+
+		lumpIndices[ lump ] = markerIndex + 1 + i;
+		isFound[ lump ]     = true;
 	}
 
-	plCloseFile( filePtr );
+	return true;
 }
 
-static void Map_LoadLines( PLPackage *wad ) {
-	PLFile *filePtr = plLoadPackageFile( wad, "M_LINES" );
-	if ( filePtr == NULL ) {
-		PrintError( "Failed to find line data!\nPL: %s\n", plGetError() );
+/* pass NULL for mapName to use the first set of lumps in the wad */
+static bool Map_FindLumps( PLPackage *wad, const char *mapName, unsigned int lumpIndices[ MAX_MAP_LUMPS ] ) {
+	if ( mapName == NULL ) {
+		for ( unsigned int i = 0; i < MAX_MAP_LUMPS; ++i ) {
+			if ( !Wad_FindLump( wad, mapLumpNames[ i ], &lumpIndices[ i ] ) ) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	unsigned int markerIndex;
+	if ( !Wad_FindLump( wad, mapName, &markerIndex ) ) {
+		return false;
+	}
+
+	return Map_FindLumpsAfterMarker( wad, markerIndex, lumpIndices );
+}
+
+bool Map_Exists( PLPackage *wad, const char *mapName ) {
+	unsigned int lumpIndices[ MAX_MAP_LUMPS ];
+	return Map_FindLumps( wad, mapName, lumpIndices );
+}
+
+/* returns the marker of the map after the given one, wrapping around to
+ * the start of the wad; NULL if the wad doesn't have any markers */
+const char *Map_GetNextMapName( PLPackage *wad, const char *mapName ) {
+	unsigned int startIndex = 0;
+	unsigned int mapIndex;
+	if ( mapName != NULL && Wad_FindLump( wad, mapName, &mapIndex ) ) {
+		startIndex = mapIndex + 1;
 	}
 
-	bool status;
-	mapData.numLines = plReadInt32( filePtr, false, &status );
+	/* two passes, so we wrap back around */
+	for ( unsigned int pass = 0; pass < 2; ++pass ) {
+		const char *lumpName;
+		for ( unsigned int i = ( pass == 0 ) ? startIndex : 0; ( lumpName = plGetPackageFileName( wad, i ) ) != NULL; ++i ) {
+			unsigned int lumpIndices[ MAX_MAP_LUMPS ];
+			if ( Map_FindLumpsAfterMarker( wad, i, lumpIndices ) ) {
+				return lumpName;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static uint8_t *Map_LoadLump( PLPackage *wad, MapLump lump, size_t *size ) {
+	uint8_t *data = Wad_LoadLumpByIndex( wad, mapData.lumpIndices[ lump ], Sys_GetLoadArena(), size );
+	if ( data == NULL ) {
+		PrintError( "Failed to load map data (%s)!\n", mapLumpNames[ lump ] );
+	}
+
+	return data;
+}
+
+static void Map_LoadPoints( PLPackage *wad ) {
+	size_t size;
+	const uint8_t *data = Map_LoadLump( wad, MAP_LUMP_POINTS, &size );
+
+	mapData.numPoints = Wad_GetLumpRecordCount( data, size, MAP_POINT_RECORD_SIZE, "M_POINTS" );
+	mapData.points = Sys_AllocateTaggedMemory( mapData.numPoints, sizeof( MapPoint ), SYS_MEMORY_TAG_MAP );
+
+	const uint8_t *record = data + sizeof( uint32_t );
+	for ( unsigned int i = 0; i < mapData.numPoints; ++i, record += MAP_POINT_RECORD_SIZE ) {
+		/* flipped so they match up with what we need */
+		mapData.points[ i ].y = Wad_GetFixedInteger( record ) * 2;
+		mapData.points[ i ].x = Wad_GetFixedInteger( record + 4 ) * 2;
+	}
+}
+
+static void Map_LoadLines( PLPackage *wad ) {
+	size_t size;
+	const uint8_t *data = Map_LoadLump( wad, MAP_LUMP_LINES, &size );
+
+	mapData.numLines = Wad_GetLumpRecordCount( data, size, MAP_LINE_RECORD_SIZE, "M_LINES" );
 	if( mapData.numLines == 0 ) {
-		PrintError( "Invalid line count provided in WAD!\nPL: %s\n", plGetError() );
+		PrintError( "Invalid line count provided in WAD!\n" );
 	}
 
-	mapData.lines = Sys_AllocateMemory( mapData.numLines, sizeof( MapLine ) );
-	for ( unsigned int i = 0; i < mapData.numLines; ++i ) {
-		mapData.lines[ i ].startVertex  = plReadInt16( filePtr, false, &status );
-		if ( mapData.lines[ i ].startVertex >= mapData.numPoints ) {
+	mapData.lines = Sys_AllocateTaggedMemory( mapData.numLines, sizeof( MapLine ), SYS_MEMORY_TAG_MAP );
+
+	const uint8_t *record = data + sizeof( uint32_t );
+	for ( unsigned int i = 0; i < mapData.numLines; ++i, record += MAP_LINE_RECORD_SIZE ) {
+		MapLine *line = &mapData.lines[ i ];
+		line->startVertex  = Wad_GetUInt16( record );
+		line->endVertex    = Wad_GetUInt16( record + 2 );
+		line->flags        = Wad_GetUInt16( record + 4 );
+		line->unknown0     = Wad_GetUInt16( record + 6 );
+		line->colSomething = Wad_GetUInt16( record + 8 );
+		line->unknown1     = record[ 10 ];
+		line->hScale       = record[ 11 ];
+		line->unknown2     = Wad_GetUInt16( record + 12 );
+		line->unknown3     = Wad_GetUInt32( record + 14 );
+		line->unknown4     = Wad_GetUInt16( record + 18 );
+
+		if ( line->startVertex >= mapData.numPoints ) {
 			PrintError( "Invalid start vertex for line %d!\n", i );
 		}
 
-		mapData.lines[ i ].endVertex    = plReadInt16( filePtr, false, &status );
-		if ( mapData.lines[ i ].endVertex >= mapData.numPoints ) {
+		if ( line->endVertex >= mapData.numPoints ) {
 			PrintError( "Invalid end vertex for line %d!\n", i );
 		}
-
-		mapData.lines[ i ].flags        = plReadInt16( filePtr, false, &status );
-		mapData.lines[ i ].unknown0     = plReadInt16( filePtr, false, &status );
-		mapData.lines[ i ].colSomething = plReadInt16( filePtr, false, &status );
-		mapData.lines[ i ].unknown1     = plReadInt8( filePtr, &status );
-		mapData.lines[ i ].hScale       = plReadInt8( filePtr, &status );
-		mapData.lines[ i ].unknown2     = plReadInt16( filePtr, false, &status );
-		mapData.lines[ i ].unknown3     = plReadInt32( filePtr, false, &status );
-		mapData.lines[ i ].unknown4     = plReadInt16( filePtr, false, &status );
 	}
+}
 
-	if( !status ) {
-		PrintError( "Failed to load line data from WAD!\nPL: %s\n", plGetError() );
-	}
+static void Map_BuildSegment( MapSegment *segment, unsigned int lineIndex ) {
+	const MapLine *line = &mapData.lines[ lineIndex ];
+	const MapPoint *startPoint = &mapData.points[ line->startVertex ];
+	const MapPoint *endPoint = &mapData.points[ line->endVertex ];
+
+	segment->start        = PLVector2( startPoint->x, startPoint->y );
+	segment->end          = PLVector2( endPoint->x, endPoint->y );
+	segment->normal       = plComputeLineNormal( &segment->start, &segment->end );
+	segment->textureIndex = MAP_DEFAULT_WALL_TEXTURE;
+	segment->lineIndex    = ( uint16_t ) lineIndex;
 
-	plCloseFile( filePtr );
+	float dx = segment->end.x - segment->start.x;
+	float dy = segment->end.y - segment->start.y;
+	segment->length = sqrtf( dx * dx + dy * dy );
 }
 
-void Map_LoadAreas( PLPackage *wad ) {
-	PLFile *filePtr = plLoadPackageFile( wad, "M_AREAS" );
-	if ( filePtr == NULL ) {
-		PrintError( "Failed to load area data!\nPL: %s\n", plGetError() );
+static void Map_LoadAreas( PLPackage *wad ) {
+	size_t size;
+	const uint8_t *data = Map_LoadLump( wad, MAP_LUMP_AREAS, &size );
+	if ( size < sizeof( uint32_t ) ) {
+		PrintError( "Truncated \"M_AREAS\" lump (%zu bytes)!\n", size );
 	}
 
-	bool status;
-	mapData.numAreas = plReadInt32( filePtr, false, &status );
-	mapData.areas = Sys_AllocateMemory( mapData.numAreas, sizeof( MapArea ) );
+	/* every area needs at least its header, so reject a bogus count before allocating for it */
+	mapData.numAreas = Wad_GetUInt32( data );
+	if ( mapData.numAreas > ( size - sizeof( uint32_t ) ) / MAP_AREA_HEADER_SIZE ) {
+		PrintError( "Truncated \"M_AREAS\" lump, %d areas won't fit in %zu bytes!\n", mapData.numAreas, size );
+	}
+
+	mapData.areas = Sys_AllocateTaggedMemory( mapData.numAreas, sizeof( MapArea ), SYS_MEMORY_TAG_MAP );
+
+	/* areas are variable length, so walk through and validate them
+	 * all first, so we know how many line indices there are */
+	const uint8_t *cur = data + sizeof( uint32_t );
+	const uint8_t *end = data + size;
+
+	mapData.numSegments = 0;
 	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		if ( ( size_t ) ( end - cur ) < MAP_AREA_HEADER_SIZE ) {
+			PrintError( "Truncated \"M_AREAS\" lump at area %d!\n", i );
+		}
+
 		MapArea *area = &mapData.areas[ i ];
-		area->unknown0 = plReadInt32( filePtr, false, &status );
-		area->unused0  = plReadInt16( filePtr, false, &status );
-		area->unused1  = plReadInt16( filePtr, false, &status );
-		area->numLines = plReadInt16( filePtr, false, &status );
+		area->unknown0    = Wad_GetUInt32( cur );
+		area->unused0     = Wad_GetUInt16( cur + 4 );
+		area->unused1     = Wad_GetUInt16( cur + 6 );
+		area->numSegments = Wad_GetUInt16( cur + 8 );
+		area->firstLine   = mapData.numSegments;
+		cur += MAP_AREA_HEADER_SIZE;
 
-		/* generate a list of all our line indices */
-		area->lineIndices = Sys_AllocateMemory( mapData.areas[ i ].numLines, sizeof( unsigned int ) );
+		if ( ( size_t ) ( end - cur ) < area->numSegments * sizeof( uint16_t ) ) {
+			PrintError( "Truncated \"M_AREAS\" lump at area %d!\n", i );
+		}
 
-		area->max[ 0 ] = area->max[ 1 ] = INT32_MIN;
-		area->min[ 0 ] = area->min[ 1 ] = INT32_MAX;
+		cur += area->numSegments * sizeof( uint16_t );
+
+		mapData.numSegments += area->numSegments;
+	}
 
-		for ( unsigned int j = 0; j < mapData.areas[ i ].numLines; ++j ) {
-			mapData.areas[ i ].lineIndices[ j ] = plReadInt16( filePtr, false, &status );
-			if ( mapData.areas[ i ].lineIndices[ j ] >= mapData.numLines ) {
-				PrintError( "Invalid line index %d in area %d!\n", mapData.areas[ i ].lineIndices[ j ], i );
+	/* the indices are kept around, so regions can be rebuilt from them */
+	mapData.lineIndices = Sys_AllocateTaggedMemory( mapData.numSegments, sizeof( uint16_t ), SYS_MEMORY_TAG_MAP );
+
+	cur = data + sizeof( uint32_t );
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		const MapArea *area = &mapData.areas[ i ];
+		cur += MAP_AREA_HEADER_SIZE;
+		for ( unsigned int j = 0; j < area->numSegments; ++j, cur += sizeof( uint16_t ) ) {
+			uint16_t lineIndex = Wad_GetUInt16( cur );
+			if ( lineIndex >= mapData.numLines ) {
+				PrintError( "Invalid line index %d in area %d!\n", lineIndex, i );
 			}
 
-			MapLine *curLine = &mapData.lines[ mapData.areas[ i ].lineIndices[ j ] ];
+			mapData.lineIndices[ area->firstLine + j ] = lineIndex;
+		}
+	}
+}
+
+/* bounds come from wherever the area's lines currently are */
+static void Map_CalculateAreaBounds( void ) {
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		MapArea *area = &mapData.areas[ i ];
+		area->max[ 0 ] = area->max[ 1 ] = INT32_MIN;
+		area->min[ 0 ] = area->min[ 1 ] = INT32_MAX;
 
-			/* calculate the area bounds */
-			const MapPoint *points[ 2 ];
-			points[ 0 ] = &mapData.points[ curLine->startVertex ];
-			points[ 1 ] = &mapData.points[ curLine->endVertex ];
+		if ( area->numSegments == 0 ) {
+			area->max[ 0 ] = area->max[ 1 ] = area->min[ 0 ] = area->min[ 1 ] = 0;
+			continue;
+		}
 
+		for ( unsigned int j = 0; j < area->numSegments; ++j ) {
+			const MapLine *line = &mapData.lines[ mapData.lineIndices[ area->firstLine + j ] ];
+			const MapPoint *points[ 2 ] = { &mapData.points[ line->startVertex ], &mapData.points[ line->endVertex ] };
 			for ( unsigned int k = 0; k < 2; ++k ) {
 				if ( points[ k ]->x > area->max[ 0 ] ) {
 					area->max[ 0 ] = points[ k ]->x;
@@ -133,31 +339,617 @@ void Map_LoadAreas( PLPackage *wad ) {
 					area->min[ 1 ] = points[ k ]->y;
 				}
 			}
+		}
+	}
+}
+
+static void Map_CalculateRegionBounds( void ) {
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		MapRegion *region = &mapData.regions[ i ];
+		region->max[ 0 ] = region->max[ 1 ] = INT32_MIN;
+		region->min[ 0 ] = region->min[ 1 ] = INT32_MAX;
+
+		for ( unsigned int j = 0; j < region->numAreas; ++j ) {
+			const MapArea *area = &mapData.areas[ mapData.regionAreas[ region->firstArea + j ] ];
+			for ( unsigned int k = 0; k < 2; ++k ) {
+				if ( area->max[ k ] > region->max[ k ] ) {
+					region->max[ k ] = area->max[ k ];
+				}
+
+				if ( area->min[ k ] < region->min[ k ] ) {
+					region->min[ k ] = area->min[ k ];
+				}
+			}
+		}
+	}
+}
+
+/* buckets the areas into regions on a coarse grid, by their centres */
+static void Map_SetupRegions( void ) {
+	int mapMin[ 2 ] = { INT32_MAX, INT32_MAX };
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		for ( unsigned int k = 0; k < 2; ++k ) {
+			if ( mapData.areas[ i ].min[ k ] < mapMin[ k ] ) {
+				mapMin[ k ] = mapData.areas[ i ].min[ k ];
+			}
+		}
+	}
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	/* first figure out which cell each area falls into */
+	unsigned int *areaCells = Sys_ArenaAllocate( arena, mapData.numAreas, sizeof( unsigned int ) );
+	unsigned int numColumns = 1, numRows = 1;
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		const MapArea *area = &mapData.areas[ i ];
+		unsigned int column = ( unsigned int ) ( ( ( area->min[ 0 ] + area->max[ 0 ] ) / 2 - mapMin[ 0 ] ) / MAP_REGION_SIZE );
+		unsigned int row = ( unsigned int ) ( ( ( area->min[ 1 ] + area->max[ 1 ] ) / 2 - mapMin[ 1 ] ) / MAP_REGION_SIZE );
+		if ( column + 1 > numColumns ) {
+			numColumns = column + 1;
+		}
+		if ( row + 1 > numRows ) {
+			numRows = row + 1;
+		}
+
+		areaCells[ i ] = row << 16 | column;
+	}
+
+	unsigned int numCells = numColumns * numRows;
+	unsigned int *cellRegions = Sys_ArenaAllocate( arena, numCells, sizeof( unsigned int ) );
+	for ( unsigned int i = 0; i < numCells; ++i ) {
+		cellRegions[ i ] = UINT32_MAX;
+	}
+
+	/* then create a region for every cell that's actually used */
+	mapData.regions = Sys_AllocateTaggedMemory( mapData.numAreas, sizeof( MapRegion ), SYS_MEMORY_TAG_MAP );
+	mapData.numRegions = 0;
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		unsigned int cell = ( areaCells[ i ] >> 16 ) * numColumns + ( areaCells[ i ] & 0xFFFF );
+		if ( cellRegions[ cell ] == UINT32_MAX ) {
+			MapRegion *region = &mapData.regions[ mapData.numRegions ];
+			atomic_init( &region->state, MAP_REGION_UNLOADED );
+
+			cellRegions[ cell ] = mapData.numRegions++;
+		}
+
+		areaCells[ i ] = cellRegions[ cell ];
+		mapData.regions[ areaCells[ i ] ].numAreas++;
+	}
+
+	unsigned int firstArea = 0;
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		mapData.regions[ i ].firstArea = firstArea;
+		firstArea += mapData.regions[ i ].numAreas;
+		mapData.regions[ i ].numAreas = 0;
+	}
+
+	/* finally, slot the areas into their regions */
+	mapData.regionAreas = Sys_AllocateTaggedMemory( mapData.numAreas, sizeof( unsigned int ), SYS_MEMORY_TAG_MAP );
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		MapArea *area = &mapData.areas[ i ];
+		MapRegion *region = &mapData.regions[ areaCells[ i ] ];
+		mapData.regionAreas[ region->firstArea + region->numAreas++ ] = i;
+
+		area->region = areaCells[ i ];
+		area->firstSegment = region->numSegments;
+		region->numSegments += area->numSegments;
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Map_CalculateRegionBounds();
+
+	PrintMsg( "Map split into %d regions\n", mapData.numRegions );
+}
+
+/* may be called from either the main or streaming thread, but only
+ * by whoever moved the region into the loading state */
+static void Map_BuildRegion( MapRegion *region ) {
+	Prof_BeginTrace( "Map_BuildRegion" );
 
-			/* generate the normal for this particular face */
-			curLine->normal = plComputeLineNormal( &PLVector2( points[ 0 ]->x, points[ 0 ]->y ), &PLVector2( points[ 1 ]->x, points[ 1 ]->y ) );
+	MapSegment *segments = Sys_AllocateTaggedMemory( region->numSegments, sizeof( MapSegment ), SYS_MEMORY_TAG_MAP );
+	for ( unsigned int i = 0; i < region->numAreas; ++i ) {
+		const MapArea *area = &mapData.areas[ mapData.regionAreas[ region->firstArea + i ] ];
+		for ( unsigned int j = 0; j < area->numSegments; ++j ) {
+			Map_BuildSegment( &segments[ area->firstSegment + j ], mapData.lineIndices[ area->firstLine + j ] );
 		}
 	}
 
-	plCloseFile( filePtr );
+	atomic_fetch_add( &mapStreamer.residentBytes, region->numSegments * sizeof( MapSegment ) );
+
+	region->segments = segments;
+	atomic_store_explicit( &region->state, MAP_REGION_RESIDENT, memory_order_release );
+
+	Prof_EndTrace( "Map_BuildRegion" );
+}
+
+static bool Map_IsRegionResident( const MapRegion *region ) {
+	return atomic_load_explicit( &region->state, memory_order_acquire ) == MAP_REGION_RESIDENT;
+}
+
+/* claims the region for building if nobody else has yet */
+static bool Map_ClaimRegion( MapRegion *region, MapRegionState expectedState ) {
+	int state = expectedState;
+	return atomic_compare_exchange_strong( &region->state, &state, MAP_REGION_LOADING );
+}
+
+static void Map_StreamingThread( void *userData ) {
+	u_unused( userData );
+
+	Sys_LockMutex( mapStreamer.mutex );
+	for ( ;; ) {
+		while ( mapStreamer.isRunning && mapStreamer.numQueued == 0 ) {
+			Sys_WaitCondition( mapStreamer.requestCondition, mapStreamer.mutex );
+		}
+
+		if ( !mapStreamer.isRunning ) {
+			break;
+		}
+
+		unsigned int regionIndex = mapStreamer.queue[ mapStreamer.queueHead ];
+		mapStreamer.queueHead = ( mapStreamer.queueHead + 1 ) % mapData.numRegions;
+		mapStreamer.numQueued--;
+
+		MapRegion *region = &mapData.regions[ regionIndex ];
+		region->isQueued = false;
+		Sys_UnlockMutex( mapStreamer.mutex );
+
+		/* the main thread may have already taken this on itself */
+		if ( Map_ClaimRegion( region, MAP_REGION_QUEUED ) ) {
+			Map_BuildRegion( region );
+		}
+
+		Sys_LockMutex( mapStreamer.mutex );
+		Sys_BroadcastCondition( mapStreamer.loadedCondition );
+	}
+	Sys_UnlockMutex( mapStreamer.mutex );
+}
+
+static void Map_QueueRegion( unsigned int regionIndex ) {
+	MapRegion *region = &mapData.regions[ regionIndex ];
+	int state = MAP_REGION_UNLOADED;
+	if ( !atomic_compare_exchange_strong( &region->state, &state, MAP_REGION_QUEUED ) ) {
+		return;
+	}
+
+	/* the main thread can claim a queued region, evict it and queue it
+	 * again before the worker gets to the old entry; that entry will
+	 * pick it up all the same, so each region is only ever in the queue
+	 * once and the queue can't overflow */
+	Sys_LockMutex( mapStreamer.mutex );
+	if ( !region->isQueued ) {
+		assert( mapStreamer.numQueued < mapData.numRegions );
+		mapStreamer.queue[ ( mapStreamer.queueHead + mapStreamer.numQueued ) % mapData.numRegions ] = regionIndex;
+		mapStreamer.numQueued++;
+		region->isQueued = true;
+		Sys_SignalCondition( mapStreamer.requestCondition );
+	}
+	Sys_UnlockMutex( mapStreamer.mutex );
+}
+
+/* builds the region right away if nobody's got to it yet. if the
+ * streaming thread is already part way through it, it'll be there
+ * by the next frame, so that's left to finish rather than waited on */
+static void Map_RequireRegion( unsigned int regionIndex ) {
+	MapRegion *region = &mapData.regions[ regionIndex ];
+	if ( Map_IsRegionResident( region ) ) {
+		return;
+	}
+
+	if ( Map_ClaimRegion( region, MAP_REGION_UNLOADED ) || Map_ClaimRegion( region, MAP_REGION_QUEUED ) ) {
+		Map_BuildRegion( region );
+	}
+}
+
+/* only safe from the main thread, as that's the only one reading segments */
+static void Map_EvictRegion( MapRegion *region ) {
+	int state = MAP_REGION_RESIDENT;
+	if ( !atomic_compare_exchange_strong( &region->state, &state, MAP_REGION_UNLOADED ) ) {
+		return;
+	}
+
+	Sys_FreeMemory( region->segments );
+	region->segments = NULL;
+
+	atomic_fetch_sub( &mapStreamer.residentBytes, region->numSegments * sizeof( MapSegment ) );
+}
+
+static float Map_GetDistanceToRegion( const MapRegion *region, const PLVector2 *position ) {
+	float dx = 0.0f, dy = 0.0f;
+	if ( position->x < region->min[ 0 ] ) {
+		dx = region->min[ 0 ] - position->x;
+	} else if ( position->x > region->max[ 0 ] ) {
+		dx = position->x - region->max[ 0 ];
+	}
+
+	if ( position->y < region->min[ 1 ] ) {
+		dy = region->min[ 1 ] - position->y;
+	} else if ( position->y > region->max[ 1 ] ) {
+		dy = position->y - region->max[ 1 ];
+	}
+
+	return sqrtf( dx * dx + dy * dy );
 }
 
-void Map_Load( PLPackage *wad ) {
+/* should be called every tick with wherever the player is */
+void Map_UpdateStreaming( const PLVector2 *position ) {
+	if ( mapData.numRegions == 0 ) {
+		return;
+	}
+
+	unsigned int closestRegion = 0;
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		MapRegion *region = &mapData.regions[ i ];
+		region->distance = Map_GetDistanceToRegion( region, position );
+		if ( region->distance < mapData.regions[ closestRegion ].distance ) {
+			closestRegion = i;
+		}
+
+		if ( region->distance <= MAP_STREAM_LOAD_DISTANCE ) {
+			/* don't bother if it'd only get thrown away again */
+			if ( atomic_load( &mapStreamer.residentBytes ) + region->numSegments * sizeof( MapSegment ) <= mapStreamer.budget ) {
+				Map_QueueRegion( i );
+			}
+		} else if ( region->distance > MAP_STREAM_EVICT_DISTANCE ) {
+			Map_EvictRegion( region );
+		}
+	}
+
+	/* whatever we're standing in has to be there */
+	Map_RequireRegion( closestRegion );
+
+	/* and if that's still too much, drop whatever's furthest away */
+	while ( atomic_load( &mapStreamer.residentBytes ) > mapStreamer.budget ) {
+		MapRegion *furthestRegion = NULL;
+		for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+			MapRegion *region = &mapData.regions[ i ];
+			if ( i == closestRegion || !Map_IsRegionResident( region ) ) {
+				continue;
+			}
+
+			if ( furthestRegion == NULL || region->distance > furthestRegion->distance ) {
+				furthestRegion = region;
+			}
+		}
+
+		if ( furthestRegion == NULL ) {
+			break;
+		}
+
+		Map_EvictRegion( furthestRegion );
+	}
+}
+
+/* without the thread, only the region the player's in gets built,
+ * there and then; for anything that loads maps without playing them */
+void Map_SetStreamingThreadEnabled( bool isEnabled ) {
+	isStreamingThreadEnabled = isEnabled;
+}
+
+static void Map_StartStreaming( void ) {
+	mapStreamer.budget = MAP_STREAM_DEFAULT_BUDGET;
+
+	const char *budgetArg = plGetCommandLineArgumentValue( "-streambudget" );
+	if ( budgetArg != NULL ) {
+		mapStreamer.budget = strtoul( budgetArg, NULL, 10 ) * 1024;
+	}
+
+	atomic_init( &mapStreamer.residentBytes, 0 );
+
+	mapStreamer.queue            = Sys_AllocateTaggedMemory( mapData.numRegions, sizeof( unsigned int ), SYS_MEMORY_TAG_MAP );
+	mapStreamer.queueHead        = 0;
+	mapStreamer.numQueued        = 0;
+	mapStreamer.mutex            = Sys_CreateMutex();
+	mapStreamer.requestCondition = Sys_CreateCondition();
+	mapStreamer.loadedCondition  = Sys_CreateCondition();
+	mapStreamer.isRunning        = true;
+	if ( isStreamingThreadEnabled ) {
+		mapStreamer.thread = Sys_CreateThread( "Map_Streaming", Map_StreamingThread, NULL );
+	}
+}
+
+static void Map_StopStreaming( void ) {
+	if ( mapStreamer.mutex == NULL ) {
+		return;
+	}
+
+	if ( mapStreamer.thread != NULL ) {
+		Sys_LockMutex( mapStreamer.mutex );
+		mapStreamer.isRunning = false;
+		Sys_SignalCondition( mapStreamer.requestCondition );
+		Sys_UnlockMutex( mapStreamer.mutex );
+
+		Sys_JoinThread( mapStreamer.thread );
+	}
+
+	Sys_DestroyCondition( mapStreamer.loadedCondition );
+	Sys_DestroyCondition( mapStreamer.requestCondition );
+	Sys_DestroyMutex( mapStreamer.mutex );
+	Sys_FreeMemory( mapStreamer.queue );
+
+	memset( &mapStreamer, 0, sizeof( mapStreamer ) );
+}
+
+/* navigation and traces need every wall at once, regardless
+ * of what ends up streamed in, so they build their own copies */
+static void Map_BuildWalls( void ) {
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	MapSegment *walls = Sys_ArenaAllocate( arena, mapData.numLines, sizeof( MapSegment ) );
+	for ( unsigned int i = 0; i < mapData.numLines; ++i ) {
+		Map_BuildSegment( &walls[ i ], i );
+	}
+	Map_BuildNavigation( walls, mapData.numLines );
+	Map_BuildBlockmap( walls, mapData.numLines );
+
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+/* textures and sprites are shared between maps, so only what's
+ * specific to the map itself gets loaded here */
+static void Map_LoadGeometry( PLPackage *wad ) {
+	/* lumps are only needed until everything's decoded */
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
 	Map_LoadPoints( wad );
 	Map_LoadLines( wad );
 	Map_LoadAreas( wad );
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	Map_CalculateAreaBounds();
+	Map_SetupRegions();
+	Map_BuildWalls();
+
+	Map_StartStreaming();
+}
+
+static void Map_FreeRegions( void ) {
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		Sys_FreeMemory( mapData.regions[ i ].segments );
+	}
+
+	Sys_FreeMemory( mapData.regionAreas );
+	Sys_FreeMemory( mapData.regions );
+	mapData.regionAreas = NULL;
+	mapData.regions     = NULL;
+	mapData.numRegions  = 0;
+}
+
+static void Map_FreeGeometry( void ) {
+	Map_StopStreaming();
+	Map_FreeNavigation();
+	Map_FreeBlockmap();
+	Map_FreeRegions();
+
+	Sys_FreeMemory( mapData.lineIndices );
+	Sys_FreeMemory( mapData.areas );
+	Sys_FreeMemory( mapData.lines );
+	Sys_FreeMemory( mapData.points );
+}
+
+/* stops the streaming thread from building anything else, waiting on
+ * whatever it's in the middle of, so the raw geometry can be swapped
+ * out from under it. anything queued is dropped back to unloaded, so
+ * its old entries in the queue are simply skipped over */
+static void Map_DrainStreaming( void ) {
+	Sys_LockMutex( mapStreamer.mutex );
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		int state = MAP_REGION_QUEUED;
+		atomic_compare_exchange_strong( &mapData.regions[ i ].state, &state, MAP_REGION_UNLOADED );
+	}
+
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		while ( atomic_load( &mapData.regions[ i ].state ) == MAP_REGION_LOADING ) {
+			Sys_WaitCondition( mapStreamer.loadedCondition, mapStreamer.mutex );
+		}
+	}
+	Sys_UnlockMutex( mapStreamer.mutex );
+
+	for ( unsigned int i = 0; i < mapData.numRegions; ++i ) {
+		Map_EvictRegion( &mapData.regions[ i ] );
+	}
+}
+
+static bool Map_AreLinesValid( void ) {
+	for ( unsigned int i = 0; i < mapData.numLines; ++i ) {
+		if ( mapData.lines[ i ].startVertex >= mapData.numPoints || mapData.lines[ i ].endVertex >= mapData.numPoints ) {
+			PrintWarn( "Line %d refers to a point that no longer exists!\n", i );
+			return false;
+		}
+	}
+
+	for ( unsigned int i = 0; i < mapData.numSegments; ++i ) {
+		if ( mapData.lineIndices[ i ] >= mapData.numLines ) {
+			PrintWarn( "Areas refer to line %d, which no longer exists!\n", mapData.lineIndices[ i ] );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* points and lines are swapped in underneath the existing regions, which
+ * are then built again as they're needed, so the streaming thread keeps
+ * going throughout. anything that'd leave the rest of the map pointing
+ * at something that's gone is rejected, keeping what we had before */
+static void Map_ReloadPointsOrLines( MapLump lump ) {
+	Map_DrainStreaming();
+
+	MapPoint *oldPoints = mapData.points;
+	unsigned int oldNumPoints = mapData.numPoints;
+	MapLine *oldLines = mapData.lines;
+	unsigned int oldNumLines = mapData.numLines;
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+	if ( lump == MAP_LUMP_POINTS ) {
+		Map_LoadPoints( globalWad );
+	} else {
+		Map_LoadLines( globalWad );
+	}
+	Sys_ResetArenaToMark( arena, mark );
+
+	if ( !Map_AreLinesValid() ) {
+		PrintWarn( "Ignoring changes to \"%s\", they don't match the rest of the map\n", mapLumpNames[ lump ] );
+		Sys_FreeMemory( lump == MAP_LUMP_POINTS ? ( void * ) mapData.points : ( void * ) mapData.lines );
+		mapData.points    = oldPoints;
+		mapData.numPoints = oldNumPoints;
+		mapData.lines     = oldLines;
+		mapData.numLines  = oldNumLines;
+		return;
+	}
+
+	Sys_FreeMemory( lump == MAP_LUMP_POINTS ? ( void * ) oldPoints : ( void * ) oldLines );
+
+	/* areas keep the regions they were given at load */
+	Map_CalculateAreaBounds();
+	Map_CalculateRegionBounds();
+
+	Map_FreeNavigation();
+	Map_FreeBlockmap();
+	Map_BuildWalls();
+}
+
+/* areas decide how the map's split into regions, so those all have
+ * to be set up again, along with the streaming thread */
+static void Map_ReloadAreas( void ) {
+	Map_StopStreaming();
+	Map_FreeRegions();
+	Map_FreeNavigation();
+	Map_FreeBlockmap();
+
+	Sys_FreeMemory( mapData.lineIndices );
+	Sys_FreeMemory( mapData.areas );
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+	Map_LoadAreas( globalWad );
+	Sys_ResetArenaToMark( arena, mark );
+
+	Map_CalculateAreaBounds();
+	Map_SetupRegions();
+	Map_BuildWalls();
+
+	Map_StartStreaming();
+}
+
+/* only whatever lump changed is loaded again, along with anything
+ * built from it; regions then get streamed back in around the player */
+static bool Map_ReloadLump( const char *lumpName, unsigned int lumpIndex ) {
+	u_unused( lumpName );
+
+	if ( mapData.numAreas == 0 ) {
+		return false;
+	}
+
+	if ( lumpIndex == mapData.lumpIndices[ MAP_LUMP_THINGS ] ) {
+		PrintWarn( "Things for \"%s\" changed, reload the map to respawn them\n", mapData.name );
+		return true;
+	}
+
+	Prof_BeginTrace( "Map_ReloadLump" );
+
+	bool isHandled = true;
+	if ( lumpIndex == mapData.lumpIndices[ MAP_LUMP_POINTS ] ) {
+		Map_ReloadPointsOrLines( MAP_LUMP_POINTS );
+	} else if ( lumpIndex == mapData.lumpIndices[ MAP_LUMP_LINES ] ) {
+		Map_ReloadPointsOrLines( MAP_LUMP_LINES );
+	} else if ( lumpIndex == mapData.lumpIndices[ MAP_LUMP_AREAS ] ) {
+		Map_ReloadAreas();
+	} else {
+		isHandled = false;
+	}
+
+	Prof_EndTrace( "Map_ReloadLump" );
+
+	return isHandled;
+}
+
+/* textures and sprites are shared between maps, so only what's
+ * specific to the map itself gets loaded here */
+void Map_Load( PLPackage *wad, const char *mapName ) {
+	Prof_BeginTrace( "Map_Load" );
+
+	static bool isReloadRegistered = false;
+	if ( !isReloadRegistered ) {
+		Wad_RegisterReloadHandler( Map_ReloadLump );
+		isReloadRegistered = true;
+	}
+
+	if ( !Map_FindLumps( wad, mapName, mapData.lumpIndices ) ) {
+		PrintError( "Failed to find map \"%s\"!\n", mapName != NULL ? mapName : mapLumpNames[ MAP_LUMP_POINTS ] );
+	}
+
+	snprintf( mapData.name, sizeof( mapData.name ), "%s", mapName != NULL ? mapName : "" );
+
+	Map_LoadGeometry( wad );
+
+	Prof_EndTrace( "Map_Load" );
+}
+
+void Map_Unload( void ) {
+	Map_FreeGeometry();
+
+	memset( &mapData, 0, sizeof( mapData ) );
+}
+
+/* empty for wads that only hold the one map */
+const char *Map_GetName( void ) {
+	return mapData.name;
+}
+
+unsigned int Map_GetLumpIndex( MapLump lump ) {
+	return mapData.lumpIndices[ lump ];
+}
+
+unsigned int Map_GetNumAreas( void ) {
+	return mapData.numAreas;
+}
+
+const MapArea *Map_GetArea( unsigned int index ) {
+	if ( index >= mapData.numAreas ) {
+		return NULL;
+	}
+
+	return &mapData.areas[ index ];
+}
+
+/* returns NULL if the area's region hasn't been streamed in */
+const MapSegment *Map_GetAreaSegments( unsigned int index, unsigned int *numSegments ) {
+	*numSegments = 0;
+	if ( index >= mapData.numAreas ) {
+		return NULL;
+	}
+
+	const MapArea *area = &mapData.areas[ index ];
+	const MapRegion *region = &mapData.regions[ area->region ];
+	if ( !Map_IsRegionResident( region ) ) {
+		return NULL;
+	}
+
+	*numSegments = area->numSegments;
+	return &region->segments[ area->firstSegment ];
 }
 
 bool Map_CheckCollisions( const PLCollisionAABB *bounds, unsigned int curArea ) {
-	const MapArea *area = &mapData.areas[ curArea ];
-	for( unsigned int j = 0; j < area->numLines; ++j ) {
-		MapLine  *line = &mapData.lines[ area->lineIndices[ j ] ];
-		MapPoint *startPoint = &mapData.points[ line->startVertex ];
-		MapPoint *endPoint = &mapData.points[ line->endVertex ];
+	if ( curArea >= mapData.numAreas ) {
+		return false;
+	}
 
-		//bool hit = plIsAABBIntersectingLine( bounds, &PLVector2( startPoint->x, startPoint->y ), &PLVector2( endPoint->x, endPoint->y ), &line->normal );
+	/* only ever looks at what's already streamed in, as the player's
+	 * own region is kept resident by Map_UpdateStreaming */
+	unsigned int numSegments;
+	const MapSegment *segments = Map_GetAreaSegments( curArea, &numSegments );
+	for( unsigned int j = 0; j < numSegments; ++j ) {
+		const MapSegment *segment = &segments[ j ];
+
+		//bool hit = plIsAABBIntersectingLine( bounds, &segment->start, &segment->end, &segment->normal );
 		float hitValue;
-		bool hit = plIsPointIntersectingLine( &PLVector2( bounds->origin.x, bounds->origin.z ), &PLVector2( startPoint->x, startPoint->y ), &PLVector2( endPoint->x, endPoint->y ), &line->normal, &hitValue );
+		bool hit = plIsPointIntersectingLine( &PLVector2( bounds->origin.x, bounds->origin.z ), &segment->start, &segment->end, &segment->normal, &hitValue );
 		if( hit ) {
 			//PrintMsg( "HIT: %f\n", hitValue );
 			//return true;
@@ -169,6 +961,47 @@ bool Map_CheckCollisions( const PLCollisionAABB *bounds, unsigned int curArea )
 	return false;
 }
 
+/* walls waiting to be drawn this frame, so they can be sorted */
+typedef struct MapDrawWall {
+	const MapSegment *segment;
+	GfxOcclusionSpan span;
+} MapDrawWall;
+
+static int Map_CompareDrawWalls( const void *a, const void *b ) {
+	float depthA = ( ( const MapDrawWall * ) a )->span.minDepth;
+	float depthB = ( ( const MapDrawWall * ) b )->span.minDepth;
+	return ( depthA > depthB ) - ( depthA < depthB );
+}
+
+static void Map_DrawWall( const MapSegment *segment, unsigned int wallHeight ) {
+	/* in the long term this should obviously all just get batched... */
+	plDrawTexturedQuad(
+			&PLVector3( segment->start.x, wallHeight, segment->start.y ),
+			&PLVector3( segment->end.x, wallHeight, segment->end.y ),
+			&PLVector3( segment->start.x, 0, segment->start.y ),
+			&PLVector3( segment->end.x, 0, segment->end.y ),
+			2, 2,
+			Gfx_GetWallTexture( segment->textureIndex )
+	);
+	Prof_CountDrawCall();
+
+#ifdef DEBUG_WALL_NORMALS
+	Gfx_EnableShaderProgram( SHADER_GENERIC );
+
+	PLVector2 linePos;
+	linePos = plAddVector2( segment->start, segment->end );
+	linePos = plDivideVector2f( &linePos, 2.0f );
+	
+	PLVector2 lineEndPos;
+	lineEndPos = plAddVector2( linePos, plScaleVector2f( &segment->normal, 64.0f ) );
+
+	PLMatrix4 transform = plMatrix4Identity();
+	plDrawSimpleLine( &transform, &PLVector3( linePos.x, 16.0f, linePos.y ), &PLVector3( lineEndPos.x, 16.0f, lineEndPos.y ), &PLColour( 255, 0, 0, 255 ) );
+
+	Gfx_EnableShaderProgram( SHADER_LIT );
+#endif
+}
+
 void Map_Draw( void ) {
 	/* fetch the local player so we can perform vis testing */
 	Actor *player = Gam_GetPlayer();
@@ -178,51 +1011,80 @@ void Map_Draw( void ) {
 
 	Gfx_EnableShaderProgram( SHADER_LIT );
 
-	/* prototype only supports a single wall texture at a time */
-	PLTexture *wallTexture = Gfx_GetWallTexture( 20 );
-	unsigned int wallHeight = wallTexture->h * 2;
+	/* prototype only supports a single wall height at a time */
+	unsigned int wallHeight = Gfx_GetWallTexture( MAP_DEFAULT_WALL_TEXTURE )->h * 2;
 
+	unsigned int maxWalls = 0;
 	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
-		const MapArea *area = &mapData.areas[ i ];
-		for ( unsigned int j = 0; j < area->numLines; ++j ) {
-			MapPoint *startPoint = &mapData.points[ mapData.lines[ area->lineIndices[ j ] ].startVertex ];
-			MapPoint *endPoint = &mapData.points[ mapData.lines[ area->lineIndices[ j ] ].endVertex ];
+		maxWalls += mapData.areas[ i ].numSegments;
+	}
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+	MapDrawWall *walls = Sys_ArenaAllocate( arena, maxWalls, sizeof( MapDrawWall ) );
+	unsigned int numWalls = 0;
+
+	bool isOccluding = Gfx_IsOcclusionEnabled();
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		unsigned int numSegments;
+		const MapSegment *segments = Map_GetAreaSegments( i, &numSegments );
+		if ( segments == NULL ) {
+			continue;
+		}
+
+		for ( unsigned int j = 0; j < numSegments; ++j ) {
+			const MapSegment *segment = &segments[ j ];
 
 			/* ensure the wall is visible before we draw it */
-			bool aVisible = Player_IsPointVisible( player, &PLVector2( startPoint->x, startPoint->y ) );
-			bool bVisible = Player_IsPointVisible( player, &PLVector2( endPoint->x, endPoint->y ) );
+			bool aVisible = Player_IsPointVisible( player, &segment->start );
+			bool bVisible = Player_IsPointVisible( player, &segment->end );
 			if ( !aVisible && !bVisible ) {
 				continue;
 			}
 
-			/* in the long term this should obviously all just get batched... */
-			plDrawTexturedQuad(
-					&PLVector3( startPoint->x, wallHeight, startPoint->y ),
-					&PLVector3( endPoint->x, wallHeight, endPoint->y ),
-					&PLVector3( startPoint->x, 0, startPoint->y ),
-					&PLVector3( endPoint->x, 0, endPoint->y ),
-					2, 2,
-					wallTexture
-			);
+			MapDrawWall *wall = &walls[ numWalls ];
+			wall->segment = segment;
+			if ( isOccluding && !Gfx_ProjectWall( &segment->start, &segment->end, &wall->span ) ) {
+				continue;
+			}
 
-#ifdef DEBUG_WALL_NORMALS
-			Gfx_EnableShaderProgram( SHADER_GENERIC );
+			numWalls++;
+		}
+	}
 
-			PLVector2 linePos;
-			linePos = plAddVector2( PLVector2( startPoint->x, startPoint->y ), PLVector2( endPoint->x, endPoint->y ) );
-			linePos = plDivideVector2f( &linePos, 2.0f );
-			
-			PLVector2 lineEndPos;
-			lineEndPos = plAddVector2( linePos, plScaleVector2f( &mapData.lines[ area->lineIndices[ j ] ].normal, 64.0f ) );
+	/* front to back, so the nearest walls hide as much as possible */
+	if ( isOccluding ) {
+		qsort( walls, numWalls, sizeof( MapDrawWall ), Map_CompareDrawWalls );
+	}
 
-			PLMatrix4 transform = plMatrix4Identity();
-			plDrawSimpleLine( &transform, &PLVector3( linePos.x, 16.0f, linePos.y ), &PLVector3( lineEndPos.x, 16.0f, lineEndPos.y ), &PLColour( 255, 0, 0, 255 ) );
+	for ( unsigned int i = 0; i < numWalls; ++i ) {
+		if ( isOccluding ) {
+			if ( Gfx_IsSpanOccluded( &walls[ i ].span ) ) {
+				continue;
+			}
 
-			Gfx_EnableShaderProgram( SHADER_LIT );
-#endif
+			Gfx_AddOccluder( &walls[ i ].span );
+		}
+
+		Map_DrawWall( walls[ i ].segment, wallHeight );
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	/* draw the ceiling and floor; these come last, so every wall
+	 * that could be in front of them is in the buffer by now */
+	for ( unsigned int i = 0; i < mapData.numAreas; ++i ) {
+		const MapArea *area = &mapData.areas[ i ];
+
+		unsigned int numSegments;
+		if ( Map_GetAreaSegments( i, &numSegments ) == NULL ) {
+			continue;
+		}
+
+		if ( Gfx_IsBoxOccluded( area->min[ 0 ], area->min[ 1 ], area->max[ 0 ], area->max[ 1 ] ) ) {
+			continue;
 		}
 
-		/* draw the ceiling and floor */
 		plDrawTexturedQuad(
 				&PLVector3( area->max[ 0 ], 0.0f, area->max[ 1 ] ),
 				&PLVector3( area->min[ 0 ], 0.0f, area->max[ 1 ] ),
@@ -231,6 +1093,7 @@ void Map_Draw( void ) {
 				2, 2,
 				Gfx_GetFloorTexture( 0 )
 		);
+		Prof_CountDrawCall();
 #ifndef DEBUG_CAM
 		plDrawTexturedQuad(
 				&PLVector3( area->max[ 0 ], wallHeight, area->max[ 1 ] ),
@@ -240,6 +1103,7 @@ void Map_Draw( void ) {
 				2, 2,
 				Gfx_GetFloorTexture( 1 )
 		);
+		Prof_CountDrawCall();
 #endif
 	}
 }
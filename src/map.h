@@ -19,21 +19,87 @@ typedef struct MapLine {
 	uint16_t unknown2;
 	uint32_t unknown3;
 	uint16_t unknown4;
+} MapLine;
+
+/* walls only use the one texture for now, as we've yet
+ * to figure out where the line records store theirs */
+#define MAP_DEFAULT_WALL_TEXTURE 20
 
+/* runtime form of a line, resolved at load so that drawing and
+ * collision can walk an area without chasing any indices */
+typedef struct MapSegment {
+	PLVector2 start;
+	PLVector2 end;
 	PLVector2 normal;
-} MapLine;
+	float     length;
+	uint16_t  textureIndex;
+	uint16_t  lineIndex; /* back to the raw line, for tools */
+} MapSegment;
 
 typedef struct MapArea {
 	uint32_t     unknown0;
 	uint16_t     unused0;
 	uint16_t     unused1;
-	unsigned int numLines;
-	unsigned int *lineIndices;
+	unsigned int region;
+	unsigned int firstSegment; /* within the region */
+	unsigned int firstLine;
+	unsigned int numSegments;
 	int          max[ 2 ]; /* boundary maximum */
 	int          min[ 2 ]; /* boundary minimum */
 } MapArea;
 
-void Map_Load( PLPackage *wad );
+#define MAP_REGION_SIZE            1024
+#define MAP_STREAM_LOAD_DISTANCE   1536.0f
+#define MAP_STREAM_EVICT_DISTANCE  2560.0f
+#define MAP_STREAM_DEFAULT_BUDGET  ( 4 * 1024 * 1024 ) /* bytes of built segments, override with -streambudget <kb> */
+
+#define MAP_NAV_CELL_SIZE      64
+#define MAP_NAV_CELLS_PER_TICK 4096 /* most of a field's search we'll do in one tick */
+
+#define MAP_BLOCK_SIZE    128
+#define MAP_TRACE_NO_LINE UINT32_MAX
+
+typedef struct MapTrace {
+	PLVector2    start;
+	PLVector2    end;
+	float        fraction;  /* of the way to the end before hitting anything */
+	unsigned int lineIndex; /* MAP_TRACE_NO_LINE if nothing was hit */
+	PLVector2    normal;    /* of the line hit, facing back along the trace */
+} MapTrace;
+
+typedef enum MapLump {
+	MAP_LUMP_POINTS,
+	MAP_LUMP_LINES,
+	MAP_LUMP_AREAS,
+	MAP_LUMP_THINGS,
+
+	MAX_MAP_LUMPS
+} MapLump;
+
+bool       Map_Exists( PLPackage *wad, const char *mapName );
+const char *Map_GetNextMapName( PLPackage *wad, const char *mapName );
+
+void         Map_Load( PLPackage *wad, const char *mapName );
+const char   *Map_GetName( void );
+unsigned int Map_GetLumpIndex( MapLump lump );
+void Map_Unload( void );
 void Map_Draw( void );
 
+void Map_UpdateStreaming( const PLVector2 *position );
+void Map_SetStreamingThreadEnabled( bool isEnabled );
+
+void Map_BuildNavigation( const MapSegment *walls, unsigned int numWalls );
+void Map_FreeNavigation( void );
+void Map_UpdateNavigation( const PLVector2 *target );
+bool Map_GetNavDirection( const PLVector2 *position, PLVector2 *direction );
+
+void Map_BuildBlockmap( const MapSegment *walls, unsigned int numWalls );
+void Map_FreeBlockmap( void );
+void Map_TraceLine( MapTrace *trace );
+void Map_TraceLines( MapTrace *traces, unsigned int numTraces );
+
+unsigned int     Map_GetNumAreas( void );
+const MapArea    *Map_GetArea( unsigned int index );
+const MapSegment *Map_GetAreaSegments( unsigned int index, unsigned int *numSegments );
+
 bool Map_CheckCollisions( const PLCollisionAABB *bounds, unsigned int curArea );
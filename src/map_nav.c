@@ -0,0 +1,370 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "map.h"
+#include "prof.h"
+
+/* shared navigation for anything chasing the player. the map is covered
+ * by a coarse grid, each cell belonging to the smallest area over its
+ * centre, and steps between cells are closed off by walls or by areas
+ * that don't touch. one flow field points every cell along the shortest
+ * route to the player's cell, so monsters only have to look up where
+ * they're standing rather than each running their own search.
+ *
+ * the field is rebuilt whenever the player moves into another cell,
+ * a slice per tick into a back buffer that's swapped in once it's
+ * complete; monsters keep following the last one until then */
+
+#define MAP_NAV_NO_AREA      UINT16_MAX
+#define MAP_NAV_NO_CELL      UINT32_MAX
+#define MAP_NAV_NO_DIRECTION UINT8_MAX
+#define MAP_NAV_DIRECTIONS   8
+
+/* orthogonal steps are even, diagonals odd, and
+ * each step's opposite is four along */
+static const int navOffsets[ MAP_NAV_DIRECTIONS ][ 2 ] = {
+		{ 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 },
+		{ -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 },
+};
+
+#define MAP_NAV_DIAGONAL 0.70710678f
+
+static const PLVector2 navDirections[ MAP_NAV_DIRECTIONS ] = {
+		{ 1.0f, 0.0f }, { MAP_NAV_DIAGONAL, MAP_NAV_DIAGONAL }, { 0.0f, 1.0f }, { -MAP_NAV_DIAGONAL, MAP_NAV_DIAGONAL },
+		{ -1.0f, 0.0f }, { -MAP_NAV_DIAGONAL, -MAP_NAV_DIAGONAL }, { 0.0f, -1.0f }, { MAP_NAV_DIAGONAL, -MAP_NAV_DIAGONAL },
+};
+
+typedef struct MapNavField {
+	uint16_t     *distances; /* in steps, UINT16_MAX if unreachable */
+	uint8_t      *directions;
+	unsigned int targetCell;
+	bool         isValid;
+} MapNavField;
+
+static struct {
+	int          origin[ 2 ];
+	unsigned int numColumns;
+	unsigned int numRows;
+	unsigned int numCells;
+	uint16_t     *cellAreas;
+	uint8_t      *closedSteps; /* per cell, a bit for each direction that's walled off */
+
+	unsigned int numAreas;
+	unsigned int areaLinkStride; /* in words */
+	uint32_t     *areaLinks;     /* bit matrix of areas whose bounds touch */
+
+	MapNavField  fields[ 2 ];
+	unsigned int frontField;
+
+	/* breadth first search into the back field */
+	bool         isBuilding;
+	unsigned int *queue;
+	unsigned int queueHead;
+	unsigned int queueTail;
+} mapNav;
+
+static bool Map_AreAreasLinked( unsigned int a, unsigned int b ) {
+	if ( a == b ) {
+		return true;
+	}
+
+	return ( mapNav.areaLinks[ a * mapNav.areaLinkStride + b / 32 ] & ( 1u << ( b % 32 ) ) ) != 0;
+}
+
+static void Map_LinkAreas( unsigned int a, unsigned int b ) {
+	mapNav.areaLinks[ a * mapNav.areaLinkStride + b / 32 ] |= 1u << ( b % 32 );
+	mapNav.areaLinks[ b * mapNav.areaLinkStride + a / 32 ] |= 1u << ( a % 32 );
+}
+
+static unsigned int Map_GetNavCell( const PLVector2 *position ) {
+	if ( mapNav.numCells == 0 ) {
+		return MAP_NAV_NO_CELL;
+	}
+
+	int column = ( int ) floorf( ( position->x - mapNav.origin[ 0 ] ) / MAP_NAV_CELL_SIZE );
+	int row = ( int ) floorf( ( position->y - mapNav.origin[ 1 ] ) / MAP_NAV_CELL_SIZE );
+	if ( column < 0 || row < 0 || column >= ( int ) mapNav.numColumns || row >= ( int ) mapNav.numRows ) {
+		return MAP_NAV_NO_CELL;
+	}
+
+	return ( unsigned int ) row * mapNav.numColumns + ( unsigned int ) column;
+}
+
+static PLVector2 Map_GetNavCellCentre( int column, int row ) {
+	return PLVector2( mapNav.origin[ 0 ] + ( column + 0.5f ) * MAP_NAV_CELL_SIZE,
+	                  mapNav.origin[ 1 ] + ( row + 0.5f ) * MAP_NAV_CELL_SIZE );
+}
+
+static float Map_GetCrossProduct( const PLVector2 *origin, const PLVector2 *a, const PLVector2 *b ) {
+	return ( a->x - origin->x ) * ( b->y - origin->y ) - ( a->y - origin->y ) * ( b->x - origin->x );
+}
+
+/* touching counts, so a wall ending exactly on a step still closes it */
+static bool Map_DoLinesCross( const PLVector2 *a0, const PLVector2 *a1, const PLVector2 *b0, const PLVector2 *b1 ) {
+	float d0 = Map_GetCrossProduct( a0, a1, b0 );
+	float d1 = Map_GetCrossProduct( a0, a1, b1 );
+	float d2 = Map_GetCrossProduct( b0, b1, a0 );
+	float d3 = Map_GetCrossProduct( b0, b1, a1 );
+	return ( ( d0 <= 0.0f && d1 >= 0.0f ) || ( d0 >= 0.0f && d1 <= 0.0f ) ) &&
+	       ( ( d2 <= 0.0f && d3 >= 0.0f ) || ( d2 >= 0.0f && d3 <= 0.0f ) ) &&
+	       !( d0 == 0.0f && d1 == 0.0f ); /* parallel and in line with the step */
+}
+
+static void Map_SetupNavAreas( void ) {
+	for ( unsigned int i = 0; i < mapNav.numCells; ++i ) {
+		mapNav.cellAreas[ i ] = MAP_NAV_NO_AREA;
+	}
+
+	/* nested areas are common, so the smallest one wins */
+	for ( unsigned int i = 0; i < mapNav.numAreas; ++i ) {
+		const MapArea *area = Map_GetArea( i );
+		int64_t size = ( int64_t ) ( area->max[ 0 ] - area->min[ 0 ] ) * ( area->max[ 1 ] - area->min[ 1 ] );
+
+		int column0 = ( int ) ceilf( ( float ) ( area->min[ 0 ] - mapNav.origin[ 0 ] ) / MAP_NAV_CELL_SIZE - 0.5f );
+		int column1 = ( int ) floorf( ( float ) ( area->max[ 0 ] - mapNav.origin[ 0 ] ) / MAP_NAV_CELL_SIZE - 0.5f );
+		int row0 = ( int ) ceilf( ( float ) ( area->min[ 1 ] - mapNav.origin[ 1 ] ) / MAP_NAV_CELL_SIZE - 0.5f );
+		int row1 = ( int ) floorf( ( float ) ( area->max[ 1 ] - mapNav.origin[ 1 ] ) / MAP_NAV_CELL_SIZE - 0.5f );
+		for ( int row = ( row0 > 0 ) ? row0 : 0; row <= row1 && row < ( int ) mapNav.numRows; ++row ) {
+			for ( int column = ( column0 > 0 ) ? column0 : 0; column <= column1 && column < ( int ) mapNav.numColumns; ++column ) {
+				uint16_t *cellArea = &mapNav.cellAreas[ row * mapNav.numColumns + column ];
+				if ( *cellArea != MAP_NAV_NO_AREA ) {
+					const MapArea *other = Map_GetArea( *cellArea );
+					if ( ( int64_t ) ( other->max[ 0 ] - other->min[ 0 ] ) * ( other->max[ 1 ] - other->min[ 1 ] ) <= size ) {
+						continue;
+					}
+				}
+
+				*cellArea = ( uint16_t ) i;
+			}
+		}
+	}
+
+	for ( unsigned int i = 0; i < mapNav.numAreas; ++i ) {
+		const MapArea *a = Map_GetArea( i );
+		for ( unsigned int j = i + 1; j < mapNav.numAreas; ++j ) {
+			const MapArea *b = Map_GetArea( j );
+			if ( a->min[ 0 ] <= b->max[ 0 ] && b->min[ 0 ] <= a->max[ 0 ] &&
+			     a->min[ 1 ] <= b->max[ 1 ] && b->min[ 1 ] <= a->max[ 1 ] ) {
+				Map_LinkAreas( i, j );
+			}
+		}
+	}
+}
+
+/* only the four forward steps from each cell are tested, and
+ * closed off from both ends, as the rest belong to a neighbour */
+static void Map_CloseNavSteps( const MapSegment *walls, unsigned int numWalls ) {
+	for ( unsigned int i = 0; i < numWalls; ++i ) {
+		const MapSegment *wall = &walls[ i ];
+
+		int column0 = ( int ) floorf( ( fminf( wall->start.x, wall->end.x ) - mapNav.origin[ 0 ] ) / MAP_NAV_CELL_SIZE - 0.5f ) - 1;
+		int column1 = ( int ) floorf( ( fmaxf( wall->start.x, wall->end.x ) - mapNav.origin[ 0 ] ) / MAP_NAV_CELL_SIZE - 0.5f ) + 1;
+		int row0 = ( int ) floorf( ( fminf( wall->start.y, wall->end.y ) - mapNav.origin[ 1 ] ) / MAP_NAV_CELL_SIZE - 0.5f ) - 1;
+		int row1 = ( int ) floorf( ( fmaxf( wall->start.y, wall->end.y ) - mapNav.origin[ 1 ] ) / MAP_NAV_CELL_SIZE - 0.5f ) + 1;
+		for ( int row = ( row0 > 0 ) ? row0 : 0; row <= row1 && row < ( int ) mapNav.numRows; ++row ) {
+			for ( int column = ( column0 > 0 ) ? column0 : 0; column <= column1 && column < ( int ) mapNav.numColumns; ++column ) {
+				PLVector2 centre = Map_GetNavCellCentre( column, row );
+				for ( unsigned int direction = 0; direction < MAP_NAV_DIRECTIONS / 2; ++direction ) {
+					int nextColumn = column + navOffsets[ direction ][ 0 ];
+					int nextRow = row + navOffsets[ direction ][ 1 ];
+					if ( nextColumn < 0 || nextRow < 0 || nextColumn >= ( int ) mapNav.numColumns || nextRow >= ( int ) mapNav.numRows ) {
+						continue;
+					}
+
+					PLVector2 nextCentre = Map_GetNavCellCentre( nextColumn, nextRow );
+					if ( !Map_DoLinesCross( &centre, &nextCentre, &wall->start, &wall->end ) ) {
+						continue;
+					}
+
+					mapNav.closedSteps[ row * mapNav.numColumns + column ] |= 1u << direction;
+					mapNav.closedSteps[ nextRow * mapNav.numColumns + nextColumn ] |= 1u << ( direction + 4 );
+				}
+			}
+		}
+	}
+}
+
+void Map_BuildNavigation( const MapSegment *walls, unsigned int numWalls ) {
+	Prof_BeginTrace( "Map_BuildNavigation" );
+
+	memset( &mapNav, 0, sizeof( mapNav ) );
+
+	mapNav.numAreas = Map_GetNumAreas();
+	if ( mapNav.numAreas == 0 ) {
+		Prof_EndTrace( "Map_BuildNavigation" );
+		return;
+	}
+
+	if ( mapNav.numAreas >= MAP_NAV_NO_AREA ) {
+		PrintError( "Too many areas for navigation (%u)!\n", mapNav.numAreas );
+	}
+
+	int mapMin[ 2 ] = { INT32_MAX, INT32_MAX };
+	int mapMax[ 2 ] = { INT32_MIN, INT32_MIN };
+	for ( unsigned int i = 0; i < mapNav.numAreas; ++i ) {
+		const MapArea *area = Map_GetArea( i );
+		for ( unsigned int k = 0; k < 2; ++k ) {
+			if ( area->min[ k ] < mapMin[ k ] ) {
+				mapMin[ k ] = area->min[ k ];
+			}
+			if ( area->max[ k ] > mapMax[ k ] ) {
+				mapMax[ k ] = area->max[ k ];
+			}
+		}
+	}
+
+	mapNav.origin[ 0 ]  = mapMin[ 0 ];
+	mapNav.origin[ 1 ]  = mapMin[ 1 ];
+	mapNav.numColumns   = ( unsigned int ) ( mapMax[ 0 ] - mapMin[ 0 ] ) / MAP_NAV_CELL_SIZE + 1;
+	mapNav.numRows      = ( unsigned int ) ( mapMax[ 1 ] - mapMin[ 1 ] ) / MAP_NAV_CELL_SIZE + 1;
+	mapNav.numCells     = mapNav.numColumns * mapNav.numRows;
+	mapNav.cellAreas    = Sys_AllocateTaggedMemory( mapNav.numCells, sizeof( uint16_t ), SYS_MEMORY_TAG_MAP );
+	mapNav.closedSteps  = Sys_AllocateTaggedMemory( mapNav.numCells, sizeof( uint8_t ), SYS_MEMORY_TAG_MAP );
+	mapNav.queue        = Sys_AllocateTaggedMemory( mapNav.numCells, sizeof( unsigned int ), SYS_MEMORY_TAG_MAP );
+
+	mapNav.areaLinkStride = ( mapNav.numAreas + 31 ) / 32;
+	mapNav.areaLinks      = Sys_AllocateTaggedMemory( mapNav.numAreas * mapNav.areaLinkStride, sizeof( uint32_t ), SYS_MEMORY_TAG_MAP );
+
+	for ( unsigned int i = 0; i < 2; ++i ) {
+		mapNav.fields[ i ].distances  = Sys_AllocateTaggedMemory( mapNav.numCells, sizeof( uint16_t ), SYS_MEMORY_TAG_MAP );
+		mapNav.fields[ i ].directions = Sys_AllocateTaggedMemory( mapNav.numCells, sizeof( uint8_t ), SYS_MEMORY_TAG_MAP );
+		mapNav.fields[ i ].targetCell = MAP_NAV_NO_CELL;
+	}
+
+	Map_SetupNavAreas();
+	Map_CloseNavSteps( walls, numWalls );
+
+	PrintMsg( "Navigation grid is %ux%u cells\n", mapNav.numColumns, mapNav.numRows );
+
+	Prof_EndTrace( "Map_BuildNavigation" );
+}
+
+void Map_FreeNavigation( void ) {
+	for ( unsigned int i = 0; i < 2; ++i ) {
+		Sys_FreeMemory( mapNav.fields[ i ].directions );
+		Sys_FreeMemory( mapNav.fields[ i ].distances );
+	}
+
+	Sys_FreeMemory( mapNav.areaLinks );
+	Sys_FreeMemory( mapNav.queue );
+	Sys_FreeMemory( mapNav.closedSteps );
+	Sys_FreeMemory( mapNav.cellAreas );
+
+	memset( &mapNav, 0, sizeof( mapNav ) );
+}
+
+static bool Map_IsNavStepOpen( unsigned int cell, unsigned int nextCell, unsigned int direction ) {
+	if ( mapNav.closedSteps[ cell ] & ( 1u << direction ) ) {
+		return false;
+	}
+
+	uint16_t area = mapNav.cellAreas[ cell ], nextArea = mapNav.cellAreas[ nextCell ];
+	if ( area == MAP_NAV_NO_AREA || nextArea == MAP_NAV_NO_AREA ) {
+		return false;
+	}
+
+	if ( !Map_AreAreasLinked( area, nextArea ) ) {
+		return false;
+	}
+
+	/* no cutting corners, both sides of a diagonal have to be clear */
+	if ( direction & 1 ) {
+		uint8_t sides = ( 1u << ( direction - 1 ) ) | ( 1u << ( ( direction + 1 ) % MAP_NAV_DIRECTIONS ) );
+		uint8_t nextSides = ( 1u << ( ( direction + 3 ) % MAP_NAV_DIRECTIONS ) ) | ( 1u << ( ( direction + 5 ) % MAP_NAV_DIRECTIONS ) );
+		if ( ( mapNav.closedSteps[ cell ] & sides ) || ( mapNav.closedSteps[ nextCell ] & nextSides ) ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void Map_BeginNavField( unsigned int targetCell ) {
+	MapNavField *field = &mapNav.fields[ mapNav.frontField ^ 1 ];
+	memset( field->distances, 0xFF, mapNav.numCells * sizeof( uint16_t ) );
+	memset( field->directions, MAP_NAV_NO_DIRECTION, mapNav.numCells * sizeof( uint8_t ) );
+	field->targetCell = targetCell;
+	field->isValid    = false;
+
+	field->distances[ targetCell ] = 0;
+	mapNav.queue[ 0 ] = targetCell;
+	mapNav.queueHead  = 0;
+	mapNav.queueTail  = 1;
+	mapNav.isBuilding = true;
+}
+
+/* every cell goes through the queue once at most, so a
+ * whole field costs the same however it's sliced up */
+static void Map_ContinueNavField( unsigned int budget ) {
+	MapNavField *field = &mapNav.fields[ mapNav.frontField ^ 1 ];
+	for ( ; budget > 0 && mapNav.queueHead < mapNav.queueTail; --budget ) {
+		unsigned int cell = mapNav.queue[ mapNav.queueHead++ ];
+		int column = ( int ) ( cell % mapNav.numColumns );
+		int row = ( int ) ( cell / mapNav.numColumns );
+		uint16_t distance = field->distances[ cell ] + 1;
+
+		for ( unsigned int direction = 0; direction < MAP_NAV_DIRECTIONS; ++direction ) {
+			int nextColumn = column + navOffsets[ direction ][ 0 ];
+			int nextRow = row + navOffsets[ direction ][ 1 ];
+			if ( nextColumn < 0 || nextRow < 0 || nextColumn >= ( int ) mapNav.numColumns || nextRow >= ( int ) mapNav.numRows ) {
+				continue;
+			}
+
+			unsigned int nextCell = ( unsigned int ) nextRow * mapNav.numColumns + ( unsigned int ) nextColumn;
+			if ( field->distances[ nextCell ] != UINT16_MAX || !Map_IsNavStepOpen( cell, nextCell, direction ) ) {
+				continue;
+			}
+
+			/* steps are symmetric, so the way back is the way we came */
+			field->distances[ nextCell ]  = distance;
+			field->directions[ nextCell ] = ( uint8_t ) ( ( direction + 4 ) % MAP_NAV_DIRECTIONS );
+			mapNav.queue[ mapNav.queueTail++ ] = nextCell;
+		}
+	}
+
+	if ( mapNav.queueHead == mapNav.queueTail ) {
+		field->isValid    = true;
+		mapNav.frontField ^= 1;
+		mapNav.isBuilding = false;
+	}
+}
+
+/* called once a tick with wherever the player is. a field that's
+ * already underway is always finished before another's started, so
+ * a player who keeps crossing cells can't stall it indefinitely */
+void Map_UpdateNavigation( const PLVector2 *target ) {
+	if ( !mapNav.isBuilding ) {
+		unsigned int targetCell = Map_GetNavCell( target );
+		if ( targetCell == MAP_NAV_NO_CELL || mapNav.cellAreas[ targetCell ] == MAP_NAV_NO_AREA ) {
+			return;
+		}
+
+		const MapNavField *front = &mapNav.fields[ mapNav.frontField ];
+		if ( front->isValid && front->targetCell == targetCell ) {
+			return;
+		}
+
+		Map_BeginNavField( targetCell );
+	}
+
+	Map_ContinueNavField( MAP_NAV_CELLS_PER_TICK );
+}
+
+/* writes out the way to go from position to get closer to the player;
+ * returns false if there's no route, or we're already in their cell */
+bool Map_GetNavDirection( const PLVector2 *position, PLVector2 *direction ) {
+	const MapNavField *field = &mapNav.fields[ mapNav.frontField ];
+	if ( !field->isValid ) {
+		return false;
+	}
+
+	unsigned int cell = Map_GetNavCell( position );
+	if ( cell == MAP_NAV_NO_CELL || field->directions[ cell ] == MAP_NAV_NO_DIRECTION ) {
+		return false;
+	}
+
+	*direction = navDirections[ field->directions[ cell ] ];
+	return true;
+}
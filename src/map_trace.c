@@ -0,0 +1,332 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "map.h"
+#include "prof.h"
+
+#include <float.h>
+
+#if defined( __SSE__ )
+#include <xmmintrin.h>
+#endif
+
+/* traces against the map's lines, for sight checks and anything else
+ * that needs to know what's in the way. lines are bucketed into a grid
+ * of blocks at load, and a trace only tests the blocks it passes through,
+ * nearest first, stopping as soon as it's hit something in the current
+ * one. each block keeps its own copy of its lines, laid out to be tested
+ * four at a time. walls always run floor to ceiling, so this is all done
+ * in the map's plane.
+ *
+ * nothing's written after load, so traces can be run from any thread */
+
+static struct {
+	int          origin[ 2 ];
+	unsigned int numColumns;
+	unsigned int numRows;
+	unsigned int *blockFirst; /* one more than there are blocks; each block is padded to a multiple of 4 */
+
+	/* line starts and extents, per block */
+	float        *x;
+	float        *y;
+	float        *dx;
+	float        *dy;
+	uint32_t     *lineIndices;
+
+	PLVector2    *normals; /* per line */
+	unsigned int numLines;
+} blockmap;
+
+/* clips the segment against the box, writing out the range of it inside */
+static bool Map_ClipToBox( const PLVector2 *start, const PLVector2 *ray, const float min[ 2 ], const float max[ 2 ], float *t0, float *t1 ) {
+	const float origin[ 2 ] = { start->x, start->y };
+	const float extent[ 2 ] = { ray->x, ray->y };
+
+	*t0 = 0.0f;
+	*t1 = 1.0f;
+	for ( unsigned int k = 0; k < 2; ++k ) {
+		if ( extent[ k ] == 0.0f ) {
+			if ( origin[ k ] < min[ k ] || origin[ k ] > max[ k ] ) {
+				return false;
+			}
+			continue;
+		}
+
+		float near = ( min[ k ] - origin[ k ] ) / extent[ k ];
+		float far = ( max[ k ] - origin[ k ] ) / extent[ k ];
+		if ( near > far ) {
+			float swap = near;
+			near = far;
+			far = swap;
+		}
+
+		*t0 = fmaxf( *t0, near );
+		*t1 = fminf( *t1, far );
+		if ( *t0 > *t1 ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void Map_GetBlockBox( unsigned int column, unsigned int row, float min[ 2 ], float max[ 2 ] ) {
+	min[ 0 ] = ( float ) ( blockmap.origin[ 0 ] + ( int ) column * MAP_BLOCK_SIZE );
+	min[ 1 ] = ( float ) ( blockmap.origin[ 1 ] + ( int ) row * MAP_BLOCK_SIZE );
+	max[ 0 ] = min[ 0 ] + MAP_BLOCK_SIZE;
+	max[ 1 ] = min[ 1 ] + MAP_BLOCK_SIZE;
+}
+
+/* only goes into the blocks the line actually passes through, rather than
+ * everything under its bounds, as long diagonals are common. without any
+ * cursors the blocks are only counted */
+static void Map_BucketLine( const MapSegment *wall, unsigned int lineIndex, unsigned int *blockCursors ) {
+	int column0 = ( int ) floorf( ( fminf( wall->start.x, wall->end.x ) - blockmap.origin[ 0 ] ) / MAP_BLOCK_SIZE );
+	int column1 = ( int ) floorf( ( fmaxf( wall->start.x, wall->end.x ) - blockmap.origin[ 0 ] ) / MAP_BLOCK_SIZE );
+	int row0 = ( int ) floorf( ( fminf( wall->start.y, wall->end.y ) - blockmap.origin[ 1 ] ) / MAP_BLOCK_SIZE );
+	int row1 = ( int ) floorf( ( fmaxf( wall->start.y, wall->end.y ) - blockmap.origin[ 1 ] ) / MAP_BLOCK_SIZE );
+
+	PLVector2 extent = PLVector2( wall->end.x - wall->start.x, wall->end.y - wall->start.y );
+	for ( int row = ( row0 > 0 ) ? row0 : 0; row <= row1 && row < ( int ) blockmap.numRows; ++row ) {
+		for ( int column = ( column0 > 0 ) ? column0 : 0; column <= column1 && column < ( int ) blockmap.numColumns; ++column ) {
+			float min[ 2 ], max[ 2 ], t0, t1;
+			Map_GetBlockBox( column, row, min, max );
+			if ( !Map_ClipToBox( &wall->start, &extent, min, max, &t0, &t1 ) ) {
+				continue;
+			}
+
+			unsigned int block = ( unsigned int ) row * blockmap.numColumns + ( unsigned int ) column;
+			if ( blockCursors == NULL ) {
+				blockmap.blockFirst[ block + 1 ]++;
+				continue;
+			}
+
+			unsigned int i = blockCursors[ block ]++;
+			blockmap.x[ i ]           = wall->start.x;
+			blockmap.y[ i ]           = wall->start.y;
+			blockmap.dx[ i ]          = extent.x;
+			blockmap.dy[ i ]          = extent.y;
+			blockmap.lineIndices[ i ] = lineIndex;
+		}
+	}
+}
+
+void Map_BuildBlockmap( const MapSegment *walls, unsigned int numWalls ) {
+	Prof_BeginTrace( "Map_BuildBlockmap" );
+
+	memset( &blockmap, 0, sizeof( blockmap ) );
+	if ( numWalls == 0 ) {
+		Prof_EndTrace( "Map_BuildBlockmap" );
+		return;
+	}
+
+	float mapMin[ 2 ] = { FLT_MAX, FLT_MAX };
+	float mapMax[ 2 ] = { -FLT_MAX, -FLT_MAX };
+	for ( unsigned int i = 0; i < numWalls; ++i ) {
+		mapMin[ 0 ] = fminf( mapMin[ 0 ], fminf( walls[ i ].start.x, walls[ i ].end.x ) );
+		mapMin[ 1 ] = fminf( mapMin[ 1 ], fminf( walls[ i ].start.y, walls[ i ].end.y ) );
+		mapMax[ 0 ] = fmaxf( mapMax[ 0 ], fmaxf( walls[ i ].start.x, walls[ i ].end.x ) );
+		mapMax[ 1 ] = fmaxf( mapMax[ 1 ], fmaxf( walls[ i ].start.y, walls[ i ].end.y ) );
+	}
+
+	blockmap.origin[ 0 ]  = ( int ) mapMin[ 0 ];
+	blockmap.origin[ 1 ]  = ( int ) mapMin[ 1 ];
+	blockmap.numColumns   = ( unsigned int ) ( mapMax[ 0 ] - mapMin[ 0 ] ) / MAP_BLOCK_SIZE + 1;
+	blockmap.numRows      = ( unsigned int ) ( mapMax[ 1 ] - mapMin[ 1 ] ) / MAP_BLOCK_SIZE + 1;
+	blockmap.numLines     = numWalls;
+
+	unsigned int numBlocks = blockmap.numColumns * blockmap.numRows;
+	blockmap.blockFirst = Sys_AllocateTaggedMemory( numBlocks + 1, sizeof( unsigned int ), SYS_MEMORY_TAG_MAP );
+	blockmap.normals    = Sys_AllocateTaggedMemory( numWalls, sizeof( PLVector2 ), SYS_MEMORY_TAG_MAP );
+
+	/* count first, then lay each block out after the last */
+	for ( unsigned int i = 0; i < numWalls; ++i ) {
+		Map_BucketLine( &walls[ i ], i, NULL );
+		blockmap.normals[ i ] = walls[ i ].normal;
+	}
+
+	for ( unsigned int i = 0; i < numBlocks; ++i ) {
+		unsigned int numBlockLines = ( blockmap.blockFirst[ i + 1 ] + 3 ) & ~3u;
+		blockmap.blockFirst[ i + 1 ] = blockmap.blockFirst[ i ] + numBlockLines;
+	}
+
+	/* padding is left zeroed, and a line with no length is never hit */
+	unsigned int numEntries = blockmap.blockFirst[ numBlocks ];
+	blockmap.x           = Sys_AllocateTaggedMemory( numEntries, sizeof( float ), SYS_MEMORY_TAG_MAP );
+	blockmap.y           = Sys_AllocateTaggedMemory( numEntries, sizeof( float ), SYS_MEMORY_TAG_MAP );
+	blockmap.dx          = Sys_AllocateTaggedMemory( numEntries, sizeof( float ), SYS_MEMORY_TAG_MAP );
+	blockmap.dy          = Sys_AllocateTaggedMemory( numEntries, sizeof( float ), SYS_MEMORY_TAG_MAP );
+	blockmap.lineIndices = Sys_AllocateTaggedMemory( numEntries, sizeof( uint32_t ), SYS_MEMORY_TAG_MAP );
+
+	SysArena *arena = Sys_GetLoadArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	unsigned int *blockCursors = Sys_ArenaAllocate( arena, numBlocks, sizeof( unsigned int ) );
+	memcpy( blockCursors, blockmap.blockFirst, numBlocks * sizeof( unsigned int ) );
+	for ( unsigned int i = 0; i < numWalls; ++i ) {
+		Map_BucketLine( &walls[ i ], i, blockCursors );
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+
+	PrintMsg( "Blockmap is %ux%u blocks, %u entries\n", blockmap.numColumns, blockmap.numRows, numEntries );
+
+	Prof_EndTrace( "Map_BuildBlockmap" );
+}
+
+void Map_FreeBlockmap( void ) {
+	Sys_FreeMemory( blockmap.lineIndices );
+	Sys_FreeMemory( blockmap.dy );
+	Sys_FreeMemory( blockmap.dx );
+	Sys_FreeMemory( blockmap.y );
+	Sys_FreeMemory( blockmap.x );
+	Sys_FreeMemory( blockmap.normals );
+	Sys_FreeMemory( blockmap.blockFirst );
+
+	memset( &blockmap, 0, sizeof( blockmap ) );
+}
+
+static void Map_HitLine( MapTrace *trace, unsigned int i, float fraction ) {
+	if ( fraction >= trace->fraction ) {
+		return;
+	}
+
+	trace->fraction  = fraction;
+	trace->lineIndex = blockmap.lineIndices[ i ];
+}
+
+/* p + t * r = q + u * s, for a hit anywhere along both */
+static void Map_TraceBlock( unsigned int block, const PLVector2 *start, const PLVector2 *ray, MapTrace *trace ) {
+	unsigned int first = blockmap.blockFirst[ block ];
+	unsigned int last = blockmap.blockFirst[ block + 1 ];
+
+#if defined( __SSE__ )
+	const __m128 px = _mm_set1_ps( start->x ), py = _mm_set1_ps( start->y );
+	const __m128 rx = _mm_set1_ps( ray->x ), ry = _mm_set1_ps( ray->y );
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.0f );
+
+	for ( unsigned int i = first; i < last; i += 4 ) {
+		__m128 sx = _mm_loadu_ps( &blockmap.dx[ i ] );
+		__m128 sy = _mm_loadu_ps( &blockmap.dy[ i ] );
+		__m128 qpx = _mm_sub_ps( _mm_loadu_ps( &blockmap.x[ i ] ), px );
+		__m128 qpy = _mm_sub_ps( _mm_loadu_ps( &blockmap.y[ i ] ), py );
+
+		__m128 denominator = _mm_sub_ps( _mm_mul_ps( rx, sy ), _mm_mul_ps( ry, sx ) );
+		__m128 t = _mm_div_ps( _mm_sub_ps( _mm_mul_ps( qpx, sy ), _mm_mul_ps( qpy, sx ) ), denominator );
+		__m128 u = _mm_div_ps( _mm_sub_ps( _mm_mul_ps( qpx, ry ), _mm_mul_ps( qpy, rx ) ), denominator );
+
+		/* parallel lines divide by zero, but nan fails every comparison */
+		__m128 hit = _mm_and_ps( _mm_cmpneq_ps( denominator, zero ), _mm_cmplt_ps( t, _mm_set1_ps( trace->fraction ) ) );
+		hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps( t, zero ), _mm_cmpge_ps( u, zero ) ) );
+		hit = _mm_and_ps( hit, _mm_cmple_ps( u, one ) );
+
+		int mask = _mm_movemask_ps( hit );
+		if ( mask == 0 ) {
+			continue;
+		}
+
+		float fractions[ 4 ];
+		_mm_storeu_ps( fractions, t );
+		for ( unsigned int j = 0; j < 4; ++j ) {
+			if ( mask & ( 1 << j ) ) {
+				Map_HitLine( trace, i + j, fractions[ j ] );
+			}
+		}
+	}
+#else
+	for ( unsigned int i = first; i < last; ++i ) {
+		float sx = blockmap.dx[ i ], sy = blockmap.dy[ i ];
+		float qpx = blockmap.x[ i ] - start->x, qpy = blockmap.y[ i ] - start->y;
+
+		float denominator = ray->x * sy - ray->y * sx;
+		if ( denominator == 0.0f ) {
+			continue;
+		}
+
+		float t = ( qpx * sy - qpy * sx ) / denominator;
+		float u = ( qpx * ray->y - qpy * ray->x ) / denominator;
+		if ( t >= 0.0f && u >= 0.0f && u <= 1.0f ) {
+			Map_HitLine( trace, i, t );
+		}
+	}
+#endif
+}
+
+/* fills in where the trace from start to end first hits a line. with
+ * nothing in the way, the fraction is left at 1 and there's no line */
+void Map_TraceLine( MapTrace *trace ) {
+	trace->fraction  = 1.0f;
+	trace->lineIndex = MAP_TRACE_NO_LINE;
+	trace->normal    = PLVector2( 0.0f, 0.0f );
+
+	if ( blockmap.numLines == 0 ) {
+		return;
+	}
+
+	const PLVector2 *start = &trace->start;
+	PLVector2 ray = PLVector2( trace->end.x - start->x, trace->end.y - start->y );
+
+	float gridMin[ 2 ], gridMax[ 2 ], t0, t1;
+	Map_GetBlockBox( 0, 0, gridMin, gridMax );
+	gridMax[ 0 ] = gridMin[ 0 ] + ( float ) blockmap.numColumns * MAP_BLOCK_SIZE;
+	gridMax[ 1 ] = gridMin[ 1 ] + ( float ) blockmap.numRows * MAP_BLOCK_SIZE;
+	if ( !Map_ClipToBox( start, &ray, gridMin, gridMax, &t0, &t1 ) ) {
+		return;
+	}
+
+	/* walk the blocks in the order the trace crosses them */
+	float entryX = start->x + ray.x * t0 - gridMin[ 0 ];
+	float entryY = start->y + ray.y * t0 - gridMin[ 1 ];
+	int column = ( int ) floorf( entryX / MAP_BLOCK_SIZE );
+	int row = ( int ) floorf( entryY / MAP_BLOCK_SIZE );
+	column = ( column < 0 ) ? 0 : ( column >= ( int ) blockmap.numColumns ) ? ( int ) blockmap.numColumns - 1 : column;
+	row = ( row < 0 ) ? 0 : ( row >= ( int ) blockmap.numRows ) ? ( int ) blockmap.numRows - 1 : row;
+
+	int stepColumn = ( ray.x > 0.0f ) ? 1 : -1;
+	int stepRow = ( ray.y > 0.0f ) ? 1 : -1;
+	float deltaX = ( ray.x != 0.0f ) ? MAP_BLOCK_SIZE / fabsf( ray.x ) : FLT_MAX;
+	float deltaY = ( ray.y != 0.0f ) ? MAP_BLOCK_SIZE / fabsf( ray.y ) : FLT_MAX;
+	float nextX = ( ray.x != 0.0f ) ? ( gridMin[ 0 ] + ( float ) ( column + ( ray.x > 0.0f ) ) * MAP_BLOCK_SIZE - start->x ) / ray.x : FLT_MAX;
+	float nextY = ( ray.y != 0.0f ) ? ( gridMin[ 1 ] + ( float ) ( row + ( ray.y > 0.0f ) ) * MAP_BLOCK_SIZE - start->y ) / ray.y : FLT_MAX;
+
+	while ( true ) {
+		Map_TraceBlock( ( unsigned int ) row * blockmap.numColumns + ( unsigned int ) column, start, &ray, trace );
+
+		/* lines cross several blocks, so a hit further on than
+		 * this one might yet be beaten by one in the next */
+		float exit = fminf( fminf( nextX, nextY ), t1 );
+		if ( trace->fraction <= exit || exit >= t1 ) {
+			break;
+		}
+
+		if ( nextX < nextY ) {
+			column += stepColumn;
+			nextX += deltaX;
+		} else {
+			row += stepRow;
+			nextY += deltaY;
+		}
+
+		if ( column < 0 || row < 0 || column >= ( int ) blockmap.numColumns || row >= ( int ) blockmap.numRows ) {
+			break;
+		}
+	}
+
+	if ( trace->lineIndex != MAP_TRACE_NO_LINE ) {
+		/* always facing back the way the trace came */
+		trace->normal = blockmap.normals[ trace->lineIndex ];
+		if ( trace->normal.x * ray.x + trace->normal.y * ray.y > 0.0f ) {
+			trace->normal = PLVector2( -trace->normal.x, -trace->normal.y );
+		}
+	}
+}
+
+/* sight checks and the like should be gathered up and
+ * run together once a tick, rather than one at a time */
+void Map_TraceLines( MapTrace *traces, unsigned int numTraces ) {
+	for ( unsigned int i = 0; i < numTraces; ++i ) {
+		Map_TraceLine( &traces[ i ] );
+	}
+}
@@ -0,0 +1,391 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+
+#include <stdatomic.h>
+
+/* allocation tracking; when enabled every live allocation is kept in an
+ * open-addressed table keyed on its address, rather than in a header,
+ * since the platform library is free to release what it allocates
+ * through us without telling us */
+
+#define SYS_MEMORY_TABLE_MIN_SIZE 4096
+#define SYS_MEMORY_TOMBSTONE      ( ( void * ) ( uintptr_t ) 1 )
+#define SYS_MEMORY_MAX_LEAKS      32
+
+typedef struct SysAllocation {
+	void         *mem;
+	size_t       size;
+	const char   *file;
+	int          line;
+	SysMemoryTag tag;
+} SysAllocation;
+
+typedef struct SysMemoryStats {
+	size_t       curBytes;
+	size_t       peakBytes;
+	size_t       totalBytes;
+	unsigned int curAllocations;
+	unsigned int totalAllocations;
+} SysMemoryStats;
+
+static struct {
+	bool           isEnabled;
+	SysAllocation  *table;
+	size_t         tableSize;
+	size_t         numUsed; /* including tombstones */
+	SysMemoryStats stats[ MAX_SYS_MEMORY_TAGS ];
+} memoryTracker;
+
+/* allocations can come from worker threads too; a spinlock is enough
+ * here and, unlike a mutex, doesn't need allocating itself */
+static atomic_flag memoryTrackerLock = ATOMIC_FLAG_INIT;
+
+static void Sys_LockMemoryTracker( void ) {
+	while ( atomic_flag_test_and_set_explicit( &memoryTrackerLock, memory_order_acquire ) ) {}
+}
+
+static void Sys_UnlockMemoryTracker( void ) {
+	atomic_flag_clear_explicit( &memoryTrackerLock, memory_order_release );
+}
+
+static const char *memoryTagNames[ MAX_SYS_MEMORY_TAGS ] = {
+		[ SYS_MEMORY_TAG_PLATFORM ] = "platform",
+		[ SYS_MEMORY_TAG_SYS      ] = "sys",
+		[ SYS_MEMORY_TAG_GFX      ] = "gfx",
+		[ SYS_MEMORY_TAG_MAP      ] = "map",
+		[ SYS_MEMORY_TAG_ACT      ] = "act",
+		[ SYS_MEMORY_TAG_GAME     ] = "game",
+};
+
+static size_t Sys_HashPointer( const void *mem, size_t tableSize ) {
+	uint64_t hash = ( uint64_t ) ( uintptr_t ) mem;
+	hash = ( hash >> 4 ) * 0x9E3779B97F4A7C15ULL;
+	return ( size_t ) ( hash >> 32 ) & ( tableSize - 1 );
+}
+
+static SysAllocation *Sys_FindAllocationSlot( SysAllocation *table, size_t tableSize, const void *mem, bool forInsert ) {
+	SysAllocation *tombstone = NULL;
+	size_t i = Sys_HashPointer( mem, tableSize );
+	for ( ;; i = ( i + 1 ) & ( tableSize - 1 ) ) {
+		SysAllocation *slot = &table[ i ];
+		if ( slot->mem == mem ) {
+			return slot;
+		} else if ( slot->mem == NULL ) {
+			return ( forInsert && tombstone != NULL ) ? tombstone : ( forInsert ? slot : NULL );
+		} else if ( slot->mem == SYS_MEMORY_TOMBSTONE && tombstone == NULL ) {
+			tombstone = slot;
+		}
+	}
+}
+
+static void Sys_GrowAllocationTable( void ) {
+	size_t newSize = memoryTracker.tableSize > 0 ? memoryTracker.tableSize * 2 : SYS_MEMORY_TABLE_MIN_SIZE;
+	/* the table itself is deliberately left out of the stats */
+	SysAllocation *newTable = calloc( newSize, sizeof( SysAllocation ) );
+	if ( newTable == NULL ) {
+		PrintError( "Failed to allocate memory tracking table!\n" );
+	}
+
+	memoryTracker.numUsed = 0;
+	for ( size_t i = 0; i < memoryTracker.tableSize; ++i ) {
+		SysAllocation *slot = &memoryTracker.table[ i ];
+		if ( slot->mem == NULL || slot->mem == SYS_MEMORY_TOMBSTONE ) {
+			continue;
+		}
+
+		*Sys_FindAllocationSlot( newTable, newSize, slot->mem, true ) = *slot;
+		memoryTracker.numUsed++;
+	}
+
+	free( memoryTracker.table );
+	memoryTracker.table = newTable;
+	memoryTracker.tableSize = newSize;
+}
+
+static void Sys_UntrackAllocation( SysAllocation *slot ) {
+	SysMemoryStats *stats = &memoryTracker.stats[ slot->tag ];
+	stats->curBytes -= slot->size;
+	stats->curAllocations--;
+
+	slot->mem = SYS_MEMORY_TOMBSTONE;
+}
+
+static void Sys_TrackAllocation( void *mem, size_t size, SysMemoryTag tag, const char *file, int line ) {
+	if ( ( memoryTracker.numUsed + 1 ) * 10 > memoryTracker.tableSize * 7 ) {
+		Sys_GrowAllocationTable();
+	}
+
+	SysAllocation *slot = Sys_FindAllocationSlot( memoryTracker.table, memoryTracker.tableSize, mem, true );
+	if ( slot->mem == mem ) {
+		/* address was handed out again, so whatever had it before
+		 * must've been freed behind our back (i.e. by the platform lib) */
+		Sys_UntrackAllocation( slot );
+	} else if ( slot->mem == NULL ) {
+		memoryTracker.numUsed++;
+	}
+
+	slot->mem  = mem;
+	slot->size = size;
+	slot->file = file;
+	slot->line = line;
+	slot->tag  = tag;
+
+	SysMemoryStats *stats = &memoryTracker.stats[ tag ];
+	stats->curBytes += size;
+	stats->totalBytes += size;
+	stats->curAllocations++;
+	stats->totalAllocations++;
+	if ( stats->curBytes > stats->peakBytes ) {
+		stats->peakBytes = stats->curBytes;
+	}
+}
+
+void Sys_EnableMemoryTracking( void ) {
+	memoryTracker.isEnabled = true;
+}
+
+void *Sys_AllocateMemoryEx( size_t num, size_t size, SysMemoryTag tag, const char *file, int line ) {
+	void *mem = calloc( num, size );
+	if( mem == NULL ) {
+		PrintError( "Failed to allocate %d bytes!\n", num * size );
+	}
+
+	if ( memoryTracker.isEnabled ) {
+		Sys_LockMemoryTracker();
+		Sys_TrackAllocation( mem, num * size, tag, file, line );
+		Sys_UnlockMemoryTracker();
+	}
+
+	return mem;
+}
+
+/* handed to the platform library, so everything it allocates ends up here */
+void *Sys_AllocateMemory( size_t num, size_t size ) {
+	return Sys_AllocateMemoryEx( num, size, SYS_MEMORY_TAG_PLATFORM, NULL, 0 );
+}
+
+void Sys_FreeMemory( void *mem ) {
+	if ( mem == NULL ) {
+		return;
+	}
+
+	if ( memoryTracker.isEnabled ) {
+		Sys_LockMemoryTracker();
+
+		SysAllocation *slot = NULL;
+		if ( memoryTracker.tableSize > 0 ) {
+			slot = Sys_FindAllocationSlot( memoryTracker.table, memoryTracker.tableSize, mem, false );
+		}
+
+		if ( slot != NULL ) {
+			Sys_UntrackAllocation( slot );
+		}
+
+		Sys_UnlockMemoryTracker();
+
+		if ( slot == NULL ) {
+			PrintWarn( "Freeing untracked memory (%p)!\n", mem );
+		}
+	}
+
+	free( mem );
+}
+
+void Sys_PrintMemoryReport( bool listLeaks ) {
+	if ( !memoryTracker.isEnabled ) {
+		return;
+	}
+
+	/* take a copy of everything first, as logging may well allocate */
+	SysMemoryStats stats[ MAX_SYS_MEMORY_TAGS ];
+	SysAllocation leaks[ SYS_MEMORY_MAX_LEAKS ];
+	unsigned int numLeaks = 0;
+	size_t leakedBytes = 0;
+
+	Sys_LockMemoryTracker();
+
+	memcpy( stats, memoryTracker.stats, sizeof( stats ) );
+
+	/* platform allocations are skipped, as we never see those freed */
+	for ( size_t i = 0; listLeaks && i < memoryTracker.tableSize; ++i ) {
+		const SysAllocation *slot = &memoryTracker.table[ i ];
+		if ( slot->mem == NULL || slot->mem == SYS_MEMORY_TOMBSTONE || slot->tag == SYS_MEMORY_TAG_PLATFORM ) {
+			continue;
+		}
+
+		if ( numLeaks < SYS_MEMORY_MAX_LEAKS ) {
+			leaks[ numLeaks ] = *slot;
+		}
+
+		numLeaks++;
+		leakedBytes += slot->size;
+	}
+
+	Sys_UnlockMemoryTracker();
+
+	PrintMsg( "Memory report:\n" );
+	PrintMsg( "%-10s %12s %12s %12s %8s %8s\n", "tag", "current", "peak", "total", "live", "allocs" );
+	for ( unsigned int i = 0; i < MAX_SYS_MEMORY_TAGS; ++i ) {
+		PrintMsg( "%-10s %12zu %12zu %12zu %8u %8u\n", memoryTagNames[ i ],
+		          stats[ i ].curBytes, stats[ i ].peakBytes, stats[ i ].totalBytes,
+		          stats[ i ].curAllocations, stats[ i ].totalAllocations );
+	}
+
+	for ( unsigned int i = 0; i < numLeaks && i < SYS_MEMORY_MAX_LEAKS; ++i ) {
+		PrintWarn( "Leaked %zu bytes (%s) allocated at %s:%d\n", leaks[ i ].size, memoryTagNames[ leaks[ i ].tag ], leaks[ i ].file, leaks[ i ].line );
+	}
+
+	if ( numLeaks > SYS_MEMORY_MAX_LEAKS ) {
+		PrintWarn( "...and %u more\n", numLeaks - SYS_MEMORY_MAX_LEAKS );
+	}
+
+	if ( numLeaks > 0 ) {
+		PrintWarn( "%u allocations leaked, totalling %zu bytes\n", numLeaks, leakedBytes );
+	}
+}
+
+/* linear arenas for transient allocations; allocating is a pointer bump
+ * and releasing everything back to a mark is O(1). memory is never
+ * zeroed and blocks are kept around after a reset, so once an arena has
+ * grown to fit its workload it stops touching the heap entirely */
+
+#define SYS_ARENA_ALIGNMENT 16
+
+typedef struct SysArenaBlock {
+	struct SysArenaBlock *next;
+	size_t               size;
+	size_t               used;
+	uint8_t              *data;
+} SysArenaBlock;
+
+typedef struct SysArena {
+	const char    *name;
+	SysArenaBlock *firstBlock;
+	SysArenaBlock *curBlock;
+	size_t        blockSize;
+	size_t        usage; /* across every block up to and including curBlock */
+	size_t        peakUsage;
+} SysArena;
+
+static SysArena *frameArena = NULL;
+static SysArena *loadArena = NULL;
+
+static SysArenaBlock *Sys_CreateArenaBlock( size_t size ) {
+	SysArenaBlock *block = Sys_AllocateTaggedMemory( 1, sizeof( SysArenaBlock ) + size + SYS_ARENA_ALIGNMENT, SYS_MEMORY_TAG_SYS );
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	block->data = ( uint8_t * ) ( ( ( uintptr_t ) ( block + 1 ) + ( SYS_ARENA_ALIGNMENT - 1 ) ) & ~( uintptr_t ) ( SYS_ARENA_ALIGNMENT - 1 ) );
+
+	return block;
+}
+
+SysArena *Sys_CreateArena( const char *name, size_t blockSize ) {
+	SysArena *arena = Sys_AllocateTaggedMemory( 1, sizeof( SysArena ), SYS_MEMORY_TAG_SYS );
+	arena->name       = name;
+	arena->blockSize  = blockSize;
+	arena->firstBlock = arena->curBlock = Sys_CreateArenaBlock( blockSize );
+
+	return arena;
+}
+
+void Sys_DestroyArena( SysArena *arena ) {
+	if ( arena == NULL ) {
+		return;
+	}
+
+	SysArenaBlock *block = arena->firstBlock;
+	while ( block != NULL ) {
+		SysArenaBlock *next = block->next;
+		Sys_FreeMemory( block );
+		block = next;
+	}
+
+	Sys_FreeMemory( arena );
+}
+
+void *Sys_ArenaAllocate( SysArena *arena, size_t num, size_t size ) {
+	size_t length = ( num * size + ( SYS_ARENA_ALIGNMENT - 1 ) ) & ~( size_t ) ( SYS_ARENA_ALIGNMENT - 1 );
+
+	SysArenaBlock *block = arena->curBlock;
+	while ( block->used + length > block->size ) {
+		/* move on to the next block, or add one that's big enough */
+		if ( block->next == NULL ) {
+			size_t blockSize = length > arena->blockSize ? length : arena->blockSize;
+			block->next = Sys_CreateArenaBlock( blockSize );
+			PrintWarn( "Arena \"%s\" grew by %zu bytes, consider increasing its block size!\n", arena->name, blockSize );
+		}
+
+		block = block->next;
+		block->used = 0;
+	}
+
+	arena->curBlock = block;
+
+	void *mem = block->data + block->used;
+	block->used += length;
+
+	/* whatever was used of the blocks we've moved past still counts */
+	arena->usage += length;
+	if ( arena->usage > arena->peakUsage ) {
+		arena->peakUsage = arena->usage;
+	}
+
+	return mem;
+}
+
+SysArenaMark Sys_GetArenaMark( const SysArena *arena ) {
+	SysArenaMark mark;
+	mark.block = arena->curBlock;
+	mark.used  = arena->curBlock->used;
+	mark.usage = arena->usage;
+	return mark;
+}
+
+void Sys_ResetArenaToMark( SysArena *arena, SysArenaMark mark ) {
+	arena->curBlock = mark.block;
+	arena->curBlock->used = mark.used;
+	arena->usage = mark.usage;
+}
+
+void Sys_ResetArena( SysArena *arena ) {
+	arena->curBlock = arena->firstBlock;
+	arena->curBlock->used = 0;
+	arena->usage = 0;
+}
+
+size_t Sys_GetArenaPeakUsage( const SysArena *arena ) {
+	return arena->peakUsage;
+}
+
+/* shared arenas */
+
+void Sys_InitializeArenas( void ) {
+	frameArena = Sys_CreateArena( "frame", SYS_FRAME_ARENA_SIZE );
+	loadArena = Sys_CreateArena( "load", SYS_LOAD_ARENA_SIZE );
+}
+
+void Sys_ShutdownArenas( void ) {
+	PrintMsg( "Arena peak usage: frame %zu bytes, load %zu bytes\n",
+	          Sys_GetArenaPeakUsage( frameArena ), Sys_GetArenaPeakUsage( loadArena ) );
+
+	Sys_DestroyArena( frameArena );
+	frameArena = NULL;
+	Sys_DestroyArena( loadArena );
+	loadArena = NULL;
+}
+
+/* reset at the start of every frame, so anything allocated
+ * from here is only valid until the frame is done */
+SysArena *Sys_GetFrameArena( void ) {
+	return frameArena;
+}
+
+/* for scratch buffers while decoding assets; callers should take a
+ * mark before loading and reset back to it once done */
+SysArena *Sys_GetLoadArena( void ) {
+	return loadArena;
+}
@@ -0,0 +1,130 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+
+/* gl context without any window or display server behind it, so the
+ * renderer can be run on headless machines. only egl is supported;
+ * mesa's surfaceless platform is preferred where it's available */
+
+#if defined( YIN_USE_EGL )
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+
+static EGLDisplay Sys_GetOffscreenDisplay( void ) {
+	const char *clientExtensions = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+	if ( clientExtensions != NULL && strstr( clientExtensions, "EGL_MESA_platform_surfaceless" ) != NULL ) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC GetPlatformDisplayEXT =
+				( PFNEGLGETPLATFORMDISPLAYEXTPROC ) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+		if ( GetPlatformDisplayEXT != NULL ) {
+			EGLDisplay display = GetPlatformDisplayEXT( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+			if ( display != EGL_NO_DISPLAY ) {
+				return display;
+			}
+		}
+	}
+
+	return eglGetDisplay( EGL_DEFAULT_DISPLAY );
+}
+
+bool Sys_CreateOffscreenContext( void ) {
+	eglDisplay = Sys_GetOffscreenDisplay();
+	if ( eglDisplay == EGL_NO_DISPLAY ) {
+		PrintWarn( "Failed to get an EGL display!\n" );
+		return false;
+	}
+
+	EGLint major, minor;
+	if ( !eglInitialize( eglDisplay, &major, &minor ) ) {
+		PrintWarn( "Failed to initialize EGL (%x)!\n", eglGetError() );
+		return false;
+	}
+
+	PrintMsg( "EGL: %d.%d (%s)\n", major, minor, eglQueryString( eglDisplay, EGL_VENDOR ) );
+
+	/* we never draw to a surface, everything goes through an fbo */
+	const char *extensions = eglQueryString( eglDisplay, EGL_EXTENSIONS );
+	if ( extensions == NULL || strstr( extensions, "EGL_KHR_surfaceless_context" ) == NULL ) {
+		PrintWarn( "EGL_KHR_surfaceless_context is unsupported!\n" );
+		return false;
+	}
+
+	static const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_SURFACE_TYPE, 0,
+			EGL_NONE
+	};
+
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if ( !eglChooseConfig( eglDisplay, configAttributes, &config, 1, &numConfigs ) || numConfigs == 0 ) {
+		PrintWarn( "Failed to find a suitable EGL config (%x)!\n", eglGetError() );
+		return false;
+	}
+
+	if ( !eglBindAPI( EGL_OPENGL_API ) ) {
+		PrintWarn( "Failed to bind the OpenGL API (%x)!\n", eglGetError() );
+		return false;
+	}
+
+	/* matches what we ask glut for */
+	static const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 2,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+	};
+
+	eglContext = eglCreateContext( eglDisplay, config, EGL_NO_CONTEXT, contextAttributes );
+	if ( eglContext == EGL_NO_CONTEXT ) {
+		PrintWarn( "Failed to create EGL context (%x)!\n", eglGetError() );
+		return false;
+	}
+
+	if ( !eglMakeCurrent( eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext ) ) {
+		PrintWarn( "Failed to make EGL context current (%x)!\n", eglGetError() );
+		return false;
+	}
+
+	return true;
+}
+
+void Sys_DestroyOffscreenContext( void ) {
+	if ( eglDisplay == EGL_NO_DISPLAY ) {
+		return;
+	}
+
+	eglMakeCurrent( eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	if ( eglContext != EGL_NO_CONTEXT ) {
+		eglDestroyContext( eglDisplay, eglContext );
+		eglContext = EGL_NO_CONTEXT;
+	}
+
+	eglTerminate( eglDisplay );
+	eglDisplay = EGL_NO_DISPLAY;
+}
+
+void *Sys_GetOffscreenProcAddress( const char *name ) {
+	return ( void * ) eglGetProcAddress( name );
+}
+
+#else
+
+bool Sys_CreateOffscreenContext( void ) {
+	PrintWarn( "Offscreen rendering is unavailable, EGL wasn't found at build time!\n" );
+	return false;
+}
+
+void Sys_DestroyOffscreenContext( void ) {}
+
+void *Sys_GetOffscreenProcAddress( const char *name ) {
+	u_unused( name );
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,463 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "prof.h"
+#include "gfx_gl.h"
+
+#include <stdatomic.h>
+
+/* lightweight frame profiler; each zone keeps a ring of recent
+ * samples so we can show a stable average rather than jitter */
+
+#define PROF_GPU_LATENCY 4 /* frames to wait before reading back timer queries */
+
+typedef struct ProfSampleRing {
+	uint64_t     samples[ PROF_NUM_SAMPLES ]; /* ns */
+	uint64_t     total;
+	unsigned int numSamples;
+	unsigned int head;
+
+	uint64_t     lifetimeTotal; /* ns, everything ever pushed */
+} ProfSampleRing;
+
+static const char *zoneNames[ MAX_PROF_ZONES ] = {
+		[ PROF_ZONE_FRAME    ] = "Sys_Display",
+		[ PROF_ZONE_TICK     ] = "Gam_Tick",
+		[ PROF_ZONE_ACT_TICK ] = "Act_TickActors",
+		[ PROF_ZONE_MAP_DRAW ] = "Map_Draw",
+		[ PROF_ZONE_ACT_DRAW ] = "Act_DisplayActors",
+};
+
+static const bool zoneIsGPU[ MAX_PROF_ZONES ] = {
+		[ PROF_ZONE_FRAME    ] = true,
+		[ PROF_ZONE_MAP_DRAW ] = true,
+		[ PROF_ZONE_ACT_DRAW ] = true,
+};
+
+static struct {
+	uint64_t       startTime;
+	ProfSampleRing cpu;
+	ProfSampleRing gpu;
+} zones[ MAX_PROF_ZONES ];
+
+static struct {
+	bool         enabled;
+	GLuint       queries[ PROF_GPU_LATENCY ][ MAX_PROF_ZONES ][ 2 ];
+	bool         issued[ PROF_GPU_LATENCY ][ MAX_PROF_ZONES ];
+	unsigned int frame;
+} gpuTimer;
+
+static unsigned int numDrawCalls = 0;
+static unsigned int lastNumDrawCalls = 0;
+
+static bool overlayEnabled = false;
+
+/* trace events are written into a fixed buffer; writers reserve a slot
+ * with an atomic increment and publish it by setting the phase last,
+ * so any thread can record without taking a lock. a flush raises
+ * isFlushing and waits for numWriters to drain before touching the
+ * buffer, and anything recorded in the meantime is dropped */
+typedef struct ProfTraceEvent {
+	char          name[ 32 ];
+	uint64_t      time; /* ns since the capture started */
+	uint64_t      threadId;
+	_Atomic char  phase; /* 'B' or 'E' once published */
+} ProfTraceEvent;
+
+static struct {
+	ProfTraceEvent *events;
+	atomic_uint    numEvents;
+	atomic_uint    numDropped;
+	atomic_uint    numWriters;
+	atomic_bool    isFlushing;
+	uint64_t       startTime;
+	const char     *path;
+	unsigned int   numFlushes;
+} trace = {
+		.events = NULL,
+};
+
+static void Prof_PushSample( ProfSampleRing *ring, uint64_t sample ) {
+	if ( ring->numSamples == PROF_NUM_SAMPLES ) {
+		ring->total -= ring->samples[ ring->head ];
+	} else {
+		ring->numSamples++;
+	}
+
+	ring->samples[ ring->head ] = sample;
+	ring->total += sample;
+	ring->lifetimeTotal += sample;
+	ring->head = ( ring->head + 1 ) % PROF_NUM_SAMPLES;
+}
+
+static double Prof_GetRingAverage( const ProfSampleRing *ring ) {
+	if ( ring->numSamples == 0 ) {
+		return 0.0;
+	}
+
+	return ( ( double ) ring->total / ring->numSamples ) / 1000000.0;
+}
+
+static double Prof_GetRingLatest( const ProfSampleRing *ring ) {
+	if ( ring->numSamples == 0 ) {
+		return 0.0;
+	}
+
+	return ring->samples[ ( ring->head + PROF_NUM_SAMPLES - 1 ) % PROF_NUM_SAMPLES ] / 1000000.0;
+}
+
+void Prof_Initialize( void ) {
+	memset( zones, 0, sizeof( zones ) );
+
+	overlayEnabled = plHasCommandLineArgument( "-profile" );
+
+	/* started as early as possible so we catch startup */
+	if ( plHasCommandLineArgument( "-trace" ) ) {
+		trace.path = plGetCommandLineArgumentValue( "-trace" );
+		if ( trace.path == NULL || trace.path[ 0 ] == '-' ) {
+			trace.path = PROF_DEFAULT_TRACE_FILE;
+		}
+
+		trace.events = Sys_AllocateTaggedMemory( PROF_MAX_TRACE_EVENTS, sizeof( ProfTraceEvent ), SYS_MEMORY_TAG_SYS );
+		atomic_init( &trace.numEvents, 0 );
+		atomic_init( &trace.numDropped, 0 );
+		atomic_init( &trace.numWriters, 0 );
+		atomic_init( &trace.isFlushing, false );
+		trace.startTime = Sys_GetNanoseconds();
+
+		PrintMsg( "Recording trace to \"%s\"...\n", trace.path );
+	}
+}
+
+void Prof_InitializeGPU( void ) {
+	memset( &gpuTimer, 0, sizeof( gpuTimer ) );
+	if ( !gfxGL.hasTimerQuery ) {
+		PrintWarn( "GPU timing is unavailable, only CPU zones will be reported!\n" );
+		return;
+	}
+
+	gfxGL.GenQueries( PROF_GPU_LATENCY * MAX_PROF_ZONES * 2, &gpuTimer.queries[ 0 ][ 0 ][ 0 ] );
+	gpuTimer.enabled = true;
+}
+
+void Prof_Shutdown( void ) {
+	if ( trace.events != NULL ) {
+		Prof_FlushTrace();
+
+		Sys_FreeMemory( trace.events );
+		trace.events = NULL;
+	}
+
+	if ( gpuTimer.enabled ) {
+		gfxGL.DeleteQueries( PROF_GPU_LATENCY * MAX_PROF_ZONES * 2, &gpuTimer.queries[ 0 ][ 0 ][ 0 ] );
+		gpuTimer.enabled = false;
+	}
+}
+
+/* pull back the results for the slot we're about to reuse, which were
+ * issued PROF_GPU_LATENCY frames ago and so shouldn't stall us */
+static void Prof_CollectGPUSlot( unsigned int slot ) {
+	for ( unsigned int i = 0; i < MAX_PROF_ZONES; ++i ) {
+		if ( !gpuTimer.issued[ slot ][ i ] ) {
+			continue;
+		}
+
+		gpuTimer.issued[ slot ][ i ] = false;
+
+		GLint available = 0;
+		gfxGL.GetQueryObjectiv( gpuTimer.queries[ slot ][ i ][ 1 ], GL_QUERY_RESULT_AVAILABLE, &available );
+		if ( !available ) {
+			continue;
+		}
+
+		GLuint64 start, end;
+		gfxGL.GetQueryObjectui64v( gpuTimer.queries[ slot ][ i ][ 0 ], GL_QUERY_RESULT, &start );
+		gfxGL.GetQueryObjectui64v( gpuTimer.queries[ slot ][ i ][ 1 ], GL_QUERY_RESULT, &end );
+		if ( end >= start ) {
+			Prof_PushSample( &zones[ i ].gpu, end - start );
+		}
+	}
+}
+
+void Prof_BeginFrame( void ) {
+	if ( gpuTimer.enabled ) {
+		Prof_CollectGPUSlot( gpuTimer.frame % PROF_GPU_LATENCY );
+	}
+
+	Prof_BeginZone( PROF_ZONE_FRAME );
+}
+
+void Prof_EndFrame( void ) {
+	Prof_EndZone( PROF_ZONE_FRAME );
+
+	lastNumDrawCalls = numDrawCalls;
+	numDrawCalls = 0;
+
+	gpuTimer.frame++;
+}
+
+void Prof_BeginZone( ProfZone zone ) {
+	assert( zone < MAX_PROF_ZONES );
+
+	zones[ zone ].startTime = Sys_GetNanoseconds();
+
+	Prof_BeginTrace( zoneNames[ zone ] );
+
+	if ( gpuTimer.enabled && zoneIsGPU[ zone ] ) {
+		unsigned int slot = gpuTimer.frame % PROF_GPU_LATENCY;
+		gfxGL.QueryCounter( gpuTimer.queries[ slot ][ zone ][ 0 ], GL_TIMESTAMP );
+	}
+}
+
+void Prof_EndZone( ProfZone zone ) {
+	assert( zone < MAX_PROF_ZONES );
+
+	Prof_PushSample( &zones[ zone ].cpu, Sys_GetNanoseconds() - zones[ zone ].startTime );
+
+	Prof_EndTrace( zoneNames[ zone ] );
+
+	if ( gpuTimer.enabled && zoneIsGPU[ zone ] ) {
+		unsigned int slot = gpuTimer.frame % PROF_GPU_LATENCY;
+		gfxGL.QueryCounter( gpuTimer.queries[ slot ][ zone ][ 1 ], GL_TIMESTAMP );
+		gpuTimer.issued[ slot ][ zone ] = true;
+	}
+}
+
+void Prof_CountDrawCall( void ) {
+	numDrawCalls++;
+}
+
+static void Prof_RecordTraceEvent( const char *name, char phase ) {
+	if ( trace.events == NULL ) {
+		return;
+	}
+
+	atomic_fetch_add( &trace.numWriters, 1 );
+	if ( atomic_load( &trace.isFlushing ) ) {
+		atomic_fetch_add_explicit( &trace.numDropped, 1, memory_order_relaxed );
+		atomic_fetch_sub( &trace.numWriters, 1 );
+		return;
+	}
+
+	unsigned int slot = atomic_fetch_add_explicit( &trace.numEvents, 1, memory_order_relaxed );
+	if ( slot >= PROF_MAX_TRACE_EVENTS ) {
+		atomic_fetch_add_explicit( &trace.numDropped, 1, memory_order_relaxed );
+		atomic_fetch_sub( &trace.numWriters, 1 );
+		return;
+	}
+
+	ProfTraceEvent *event = &trace.events[ slot ];
+	snprintf( event->name, sizeof( event->name ), "%s", name );
+	event->time     = Sys_GetNanoseconds() - trace.startTime;
+	event->threadId = Sys_GetThreadId();
+	atomic_store_explicit( &event->phase, phase, memory_order_release );
+
+	atomic_fetch_sub( &trace.numWriters, 1 );
+}
+
+void Prof_BeginTrace( const char *name ) {
+	Prof_RecordTraceEvent( name, 'B' );
+}
+
+void Prof_EndTrace( const char *name ) {
+	Prof_RecordTraceEvent( name, 'E' );
+}
+
+bool Prof_IsTracing( void ) {
+	return trace.events != NULL;
+}
+
+/* open begin events per thread, so a capture that was cut short, either
+ * by the buffer filling or by a flush landing mid-zone, still comes out
+ * with every begin matched by an end */
+#define PROF_MAX_TRACE_THREADS 32
+#define PROF_MAX_TRACE_DEPTH   32
+
+typedef struct ProfTraceStack {
+	uint64_t     threadId;
+	unsigned int depth;
+	unsigned int numOverflowed; /* begins past PROF_MAX_TRACE_DEPTH, skipped along with their ends */
+	unsigned int open[ PROF_MAX_TRACE_DEPTH ];
+} ProfTraceStack;
+
+static ProfTraceStack *Prof_GetTraceStack( ProfTraceStack *stacks, unsigned int *numStacks, uint64_t threadId ) {
+	for ( unsigned int i = 0; i < *numStacks; ++i ) {
+		if ( stacks[ i ].threadId == threadId ) {
+			return &stacks[ i ];
+		}
+	}
+
+	if ( *numStacks >= PROF_MAX_TRACE_THREADS ) {
+		return NULL;
+	}
+
+	ProfTraceStack *stack = &stacks[ ( *numStacks )++ ];
+	memset( stack, 0, sizeof( ProfTraceStack ) );
+	stack->threadId = threadId;
+	return stack;
+}
+
+static void Prof_WriteTraceEvent( FILE *file, const char *name, char phase, uint64_t time, uint64_t threadId, bool isFirst ) {
+	fprintf( file, "%s{\"name\":\"", isFirst ? "" : ",\n" );
+	for ( const char *c = name; *c != '\0'; ++c ) {
+		if ( *c == '"' || *c == '\\' ) {
+			fputc( '\\', file );
+		}
+		fputc( *c, file );
+	}
+
+	fprintf( file, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu}",
+	         phase, time / 1000.0, ( unsigned long long ) threadId );
+}
+
+/* writes out everything captured so far in the chrome trace-event format
+ * and starts a new capture; should only be called from the main thread */
+void Prof_FlushTrace( void ) {
+	if ( trace.events == NULL ) {
+		return;
+	}
+
+	/* subsequent flushes get their own file so we don't lose earlier captures */
+	char path[ PL_SYSTEM_MAX_PATH ];
+	if ( trace.numFlushes == 0 ) {
+		snprintf( path, sizeof( path ), "%s", trace.path );
+	} else {
+		snprintf( path, sizeof( path ), "%s.%u", trace.path, trace.numFlushes );
+	}
+
+	FILE *file = fopen( path, "w" );
+	if ( file == NULL ) {
+		PrintWarn( "Failed to open \"%s\" for writing trace!\n", path );
+		return;
+	}
+
+	/* once this drains, every reserved slot has been published */
+	atomic_store( &trace.isFlushing, true );
+	while ( atomic_load( &trace.numWriters ) > 0 ) {
+		/* writers only hold on for a handful of instructions */
+	}
+
+	unsigned int numEvents = atomic_load( &trace.numEvents );
+	if ( numEvents > PROF_MAX_TRACE_EVENTS ) {
+		numEvents = PROF_MAX_TRACE_EVENTS;
+	}
+
+	fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	static ProfTraceStack stacks[ PROF_MAX_TRACE_THREADS ];
+	unsigned int numStacks = 0;
+	uint64_t lastTime = 0;
+
+	unsigned int numWritten = 0;
+	for ( unsigned int i = 0; i < numEvents; ++i ) {
+		ProfTraceEvent *event = &trace.events[ i ];
+		char phase = atomic_load_explicit( &event->phase, memory_order_acquire );
+
+		ProfTraceStack *stack = Prof_GetTraceStack( stacks, &numStacks, event->threadId );
+		if ( stack != NULL ) {
+			if ( phase == 'B' ) {
+				if ( stack->depth >= PROF_MAX_TRACE_DEPTH ) {
+					stack->numOverflowed++;
+					continue;
+				}
+
+				stack->open[ stack->depth++ ] = i;
+			} else if ( stack->numOverflowed > 0 ) {
+				stack->numOverflowed--;
+				continue;
+			} else if ( stack->depth == 0 ) {
+				continue; /* its begin went in an earlier capture */
+			} else {
+				stack->depth--;
+			}
+		}
+
+		Prof_WriteTraceEvent( file, event->name, phase, event->time, event->threadId, numWritten == 0 );
+		numWritten++;
+
+		if ( event->time > lastTime ) {
+			lastTime = event->time;
+		}
+	}
+
+	/* and close off anything left open, innermost first */
+	for ( unsigned int i = 0; i < numStacks; ++i ) {
+		while ( stacks[ i ].depth > 0 ) {
+			const ProfTraceEvent *event = &trace.events[ stacks[ i ].open[ --stacks[ i ].depth ] ];
+			Prof_WriteTraceEvent( file, event->name, 'E', lastTime, event->threadId, numWritten == 0 );
+			numWritten++;
+		}
+	}
+
+	fprintf( file, "\n]}\n" );
+	fclose( file );
+
+	unsigned int numDropped = atomic_load( &trace.numDropped );
+	if ( numDropped > 0 ) {
+		PrintWarn( "Trace buffer overflowed, %u events were dropped!\n", numDropped );
+	}
+
+	PrintMsg( "Wrote %u trace events to \"%s\"\n", numWritten, path );
+
+	/* and reset for the next capture */
+	memset( trace.events, 0, sizeof( ProfTraceEvent ) * numEvents );
+	atomic_store( &trace.numEvents, 0 );
+	atomic_store( &trace.numDropped, 0 );
+	trace.numFlushes++;
+
+	atomic_store( &trace.isFlushing, false );
+}
+
+double Prof_GetZoneTime( ProfZone zone ) {
+	return Prof_GetRingAverage( &zones[ zone ].cpu );
+}
+
+double Prof_GetZoneGPUTime( ProfZone zone ) {
+	if ( !gpuTimer.enabled || !zoneIsGPU[ zone ] ) {
+		return -1.0;
+	}
+
+	return Prof_GetRingAverage( &zones[ zone ].gpu );
+}
+
+double Prof_GetZoneLatestTime( ProfZone zone ) {
+	return Prof_GetRingLatest( &zones[ zone ].cpu );
+}
+
+double Prof_GetZoneLatestGPUTime( ProfZone zone ) {
+	if ( !gpuTimer.enabled || !zoneIsGPU[ zone ] ) {
+		return -1.0;
+	}
+
+	return Prof_GetRingLatest( &zones[ zone ].gpu );
+}
+
+double Prof_GetZoneTotalTime( ProfZone zone ) {
+	return zones[ zone ].cpu.lifetimeTotal / 1000000.0;
+}
+
+double Prof_GetZoneTotalGPUTime( ProfZone zone ) {
+	if ( !gpuTimer.enabled || !zoneIsGPU[ zone ] ) {
+		return -1.0;
+	}
+
+	return zones[ zone ].gpu.lifetimeTotal / 1000000.0;
+}
+
+const char *Prof_GetZoneName( ProfZone zone ) {
+	return zoneNames[ zone ];
+}
+
+unsigned int Prof_GetNumDrawCalls( void ) {
+	return lastNumDrawCalls;
+}
+
+void Prof_ToggleOverlay( void ) {
+	overlayEnabled = !overlayEnabled;
+}
+
+bool Prof_IsOverlayEnabled( void ) {
+	return overlayEnabled;
+}
@@ -0,0 +1,52 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#pragma once
+
+typedef enum ProfZone {
+	PROF_ZONE_FRAME,    /* everything under Sys_Display */
+	PROF_ZONE_TICK,     /* Gam_Tick */
+	PROF_ZONE_ACT_TICK, /* Act_TickActors */
+	PROF_ZONE_MAP_DRAW, /* Map_Draw */
+	PROF_ZONE_ACT_DRAW, /* Act_DisplayActors */
+
+	MAX_PROF_ZONES
+} ProfZone;
+
+#define PROF_NUM_SAMPLES 128 /* size of each zone's sample ring */
+
+void Prof_Initialize( void );
+void Prof_InitializeGPU( void );
+void Prof_Shutdown( void );
+
+void Prof_BeginFrame( void );
+void Prof_EndFrame( void );
+
+void Prof_BeginZone( ProfZone zone );
+void Prof_EndZone( ProfZone zone );
+
+void Prof_CountDrawCall( void );
+
+/* trace capture, for offline analysis in chrome://tracing or Perfetto;
+ * zones above are recorded automatically, these are for anything else.
+ * begin/end pairs must nest properly on each thread */
+#define PROF_MAX_TRACE_EVENTS  ( 1 << 17 )
+#define PROF_DEFAULT_TRACE_FILE "trace.json"
+
+void Prof_BeginTrace( const char *name );
+void Prof_EndTrace( const char *name );
+bool Prof_IsTracing( void );
+void Prof_FlushTrace( void );
+
+double       Prof_GetZoneTime( ProfZone zone );         /* ms, averaged over the ring */
+double       Prof_GetZoneGPUTime( ProfZone zone );      /* ms, or negative if unavailable */
+double       Prof_GetZoneLatestTime( ProfZone zone );   /* ms, last sample only */
+double       Prof_GetZoneLatestGPUTime( ProfZone zone ); /* ms, trails the cpu by a few frames */
+double       Prof_GetZoneTotalTime( ProfZone zone );    /* ms, since startup */
+double       Prof_GetZoneTotalGPUTime( ProfZone zone ); /* ms, or negative if unavailable */
+const char   *Prof_GetZoneName( ProfZone zone );
+unsigned int Prof_GetNumDrawCalls( void );              /* from the last completed frame */
+
+void Prof_ToggleOverlay( void );
+bool Prof_IsOverlayEnabled( void );
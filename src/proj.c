@@ -0,0 +1,257 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "proj.h"
+#include "act.h"
+#include "gfx.h"
+#include "map.h"
+
+/* projectiles are kept packed at the front of the pool, so spawning and
+ * removing them never allocates and a tick only walks live ones. every
+ * tick each one is swept along its path against the walls, all in one
+ * batch of traces, and against the actors, which are sorted along x so
+ * each sweep only looks at those it could possibly reach. like the walls
+ * they're treated as running floor to ceiling, so height is kept as
+ * spawned and only used for drawing */
+
+static struct {
+	float        x[ PROJ_MAX_PROJECTILES ];
+	float        y[ PROJ_MAX_PROJECTILES ];
+	float        z[ PROJ_MAX_PROJECTILES ];
+	float        vx[ PROJ_MAX_PROJECTILES ];
+	float        vz[ PROJ_MAX_PROJECTILES ];
+	unsigned int lifetimes[ PROJ_MAX_PROJECTILES ];
+	Actor        *owners[ PROJ_MAX_PROJECTILES ]; /* never hit their own projectiles; cleared when they go away */
+
+	unsigned int numProjectiles;
+} projectiles;
+
+/* actor bounds for the current tick, expanded by the projectile radius */
+typedef struct ProjTarget {
+	Actor *actor;
+	float centre;
+	float min[ 2 ];
+	float max[ 2 ];
+	unsigned int order; /* in the actor list, to break ties */
+} ProjTarget;
+
+bool Proj_SpawnProjectile( Actor *owner, const PLVector3 *position, const PLVector3 *velocity ) {
+	if ( projectiles.numProjectiles >= PROJ_MAX_PROJECTILES ) {
+		return false;
+	}
+
+	unsigned int i = projectiles.numProjectiles++;
+	projectiles.x[ i ]         = position->x;
+	projectiles.y[ i ]         = position->y;
+	projectiles.z[ i ]         = position->z;
+	projectiles.vx[ i ]        = velocity->x;
+	projectiles.vz[ i ]        = velocity->z;
+	projectiles.lifetimes[ i ] = PROJ_LIFETIME;
+	projectiles.owners[ i ]    = owner;
+
+	return true;
+}
+
+void Proj_ClearProjectiles( void ) {
+	projectiles.numProjectiles = 0;
+}
+
+/* otherwise a new actor allocated at the same address would be immune */
+void Proj_ForgetOwner( const Actor *owner ) {
+	for ( unsigned int i = 0; i < projectiles.numProjectiles; ++i ) {
+		if ( projectiles.owners[ i ] == owner ) {
+			projectiles.owners[ i ] = NULL;
+		}
+	}
+}
+
+unsigned int Proj_GetNumProjectiles( void ) {
+	return projectiles.numProjectiles;
+}
+
+/* swaps the last one in, so this has to be walked backwards */
+static void Proj_RemoveProjectile( unsigned int i ) {
+	unsigned int last = --projectiles.numProjectiles;
+	projectiles.x[ i ]         = projectiles.x[ last ];
+	projectiles.y[ i ]         = projectiles.y[ last ];
+	projectiles.z[ i ]         = projectiles.z[ last ];
+	projectiles.vx[ i ]        = projectiles.vx[ last ];
+	projectiles.vz[ i ]        = projectiles.vz[ last ];
+	projectiles.lifetimes[ i ] = projectiles.lifetimes[ last ];
+	projectiles.owners[ i ]    = projectiles.owners[ last ];
+}
+
+static int Proj_CompareTargets( const void *a, const void *b ) {
+	const ProjTarget *targetA = a, *targetB = b;
+	if ( targetA->centre != targetB->centre ) {
+		return ( targetA->centre > targetB->centre ) - ( targetA->centre < targetB->centre );
+	}
+
+	return ( targetA->order > targetB->order ) - ( targetA->order < targetB->order );
+}
+
+static unsigned int Proj_GatherTargets( SysArena *arena, ProjTarget **destination, float *maxHalfWidth ) {
+	unsigned int numActors = Act_GetNumActors();
+	Actor **actors = Sys_ArenaAllocate( arena, numActors, sizeof( Actor * ) );
+	numActors = Act_GetActors( actors, numActors );
+
+	ProjTarget *targets = Sys_ArenaAllocate( arena, numActors, sizeof( ProjTarget ) );
+	*maxHalfWidth = 0.0f;
+	for ( unsigned int i = 0; i < numActors; ++i ) {
+		const PLAABB *bounds = Act_GetBounds( actors[ i ] );
+		PLVector3 position = Act_GetPosition( actors[ i ] );
+
+		ProjTarget *target = &targets[ i ];
+		target->actor    = actors[ i ];
+		target->order    = i;
+		target->min[ 0 ] = position.x + bounds->mins.x - PROJ_RADIUS;
+		target->min[ 1 ] = position.z + bounds->mins.z - PROJ_RADIUS;
+		target->max[ 0 ] = position.x + bounds->maxs.x + PROJ_RADIUS;
+		target->max[ 1 ] = position.z + bounds->maxs.z + PROJ_RADIUS;
+		target->centre   = ( target->min[ 0 ] + target->max[ 0 ] ) / 2.0f;
+
+		*maxHalfWidth = fmaxf( *maxHalfWidth, ( target->max[ 0 ] - target->min[ 0 ] ) / 2.0f );
+	}
+
+	qsort( targets, numActors, sizeof( ProjTarget ), Proj_CompareTargets );
+
+	*destination = targets;
+	return numActors;
+}
+
+/* slab test of the sweep against a box, for the fraction it's entered at */
+static bool Proj_SweepBox( float x, float z, float dx, float dz, const ProjTarget *target, float *fraction ) {
+	const float origin[ 2 ] = { x, z };
+	const float extent[ 2 ] = { dx, dz };
+
+	float t0 = 0.0f, t1 = 1.0f;
+	for ( unsigned int k = 0; k < 2; ++k ) {
+		if ( extent[ k ] == 0.0f ) {
+			if ( origin[ k ] < target->min[ k ] || origin[ k ] > target->max[ k ] ) {
+				return false;
+			}
+			continue;
+		}
+
+		float near = ( target->min[ k ] - origin[ k ] ) / extent[ k ];
+		float far = ( target->max[ k ] - origin[ k ] ) / extent[ k ];
+		if ( near > far ) {
+			float swap = near;
+			near = far;
+			far = swap;
+		}
+
+		t0 = fmaxf( t0, near );
+		t1 = fminf( t1, far );
+		if ( t0 > t1 ) {
+			return false;
+		}
+	}
+
+	*fraction = t0;
+	return true;
+}
+
+/* returns the nearest actor the projectile's sweep hits before limit */
+static Actor *Proj_SweepTargets( unsigned int i, const ProjTarget *targets, unsigned int numTargets, float maxHalfWidth, float limit ) {
+	float x = projectiles.x[ i ], z = projectiles.z[ i ];
+	float dx = projectiles.vx[ i ], dz = projectiles.vz[ i ];
+	float minCentre = fminf( x, x + dx ) - maxHalfWidth;
+	float maxCentre = fmaxf( x, x + dx ) + maxHalfWidth;
+
+	/* first target that could be in reach */
+	unsigned int low = 0, high = numTargets;
+	while ( low < high ) {
+		unsigned int middle = ( low + high ) / 2;
+		if ( targets[ middle ].centre < minCentre ) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	Actor *hitActor = NULL;
+	for ( unsigned int j = low; j < numTargets && targets[ j ].centre <= maxCentre; ++j ) {
+		if ( targets[ j ].actor == projectiles.owners[ i ] ) {
+			continue;
+		}
+
+		float fraction;
+		if ( Proj_SweepBox( x, z, dx, dz, &targets[ j ], &fraction ) && fraction < limit ) {
+			limit = fraction;
+			hitActor = targets[ j ].actor;
+		}
+	}
+
+	return hitActor;
+}
+
+void Proj_TickProjectiles( void ) {
+	if ( projectiles.numProjectiles == 0 ) {
+		return;
+	}
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	MapTrace *traces = Sys_ArenaAllocate( arena, projectiles.numProjectiles, sizeof( MapTrace ) );
+	for ( unsigned int i = 0; i < projectiles.numProjectiles; ++i ) {
+		traces[ i ].start = PLVector2( projectiles.x[ i ], projectiles.z[ i ] );
+		traces[ i ].end   = PLVector2( projectiles.x[ i ] + projectiles.vx[ i ], projectiles.z[ i ] + projectiles.vz[ i ] );
+	}
+	Map_TraceLines( traces, projectiles.numProjectiles );
+
+	ProjTarget *targets;
+	float maxHalfWidth;
+	unsigned int numTargets = Proj_GatherTargets( arena, &targets, &maxHalfWidth );
+
+	for ( unsigned int i = projectiles.numProjectiles; i-- > 0; ) {
+		Actor *hitActor = Proj_SweepTargets( i, targets, numTargets, maxHalfWidth, traces[ i ].fraction );
+		if ( hitActor != NULL ) {
+			PLVector3 velocity = Act_GetVelocity( hitActor );
+			velocity.x += projectiles.vx[ i ] * PROJ_KNOCKBACK;
+			velocity.z += projectiles.vz[ i ] * PROJ_KNOCKBACK;
+			Act_SetVelocity( hitActor, &velocity );
+			Act_WakeActor( hitActor );
+
+			Proj_RemoveProjectile( i );
+			continue;
+		}
+
+		if ( traces[ i ].lineIndex != MAP_TRACE_NO_LINE || --projectiles.lifetimes[ i ] == 0 ) {
+			Proj_RemoveProjectile( i );
+			continue;
+		}
+
+		projectiles.x[ i ] += projectiles.vx[ i ];
+		projectiles.z[ i ] += projectiles.vz[ i ];
+	}
+
+	Sys_ResetArenaToMark( arena, mark );
+}
+
+void Proj_DrawProjectiles( void ) {
+	if ( projectiles.numProjectiles == 0 ) {
+		return;
+	}
+
+	SysArena *arena = Sys_GetFrameArena();
+	SysArenaMark mark = Sys_GetArenaMark( arena );
+
+	/* positions can go straight through, they're laid out the same */
+	GfxSphereList spheres;
+	spheres.x          = projectiles.x;
+	spheres.y          = projectiles.y;
+	spheres.z          = projectiles.z;
+	spheres.radii      = Sys_ArenaAllocate( arena, projectiles.numProjectiles, sizeof( float ) );
+	spheres.numSpheres = projectiles.numProjectiles;
+	for ( unsigned int i = 0; i < projectiles.numProjectiles; ++i ) {
+		spheres.radii[ i ] = PROJ_RADIUS;
+	}
+
+	Gfx_DrawBillboards( &spheres );
+
+	Sys_ResetArenaToMark( arena, mark );
+}
@@ -0,0 +1,20 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#pragma once
+
+/* projectiles live in their own fixed pool rather than as actors */
+#define PROJ_MAX_PROJECTILES 512
+#define PROJ_RADIUS          8.0f
+#define PROJ_LIFETIME        180   /* ticks */
+#define PROJ_KNOCKBACK       0.25f /* of the projectile's velocity, given to whatever it hits */
+
+typedef struct Actor Actor;
+
+bool         Proj_SpawnProjectile( Actor *owner, const PLVector3 *position, const PLVector3 *velocity );
+void         Proj_ClearProjectiles( void );
+void         Proj_ForgetOwner( const Actor *owner );
+void         Proj_TickProjectiles( void );
+void         Proj_DrawProjectiles( void );
+unsigned int Proj_GetNumProjectiles( void );
@@ -0,0 +1,184 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+
+/* thin wrapper over whatever threading the platform provides */
+
+#if defined( _WIN32 )
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct SysThread {
+	const char *name;
+	void       ( *Function )( void *userData );
+	void       *userData;
+#if defined( _WIN32 )
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+} SysThread;
+
+typedef struct SysMutex {
+#if defined( _WIN32 )
+	CRITICAL_SECTION handle;
+#else
+	pthread_mutex_t handle;
+#endif
+} SysMutex;
+
+typedef struct SysCondition {
+#if defined( _WIN32 )
+	CONDITION_VARIABLE handle;
+#else
+	pthread_cond_t handle;
+#endif
+} SysCondition;
+
+#if defined( _WIN32 )
+static DWORD WINAPI Sys_ThreadEntry( LPVOID param ) {
+	SysThread *thread = param;
+	thread->Function( thread->userData );
+	return 0;
+}
+#else
+static void *Sys_ThreadEntry( void *param ) {
+	SysThread *thread = param;
+	thread->Function( thread->userData );
+	return NULL;
+}
+#endif
+
+SysThread *Sys_CreateThread( const char *name, void ( *Function )( void *userData ), void *userData ) {
+	SysThread *thread = Sys_AllocateTaggedMemory( 1, sizeof( SysThread ), SYS_MEMORY_TAG_SYS );
+	thread->name     = name;
+	thread->Function = Function;
+	thread->userData = userData;
+
+#if defined( _WIN32 )
+	thread->handle = CreateThread( NULL, 0, Sys_ThreadEntry, thread, 0, NULL );
+	if ( thread->handle == NULL ) {
+		PrintError( "Failed to create thread \"%s\"!\n", name );
+	}
+#else
+	if ( pthread_create( &thread->handle, NULL, Sys_ThreadEntry, thread ) != 0 ) {
+		PrintError( "Failed to create thread \"%s\"!\n", name );
+	}
+#endif
+
+	return thread;
+}
+
+/* waits for the thread to exit and then frees it */
+void Sys_JoinThread( SysThread *thread ) {
+#if defined( _WIN32 )
+	WaitForSingleObject( thread->handle, INFINITE );
+	CloseHandle( thread->handle );
+#else
+	pthread_join( thread->handle, NULL );
+#endif
+
+	Sys_FreeMemory( thread );
+}
+
+SysMutex *Sys_CreateMutex( void ) {
+	SysMutex *mutex = Sys_AllocateTaggedMemory( 1, sizeof( SysMutex ), SYS_MEMORY_TAG_SYS );
+#if defined( _WIN32 )
+	InitializeCriticalSection( &mutex->handle );
+#else
+	pthread_mutex_init( &mutex->handle, NULL );
+#endif
+	return mutex;
+}
+
+void Sys_DestroyMutex( SysMutex *mutex ) {
+	if ( mutex == NULL ) {
+		return;
+	}
+
+#if defined( _WIN32 )
+	DeleteCriticalSection( &mutex->handle );
+#else
+	pthread_mutex_destroy( &mutex->handle );
+#endif
+	Sys_FreeMemory( mutex );
+}
+
+void Sys_LockMutex( SysMutex *mutex ) {
+#if defined( _WIN32 )
+	EnterCriticalSection( &mutex->handle );
+#else
+	pthread_mutex_lock( &mutex->handle );
+#endif
+}
+
+void Sys_UnlockMutex( SysMutex *mutex ) {
+#if defined( _WIN32 )
+	LeaveCriticalSection( &mutex->handle );
+#else
+	pthread_mutex_unlock( &mutex->handle );
+#endif
+}
+
+SysCondition *Sys_CreateCondition( void ) {
+	SysCondition *condition = Sys_AllocateTaggedMemory( 1, sizeof( SysCondition ), SYS_MEMORY_TAG_SYS );
+#if defined( _WIN32 )
+	InitializeConditionVariable( &condition->handle );
+#else
+	pthread_cond_init( &condition->handle, NULL );
+#endif
+	return condition;
+}
+
+void Sys_DestroyCondition( SysCondition *condition ) {
+	if ( condition == NULL ) {
+		return;
+	}
+
+#if !defined( _WIN32 ) /* nothing to clean up on windows */
+	pthread_cond_destroy( &condition->handle );
+#endif
+	Sys_FreeMemory( condition );
+}
+
+/* mutex must be locked by the caller; wakeups can be spurious, so
+ * always check whatever's being waited on again afterwards */
+void Sys_WaitCondition( SysCondition *condition, SysMutex *mutex ) {
+#if defined( _WIN32 )
+	SleepConditionVariableCS( &condition->handle, &mutex->handle, INFINITE );
+#else
+	pthread_cond_wait( &condition->handle, &mutex->handle );
+#endif
+}
+
+void Sys_SignalCondition( SysCondition *condition ) {
+#if defined( _WIN32 )
+	WakeConditionVariable( &condition->handle );
+#else
+	pthread_cond_signal( &condition->handle );
+#endif
+}
+
+void Sys_BroadcastCondition( SysCondition *condition ) {
+#if defined( _WIN32 )
+	WakeAllConditionVariable( &condition->handle );
+#else
+	pthread_cond_broadcast( &condition->handle );
+#endif
+}
+
+unsigned int Sys_GetNumProcessors( void ) {
+#if defined( _WIN32 )
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo( &systemInfo );
+	return systemInfo.dwNumberOfProcessors;
+#else
+	long numProcessors = sysconf( _SC_NPROCESSORS_ONLN );
+	return ( numProcessors > 0 ) ? ( unsigned int ) numProcessors : 1;
+#endif
+}
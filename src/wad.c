@@ -0,0 +1,533 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#include "yin.h"
+#include "wad.h"
+
+#if defined( __linux__ )
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+/* with -hotreload, loose files under the override directory (i.e.
+ * "override/TITLEPIC.lmp") take priority over what's in the wad, and
+ * both are watched for changes while the game is running */
+
+#define WAD_OVERRIDE_DIR       "override"
+#define WAD_OVERRIDE_EXTENSION ".lmp"
+#define WAD_MAX_RELOAD_HANDLERS 8
+#define WAD_POLL_INTERVAL       1000000000ULL /* ns, where we can't be notified */
+
+#define WAD_HEADER_SIZE          12
+#define WAD_DIRECTORY_ENTRY_SIZE 16
+
+/* where each lump's contents sit within the wad's image */
+typedef struct WadLumpState {
+	char   name[ 16 ];
+	size_t offset;
+	size_t size;
+} WadLumpState;
+
+static struct {
+	bool               isEnabled;
+	WadReloadHandler   handlers[ WAD_MAX_RELOAD_HANDLERS ];
+	unsigned int       numHandlers;
+	WadLumpState       *lumps;
+	unsigned int       numLumps;
+	uint8_t            *image; /* the whole wad as of the last reload, to compare against */
+	size_t             imageSize;
+#if defined( __linux__ )
+	int                notifyDescriptor;
+	int                wadWatch;      /* the working directory, for the wad itself */
+	int                overrideWatch; /* and for loose lumps */
+#else
+	time_t             wadTimeStamp;
+	uint64_t           lastPollTime;
+#endif
+} wadReload;
+
+#define WAD_LUMP_NAME_LENGTH 8
+
+static struct {
+	PLPackage    *wad;
+	uint64_t     *keys; /* zero is an empty slot */
+	unsigned int *indices;
+	unsigned int tableSize; /* always a power of two */
+} wadIndex;
+
+/* returns false if the name is too long to be in a wad */
+static bool Wad_GetLumpKey( const char *lumpName, uint64_t *key ) {
+	uint8_t name[ WAD_LUMP_NAME_LENGTH ] = { 0 };
+	for ( unsigned int i = 0; lumpName[ i ] != '\0'; ++i ) {
+		if ( i >= WAD_LUMP_NAME_LENGTH ) {
+			return false;
+		}
+
+		name[ i ] = ( uint8_t ) lumpName[ i ];
+	}
+
+	memcpy( key, name, sizeof( *key ) );
+
+	return true;
+}
+
+static unsigned int Wad_GetLumpSlot( uint64_t key ) {
+	return ( unsigned int ) ( ( key * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( wadIndex.tableSize - 1 );
+}
+
+void Wad_DestroyLumpIndex( void ) {
+	Sys_FreeMemory( wadIndex.keys );
+	Sys_FreeMemory( wadIndex.indices );
+	memset( &wadIndex, 0, sizeof( wadIndex ) );
+}
+
+void Wad_BuildLumpIndex( PLPackage *wad ) {
+	Wad_DestroyLumpIndex();
+
+	unsigned int numLumps = 0;
+	while ( plGetPackageFileName( wad, numLumps ) != NULL ) {
+		numLumps++;
+	}
+
+	/* keep it at most half full, so probes stay short */
+	wadIndex.tableSize = 16;
+	while ( wadIndex.tableSize < numLumps * 2 ) {
+		wadIndex.tableSize <<= 1;
+	}
+
+	wadIndex.keys = Sys_AllocateTaggedMemory( wadIndex.tableSize, sizeof( uint64_t ), SYS_MEMORY_TAG_SYS );
+	wadIndex.indices = Sys_AllocateTaggedMemory( wadIndex.tableSize, sizeof( unsigned int ), SYS_MEMORY_TAG_SYS );
+
+	for ( unsigned int i = 0; i < numLumps; ++i ) {
+		uint64_t key;
+		if ( !Wad_GetLumpKey( plGetPackageFileName( wad, i ), &key ) || key == 0 ) {
+			PrintWarn( "Unexpected lump name at %d, not indexing package!\n", i );
+			Wad_DestroyLumpIndex();
+			return;
+		}
+
+		/* duplicates keep the first, same as the platform library */
+		unsigned int slot = Wad_GetLumpSlot( key );
+		while ( wadIndex.keys[ slot ] != 0 && wadIndex.keys[ slot ] != key ) {
+			slot = ( slot + 1 ) & ( wadIndex.tableSize - 1 );
+		}
+
+		if ( wadIndex.keys[ slot ] == 0 ) {
+			wadIndex.keys[ slot ] = key;
+			wadIndex.indices[ slot ] = i;
+		}
+	}
+
+	wadIndex.wad = wad;
+
+	PrintMsg( "Indexed %d lumps\n", numLumps );
+}
+
+bool Wad_FindLump( PLPackage *wad, const char *lumpName, unsigned int *index ) {
+	if ( wad != wadIndex.wad || wad == NULL ) {
+		*index = plGetPackageTableIndex( wad, lumpName );
+		return plGetFunctionResult() == PL_RESULT_SUCCESS;
+	}
+
+	uint64_t key;
+	if ( !Wad_GetLumpKey( lumpName, &key ) || key == 0 ) {
+		return false;
+	}
+
+	for ( unsigned int slot = Wad_GetLumpSlot( key );; slot = ( slot + 1 ) & ( wadIndex.tableSize - 1 ) ) {
+		if ( wadIndex.keys[ slot ] == key ) {
+			*index = wadIndex.indices[ slot ];
+			return true;
+		} else if ( wadIndex.keys[ slot ] == 0 ) {
+			return false;
+		}
+	}
+}
+
+/* returns the override path for the lump if there is one */
+static bool Wad_GetOverridePath( const char *lumpName, char *path, size_t length ) {
+	if ( !wadReload.isEnabled ) {
+		return false;
+	}
+
+	snprintf( path, length, WAD_OVERRIDE_DIR "/%s" WAD_OVERRIDE_EXTENSION, lumpName );
+	return plFileExists( path );
+}
+
+PLFile *Wad_OpenLump( PLPackage *wad, const char *lumpName ) {
+	char path[ PL_SYSTEM_MAX_PATH ];
+	if ( Wad_GetOverridePath( lumpName, path, sizeof( path ) ) ) {
+		return plOpenFile( path, true );
+	}
+
+	/* the platform library gives us a more useful error if it's missing */
+	unsigned int index;
+	if ( !Wad_FindLump( wad, lumpName, &index ) ) {
+		return plLoadPackageFile( wad, lumpName );
+	}
+
+	return plLoadPackageFileByIndex( wad, index );
+}
+
+PLFile *Wad_OpenLumpByIndex( PLPackage *wad, unsigned int index ) {
+	char path[ PL_SYSTEM_MAX_PATH ];
+	const char *lumpName = plGetPackageFileName( wad, index );
+	if ( lumpName != NULL && Wad_GetOverridePath( lumpName, path, sizeof( path ) ) ) {
+		return plOpenFile( path, true );
+	}
+
+	return plLoadPackageFileByIndex( wad, index );
+}
+
+static uint8_t *Wad_ReadLump( PLFile *filePtr, const char *lumpName, SysArena *arena, size_t *size ) {
+	*size = plGetFileSize( filePtr );
+
+	uint8_t *data = Sys_ArenaAllocate( arena, *size, sizeof( uint8_t ) );
+	if ( plReadFile( filePtr, data, sizeof( uint8_t ), *size ) != *size ) {
+		PrintWarn( "Failed to read \"%s\"!\nPL: %s\n", lumpName, plGetError() );
+		data = NULL;
+	}
+
+	plCloseFile( filePtr );
+
+	return data;
+}
+
+/* reads the whole lump into the given arena, so it's up to the
+ * caller to reset it once done; returns NULL if it couldn't be read */
+uint8_t *Wad_LoadLump( PLPackage *wad, const char *lumpName, SysArena *arena, size_t *size ) {
+	PLFile *filePtr = Wad_OpenLump( wad, lumpName );
+	if ( filePtr == NULL ) {
+		PrintWarn( "Failed to find \"%s\"!\nPL: %s\n", lumpName, plGetError() );
+		return NULL;
+	}
+
+	return Wad_ReadLump( filePtr, lumpName, arena, size );
+}
+
+uint8_t *Wad_LoadLumpByIndex( PLPackage *wad, unsigned int index, SysArena *arena, size_t *size ) {
+	const char *lumpName = plGetPackageFileName( wad, index );
+	if ( lumpName == NULL ) {
+		lumpName = "Unknown";
+	}
+
+	PLFile *filePtr = Wad_OpenLumpByIndex( wad, index );
+	if ( filePtr == NULL ) {
+		PrintWarn( "Failed to load lump %d (%s)!\nPL: %s\n", index, lumpName, plGetError() );
+		return NULL;
+	}
+
+	return Wad_ReadLump( filePtr, lumpName, arena, size );
+}
+
+/* for lumps made up of a count followed by fixed size records; rejects
+ * the lump if it's too small to hold everything it claims to */
+uint32_t Wad_GetLumpRecordCount( const uint8_t *data, size_t size, size_t recordSize, const char *lumpName ) {
+	if ( size < sizeof( uint32_t ) ) {
+		PrintError( "Truncated \"%s\" lump (%zu bytes)!\n", lumpName, size );
+	}
+
+	uint32_t numRecords = Wad_GetUInt32( data );
+	size_t expectedSize = sizeof( uint32_t ) + ( size_t ) numRecords * recordSize;
+	if ( size < expectedSize ) {
+		PrintError( "Truncated \"%s\" lump, expected %zu bytes but got %zu!\n", lumpName, expectedSize, size );
+	} else if ( size > expectedSize ) {
+		PrintWarn( "Ignoring %zu trailing bytes in \"%s\" lump\n", size - expectedSize, lumpName );
+	}
+
+	return numRecords;
+}
+
+/****************************************
+ * Hot Reload
+ ****************************************/
+
+/* reads the wad in one go, rather than going through the package
+ * a lump at a time, so telling what's changed is a straight compare */
+static uint8_t *Wad_ReadImage( const char *path, size_t *size ) {
+	FILE *file = fopen( path, "rb" );
+	if ( file == NULL ) {
+		PrintWarn( "Failed to open \"%s\"!\n", path );
+		return NULL;
+	}
+
+	fseek( file, 0, SEEK_END );
+	long fileSize = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	if ( fileSize < WAD_HEADER_SIZE ) {
+		PrintWarn( "Invalid size for \"%s\" (%ld bytes)!\n", path, fileSize );
+		fclose( file );
+		return NULL;
+	}
+
+	*size = ( size_t ) fileSize;
+	uint8_t *image = Sys_AllocateTaggedMemory( *size, sizeof( uint8_t ), SYS_MEMORY_TAG_SYS );
+	if ( fread( image, 1, *size, file ) != *size ) {
+		PrintWarn( "Failed to read \"%s\"!\n", path );
+		Sys_FreeMemory( image );
+		image = NULL;
+	}
+
+	fclose( file );
+
+	return image;
+}
+
+/* picks out where every lump is from the wad's directory; lumps are
+ * named as the package has them, so they match up with its indices */
+static WadLumpState *Wad_GetLumpStates( PLPackage *wad, const uint8_t *image, size_t imageSize, unsigned int *numLumps ) {
+	*numLumps = Wad_GetUInt32( image + 4 );
+	size_t directoryOffset = Wad_GetUInt32( image + 8 );
+	if ( directoryOffset > imageSize || *numLumps > ( imageSize - directoryOffset ) / WAD_DIRECTORY_ENTRY_SIZE ) {
+		PrintWarn( "Invalid directory in \"" YIN_GLOBAL_WAD "\"!\n" );
+		return NULL;
+	}
+
+	WadLumpState *lumps = Sys_AllocateTaggedMemory( *numLumps, sizeof( WadLumpState ), SYS_MEMORY_TAG_SYS );
+	const uint8_t *entry = image + directoryOffset;
+	for ( unsigned int i = 0; i < *numLumps; ++i, entry += WAD_DIRECTORY_ENTRY_SIZE ) {
+		const char *lumpName = plGetPackageFileName( wad, i );
+		lumps[ i ].offset = Wad_GetUInt32( entry );
+		lumps[ i ].size   = Wad_GetUInt32( entry + 4 );
+		if ( lumpName == NULL || lumps[ i ].offset > imageSize || lumps[ i ].size > imageSize - lumps[ i ].offset ) {
+			PrintWarn( "Invalid directory entry %d in \"" YIN_GLOBAL_WAD "\"!\n", i );
+			Sys_FreeMemory( lumps );
+			return NULL;
+		}
+
+		snprintf( lumps[ i ].name, sizeof( lumps[ i ].name ), "%s", lumpName );
+	}
+
+	return lumps;
+}
+
+static bool Wad_IsLumpChanged( const WadLumpState *oldLump, const uint8_t *oldImage, const WadLumpState *newLump, const uint8_t *newImage ) {
+	return oldLump->size != newLump->size || memcmp( oldImage + oldLump->offset, newImage + newLump->offset, newLump->size ) != 0;
+}
+
+void Wad_RegisterReloadHandler( WadReloadHandler handler ) {
+	if ( wadReload.numHandlers >= WAD_MAX_RELOAD_HANDLERS ) {
+		PrintError( "Too many reload handlers registered!\n" );
+	}
+
+	wadReload.handlers[ wadReload.numHandlers++ ] = handler;
+}
+
+/* returns false if nothing cared about the lump */
+static bool Wad_DispatchReload( const char *lumpName, unsigned int lumpIndex ) {
+	bool isHandled = false;
+	for ( unsigned int i = 0; i < wadReload.numHandlers; ++i ) {
+		isHandled |= wadReload.handlers[ i ]( lumpName, lumpIndex );
+	}
+
+	return isHandled;
+}
+
+/* swaps in the updated wad, as long as only the contents of lumps have
+ * changed; anything else would invalidate the indices we hold onto */
+static void Wad_ReloadGlobalWad( void ) {
+	size_t imageSize;
+	uint8_t *image = Wad_ReadImage( YIN_GLOBAL_WAD, &imageSize );
+	if ( image == NULL ) {
+		return;
+	}
+
+	PLPackage *wad = plLoadPackage( YIN_GLOBAL_WAD );
+	if ( wad == NULL ) {
+		PrintWarn( "Failed to reload \"" YIN_GLOBAL_WAD "\"!\nPL: %s\n", plGetError() );
+		Sys_FreeMemory( image );
+		return;
+	}
+
+	unsigned int numLumps;
+	WadLumpState *lumps = Wad_GetLumpStates( wad, image, imageSize, &numLumps );
+
+	bool isCompatible = ( lumps != NULL && numLumps == wadReload.numLumps && plGetPackageFileName( wad, numLumps ) == NULL );
+	for ( unsigned int i = 0; isCompatible && i < numLumps; ++i ) {
+		isCompatible = ( strcmp( lumps[ i ].name, wadReload.lumps[ i ].name ) == 0 );
+	}
+
+	if ( !isCompatible ) {
+		PrintWarn( "Lumps in \"" YIN_GLOBAL_WAD "\" were added, removed or reordered, restart to pick up the changes\n" );
+		Sys_FreeMemory( lumps );
+		Sys_FreeMemory( image );
+		plDestroyPackage( wad );
+		return;
+	}
+
+	plDestroyPackage( globalWad );
+	globalWad = wad;
+	Wad_BuildLumpIndex( globalWad );
+
+	WadLumpState *oldLumps = wadReload.lumps;
+	uint8_t *oldImage = wadReload.image;
+	wadReload.lumps     = lumps;
+	wadReload.image     = image;
+	wadReload.imageSize = imageSize;
+
+	for ( unsigned int i = 0; i < numLumps; ++i ) {
+		if ( !Wad_IsLumpChanged( &oldLumps[ i ], oldImage, &lumps[ i ], image ) ) {
+			continue;
+		}
+
+		PrintMsg( "Reloading \"%s\"...\n", lumps[ i ].name );
+		if ( !Wad_DispatchReload( lumps[ i ].name, i ) ) {
+			PrintWarn( "Nothing to reload for \"%s\", it may need a restart\n", lumps[ i ].name );
+		}
+	}
+
+	Sys_FreeMemory( oldLumps );
+	Sys_FreeMemory( oldImage );
+}
+
+/* names aren't unique, as every map has its own M_POINTS and so on, so
+ * the override goes out against every lump with that name; handlers
+ * only pick up on the indices they're actually using, i.e. the lumps
+ * of whichever map is loaded */
+static void Wad_ReloadOverride( const char *fileName ) {
+	const char *extension = strrchr( fileName, '.' );
+	if ( extension == NULL || strcmp( extension, WAD_OVERRIDE_EXTENSION ) != 0 ) {
+		return;
+	}
+
+	char lumpName[ 16 ];
+	snprintf( lumpName, sizeof( lumpName ), "%.*s", ( int ) ( extension - fileName ), fileName );
+
+	PrintMsg( "Reloading \"%s\"...\n", lumpName );
+
+	bool isFound = false, isHandled = false;
+	for ( unsigned int i = 0; i < wadReload.numLumps; ++i ) {
+		if ( strcmp( wadReload.lumps[ i ].name, lumpName ) != 0 ) {
+			continue;
+		}
+
+		isFound = true;
+		isHandled |= Wad_DispatchReload( wadReload.lumps[ i ].name, i );
+	}
+
+	if ( !isFound ) {
+		PrintWarn( "Override \"%s\" doesn't match any lump in \"" YIN_GLOBAL_WAD "\"!\n", fileName );
+	} else if ( !isHandled ) {
+		PrintWarn( "Nothing to reload for \"%s\", it may need a restart\n", lumpName );
+	}
+}
+
+void Wad_InitializeHotReload( void ) {
+	if ( !plHasCommandLineArgument( "-hotreload" ) ) {
+		return;
+	}
+
+	wadReload.image = Wad_ReadImage( YIN_GLOBAL_WAD, &wadReload.imageSize );
+	if ( wadReload.image != NULL ) {
+		wadReload.lumps = Wad_GetLumpStates( globalWad, wadReload.image, wadReload.imageSize, &wadReload.numLumps );
+	}
+
+	if ( wadReload.lumps == NULL ) {
+		PrintWarn( "Failed to read the directory of \"" YIN_GLOBAL_WAD "\", hot reload disabled!\n" );
+		Sys_FreeMemory( wadReload.image );
+		wadReload.image = NULL;
+		return;
+	}
+
+	wadReload.isEnabled = true;
+
+#if defined( __linux__ )
+	wadReload.notifyDescriptor = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if ( wadReload.notifyDescriptor < 0 ) {
+		PrintWarn( "Failed to initialize inotify, hot reload disabled (%s)!\n", strerror( errno ) );
+		Sys_FreeMemory( wadReload.lumps );
+		Sys_FreeMemory( wadReload.image );
+		wadReload.lumps     = NULL;
+		wadReload.image     = NULL;
+		wadReload.isEnabled = false;
+		return;
+	}
+
+	/* watch the directories rather than the files, as most
+	 * tools will write out a new file and then move it over */
+	uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+	wadReload.wadWatch = inotify_add_watch( wadReload.notifyDescriptor, ".", mask );
+	if ( wadReload.wadWatch < 0 ) {
+		PrintWarn( "Failed to watch \"" YIN_GLOBAL_WAD "\" (%s)!\n", strerror( errno ) );
+	}
+
+	wadReload.overrideWatch = inotify_add_watch( wadReload.notifyDescriptor, WAD_OVERRIDE_DIR, mask );
+	if ( wadReload.overrideWatch < 0 ) {
+		PrintWarn( "Failed to watch \"" WAD_OVERRIDE_DIR "\" (%s)!\n", strerror( errno ) );
+	}
+
+	PrintMsg( "Hot reload enabled, watching \"" YIN_GLOBAL_WAD "\" and \"" WAD_OVERRIDE_DIR "/\"\n" );
+#else
+	wadReload.wadTimeStamp = plGetLocalFileTimeStamp( YIN_GLOBAL_WAD );
+	wadReload.lastPollTime = Sys_GetNanoseconds();
+
+	/* there's no cheap way to spot a new file turning up here */
+	PrintMsg( "Hot reload enabled, watching \"" YIN_GLOBAL_WAD "\" (overrides are only picked up on linux)\n" );
+#endif
+}
+
+void Wad_ShutdownHotReload( void ) {
+	if ( !wadReload.isEnabled ) {
+		return;
+	}
+
+#if defined( __linux__ )
+	close( wadReload.notifyDescriptor );
+#endif
+
+	Sys_FreeMemory( wadReload.lumps );
+	Sys_FreeMemory( wadReload.image );
+	memset( &wadReload, 0, sizeof( wadReload ) );
+}
+
+/* should be called once a frame, from the main thread */
+void Wad_PollHotReload( void ) {
+	if ( !wadReload.isEnabled ) {
+		return;
+	}
+
+#if defined( __linux__ )
+	bool isWadChanged = false;
+
+	uint8_t buffer[ 4096 ] __attribute__( ( aligned( __alignof__( struct inotify_event ) ) ) );
+	ssize_t length;
+	while ( ( length = read( wadReload.notifyDescriptor, buffer, sizeof( buffer ) ) ) > 0 ) {
+		for ( uint8_t *cur = buffer; cur < buffer + length; ) {
+			const struct inotify_event *event = ( const struct inotify_event * ) cur;
+			cur += sizeof( struct inotify_event ) + event->len;
+			if ( event->len == 0 ) {
+				continue;
+			}
+
+			/* anything else turning up in the working directory, like a
+			 * recorded demo, is none of our business */
+			if ( event->wd == wadReload.wadWatch && strcmp( event->name, YIN_GLOBAL_WAD ) == 0 ) {
+				/* could get several of these for one save */
+				isWadChanged = true;
+			} else if ( event->wd == wadReload.overrideWatch ) {
+				Wad_ReloadOverride( event->name );
+			}
+		}
+	}
+
+	if ( isWadChanged ) {
+		Wad_ReloadGlobalWad();
+	}
+#else
+	uint64_t time = Sys_GetNanoseconds();
+	if ( time - wadReload.lastPollTime < WAD_POLL_INTERVAL ) {
+		return;
+	}
+
+	wadReload.lastPollTime = time;
+
+	time_t timeStamp = plGetLocalFileTimeStamp( YIN_GLOBAL_WAD );
+	if ( timeStamp != wadReload.wadTimeStamp ) {
+		wadReload.wadTimeStamp = timeStamp;
+		Wad_ReloadGlobalWad();
+	}
+#endif
+}
@@ -0,0 +1,51 @@
+/* Copyright (C) 2020 Mark Sowden <markelswo@gmail.com>
+ * Project Yin
+ * */
+
+#pragma once
+
+/* lumps are read in one go and then decoded straight out of memory;
+ * everything in the wad is stored little-endian */
+
+/* the global wad's directory is indexed by name, as lump names are at
+ * most 8 bytes and can be compared as a single integer; other packages
+ * fall back to the platform library's lookup */
+void Wad_BuildLumpIndex( PLPackage *wad );
+void Wad_DestroyLumpIndex( void );
+bool Wad_FindLump( PLPackage *wad, const char *lumpName, unsigned int *index );
+
+PLFile *Wad_OpenLump( PLPackage *wad, const char *lumpName );
+PLFile *Wad_OpenLumpByIndex( PLPackage *wad, unsigned int index );
+
+uint8_t *Wad_LoadLump( PLPackage *wad, const char *lumpName, SysArena *arena, size_t *size );
+uint8_t *Wad_LoadLumpByIndex( PLPackage *wad, unsigned int index, SysArena *arena, size_t *size );
+uint32_t Wad_GetLumpRecordCount( const uint8_t *data, size_t size, size_t recordSize, const char *lumpName );
+
+/* handlers return true if the lump was something they cared about */
+typedef bool ( *WadReloadHandler )( const char *lumpName, unsigned int lumpIndex );
+
+void Wad_InitializeHotReload( void );
+void Wad_ShutdownHotReload( void );
+void Wad_PollHotReload( void );
+void Wad_RegisterReloadHandler( WadReloadHandler handler );
+
+static inline uint16_t Wad_GetUInt16( const uint8_t *data ) {
+	return ( uint16_t ) ( data[ 0 ] | ( data[ 1 ] << 8 ) );
+}
+
+static inline int16_t Wad_GetInt16( const uint8_t *data ) {
+	return ( int16_t ) Wad_GetUInt16( data );
+}
+
+static inline uint32_t Wad_GetUInt32( const uint8_t *data ) {
+	return ( uint32_t ) data[ 0 ] | ( ( uint32_t ) data[ 1 ] << 8 ) | ( ( uint32_t ) data[ 2 ] << 16 ) | ( ( uint32_t ) data[ 3 ] << 24 );
+}
+
+static inline int32_t Wad_GetInt32( const uint8_t *data ) {
+	return ( int32_t ) Wad_GetUInt32( data );
+}
+
+/* positions are stored as 16.16 fixed point */
+static inline int16_t Wad_GetFixedInteger( const uint8_t *data ) {
+	return ( int16_t ) ( Wad_GetInt32( data ) >> 16 );
+}
@@ -6,21 +6,28 @@
 #include "gfx.h"
 #include "act.h"
 #include "game.h"
+#include "prof.h"
+#include "demo.h"
+#include "map.h"
+#include "wad.h"
 
 #include <GL/freeglut.h>
 
+#if defined( _WIN32 )
+#include <Windows.h>
+#elif defined( __linux__ )
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <pthread.h>
+#endif
+
 PLPackage *globalWad = NULL;
 
 unsigned int numTicks = 0;
 
-void *Sys_AllocateMemory( size_t num, size_t size ) {
-	void *mem = calloc( num, size );
-	if( mem == NULL ) {
-		PrintError( "Failed to allocate %d bytes!\n", num * size );
-	}
-
-	return mem;
-}
+static bool isHeadless = false;
+static bool isOffscreen = false;
 
 /* wrapper for malloc */
 static void *Sys_malloc( size_t size ) {
@@ -28,15 +35,61 @@ static void *Sys_malloc( size_t size ) {
 }
 
 static void Sys_Close( void ) {
+	Wad_ShutdownHotReload();
+	Demo_Shutdown();
+	Prof_Shutdown();
 	Act_Shutdown();
 	Gam_Shutdown();
-	Gfx_Shutdown();
+	Gfx_ShutdownSoftware();
+	if ( isOffscreen ) {
+		Gfx_ShutdownOffscreenTarget();
+	}
+	if ( !isHeadless ) {
+		Gfx_Shutdown();
+	} else {
+		Gfx_ShutdownFrameCache();
+	}
+	if ( isOffscreen ) {
+		Sys_DestroyOffscreenContext();
+	}
+	Wad_DestroyLumpIndex();
+	Sys_ShutdownArenas();
+	Sys_PrintMemoryReport( true );
+}
+
+static _Noreturn void Sys_Quit( int status ) {
+	Sys_Close();
+	exit( status );
+}
+
+bool Sys_IsHeadless( void ) {
+	return isHeadless;
+}
+
+bool Sys_IsOffscreen( void ) {
+	return isOffscreen;
 }
 
 static void Sys_Display( void ) {
+	Sys_ResetArena( Sys_GetFrameArena() );
+
+	Wad_PollHotReload();
+
+	Prof_BeginFrame();
+
+	if ( isOffscreen ) {
+		Gfx_BindOffscreenTarget();
+	}
+
 	Gfx_Display();
 
-	glutSwapBuffers();
+	Prof_EndFrame();
+
+	if ( isOffscreen ) {
+		Gfx_EndOffscreenFrame();
+	} else {
+		glutSwapBuffers();
+	}
 }
 
 static unsigned char Sys_TranslateKeyboardInput( unsigned char key ) {
@@ -54,9 +107,25 @@ static unsigned char Sys_TranslateKeyboardInput( unsigned char key ) {
 
 bool keyStates[ MAX_BUTTON_INPUTS ];
 bool Sys_GetInputState( InputButton inputIndex ) {
+	if ( Demo_IsPlaying() ) {
+		return Demo_GetInputState( inputIndex );
+	}
+
 	return keyStates[ inputIndex ];
 }
 
+/* packs the current keyboard state, one bit per button */
+uint16_t Sys_GetInputMask( void ) {
+	uint16_t mask = 0;
+	for ( unsigned int i = 0; i < MAX_BUTTON_INPUTS; ++i ) {
+		if ( keyStates[ i ] ) {
+			mask |= ( uint16_t ) ( 1u << i );
+		}
+	}
+
+	return mask;
+}
+
 static void Sys_Keyboard( unsigned char key, int x, int y ) {
 	u_unused( x );
 	u_unused( y );
@@ -71,6 +140,37 @@ static void Sys_Keyboard( unsigned char key, int x, int y ) {
 	keyStates[ key ] = true;
 }
 
+/* function keys are reserved for debugging tools */
+static void Sys_SpecialKey( int key, int x, int y ) {
+	u_unused( x );
+	u_unused( y );
+
+	switch( key ) {
+		default: break;
+		case GLUT_KEY_F3:
+			Prof_ToggleOverlay();
+			break;
+		case GLUT_KEY_F4:
+			Prof_FlushTrace();
+			break;
+		case GLUT_KEY_F5:
+			Sys_PrintMemoryReport( false );
+			break;
+		case GLUT_KEY_F6: {
+			/* would throw off anything being recorded or played back */
+			if ( !Gam_IsActive() || Demo_IsRecording() || Demo_IsPlaying() ) {
+				break;
+			}
+
+			const char *nextMap = Map_GetNextMapName( globalWad, Map_GetName() );
+			if ( nextMap != NULL ) {
+				Gam_ChangeMap( nextMap );
+			}
+			break;
+		}
+	}
+}
+
 static void Sys_KeyboardUp( unsigned char key, int x, int y ) {
 	u_unused( x );
 	u_unused( y );
@@ -92,10 +192,24 @@ static void Sys_Idle( void ) {
 	Sys_Display();
 }
 
-static void Sys_Tick( int time ) {
+static void Sys_RunTick( void ) {
+	Demo_BeginTick();
+
+	Prof_BeginZone( PROF_ZONE_TICK );
 	Gam_Tick();
+	Prof_EndZone( PROF_ZONE_TICK );
+
+	Demo_EndTick();
 
 	numTicks++;
+}
+
+static void Sys_Tick( int time ) {
+	Sys_RunTick();
+
+	if ( Demo_IsFinished() ) {
+		Sys_Quit( Demo_GetNumMismatches() > 0 ? EXIT_FAILURE : EXIT_SUCCESS );
+	}
 
 	glutTimerFunc( YIN_TICK_RATE, Sys_Tick, 0 );
 }
@@ -104,7 +218,50 @@ unsigned int Sys_GetNumTicks( void ) {
 	return numTicks;
 }
 
-int Sys_Init( int argc, char **argv ) {
+void Sys_SetNumTicks( unsigned int ticks ) {
+	numTicks = ticks;
+}
+
+/* monotonic clock, only meaningful relative to other calls */
+uint64_t Sys_GetNanoseconds( void ) {
+#if defined( _WIN32 )
+	static LARGE_INTEGER frequency = { 0 };
+	if ( frequency.QuadPart == 0 ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter( &counter );
+	return ( uint64_t ) ( ( counter.QuadPart / frequency.QuadPart ) * 1000000000ULL +
+	                      ( ( counter.QuadPart % frequency.QuadPart ) * 1000000000ULL ) / frequency.QuadPart );
+#else
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( uint64_t ) ts.tv_sec * 1000000000ULL + ( uint64_t ) ts.tv_nsec;
+#endif
+}
+
+uint64_t Sys_GetThreadId( void ) {
+#if defined( _WIN32 )
+	return GetCurrentThreadId();
+#elif defined( __linux__ )
+	return ( uint64_t ) syscall( SYS_gettid );
+#else
+	return ( uint64_t ) ( uintptr_t ) pthread_self();
+#endif
+}
+
+/* brings up everything short of the window, so tools can share it */
+int Sys_InitializePlatform( int argc, char **argv ) {
+	/* this needs to be decided before anything is allocated, so
+	 * we can't wait on the platform library to parse the args */
+	for ( int i = 1; i < argc; ++i ) {
+		if ( strcmp( argv[ i ], "-memtrack" ) == 0 ) {
+			Sys_EnableMemoryTracking();
+			break;
+		}
+	}
+
 	pl_calloc = Sys_AllocateMemory;
 	pl_malloc = Sys_malloc;
 
@@ -126,6 +283,10 @@ int Sys_Init( int argc, char **argv ) {
 
 	PrintMsg( "Initializing...\n" );
 
+	Sys_InitializeArenas();
+
+	Prof_Initialize();
+
 	/* ensure our wad is available */
 	globalWad = plLoadPackage( YIN_GLOBAL_WAD );
 	if( globalWad == NULL ) {
@@ -133,6 +294,114 @@ int Sys_Init( int argc, char **argv ) {
 		return EXIT_FAILURE;
 	}
 
+	Wad_BuildLumpIndex( globalWad );
+	Wad_InitializeHotReload();
+
+	return EXIT_SUCCESS;
+}
+
+/* timedemo runs a tick per frame, as fast as we can draw */
+static void Sys_TimeDemoFrame( void ) {
+	static uint64_t lastFrameEnd = 0;
+	if ( lastFrameEnd == 0 ) {
+		Demo_BeginTimeDemo();
+		lastFrameEnd = Sys_GetNanoseconds();
+	}
+
+	Sys_RunTick();
+	Sys_Display();
+
+	/* measure between frame ends so time spent in glut counts too */
+	uint64_t frameEnd = Sys_GetNanoseconds();
+	Demo_AddFrameTime( frameEnd - lastFrameEnd );
+	lastFrameEnd = frameEnd;
+
+	if ( Demo_IsFinished() ) {
+		Demo_WriteTimeDemoSummary();
+		Sys_Quit( Demo_GetNumMismatches() > 0 ? EXIT_FAILURE : EXIT_SUCCESS );
+	}
+}
+
+/* runs through a demo as fast as possible without any window or
+ * rendering, which is handy for verifying behaviour on servers */
+static int Sys_RunHeadless( void ) {
+	if ( !Demo_IsPlaying() ) {
+		PrintError( "Headless mode requires a demo to play back (-playdemo)!\n" );
+	}
+
+	Act_Initialize();
+
+	Demo_Start();
+	while ( !Demo_IsFinished() ) {
+		Sys_RunTick();
+	}
+
+	/* lets the software renderer be checked without a window */
+	const char *screenshotPath = plGetCommandLineArgumentValue( "-screenshot" );
+	if ( screenshotPath != NULL && Gfx_IsSoftwareRendererEnabled() && Gam_GetPlayer() != NULL ) {
+		Gfx_DrawSoftwareScene( Gam_GetPlayer() );
+		Gfx_WriteSoftwareScreenshot( screenshotPath );
+	}
+
+	Sys_Quit( Demo_GetNumMismatches() > 0 ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+/* plays back a demo a tick per frame, rendering into an fbo rather than
+ * a window, so rendering can be checked and timed on servers too */
+static int Sys_RunOffscreen( void ) {
+	if ( !Demo_IsPlaying() ) {
+		PrintError( "Offscreen mode requires a demo to play back (-playdemo)!\n" );
+	}
+
+	if ( !Sys_CreateOffscreenContext() ) {
+		PrintError( "Failed to create offscreen context!\n" );
+	}
+
+	Gfx_Initialize();
+	Gfx_InitializeOffscreenTarget();
+
+	Act_Initialize();
+
+	Demo_Start();
+	while ( !Demo_IsFinished() ) {
+		Sys_RunTick();
+		Sys_Display();
+	}
+
+	Sys_Quit( Demo_GetNumMismatches() > 0 ? EXIT_FAILURE : EXIT_SUCCESS );
+}
+
+int Sys_Init( int argc, char **argv ) {
+	int status = Sys_InitializePlatform( argc, argv );
+	if ( status != EXIT_SUCCESS ) {
+		return status;
+	}
+
+	Demo_Initialize();
+
+	if ( plHasCommandLineArgument( "-software" ) ) {
+		Gfx_InitializeSoftware();
+	}
+
+	isHeadless = plHasCommandLineArgument( "-headless" );
+	if ( isHeadless ) {
+		return Sys_RunHeadless();
+	}
+
+	isOffscreen = plHasCommandLineArgument( "-offscreen" );
+	if ( isOffscreen ) {
+		return Sys_RunOffscreen();
+	}
+
+#if defined( __linux__ )
+	/* we don't want to be capped by the display during a timedemo;
+	 * these are honoured by mesa and nvidia respectively */
+	if ( Demo_IsTimeDemo() ) {
+		setenv( "vblank_mode", "0", 0 );
+		setenv( "__GL_SYNC_TO_VBLANK", "0", 0 );
+	}
+#endif
+
 	glutInitWindowSize( YIN_WINDOW_WIDTH, YIN_WINDOW_HEIGHT );
 	glutInitWindowPosition( 256, 256 );
 	glutInit( &argc, argv );
@@ -148,21 +417,31 @@ int Sys_Init( int argc, char **argv ) {
 	glutDisplayFunc( Sys_Display );
 	glutKeyboardFunc( Sys_Keyboard );
 	glutKeyboardUpFunc( Sys_KeyboardUp );
+	glutSpecialFunc( Sys_SpecialKey );
 	glutCloseFunc( Sys_Close );
-	glutIdleFunc( Sys_Idle );
 
-	glutTimerFunc( YIN_TICK_RATE, Sys_Tick, 0 );
+	if ( Demo_IsTimeDemo() ) {
+		glutIdleFunc( Sys_TimeDemoFrame );
+	} else {
+		glutIdleFunc( Sys_Idle );
+		glutTimerFunc( YIN_TICK_RATE, Sys_Tick, 0 );
+	}
 
 	Act_Initialize();
 
+	Demo_Start();
+
 	glutMainLoop();
 
 	return EXIT_SUCCESS;
 }
 
-#if defined( _WIN32 )
+#if defined( YIN_NO_MAIN )
+
+/* entry point is provided elsewhere, i.e. yin_bench */
+
+#elif defined( _WIN32 )
 
-#include <Windows.h>
 #include <shellapi.h>
 
 int WinMain(
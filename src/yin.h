@@ -68,8 +68,90 @@ enum {
 extern PLPackage *globalWad;
 #define YIN_GLOBAL_WAD "yin.wad"
 
-bool Sys_GetInputState( InputButton inputIndex );
+int Sys_InitializePlatform( int argc, char **argv );
+
+bool     Sys_GetInputState( InputButton inputIndex );
+uint16_t Sys_GetInputMask( void );
+
+bool Sys_IsHeadless( void );
+bool Sys_IsOffscreen( void );
+
+/* offscreen.c */
+
+bool Sys_CreateOffscreenContext( void );
+void Sys_DestroyOffscreenContext( void );
+void *Sys_GetOffscreenProcAddress( const char *name );
+
+/* mem.c */
+
+typedef enum SysMemoryTag {
+	SYS_MEMORY_TAG_PLATFORM,
+	SYS_MEMORY_TAG_SYS,
+	SYS_MEMORY_TAG_GFX,
+	SYS_MEMORY_TAG_MAP,
+	SYS_MEMORY_TAG_ACT,
+	SYS_MEMORY_TAG_GAME,
+
+	MAX_SYS_MEMORY_TAGS
+} SysMemoryTag;
 
 void *Sys_AllocateMemory( size_t num, size_t size );
+void *Sys_AllocateMemoryEx( size_t num, size_t size, SysMemoryTag tag, const char *file, int line );
+void Sys_FreeMemory( void *mem );
+
+/* all allocations made from our own code should go through here, so
+ * they can be attributed if tracking is enabled (-memtrack) */
+#define Sys_AllocateTaggedMemory( num, size, tag ) Sys_AllocateMemoryEx( ( num ), ( size ), ( tag ), __FILE__, __LINE__ )
+
+void Sys_EnableMemoryTracking( void );
+void Sys_PrintMemoryReport( bool listLeaks );
+
+#define SYS_FRAME_ARENA_SIZE ( 1024 * 1024 )
+#define SYS_LOAD_ARENA_SIZE  ( 1024 * 1024 )
+
+typedef struct SysArena SysArena;
+typedef struct SysArenaMark {
+	struct SysArenaBlock *block;
+	size_t               used;
+	size_t               usage;
+} SysArenaMark;
+
+SysArena     *Sys_CreateArena( const char *name, size_t blockSize );
+void         Sys_DestroyArena( SysArena *arena );
+void         *Sys_ArenaAllocate( SysArena *arena, size_t num, size_t size );
+SysArenaMark Sys_GetArenaMark( const SysArena *arena );
+void         Sys_ResetArenaToMark( SysArena *arena, SysArenaMark mark );
+void         Sys_ResetArena( SysArena *arena );
+size_t       Sys_GetArenaPeakUsage( const SysArena *arena );
+
+void     Sys_InitializeArenas( void );
+void     Sys_ShutdownArenas( void );
+SysArena *Sys_GetFrameArena( void );
+SysArena *Sys_GetLoadArena( void );
+
+/* thread.c */
+
+typedef struct SysThread SysThread;
+typedef struct SysMutex SysMutex;
+typedef struct SysCondition SysCondition;
+
+SysThread *Sys_CreateThread( const char *name, void ( *Function )( void *userData ), void *userData );
+void      Sys_JoinThread( SysThread *thread );
+
+SysMutex *Sys_CreateMutex( void );
+void     Sys_DestroyMutex( SysMutex *mutex );
+void     Sys_LockMutex( SysMutex *mutex );
+void     Sys_UnlockMutex( SysMutex *mutex );
+
+SysCondition *Sys_CreateCondition( void );
+void         Sys_DestroyCondition( SysCondition *condition );
+void         Sys_WaitCondition( SysCondition *condition, SysMutex *mutex );
+void         Sys_SignalCondition( SysCondition *condition );
+void         Sys_BroadcastCondition( SysCondition *condition );
+
+unsigned int Sys_GetNumProcessors( void );
 
 unsigned int Sys_GetNumTicks( void );
+void         Sys_SetNumTicks( unsigned int ticks );
+uint64_t     Sys_GetNanoseconds( void );
+uint64_t     Sys_GetThreadId( void );